@@ -0,0 +1,42 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+// Request-handler style bursts of log calls, with and without setBatching().
+// Usage: node bench/batching.js
+
+// @ts-check
+
+const spdlog = require('..');
+const { logFile } = require('./common');
+
+const burstSizes = [10, 50, 200];
+const bursts = 2000;
+
+async function run(name, logger, size) {
+	const start = process.hrtime.bigint();
+	for (let burst = 0; burst < bursts; burst++) {
+		for (let i = 0; i < size; i++) {
+			logger.info('Handled request step');
+		}
+		// End of the handler: lets the batched logger flush.
+		await Promise.resolve();
+	}
+	const elapsed = Number(process.hrtime.bigint() - start);
+	console.log(`${name.padEnd(32)} burst ${String(size).padStart(3)}: ${(elapsed / (bursts * size)).toFixed(0).padStart(6)} ns/call`);
+}
+
+(async () => {
+	const direct = new spdlog.Logger('rotating', 'direct', logFile('direct'), 1024 * 1024 * 64, 2);
+	const batched = new spdlog.Logger('rotating', 'batched', logFile('batched'), 1024 * 1024 * 64, 2);
+	batched.setBatching(true);
+
+	for (const size of burstSizes) {
+		await run('direct', direct, size);
+		await run('batched', batched, size);
+	}
+
+	direct.drop();
+	batched.drop();
+})();
@@ -0,0 +1,76 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+// Throughput of a file logger alone and also sending to a stand-in
+// collector over a Unix domain socket and over TCP, then the same while the
+// collector is down and records spill to disk. The event loop delay shows
+// whether logging ever waits for the collector. Time includes the final
+// flush.
+// Usage: node bench/collector.js
+
+// @ts-check
+
+const fs = require('fs');
+const net = require('net');
+const { monitorEventLoopDelay } = require('perf_hooks');
+const spdlog = require('..');
+const { logFile } = require('./common');
+
+const iterations = 500000;
+const message = 'Handled request step with a message of moderate length '.repeat(2);
+
+/**
+ * @param {string} name
+ * @param {import('..').CollectorOptions | undefined} collector
+ */
+async function run(name, collector) {
+	const logger = new spdlog.Logger('rotating', `collector-${name}`, logFile(`collector-${name}`), 1024 * 1024 * 1024, 2, { collector });
+	logger.setPattern('%v');
+	const delay = monitorEventLoopDelay({ resolution: 1 });
+	delay.enable();
+	const start = process.hrtime.bigint();
+	for (let i = 0; i < iterations; i++) {
+		logger.info(message);
+		if (i % 10000 === 0) {
+			// Lets the delay monitor run.
+			await new Promise(resolve => setImmediate(resolve));
+		}
+	}
+	logger.flush();
+	const elapsed = Number(process.hrtime.bigint() - start);
+	delay.disable();
+	logger.drop();
+	const megabytes = iterations * message.length / 1e6;
+	console.log(`${name.padEnd(12)} ${(elapsed / iterations).toFixed(0).padStart(6)} ns/record ${(megabytes / (elapsed / 1e9)).toFixed(0).padStart(6)} MB/s max loop delay ${(delay.max / 1e6).toFixed(1).padStart(6)} ms`);
+}
+
+/**
+ * @param {string | number} address
+ */
+async function listen(address) {
+	const server = net.createServer(socket => socket.resume());
+	await new Promise(resolve => server.listen(address, () => resolve(undefined)));
+	return server;
+}
+
+async function main() {
+	await run('file only', undefined);
+
+	const socketPath = logFile('collector').replace(/\.log$/, '.sock');
+	const uds = await listen(socketPath);
+	await run('uds', { path: socketPath });
+	uds.close();
+
+	const tcp = await listen(0);
+	const address = /** @type {import('net').AddressInfo} */ (tcp.address());
+	await run('tcp', { host: '127.0.0.1', port: address.port });
+	tcp.close();
+
+	const spillFile = logFile('collector-spill');
+	await run('down+spill', { path: socketPath, spillFile, spillSize: 1024 * 1024 * 1024 });
+	console.log(`spilled ${(fs.statSync(spillFile).size / 1e6).toFixed(0)} MB`);
+}
+
+main();
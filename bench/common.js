@@ -0,0 +1,45 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+// @ts-check
+
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+
+const logDirectory = fs.mkdtempSync(path.join(os.tmpdir(), 'spdlog-bench-'));
+process.on('exit', () => fs.rmSync(logDirectory, { recursive: true, force: true }));
+
+/**
+ * Returns a fresh log file path inside a temporary directory that is removed
+ * when the process exits.
+ * @param {string} name
+ */
+function logFile(name) {
+	return path.join(logDirectory, `${name}.log`);
+}
+
+/**
+ * Runs `fn` `iterations` times after a short warmup and prints the mean cost
+ * per iteration.
+ * @param {string} name
+ * @param {number} iterations
+ * @param {() => void} fn
+ */
+function measure(name, iterations, fn) {
+	for (let i = 0; i < Math.min(iterations, 1000); i++) {
+		fn();
+	}
+	const start = process.hrtime.bigint();
+	for (let i = 0; i < iterations; i++) {
+		fn();
+	}
+	const elapsed = Number(process.hrtime.bigint() - start);
+	console.log(`${name.padEnd(48)} ${(elapsed / iterations).toFixed(0).padStart(10)} ns/op`);
+	return elapsed / iterations;
+}
+
+exports.logFile = logFile;
+exports.measure = measure;
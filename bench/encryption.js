@@ -0,0 +1,41 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+// Throughput of a file logger with staging buffers writing plain text and
+// writing AES-128-GCM and AES-256-GCM encrypted chunks of 16 KiB and 64 KiB.
+// Time includes the final flush.
+// Usage: node bench/encryption.js
+
+// @ts-check
+
+const crypto = require('crypto');
+const spdlog = require('..');
+const { logFile } = require('./common');
+
+const iterations = 500000;
+const message = 'Handled request step with a message of moderate length '.repeat(4);
+const variants = [
+	{ name: 'plain' },
+	{ name: 'aes128-16k', encryption: { key: crypto.randomBytes(16), chunkSize: 16 * 1024 } },
+	{ name: 'aes128-64k', encryption: { key: crypto.randomBytes(16), chunkSize: 64 * 1024 } },
+	{ name: 'aes256-16k', encryption: { key: crypto.randomBytes(32), chunkSize: 16 * 1024 } },
+	{ name: 'aes256-64k', encryption: { key: crypto.randomBytes(32), chunkSize: 64 * 1024 } },
+];
+
+let plain = 0;
+for (const { name, encryption } of variants) {
+	const logger = new spdlog.Logger('rotating', `encryption-${name}`, logFile(`encryption-${name}`), 1024 * 1024 * 1024, 2, { stagingBuffers: true, encryption });
+	logger.setPattern('%v');
+	const start = process.hrtime.bigint();
+	for (let i = 0; i < iterations; i++) {
+		logger.info(message);
+	}
+	logger.flush();
+	const elapsed = Number(process.hrtime.bigint() - start);
+	const throughput = iterations * message.length / 1e6 / (elapsed / 1e9);
+	plain = plain || throughput;
+	console.log(`${name.padEnd(10)} ${(elapsed / iterations).toFixed(0).padStart(6)} ns/record ${throughput.toFixed(0).padStart(6)} MB/s ${(100 * (plain - throughput) / plain).toFixed(1).padStart(6)}% overhead`);
+	logger.drop();
+}
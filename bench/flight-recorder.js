@@ -0,0 +1,47 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+// Cost per trace call with a compressed flight recorder, and how much history
+// it holds compared to its memory budget.
+// Usage: node bench/flight-recorder.js
+
+// @ts-check
+
+const spdlog = require('..');
+const { logFile } = require('./common');
+
+const iterations = 300000;
+const memoryBudget = 4 * 1024 * 1024;
+
+function message(i) {
+	return `Resolved request ${i % 977} for /api/items/${i * 7919 % 100003} in ${i % 53}ms status=${i % 11 === 0 ? 404 : 200}`;
+}
+
+function run(name, options, level) {
+	const logger = new spdlog.Logger('rotating', name, logFile(name), 1024 * 1024 * 1024, 2, options);
+	logger.setLevel(level);
+	const start = process.hrtime.bigint();
+	for (let i = 0; i < iterations; i++) {
+		logger.trace(message(i));
+	}
+	logger.flush();
+	const elapsed = Number(process.hrtime.bigint() - start);
+	console.log(`${name.padEnd(24)} ${(elapsed / iterations).toFixed(0).padStart(6)} ns/call`);
+	return logger;
+}
+
+run('file, trace disabled', {}, 2);
+run('file, trace enabled', {}, 0);
+// Records below the logger level are only kept in memory.
+const logger = run('flight recorder', { flightRecorder: { memoryBudget } }, 2);
+
+const text = logger.snapshot();
+const compressed = logger.snapshot({ compressed: true }).reduce((size, chunk) => size + chunk.length, 0);
+const records = text.split('\n').length - 1;
+console.log(`held ${records} records, ${(text.length / 1024 / 1024).toFixed(1)} MB of text in ${(compressed / 1024 / 1024).toFixed(1)} MB, ${(text.length / compressed).toFixed(1)}x`);
+const start = process.hrtime.bigint();
+logger.snapshot();
+console.log(`snapshot() ${(Number(process.hrtime.bigint() - start) / 1e6).toFixed(1)} ms`);
+logger.drop();
@@ -0,0 +1,46 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+// Throughput of a file logger with staging buffers writing plain records and
+// writing them in CRC32C frames, for short and long messages, and how fast
+// readFramedLog() verifies the framed file. Time includes the final flush.
+// Usage: node bench/framing.js
+
+// @ts-check
+
+const fs = require('fs');
+const spdlog = require('..');
+const { logFile } = require('./common');
+
+const iterations = 500000;
+const messages = {
+	short: 'Handled request step',
+	long: 'Handled request step with a message of moderate length '.repeat(16),
+};
+
+for (const [messageName, message] of Object.entries(messages)) {
+	for (const framed of [false, true]) {
+		const name = `framing-${messageName}-${framed ? 'framed' : 'plain'}`;
+		const file = logFile(name);
+		const logger = new spdlog.Logger('rotating', name, file, 1024 * 1024 * 1024, 2, { stagingBuffers: true, framed });
+		logger.setPattern('%v');
+		const start = process.hrtime.bigint();
+		for (let i = 0; i < iterations; i++) {
+			logger.info(message);
+		}
+		logger.flush();
+		const elapsed = Number(process.hrtime.bigint() - start);
+		logger.drop();
+		const megabytes = iterations * message.length / 1e6;
+		let verify = '';
+		if (framed) {
+			const readStart = process.hrtime.bigint();
+			spdlog.readFramedLog(file);
+			const readElapsed = Number(process.hrtime.bigint() - readStart);
+			verify = ` read ${(fs.statSync(file).size / 1e6 / (readElapsed / 1e9)).toFixed(0).padStart(6)} MB/s`;
+		}
+		console.log(`${messageName.padEnd(5)} ${(framed ? 'framed' : 'plain').padEnd(6)} ${(elapsed / iterations).toFixed(0).padStart(6)} ns/record ${(megabytes / (elapsed / 1e9)).toFixed(0).padStart(6)} MB/s${verify}`);
+	}
+}
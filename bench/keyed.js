@@ -0,0 +1,76 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+// Throughput of a keyed logger writing to 10k keys, chosen with a Zipf
+// distribution as extensions and workspaces are, for several limits on open
+// files. Time includes waiting for the worker thread to write everything.
+// Usage: node bench/keyed.js
+
+// @ts-check
+
+const fs = require('fs');
+const path = require('path');
+const spdlog = require('..');
+const { logFile } = require('./common');
+
+const iterations = 500000;
+const keyCount = 10000;
+const message = 'Handled request step with a message of moderate length';
+
+// Key i is picked with a probability proportional to 1 / (i + 1).
+const weights = [];
+let total = 0;
+for (let i = 0; i < keyCount; i++) {
+	total += 1 / (i + 1);
+	weights.push(total);
+}
+let seed = 1;
+const picks = new Uint16Array(iterations);
+for (let i = 0; i < iterations; i++) {
+	seed = (seed * 1103515245 + 12345) % 2147483648;
+	const target = seed / 2147483648 * total;
+	let low = 0;
+	let high = keyCount - 1;
+	while (low < high) {
+		const middle = (low + high) >> 1;
+		if (weights[middle] < target) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	picks[i] = low;
+}
+
+async function main() {
+	for (const maxOpenFiles of [16, 64, 256, 1024]) {
+		const name = `keyed-${maxOpenFiles}`;
+		const directory = path.join(path.dirname(logFile(name)), name);
+		const logger = await spdlog.createKeyedLogger(name, directory, 1024 * 1024 * 1024, 2, { maxOpenFiles });
+		logger.setPattern('%v');
+		const routed = [];
+		for (let i = 0; i < keyCount; i++) {
+			routed.push(logger.route(`ext-${i}`));
+		}
+
+		const start = process.hrtime.bigint();
+		for (let i = 0; i < iterations; i++) {
+			routed[picks[i]].info(message);
+		}
+		// The last record goes to a file of its own, once it is there the
+		// worker thread wrote everything before it.
+		logger.info('done');
+		logger.flush();
+		const last = path.join(directory, `${name}.log`);
+		while (!fs.existsSync(last) || fs.statSync(last).size === 0) {
+			await new Promise(c => setTimeout(c, 1));
+		}
+		const elapsed = Number(process.hrtime.bigint() - start);
+		logger.drop();
+		console.log(`${String(maxOpenFiles).padStart(4)} open ${(elapsed / iterations).toFixed(0).padStart(6)} ns/record ${(iterations / (elapsed / 1e9) / 1e6).toFixed(2).padStart(6)} M records/s ${fs.readdirSync(directory).length} files`);
+	}
+}
+
+main();
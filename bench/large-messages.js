@@ -0,0 +1,47 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+// Logging 1 MB and larger messages as a regular string, as a Buffer and as an
+// external string, which is what Node creates for large latin1, ascii, hex
+// and base64 decodes. External strings are pinned instead of copied.
+// "call" is the time spent in the logging call, "written" includes the
+// flush.
+// Usage: node bench/large-messages.js
+
+// @ts-check
+
+const spdlog = require('..');
+const { logFile } = require('./common');
+
+const iterations = 50;
+
+function run(name, logger, message) {
+	let call = 0n;
+	const start = process.hrtime.bigint();
+	for (let i = 0; i < iterations; i++) {
+		const before = process.hrtime.bigint();
+		logger.info(message);
+		call += process.hrtime.bigint() - before;
+	}
+	logger.flush();
+	const written = process.hrtime.bigint() - start;
+	console.log(`${name.padEnd(28)} call ${(Number(call) / iterations / 1e3).toFixed(0).padStart(6)} us, written ${(Number(written) / iterations / 1e3).toFixed(0).padStart(6)} us`);
+}
+
+for (const threads of [0, 1]) {
+	const logger = new spdlog.Logger('rotating', `large-${threads}`, logFile(`large-${threads}`), 1024 * 1024 * 1024, 2, { formatterThreads: threads });
+	logger.setPattern('%v');
+	console.log(`formatterThreads ${threads}`);
+	for (const megabytes of [1, 4, 16]) {
+		const buffer = Buffer.alloc(megabytes * 1024 * 1024, 'x');
+		// A copy of the string data, so it is not the external string below.
+		const string = buffer.toString('utf8');
+		const external = buffer.toString('latin1');
+		run(`  ${megabytes} MB string`, logger, string);
+		run(`  ${megabytes} MB Buffer`, logger, buffer);
+		run(`  ${megabytes} MB external string`, logger, external);
+	}
+	logger.drop();
+}
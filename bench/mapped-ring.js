@@ -0,0 +1,34 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+// Cost per call of also writing records to a memory mapped ring, and of
+// recovering the ring afterwards.
+// Usage: node bench/mapped-ring.js
+
+// @ts-check
+
+const spdlog = require('..');
+const { logFile, measure } = require('./common');
+
+const iterations = 300000;
+
+function message(i) {
+	return `Resolved request ${i % 977} for /api/items/${i * 7919 % 100003} in ${i % 53}ms`;
+}
+
+function run(name, options) {
+	const logger = new spdlog.Logger('rotating', name, logFile(name), 1024 * 1024 * 1024, 2, options);
+	let i = 0;
+	measure(name, iterations, () => logger.info(message(i++)));
+	logger.drop();
+}
+
+run('file', {});
+const ring = logFile('ring');
+run('file and mapped ring', { mappedRing: { file: ring, size: 16 * 1024 * 1024 } });
+
+let text = '';
+measure('recoverMappedRing() of 16 MB', 10, () => text = spdlog.recoverMappedRing(ring));
+console.log(`recovered ${text.split('\n').length - 1} records`);
@@ -0,0 +1,40 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+// Cost of counting an event with a counter against logging a record for it.
+// Usage: node bench/metrics.js
+
+// @ts-check
+
+const spdlog = require('..');
+const { logFile } = require('./common');
+
+const iterations = 2000000;
+
+const logger = new spdlog.Logger('rotating', 'metrics-bench', logFile('metrics-bench'), 1024 * 1024 * 1024, 2);
+logger.setPattern('%v');
+const counter = logger.counter('events');
+
+const runs = {
+	counter() {
+		for (let i = 0; i < iterations; i++) {
+			counter.inc();
+		}
+	},
+	record() {
+		for (let i = 0; i < iterations; i++) {
+			logger.info('Handled event');
+		}
+	},
+};
+
+for (const [name, run] of Object.entries(runs)) {
+	const start = process.hrtime.bigint();
+	run();
+	logger.flush();
+	const elapsed = Number(process.hrtime.bigint() - start);
+	console.log(`${name.padEnd(7)} ${(elapsed / iterations).toFixed(1).padStart(7)} ns/event`);
+}
+logger.drop();
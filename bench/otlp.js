@@ -0,0 +1,34 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+// Throughput of a file logger alone and also exporting OTLP protobuf to a
+// file, with staging buffers so encoding happens off the logging thread.
+// Time includes the final flush; the export itself finishes on drop.
+// Usage: node bench/otlp.js
+
+// @ts-check
+
+const fs = require('fs');
+const spdlog = require('..');
+const { logFile } = require('./common');
+
+const iterations = 500000;
+const message = 'Handled request step with a message of moderate length';
+
+for (const otlp of [false, true]) {
+	const name = otlp ? 'otlp' : 'plain';
+	const otlpFile = logFile('otlp-export').replace(/\.log$/, '.bin');
+	const logger = new spdlog.Logger('rotating', `otlp-${name}`, logFile(`otlp-${name}`), 1024 * 1024 * 1024, 2, { stagingBuffers: true, otlp: otlp ? { file: otlpFile } : undefined });
+	logger.setPattern('%v');
+	const start = process.hrtime.bigint();
+	for (let i = 0; i < iterations; i++) {
+		logger.info(message);
+	}
+	logger.flush();
+	const elapsed = Number(process.hrtime.bigint() - start);
+	logger.drop();
+	const exported = otlp ? ` exported ${(fs.statSync(otlpFile).size / 1e6).toFixed(0)} MB` : '';
+	console.log(`${name.padEnd(5)} ${(elapsed / iterations).toFixed(0).padStart(6)} ns/record ${(iterations / (elapsed / 1e9) / 1e6).toFixed(2).padStart(6)} M records/s${exported}`);
+}
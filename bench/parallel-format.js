@@ -0,0 +1,39 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+// Throughput of a file logger with 0 (inline) to 8 formatter threads, for a
+// cheap and an expensive pattern. Time includes the final flush, so it covers
+// formatting and writing every record. ns/call is the time spent in the
+// logging calls themselves.
+// Usage: node bench/parallel-format.js
+
+// @ts-check
+
+const spdlog = require('..');
+const { logFile } = require('./common');
+
+const iterations = 300000;
+const patterns = {
+	short: '%v',
+	long: '[%Y-%m-%d %H:%M:%S.%f %z] [%n] [%^%l%$] [pid %P] [tid %t] %v',
+};
+const message = 'Handled request step with a message of moderate length';
+
+for (const [patternName, pattern] of Object.entries(patterns)) {
+	for (const threads of [0, 1, 2, 4, 8]) {
+		const name = `parallel-${patternName}-${threads}`;
+		const logger = new spdlog.Logger('rotating', name, logFile(name), 1024 * 1024 * 1024, 2, { formatterThreads: threads });
+		logger.setPattern(pattern);
+		const start = process.hrtime.bigint();
+		for (let i = 0; i < iterations; i++) {
+			logger.info(message);
+		}
+		const logged = Number(process.hrtime.bigint() - start);
+		logger.flush();
+		const elapsed = Number(process.hrtime.bigint() - start);
+		console.log(`${patternName.padEnd(6)} formatterThreads ${threads}: ${(logged / iterations).toFixed(0).padStart(6)} ns/call ${(elapsed / iterations).toFixed(0).padStart(6)} ns/record`);
+		logger.drop();
+	}
+}
@@ -0,0 +1,38 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+// Throughput of a file logger on 2 formatter threads without redaction and
+// with 10, 100 and 1000 literals plus emails and bearer tokens, for records
+// without a match and with one. Time includes the final flush.
+// Usage: node bench/redaction.js
+
+// @ts-check
+
+const spdlog = require('..');
+const { logFile } = require('./common');
+
+const iterations = 300000;
+const messages = {
+	clean: 'Handled request step with a message of moderate length '.repeat(4),
+	secret: 'Handled request step for jane.doe@example.com with a token secret-17 '.repeat(3),
+};
+
+for (const [messageName, message] of Object.entries(messages)) {
+	for (const count of [0, 10, 100, 1000]) {
+		const name = `redaction-${messageName}-${count}`;
+		const redact = count ? { literals: Array.from({ length: count }, (_, i) => `secret-${i}`), emails: true, bearerTokens: true } : undefined;
+		const logger = new spdlog.Logger('rotating', name, logFile(name), 1024 * 1024 * 1024, 2, { formatterThreads: 2, redact });
+		logger.setPattern('%v');
+		const start = process.hrtime.bigint();
+		for (let i = 0; i < iterations; i++) {
+			logger.info(message);
+		}
+		logger.flush();
+		const elapsed = Number(process.hrtime.bigint() - start);
+		const megabytes = iterations * message.length / 1e6;
+		console.log(`${messageName.padEnd(6)} ${String(count).padStart(4)} literals: ${(elapsed / iterations).toFixed(0).padStart(6)} ns/record ${(megabytes / (elapsed / 1e9)).toFixed(0).padStart(6)} MB/s`);
+		logger.drop();
+	}
+}
@@ -0,0 +1,27 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+// Cost per call of a hot loop logging one template, with and without
+// adaptive sampling, for a short and a long message.
+// Usage: node bench/sampling.js
+
+// @ts-check
+
+const spdlog = require('..');
+const { logFile, measure } = require('./common');
+
+const iterations = 300000;
+const padding = 'x'.repeat(4096);
+
+for (const [name, message] of [['short', i => `hot loop iteration ${i}`], ['4 KB', i => `hot loop iteration ${i} ${padding}`]]) {
+	for (const rate of [0, 100]) {
+		const label = `${name}, ${rate ? `sampled at ${rate}/s` : 'unsampled'}`;
+		const logger = new spdlog.Logger('rotating', label, logFile(label), 1024 * 1024 * 1024, 2);
+		logger.setSampling(rate);
+		let i = 0;
+		measure(label, iterations, () => logger.info(message(i++)));
+		logger.drop();
+	}
+}
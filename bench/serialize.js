@@ -0,0 +1,37 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+// Compares native object serialization with JSON.stringify + info().
+// Usage: node bench/serialize.js
+
+// @ts-check
+
+const spdlog = require('..');
+const { logFile, measure } = require('./common');
+
+const payloads = {
+	small: { id: 42, method: 'GET', path: '/api/items', ok: true },
+	nested: {
+		request: { id: 'a1b2c3', headers: { accept: 'application/json', 'user-agent': 'bench' } },
+		timings: [1.25, 3.5, 12.75, 0.5],
+		user: { name: 'someone', roles: ['reader', 'writer'] }
+	},
+	array: Array.from({ length: 50 }, (_, i) => ({ index: i, value: `item ${i}` })),
+	error: new Error('Something failed')
+};
+
+const logger = new spdlog.Logger('rotating_async', 'serialize', logFile('serialize'), 1024 * 1024 * 64, 2);
+const iterations = 100000;
+
+for (const [name, payload] of Object.entries(payloads)) {
+	measure(`${name}: JSON.stringify + info()`, iterations, () => logger.info(JSON.stringify(payload)));
+	measure(`${name}: info(object)`, iterations, () => logger.info(payload));
+}
+
+logger.setLevel(3); // warn
+measure('disabled level: JSON.stringify + info()', iterations, () => logger.info(JSON.stringify(payloads.nested)));
+measure('disabled level: info(object)', iterations, () => logger.info(payloads.nested));
+
+logger.drop();
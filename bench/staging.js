@@ -0,0 +1,59 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+// 1 to 16 worker threads logging to one shared logger, with the default
+// locking file sink and with per thread staging buffers. Time covers the
+// logging in all workers and the final flush.
+// Usage: node bench/staging.js
+
+// @ts-check
+
+const path = require('path');
+const { Worker } = require('worker_threads');
+const spdlog = require('..');
+const { logFile } = require('./common');
+
+const perThread = 100000;
+
+const source = `
+	const { workerData, parentPort } = require('worker_threads');
+	const spdlog = require(${JSON.stringify(path.join(__dirname, '..'))});
+	const logger = new spdlog.Logger('rotating', workerData.name, workerData.file, 1024 * 1024 * 1024, 2);
+	const start = new Int32Array(workerData.start);
+	parentPort.postMessage('ready');
+	Atomics.wait(start, 0, 0);
+	for (let i = 0; i < ${perThread}; i++) {
+		logger.info('Handled request step with a message of moderate length');
+	}
+`;
+
+async function run(name, options, threads) {
+	const file = logFile(name);
+	const logger = new spdlog.Logger('rotating', name, file, 1024 * 1024 * 1024, 2, options);
+	logger.setPattern('[%H:%M:%S.%e] [%l] %v');
+	const start = new Int32Array(new SharedArrayBuffer(4));
+	const workers = [];
+	for (let i = 0; i < threads; i++) {
+		const worker = new Worker(source, { eval: true, workerData: { name, file, start: start.buffer } });
+		await new Promise(c => worker.once('message', c));
+		workers.push(new Promise(c => worker.once('exit', c)));
+	}
+	const began = process.hrtime.bigint();
+	Atomics.store(start, 0, 1);
+	Atomics.notify(start, 0);
+	await Promise.all(workers);
+	logger.flush();
+	const elapsed = Number(process.hrtime.bigint() - began);
+	logger.drop();
+	return elapsed / (threads * perThread);
+}
+
+(async () => {
+	for (const threads of [1, 2, 4, 8, 16]) {
+		const locked = await run(`locked-${threads}`, {}, threads);
+		const staged = await run(`staged-${threads}`, { stagingBuffers: true }, threads);
+		console.log(`${String(threads).padStart(2)} producers: locked ${locked.toFixed(0).padStart(5)} ns/record, staged ${staged.toFixed(0).padStart(5)} ns/record`);
+	}
+})();
@@ -0,0 +1,44 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+// Cost per call of counting top talkers at different sample rates, with
+// messages from 5000 call sites of which a few flood.
+// Usage: node bench/top-talkers.js
+
+// @ts-check
+
+const spdlog = require('..');
+const { logFile, measure } = require('./common');
+
+const iterations = 300000;
+
+// The site id is spelled in letters, words with digits do not count.
+function siteName(site) {
+	let name = '';
+	for (let n = site; name.length < 3; n = Math.floor(n / 26)) {
+		name += String.fromCharCode(97 + n % 26);
+	}
+	return name;
+}
+
+function message(i) {
+	// Every fourth message comes from one of three noisy sites.
+	const site = i % 4 === 0 ? i % 3 : i * 7919 % 5000;
+	return `site ${siteName(site)} handled item ${i} in ${i % 53}ms`;
+}
+
+for (const sampleEvery of [0, 64, 16, 1]) {
+	const name = sampleEvery === 0 ? 'untracked' : `sampleEvery ${sampleEvery}`;
+	const logger = new spdlog.Logger('rotating', name, logFile(name), 1024 * 1024 * 1024, 2);
+	if (sampleEvery) {
+		logger.trackTopTalkers(64, sampleEvery);
+	}
+	let i = 0;
+	measure(name, iterations, () => logger.info(message(i++)));
+	if (sampleEvery) {
+		console.log(logger.getTopTalkers(3).map(talker => `  ${talker.template}: ${talker.count}`).join('\n'));
+	}
+	logger.drop();
+}
@@ -0,0 +1,44 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+// Cost of timing a step with span() against logging its start and end as
+// two records, which is what a trace is otherwise pieced together from.
+// Usage: node bench/trace.js
+
+// @ts-check
+
+const fs = require('fs');
+const spdlog = require('..');
+const { logFile } = require('./common');
+
+const iterations = 500000;
+
+const traceFile = logFile('trace-spans').replace(/\.log$/, '.json');
+const logger = new spdlog.Logger('rotating', 'trace-bench', logFile('trace-bench'), 1024 * 1024 * 1024, 2, { trace: { file: traceFile } });
+logger.setPattern('%v');
+
+const runs = {
+	span() {
+		for (let i = 0; i < iterations; i++) {
+			logger.span('step').end();
+		}
+	},
+	records() {
+		for (let i = 0; i < iterations; i++) {
+			logger.info('step start');
+			logger.info('step end');
+		}
+	},
+};
+
+for (const [name, run] of Object.entries(runs)) {
+	const start = process.hrtime.bigint();
+	run();
+	logger.flush();
+	const elapsed = Number(process.hrtime.bigint() - start);
+	console.log(`${name.padEnd(7)} ${(elapsed / iterations).toFixed(0).padStart(6)} ns/step`);
+}
+logger.drop();
+console.log(`trace file ${(fs.statSync(traceFile).size / 1e6).toFixed(0)} MB`);
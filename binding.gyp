@@ -3,7 +3,32 @@
 		"target_name": "spdlog",
 		"sources": [
 			"src/main.cc",
-			"src/logger.cc"
+			"src/collector_sink.cc",
+			"src/config.cc",
+			"src/crc32c.cc",
+			"src/deduping_file_sink.cc",
+			"src/emergency.cc",
+			"src/encrypted_sink.cc",
+			"src/framed_sink.cc",
+			"src/keyed_file_sink.cc",
+			"src/load_shedder.cc",
+			"src/logger.cc",
+			"src/mapped_ring_sink.cc",
+			"src/message_template.cc",
+			"src/metrics.cc",
+			"src/otlp_sink.cc",
+			"src/parallel_sink.cc",
+			"src/pinned.cc",
+			"src/record.cc",
+			"src/recorder_sink.cc",
+			"src/redaction_sink.cc",
+			"src/sampler.cc",
+			"src/serializer.cc",
+			"src/staging_sink.cc",
+			"src/stream_socket.cc",
+			"src/syslog_sink.cc",
+			"src/top_talkers.cc",
+			"src/trace_sink.cc"
 		],
 		"include_dirs": [
 			"<!(node -e \"require('nan')\")",
@@ -7,8 +7,71 @@
 export const version: number;
 export function setLevel(level: number): void;
 export function setFlushOn(level: number): void;
-export function createRotatingLogger(name: string, filename: string, filesize: number, filecount: number): Promise<Logger>;
-export function createAsyncRotatingLogger(name: string, filename: string, filesize: number, filecount: number): Promise<Logger>;
+/**
+ * The records a logger with a `mappedRing` left in its ring file, oldest
+ * first. Records that were not completely written when the process died are
+ * left out.
+ */
+export function recoverMappedRing(filename: string): string;
+/**
+ * The text of a log written with `encryption`, decrypted with `key`. A chunk
+ * that was cut short at the end of the file is left out. Throws if the key is
+ * wrong or the file was changed.
+ */
+export function decryptLog(filename: string, key: Uint8Array): string;
+/**
+ * The records of a log written with `framed`, in order. Frames that were torn
+ * by a crash or damaged later are skipped; reading resumes at the next intact
+ * frame.
+ */
+export function readFramedLog(filename: string): FramedLogContents;
+
+export interface FramedLogContents {
+    /** The text of the intact records. */
+    text: string;
+    records: number;
+    /** Runs of bytes that did not hold an intact frame. */
+    corruptRegions: number;
+    skippedBytes: number;
+}
+/**
+ * Opens `filename` now and, when the process dies of SIGSEGV, SIGABRT or
+ * SIGBUS, appends every flight recorder's history to it: the sealed chunks
+ * as gzip members, then the open chunk as text. Each part follows a
+ * `--- <label>, <size> bytes ---` line.
+ * SIGSEGV and SIGBUS reach the handler that was installed before first, and
+ * nothing is dumped if it recovers from the fault. Not available on Windows.
+ */
+export function enableEmergencyDump(filename: string): void;
+/**
+ * Apply settings to the loggers whose name matches a pattern in `loggers`,
+ * where `*` matches any run of characters and `?` any single one. Later
+ * patterns override earlier ones. The settings apply to live loggers and to
+ * every logger created afterwards, on any thread. Calling it again replaces
+ * the settings; loggers no pattern matches keep what they have. Nothing is
+ * applied if any setting is invalid. Levels from the `SPDLOG_LEVEL`
+ * environment variable, such as `info,main=debug`, apply before any of it.
+ */
+export function configure(config: LoggingConfig): void;
+/**
+ * `configure()` with the JSON in `file`. With `watch` the file is loaded
+ * again whenever it changes; errors of those loads go to `onError`.
+ */
+export function loadConfig(file: string, options?: { watch?: boolean, onError?: (err: Error) => void }): { close(): void };
+export function createRotatingLogger(name: string, filename: string, filesize: number, filecount: number, options?: LoggerOptions): Promise<Logger>;
+export function createAsyncRotatingLogger(name: string, filename: string, filesize: number, filecount: number, options?: LoggerOptions): Promise<Logger>;
+/**
+ * An async logger that writes the records of each `route(key)` to a rotating
+ * file `<key>.log` in `directory`, and other records to `<name>.log`, both
+ * lowercased. Files are opened and closed on the worker thread; only the
+ * `maxOpenFiles` most recently written stay open.
+ */
+export function createKeyedLogger(name: string, directory: string, filesize: number, filecount: number, options?: KeyedLoggerOptions): Promise<Logger>;
+
+export interface KeyedLoggerOptions {
+    /** Defaults to 64. */
+    maxOpenFiles?: number;
+}
 
 export enum LogLevel {
     Trace,
@@ -20,19 +83,405 @@ export enum LogLevel {
     Off
 }
 
+export interface LoggingConfig {
+    /** Seconds between flushes of all loggers, 0 stops flushing. */
+    flushEvery?: number;
+    loggers?: Record<string, LoggerConfig>;
+}
+
+export interface LoggerConfig {
+    /** A level or its name, such as `"debug"`. */
+    level?: LogLevel | string;
+    pattern?: string;
+    /** Flush after every record of this level or above. */
+    flushOn?: LogLevel | string;
+}
+
+export interface LoggerOptions {
+    /**
+     * Format records on this many background threads and write them from one
+     * more thread, in the order they were logged. Logging then only copies the
+     * message; `flush()` waits until everything logged before it was written.
+     * 0, the default, formats and writes on the calling thread.
+     */
+    formatterThreads?: number;
+    /**
+     * Give every thread that logs to this logger a queue of its own, drained
+     * by a background thread that orders records across threads by time.
+     * Worker threads share a logger by creating one with the same name. The
+     * queues take the place of the async thread pool, so an async logger with
+     * staging buffers does not support `setLoadShedding()`.
+     */
+    stagingBuffers?: boolean;
+    /**
+     * Keep the most recent records in memory, gzip compressed in chunks, for
+     * `snapshot()`. The recorder also keeps records below the logger level,
+     * from its own `level` on.
+     */
+    flightRecorder?: FlightRecorderOptions;
+    /**
+     * Also write every record to a ring in a memory mapped file. The records
+     * reach the file even when the process is killed or crashes, and
+     * `recoverMappedRing()` reads them back.
+     */
+    mappedRing?: MappedRingOptions;
+    /**
+     * Replace secrets in message text when records are formatted, which is
+     * on the formatter threads with `formatterThreads` and on the background
+     * thread with `stagingBuffers`. Everything written, including the flight
+     * recorder and mapped ring, only sees the redacted text.
+     */
+    redact?: RedactOptions;
+    /**
+     * Encrypt the file with AES-GCM in authenticated chunks, which
+     * `decryptLog()` reads back. Every flush ends a chunk, so the file
+     * decrypts up to the last flush. Cannot be combined with `mappedRing`.
+     */
+    encryption?: EncryptionOptions;
+    /**
+     * Write every record in a frame with its length and CRC32C, which
+     * `readFramedLog()` reads back. A record torn by a crash or damaged
+     * later only loses itself. Cannot be combined with `encryption`.
+     */
+    framed?: boolean;
+    /**
+     * Write each distinct error stack trace only once per log file, see
+     * `SerializerOptions.dedupeStacks`, which this turns on. Without it the
+     * file never looks for stacks. Cannot be combined with `framed` or
+     * `encryption`.
+     */
+    dedupeStacks?: boolean;
+    /**
+     * Also send every record to a local collector. A background thread
+     * writes the records in batches and reconnects with backoff; while the
+     * collector is unreachable the batches go to `spillFile` and are sent
+     * once it is back. Not available on Windows.
+     */
+    collector?: CollectorOptions;
+    /**
+     * Also send every record as a datagram to a local syslog or journald
+     * socket. Records are sent in batches from a background thread and are
+     * dropped when the socket does not take them. The message is the record
+     * as formatted by the pattern, without the line ending, so a pattern of
+     * `%v` suits best. Not available on Windows.
+     */
+    syslog?: SyslogOptions;
+    /**
+     * Also export every record as an OpenTelemetry log record. A background
+     * thread encodes batches as OTLP `ExportLogsServiceRequest` protobufs,
+     * each preceded by its length as a 4 byte big endian number. The body is
+     * the record as formatted by the pattern, without the line ending, the
+     * async context becomes the trace and span id and a `request.id`
+     * attribute, and the logger name the instrumentation scope.
+     */
+    otlp?: OtlpOptions;
+    /**
+     * Write the spans of `span()` to `file` as Chrome trace events, which
+     * chrome://tracing, Perfetto and speedscope open. A background thread
+     * writes them; `flush()` waits until they are. Loggers opened under the
+     * same name, for example on worker threads, write to the same file, and
+     * asking for another file than the one they write to throws.
+     */
+    trace?: TraceOptions;
+}
+
+export interface TraceOptions {
+    file: string;
+}
+
+export interface Counter {
+    /** Adds `n`, a safe integer of 0 or more, defaults to 1. */
+    inc(n?: number): void;
+}
+
+export interface Gauge {
+    set(value: number): void;
+}
+
+export interface Span {
+    readonly name: string;
+    /** Returns the duration in milliseconds. Only the first call records the span. */
+    end(): number;
+}
+
+export interface OtlpOptions {
+    /** File the batches are appended to. */
+    file?: string;
+    /** Unix domain socket of a collector, used when there is no `file`. Not available on Windows. */
+    path?: string;
+    /**
+     * Resource attributes. `service.name` defaults to the logger name and
+     * `process.pid` is always added.
+     */
+    resource?: Record<string, string | number | boolean>;
+}
+
+export interface SyslogOptions {
+    /** Datagram socket. Defaults to `/dev/log`, or `/run/systemd/journal/socket` for `journald`. */
+    path?: string;
+    /**
+     * `rfc5424` messages carry the async context as structured data,
+     * `journald` native ones as `TRACE_ID`, `SPAN_ID` and `REQUEST_ID`
+     * fields. Defaults to `rfc5424`.
+     */
+    format?: 'rfc5424' | 'journald';
+    /** Defaults to the logger name. */
+    appName?: string;
+    /** From 0 to 23. Defaults to 1, user. */
+    facility?: number;
+}
+
+export interface CollectorOptions {
+    /** Unix domain socket of the collector. */
+    path?: string;
+    /** TCP host of the collector, used with `port` when there is no `path`. */
+    host?: string;
+    port?: number;
+    /** Bytes that are sent without waiting for `flushInterval`. Defaults to 64 KiB. */
+    batchSize?: number;
+    /** Milliseconds records wait at most before they are sent. Defaults to 100. */
+    flushInterval?: number;
+    /**
+     * Where records go while the collector is unreachable. Records left by
+     * an earlier process are sent too. Without it they are dropped.
+     */
+    spillFile?: string;
+    /** Bytes the spill file may grow to, further records are dropped. Defaults to 64 MiB. */
+    spillSize?: number;
+}
+
+export interface EncryptionOptions {
+    /** 16 bytes for AES-128 or 32 bytes for AES-256. */
+    key: Uint8Array;
+    /** Bytes of text per chunk, from 4 KiB to 64 MiB. Defaults to 64 KiB. */
+    chunkSize?: number;
+}
+
+export interface RedactOptions {
+    /** Strings replaced wherever they occur. Of those starting at the same place the longest is replaced. */
+    literals?: string[];
+    /** Replace email addresses. */
+    emails?: boolean;
+    /** Replace the token after `Bearer `. */
+    bearerTokens?: boolean;
+    /** Defaults to `[REDACTED]`. */
+    replacement?: string;
+}
+
+export interface MappedRingOptions {
+    /** Ring file. An existing ring of the same size is continued. */
+    file: string;
+    /** Bytes of the file, from 64 KiB to 1 GiB. Defaults to 4 MiB. */
+    size?: number;
+}
+
+export interface FlightRecorderOptions {
+    /** Bytes of memory for the history. The oldest chunks are dropped beyond it. */
+    memoryBudget: number;
+    /** Bytes of text per compressed chunk. Defaults to 64 KiB. */
+    chunkSize?: number;
+    /** Lowest level kept in memory. Defaults to `LogLevel.Trace`. */
+    level?: LogLevel;
+}
+
+export interface TopTalker {
+    template: string;
+    level: LogLevel;
+    /** Estimated messages since counting started, at most `error` too high. */
+    count: number;
+    error: number;
+    /** Estimated messages per second. */
+    rate: number;
+}
+
+export interface LoadSheddingOptions {
+    /** Queue fill, from 0 to 1, above which one more level is dropped. Defaults to 0.75. */
+    highWatermark?: number;
+    /** Queue fill at or below which one level comes back. Defaults to 0.25. */
+    lowWatermark?: number;
+    /** Highest level that may be dropped, at most `LogLevel.Error`. Defaults to `LogLevel.Info`. */
+    maxLevel?: LogLevel;
+    /** Milliseconds between steps, and that the queue has to stay low before a level comes back. Defaults to 1000. */
+    holdTime?: number;
+}
+
+export interface SerializerOptions {
+    /** Maximum nesting depth before objects are replaced by `"[Object]"`, at most 1000. Defaults to 10. */
+    depth?: number;
+    /** Maximum number of array items or object properties written. Defaults to 100. */
+    maxItems?: number;
+    /** Maximum number of UTF-8 bytes kept from each string. Defaults to 10240. */
+    maxStringLength?: number;
+    /**
+     * Write each distinct error stack trace only once per log file. Later errors
+     * thrown from the same place keep their first line and refer to it as
+     * `[stack <id>]`. Every file stands on its own: a record that rotates the
+     * file is written in full, and so is a record whose text was redacted or
+     * changed by the formatter, such as with `setJsonFormatter()`. Only
+     * loggers created with `dedupeStacks` accept `true`; on others it throws.
+     */
+    dedupeStacks?: boolean;
+}
+
+/**
+ * Trace, span and request ids parsed once into a compact native form. Store
+ * one per request in an `AsyncLocalStorage` bound with `setAsyncContext` and
+ * every record logged inside it carries the ids.
+ */
+export class LogContext {
+    /**
+     * @param ids `traceId` is 32 and `spanId` 16 hex digits, `requestId` a
+     * non-negative safe integer or bigint. All of them are optional.
+     */
+    constructor(ids: { traceId?: string; spanId?: string; requestId?: number | bigint });
+}
+
+export interface AsyncContextStorage {
+    getStore(): LogContext | undefined;
+}
+
 export class Logger {
-    constructor(loggerType: "rotating" | "rotating_async" | "stdout_async", name: string, filename: string, filesize: number, filecount: number);
-
-    trace(message: string): void;
-    debug(message: string): void;
-    info(message: string): void;
-    warn(message: string): void;
-    error(message: string): void;
-    critical(message: string): void;
+    constructor(loggerType: "rotating" | "rotating_async" | "stdout_async", name: string, filename: string, filesize: number, filecount: number, options?: LoggerOptions);
+
+    /**
+     * Strings are written as they are, Buffers and typed arrays as their
+     * bytes and other values serialized. Large external strings, which Node
+     * creates for large latin1, ascii, hex and base64 decodes, are written
+     * from their own memory without a copy. Buffers are always copied, so
+     * changing one after the call does not change what is written.
+     */
+    trace(message: unknown): void;
+    debug(message: unknown): void;
+    info(message: unknown): void;
+    warn(message: unknown): void;
+    error(message: unknown): void;
+    critical(message: unknown): void;
+    /**
+     * Log several messages with one native call. The first `messages.length`
+     * entries of `levels` are `LogLevel` values and those of `timestamps` are
+     * milliseconds since the epoch.
+     */
+    logBatch(levels: Uint8Array, messages: unknown[], timestamps: Float64Array, contexts?: (LogContext | undefined)[]): void;
+    /**
+     * Queue level calls in JS and hand them to the native logger in one batch
+     * per microtask. Timestamps, async contexts and the level are taken when
+     * each call is made. Values that are not strings are serialized when the
+     * batch is written, so objects changed before the next microtask are
+     * written as changed. Errors of writing a batch are reported on stderr.
+     */
+    setBatching(enabled: boolean): void;
     getLevel(): number;
     setLevel(level: number): void;
+    /**
+     * Whether records of `level` are written, or kept by the flight
+     * recorder.
+     */
+    shouldLog(level: number): boolean;
+    /**
+     * Besides the spdlog flags, `%{trace_id}`, `%{span_id}` and `%{request_id}`
+     * write the ids of the record's `LogContext`, or nothing if it has none.
+     */
     setPattern(pattern: string): void;
+    /**
+     * Write one JSON object per line with `time`, `level`, `logger`, `message`
+     * and the `trace_id`, `span_id` and `request_id` of the record's context.
+     */
+    setJsonFormatter(): void;
     clearFormatters(): void;
+    /**
+     * Limit the number of UTF-8 bytes written per message. Longer messages are
+     * cut and suffixed with a `…[truncated N characters]` marker, counting
+     * UTF-16 code units, or `…[truncated N bytes]` for Buffers. 0 disables
+     * the limit.
+     */
+    setMaxMessageSize(size: number): void;
+    /**
+     * Limits used when logging values that are not strings. Objects, arrays,
+     * Maps and Sets are serialized natively into JSON-like text. Errors are
+     * written as their stack followed by their `cause` chain.
+     */
+    setSerializerOptions(options: SerializerOptions): void;
+    /**
+     * Create a logger that writes through this logger and prefixes every
+     * message with `key=value` pairs from `context`. The context is encoded
+     * once, so children are cheap to create. Level, pattern, serializer
+     * options and the max message size are shared with the parent. Dropping a
+     * child only detaches it, dropping the parent stops all of its children.
+     * An exception thrown by reading a property of `context` is thrown by
+     * `child()`; values inside the properties are serialized like messages.
+     */
+    child(context: Record<string, unknown>): Logger;
+    /**
+     * A child whose records go to the file of `key` on a logger created
+     * with `createKeyedLogger()`. Keys are letters, digits, `.`, `_` and
+     * `-`, do not start with `.`, and are at most 128 bytes. Device names
+     * reserved on Windows, such as `con`, `nul`, `com1` or `lpt1`, are
+     * rejected with any extension. Keys are case-insensitive: they are
+     * lowercased, so `Alice` and `alice` write to `alice.log` on every
+     * platform. Other loggers write the records as usual.
+     */
+    route(key: string): Logger;
+    /**
+     * Read the `LogContext` of each record from `storage.getStore()`, usually
+     * an `AsyncLocalStorage`. Children inherit the storage. Pass `null` to stop.
+     */
+    setAsyncContext(storage: AsyncContextStorage | null): void;
+    /**
+     * The history of a logger created with a `flightRecorder`, oldest record
+     * first, including everything logged before the call. Also works after
+     * `drop()`. With `compressed` the chunks are returned as they are held,
+     * gzip members that can be concatenated into a single gzip file.
+     */
+    snapshot(): string;
+    snapshot(options: { compressed: true }): Buffer[];
+    /**
+     * Count which message templates are logged most often, in `capacity`
+     * counters, from a random sample of about one in `sampleEvery` messages
+     * that pass the level. A template is the first 256 bytes of a message with
+     * every word containing a digit replaced by `#`. Other values count by
+     * type, followed by the message and first stack frame of an error or the
+     * own keys of an object, such as `[Object] id name`. Calling it again
+     * starts over, a `capacity` of 0 stops counting. Defaults to 64 counters,
+     * one in 16.
+     */
+    trackTopTalkers(capacity?: number, sampleEvery?: number): void;
+    /** The `count` most frequent templates, most frequent first. Defaults to all. */
+    getTopTalkers(count?: number): TopTalker[];
+    /**
+     * Limit each message template, as in `trackTopTalkers()`, to `rate`
+     * messages per second. Past that the gap between kept messages doubles
+     * each time, until the next second starts over. The next message kept
+     * of a template ends in `[N similar skipped]`. Templates that stay under
+     * the rate are never sampled out. Messages are dropped before they are
+     * transcoded or serialized. 0, the default, keeps everything.
+     */
+    setSampling(rate: number): void;
+    /**
+     * Drop the lowest levels while the queue of an async logger fills up:
+     * trace first, then debug, up to `maxLevel`, and bring them back once it
+     * drained. Every step writes a warning with the queue fill and how many
+     * messages were dropped. Pass `null` to stop.
+     */
+    setLoadShedding(options: LoadSheddingOptions | null): void;
+    /**
+     * Start timing `name`. `end()` records the span in the `trace` file of
+     * the logger; without one the span is only timed.
+     */
+    span(name: string): Span;
+    /**
+     * A counter of `name`, which has no spaces or `=`. Counters and gauges
+     * are written together as one info record per interval, such as
+     * `metrics requests=120 queue_depth=17.5`, by a thread of their own and
+     * once more on `drop()`. Counters hold the count of the interval, up to
+     * 2^63 - 1, gauges their last value. Intervals in which nothing moved
+     * write nothing. Updates are Atomics on shared memory, without a native
+     * call.
+     */
+    counter(name: string): Counter;
+    /** A gauge of `name`, written with the counters; see `counter()`. */
+    gauge(name: string): Gauge;
+    /** Milliseconds between metrics summaries. Defaults to 60000. */
+    setMetricsInterval(interval: number): void;
     /**
      * A synchronous operation to flush the contents into file
     */
@@ -1,32 +1,368 @@
+const fs = require('fs');
 const path = require('path');
 const mkdirp = require('mkdirp');
+const { performance } = require('perf_hooks');
 const spdlog = require('bindings')('spdlog');
 
 exports.version = spdlog.version;
-exports.setLevel = spdlog.setLevel;
+exports.setLevel = setLevel;
 exports.setFlushOn = spdlog.setFlushOn;
+exports.recoverMappedRing = spdlog.recoverMappedRing;
+exports.decryptLog = spdlog.decryptLog;
+exports.readFramedLog = spdlog.readFramedLog;
+exports.enableEmergencyDump = spdlog.enableEmergencyDump;
+exports.configure = configure;
 exports.Logger = spdlog.Logger;
+exports.LogContext = spdlog.LogContext;
 
-function createRotatingLogger(name, filepath, maxFileSize, maxFiles) {
-	return createLogger('rotating', name, filepath, maxFileSize, maxFiles);
+const levelMethods = ['trace', 'debug', 'info', 'warn', 'error', 'critical'];
+const batchState = Symbol('batchState');
+const asyncStorage = Symbol('asyncStorage');
+// Flushes of the batches waiting for their microtask.
+const pendingBatches = new Set();
+
+/**
+ * Writes the pending batches of all loggers. Levels are checked when a call
+ * is batched, so this runs before any level changes.
+ */
+function flushBatches() {
+	for (const flush of pendingBatches) {
+		flush();
+	}
+}
+
+function reportError(err) {
+	console.error(`[*** LOG ERROR ***] ${err instanceof Error ? err.message : String(err)}`);
+}
+
+function setLevel(level) {
+	flushBatches();
+	return spdlog.setLevel(level);
+}
+
+function configure(config) {
+	flushBatches();
+	return spdlog.configure(config);
+}
+
+const loggerSetLevel = spdlog.Logger.prototype.setLevel;
+spdlog.Logger.prototype.setLevel = function (level) {
+	// Children share the level of their root, whose batch may be pending.
+	flushBatches();
+	return loggerSetLevel.call(this, level);
+};
+
+const setAsyncContext = spdlog.Logger.prototype.setAsyncContext;
+/**
+ * Binds an AsyncLocalStorage whose store is a LogContext. The native side
+ * reads the store on every record; the storage is also remembered here so
+ * that batched calls can capture the store at call time.
+ * @param {{ getStore(): unknown } | undefined} storage
+ */
+spdlog.Logger.prototype.setAsyncContext = function (storage) {
+	setAsyncContext.call(this, storage);
+	this[asyncStorage] = storage || undefined;
+	return this;
+};
+
+const child = spdlog.Logger.prototype.child;
+spdlog.Logger.prototype.child = function (context) {
+	const logger = child.call(this, context);
+	logger[asyncStorage] = this[asyncStorage];
+	return logger;
+};
+
+const route = spdlog.Logger.prototype.route;
+spdlog.Logger.prototype.route = function (key) {
+	const logger = route.call(this, key);
+	logger[asyncStorage] = this[asyncStorage];
+	return logger;
+};
+
+class Span {
+	constructor(logger, name) {
+		this.logger = logger;
+		this.name = name;
+		this.start = performance.now();
+		this.duration = undefined;
+	}
+
+	/**
+	 * Records the span in the trace file of the logger, once. Returns its
+	 * duration in milliseconds.
+	 * @returns {number}
+	 */
+	end() {
+		if (this.duration === undefined) {
+			const end = performance.now();
+			this.duration = end - this.start;
+			this.logger.recordSpan(this.name, this.start, end);
+		}
+		return this.duration;
+	}
 }
 
-function createAsyncRotatingLogger(name, filepath, maxFileSize, maxFiles) {
-	return createLogger('rotating_async', name, filepath, maxFileSize, maxFiles);
+/**
+ * Starts timing `name` on the calling thread. The span is written to the
+ * trace file the logger was created with when `end()` is called, and is
+ * only timed without one.
+ * @param {string} name
+ * @returns {Span}
+ */
+spdlog.Logger.prototype.span = function (name) {
+	if (typeof name !== 'string') {
+		throw new Error('Provide the span name');
+	}
+	return new Span(this, name);
+};
+
+class Counter {
+	constructor(cell) {
+		this.cell = new BigInt64Array(cell);
+	}
+
+	/**
+	 * Adds `n`, a safe integer from 0, to the count of the current interval.
+	 * @param {number} [n]
+	 */
+	inc(n = 1) {
+		if (!Number.isSafeInteger(n) || n < 0) {
+			throw new Error('Provide a count that is a safe integer of 0 or more');
+		}
+		Atomics.add(this.cell, 0, BigInt(n));
+	}
+}
+
+class Gauge {
+	constructor(cell) {
+		this.cell = new Float64Array(cell);
+	}
+
+	/** @param {number} value */
+	set(value) {
+		this.cell[0] = value;
+	}
+}
+
+/**
+ * A counter that is written with the other metrics of the logger as one
+ * summary record per interval. Incrementing it does not call into native
+ * code. Handles of the same name share the count.
+ * @param {string} name
+ * @returns {Counter}
+ */
+spdlog.Logger.prototype.counter = function (name) {
+	return new Counter(this.metric(name, 0));
+};
+
+/**
+ * A gauge whose last value is written with the other metrics of the logger
+ * as one summary record per interval.
+ * @param {string} name
+ * @returns {Gauge}
+ */
+spdlog.Logger.prototype.gauge = function (name) {
+	return new Gauge(this.metric(name, 1));
+};
+
+/**
+ * Opt-in batching: level calls are queued in JS together with their
+ * timestamp and handed to the native logger in a single call from a
+ * microtask, so a burst of log calls crosses into native code once.
+ * All other methods flush the pending batch first to keep ordering intact.
+ * The level is checked when a call is made, once per level and batch.
+ * Messages are serialized when the batch is written, and errors of that
+ * are reported on stderr like those of the sinks.
+ * @param {boolean} enabled
+ */
+spdlog.Logger.prototype.setBatching = function (enabled) {
+	const state = this[batchState];
+	if (!enabled) {
+		if (state) {
+			state.flush();
+			for (const name of state.overrides) {
+				delete this[name];
+			}
+			delete this[batchState];
+		}
+		return this;
+	}
+	if (state) {
+		return this;
+	}
+
+	const proto = spdlog.Logger.prototype;
+	let levels = new Uint8Array(64);
+	let timestamps = new Float64Array(64);
+	let messages = [];
+	let contexts = [];
+	// Whether each level is enabled, for the calls of the pending batch.
+	let allowed = [];
+	let scheduled = false;
+
+	const flush = () => {
+		scheduled = false;
+		pendingBatches.delete(flush);
+		if (messages.length === 0) {
+			return;
+		}
+		const batch = messages;
+		const batchContexts = contexts;
+		messages = [];
+		contexts = [];
+		try {
+			proto.logBatch.call(this, levels, batch, timestamps, batchContexts);
+		} catch (err) {
+			reportError(err);
+		}
+	};
+
+	const overrides = [];
+	levelMethods.forEach((name, level) => {
+		this[name] = function (message) {
+			if (message === undefined) {
+				throw new Error('Provide a message to log');
+			}
+			if (!scheduled) {
+				allowed = [];
+			}
+			if (allowed[level] === undefined) {
+				allowed[level] = proto.shouldLog.call(this, level);
+			}
+			if (!allowed[level]) {
+				return this;
+			}
+			const index = messages.length;
+			if (index === levels.length) {
+				const grownLevels = new Uint8Array(index * 2);
+				grownLevels.set(levels);
+				levels = grownLevels;
+				const grownTimestamps = new Float64Array(index * 2);
+				grownTimestamps.set(timestamps);
+				timestamps = grownTimestamps;
+			}
+			levels[index] = level;
+			timestamps[index] = performance.timeOrigin + performance.now();
+			messages.push(message);
+			const storage = this[asyncStorage];
+			let context;
+			try {
+				context = storage ? storage.getStore() : undefined;
+			} catch (err) {
+				reportError(err);
+			}
+			contexts.push(context);
+			if (!scheduled) {
+				scheduled = true;
+				pendingBatches.add(flush);
+				queueMicrotask(flush);
+			}
+			return this;
+		};
+		overrides.push(name);
+	});
+	for (const name of Object.getOwnPropertyNames(proto)) {
+		if (name === 'constructor' || name === 'setBatching' || levelMethods.includes(name) || typeof proto[name] !== 'function') {
+			continue;
+		}
+		this[name] = function (...args) {
+			flush();
+			return proto[name].apply(this, args);
+		};
+		overrides.push(name);
+	}
+
+	this[batchState] = { flush, overrides };
+	return this;
+};
+
+/**
+ * Applies the JSON configuration in `file` with `configure`. With `watch` it
+ * is applied again whenever the file changes, until `close()` is called.
+ * Errors of later loads go to `onError`, the previous settings stay.
+ * @param {string} file
+ * @param {{ watch?: boolean, onError?: (err: Error) => void }} [options]
+ */
+function loadConfig(file, options) {
+	const load = () => configure(JSON.parse(fs.readFileSync(file, 'utf8')));
+	load();
+	if (!options || !options.watch) {
+		return { close() { } };
+	}
+
+	// Editors save by renaming over the file, so the directory is watched.
+	let timer;
+	const watcher = fs.watch(path.dirname(file), (_event, name) => {
+		if (name && name !== path.basename(file)) {
+			return;
+		}
+		// A save shows up as several events, load once they settled.
+		clearTimeout(timer);
+		timer = setTimeout(() => {
+			try {
+				load();
+			} catch (err) {
+				if (options.onError) {
+					options.onError(err);
+				}
+			}
+		}, 50);
+		timer.unref();
+	});
+	watcher.unref();
+	return {
+		close() {
+			clearTimeout(timer);
+			watcher.close();
+		}
+	};
+}
+
+function createRotatingLogger(name, filepath, maxFileSize, maxFiles, options) {
+	return createLogger('rotating', name, filepath, maxFileSize, maxFiles, options);
+}
+
+function createAsyncRotatingLogger(name, filepath, maxFileSize, maxFiles, options) {
+	return createLogger('rotating_async', name, filepath, maxFileSize, maxFiles, options);
+}
+
+/**
+ * Creates an async logger that writes the records of each `route(key)` to
+ * a rotating file `<key>.log` in `directory`, and other records to
+ * `<name>.log`. At most `options.maxOpenFiles` files are open at a time,
+ * 64 by default.
+ * @param {string} name
+ * @param {string} directory
+ * @param {number} maxFileSize
+ * @param {number} maxFiles
+ * @param {{ maxOpenFiles?: number }} [options]
+ */
+function createKeyedLogger(name, directory, maxFileSize, maxFiles, options) {
+	return new Promise((c, e) => {
+		mkdirp(directory, err => {
+			if (err) {
+				e(err);
+			} else {
+				c(new spdlog.Logger('keyed', name, directory, maxFileSize, maxFiles, options));
+			}
+		});
+	});
 }
 
-function createLogger(loggerType, name, filepath, maxFileSize, maxFiles) {
+function createLogger(loggerType, name, filepath, maxFileSize, maxFiles, options) {
 	return new Promise((c, e) => {
 		const dirname = path.dirname(filepath);
 		mkdirp(dirname, err => {
 			if (err) {
 				e(err);
 			} else {
-				c(new spdlog.Logger(loggerType, name, filepath, maxFileSize, maxFiles));
+				c(new spdlog.Logger(loggerType, name, filepath, maxFileSize, maxFiles, options));
 			}
 		});
 	});
 }
 
+exports.loadConfig = loadConfig;
 exports.createRotatingLogger = createRotatingLogger;
 exports.createAsyncRotatingLogger = createAsyncRotatingLogger;
+exports.createKeyedLogger = createKeyedLogger;
@@ -0,0 +1,274 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "collector_sink.h"
+#include "sink_helpers.h"
+#include "stream_socket.h"
+
+namespace {
+
+// Bytes of records that may wait for the sender while it is busy, beyond
+// them records are dropped.
+const size_t kMaxPending = 16 * 1024 * 1024;
+const std::chrono::milliseconds kMinBackoff(50);
+const std::chrono::milliseconds kMaxBackoff(2000);
+// A collector that takes longer to accept a connection or data counts as
+// unreachable.
+const int kTimeoutMs = 1000;
+
+}  // namespace
+
+#if defined(_WIN32)
+
+CollectorSink::CollectorSink(std::shared_ptr<spdlog::sinks::sink>,
+                             const Options &) {
+  spdlog::throw_spdlog_ex("The collector sink needs POSIX sockets");
+}
+
+CollectorSink::~CollectorSink() {}
+
+void CollectorSink::sink_it_(const spdlog::details::log_msg &) {}
+
+void CollectorSink::flush_() {}
+
+#else
+
+CollectorSink::CollectorSink(std::shared_ptr<spdlog::sinks::sink> inner,
+                             const Options &options)
+    : inner_(std::move(inner)),
+      options_(options),
+      send_now_(false),
+      stopping_(false),
+      dropped_bytes_(0),
+      socket_(-1),
+      spill_(-1),
+      spill_used_(0),
+      retry_at_(std::chrono::steady_clock::now()),
+      backoff_(kMinBackoff),
+      reported_(false) {
+  if (options_.path.empty() && options_.host.empty()) {
+    spdlog::throw_spdlog_ex("Provide the collector path or host");
+  }
+  if (options_.path.size() >= sizeof(sockaddr_un().sun_path)) {
+    spdlog::throw_spdlog_ex("The collector path is too long");
+  }
+  if (!options_.spill_file.empty()) {
+    // Batches a previous run spilled are replayed too.
+    spill_ = ::open(options_.spill_file.c_str(),
+                    O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    struct stat status;
+    if (spill_ < 0 || ::fstat(spill_, &status) != 0) {
+      const int error = errno;
+      if (spill_ >= 0) {
+        ::close(spill_);
+      }
+      spdlog::throw_spdlog_ex(
+          "Failed to open the collector spill file " + options_.spill_file,
+          error);
+    }
+    spill_used_ = static_cast<size_t>(status.st_size);
+  }
+  inner_->set_formatter(spdlog::details::make_unique<PassthroughFormatter>());
+  sender_ = std::thread(&CollectorSink::SendLoop, this);
+}
+
+CollectorSink::~CollectorSink() {
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_one();
+  sender_.join();
+  Disconnect();
+  if (spill_ >= 0) {
+    ::close(spill_);
+  }
+}
+
+void CollectorSink::sink_it_(const spdlog::details::log_msg &msg) {
+  formatted_.clear();
+  const size_t start = record::FormatForwarded(*formatter_, msg, formatted_);
+  spdlog::details::log_msg formatted = msg;
+  formatted.payload = spdlog::string_view_t(formatted_.data(), formatted_.size());
+  inner_->log(formatted);
+
+  const char *text = formatted_.data() + start;
+  const size_t textSize = formatted_.size() - start;
+  bool wake = false;
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    if (pending_.size() + textSize > kMaxPending) {
+      dropped_bytes_ += textSize;
+      return;
+    }
+    // Only the record that fills the batch wakes the sender.
+    wake = pending_.size() < options_.batch_size &&
+           pending_.size() + textSize >= options_.batch_size;
+    pending_.append(text, textSize);
+  }
+  if (wake) {
+    wake_.notify_one();
+  }
+}
+
+void CollectorSink::flush_() {
+  inner_->flush();
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    send_now_ = true;
+  }
+  wake_.notify_one();
+}
+
+void CollectorSink::SendLoop() {
+  std::string batch;
+  std::unique_lock<std::mutex> lock(queue_mutex_);
+  for (;;) {
+    wake_.wait_for(lock, options_.flush_interval, [this] {
+      return stopping_ || send_now_ || pending_.size() >= options_.batch_size;
+    });
+    const bool stopping = stopping_;
+    send_now_ = false;
+    batch.clear();
+    batch.swap(pending_);
+    const uint64_t dropped = dropped_bytes_;
+    dropped_bytes_ = 0;
+    lock.unlock();
+
+    if (dropped > 0) {
+      ReportError("Records for the log collector were dropped, the sender "
+                  "fell behind");
+    }
+    if (stopping) {
+      // One last attempt, whatever the backoff says.
+      retry_at_ = std::chrono::steady_clock::now();
+    }
+    Deliver(batch);
+
+    lock.lock();
+    if (stopping_ && pending_.empty()) {
+      return;
+    }
+  }
+}
+
+void CollectorSink::Deliver(const std::string &batch) {
+  if (socket_ < 0 && std::chrono::steady_clock::now() >= retry_at_) {
+    if (Connect() && Replay()) {
+      backoff_ = kMinBackoff;
+      reported_ = false;
+    } else {
+      Disconnect();
+      retry_at_ = std::chrono::steady_clock::now() + backoff_;
+      backoff_ = std::min(backoff_ * 2, kMaxBackoff);
+    }
+  }
+  if (batch.empty()) {
+    return;
+  }
+  if (socket_ >= 0 && Send(batch.data(), batch.size())) {
+    return;
+  }
+  Disconnect();
+  Spill(batch);
+}
+
+bool CollectorSink::Connect() {
+  socket_ = ConnectStream(options_.path, options_.host, options_.port,
+                          kTimeoutMs);
+  return socket_ >= 0;
+}
+
+void CollectorSink::Disconnect() {
+  if (socket_ >= 0) {
+    ::close(socket_);
+    socket_ = -1;
+  }
+}
+
+bool CollectorSink::Send(const char *data, size_t size) {
+  // A collector that went away is only noticed when reading. Writing first
+  // would hand a batch to a connection that is already dead.
+  pollfd poll_fd = {socket_, POLLIN, 0};
+  if (::poll(&poll_fd, 1, 0) == 1) {
+    char byte;
+    if (::recv(socket_, &byte, 1, MSG_PEEK | MSG_DONTWAIT) == 0 ||
+        (poll_fd.revents & (POLLERR | POLLHUP)) != 0) {
+      return false;
+    }
+  }
+
+  return SendAll(socket_, data, size);
+}
+
+bool CollectorSink::Replay() {
+  if (spill_used_ == 0) {
+    return true;
+  }
+  char buffer[64 * 1024];
+  off_t offset = 0;
+  for (;;) {
+    const ssize_t read = ::pread(spill_, buffer, sizeof(buffer), offset);
+    if (read < 0 && errno == EINTR) {
+      continue;
+    }
+    if (read <= 0) {
+      break;
+    }
+    if (!Send(buffer, static_cast<size_t>(read))) {
+      return false;
+    }
+    offset += read;
+  }
+  if (::ftruncate(spill_, 0) != 0) {
+    ReportError("Failed to empty the collector spill file");
+  }
+  spill_used_ = 0;
+  return true;
+}
+
+void CollectorSink::Spill(const std::string &batch) {
+  if (spill_ >= 0 && spill_used_ + batch.size() <= options_.spill_size) {
+    const char *data = batch.data();
+    size_t size = batch.size();
+    while (size > 0) {
+      const ssize_t written = ::write(spill_, data, size);
+      if (written < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        break;
+      }
+      data += written;
+      size -= static_cast<size_t>(written);
+    }
+    spill_used_ += batch.size() - size;
+    if (size == 0) {
+      return;
+    }
+  }
+  // Once per outage.
+  if (!reported_) {
+    reported_ = true;
+    ReportError("The log collector is unreachable and records are dropped");
+  }
+}
+
+#endif
@@ -0,0 +1,94 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#ifndef COLLECTOR_SINK_H
+#define COLLECTOR_SINK_H
+
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/base_sink.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Passes every formatted record on to |inner| and also sends it to a local
+// collector over a Unix domain socket or TCP.
+//
+// Records collect in memory and a sender thread writes them to the socket
+// in batches, so the logging thread never waits for the network. While the
+// collector cannot be reached the sender retries with exponential backoff
+// and appends the batches to a bounded spill file, which it replays before
+// anything else once it is connected again. Delivery is at least once: a
+// batch that fails half way is spilled and sent again as a whole. Records
+// that find neither room in memory nor in the spill file are dropped. Not
+// available on Windows.
+class CollectorSink : public spdlog::sinks::base_sink<std::mutex> {
+ public:
+  struct Options {
+    Options()
+        : port(0),
+          batch_size(64 * 1024),
+          flush_interval(100),
+          spill_size(64 * 1024 * 1024) {}
+
+    // Socket path, or else |host| and |port|.
+    std::string path;
+    std::string host;
+    uint16_t port;
+    // Bytes that make the sender write without waiting for the interval.
+    size_t batch_size;
+    std::chrono::milliseconds flush_interval;
+    // No spilling if empty.
+    spdlog::filename_t spill_file;
+    size_t spill_size;
+  };
+
+  CollectorSink(std::shared_ptr<spdlog::sinks::sink> inner,
+                const Options &options);
+  // Sends or spills what is left, trying to connect once more if needed.
+  ~CollectorSink() override;
+
+ protected:
+  void sink_it_(const spdlog::details::log_msg &msg) override;
+  // Also has the sender write the records collected so far without waiting
+  // for them to be written.
+  void flush_() override;
+
+ private:
+  void SendLoop();
+  void Deliver(const std::string &batch);
+  bool Connect();
+  void Disconnect();
+  bool Send(const char *data, size_t size);
+  bool Replay();
+  void Spill(const std::string &batch);
+
+  std::shared_ptr<spdlog::sinks::sink> inner_;
+  const Options options_;
+  spdlog::memory_buf_t formatted_;
+
+  std::mutex queue_mutex_;
+  std::condition_variable wake_;
+  std::string pending_;
+  bool send_now_;
+  bool stopping_;
+  uint64_t dropped_bytes_;
+
+  // Only used by the sender thread.
+  int socket_;
+  int spill_;
+  size_t spill_used_;
+  std::chrono::steady_clock::time_point retry_at_;
+  std::chrono::milliseconds backoff_;
+  bool reported_;
+
+  std::thread sender_;
+};
+
+#endif  // !COLLECTOR_SINK_H
@@ -0,0 +1,137 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+
+#include "config.h"
+#include "record.h"
+#include "recorder_sink.h"
+
+namespace config {
+
+namespace {
+
+std::mutex mutex;
+Settings current;
+// Set by SetLevel() for every logger, before the rules apply.
+bool has_default_level = false;
+spdlog::level::level_enum default_level;
+// What the loggers were created with, by name. The level of a logger with a
+// recorder is set through it.
+struct Registration {
+  std::weak_ptr<FlightRecorderSink> recorder;
+  bool dedupe_stacks;
+};
+std::unordered_map<std::string, Registration> registrations;
+
+void ApplyLevel(spdlog::logger &logger, spdlog::level::level_enum level) {
+  auto found = registrations.find(logger.name());
+  std::shared_ptr<FlightRecorderSink> recorder;
+  if (found != registrations.end()) {
+    recorder = found->second.recorder.lock();
+  }
+  if (recorder) {
+    // As Logger::SetLevel, the recorder may want more than is written.
+    recorder->SetForwardLevel(level);
+    level = std::min(level, recorder->RecordLevel());
+  }
+  logger.set_level(level);
+}
+
+void ApplyRules(spdlog::logger &logger) {
+  for (const Rule &rule : current.rules) {
+    if (!Match(rule.glob.c_str(), logger.name().c_str())) {
+      continue;
+    }
+    if (rule.has_level) {
+      ApplyLevel(logger, rule.level);
+    }
+    if (!rule.pattern.empty()) {
+      logger.set_formatter(record::MakePatternFormatter(rule.pattern));
+    }
+    if (rule.has_flush_on) {
+      logger.flush_on(rule.flush_on);
+    }
+  }
+}
+
+}  // namespace
+
+void Apply(Settings settings) {
+  std::lock_guard<std::mutex> lock(mutex);
+  current = std::move(settings);
+  if (current.has_flush_every) {
+    spdlog::flush_every(current.flush_every);
+  }
+  spdlog::apply_all([](std::shared_ptr<spdlog::logger> logger) {
+    ApplyRules(*logger);
+  });
+}
+
+void Configure(const std::shared_ptr<spdlog::logger> &logger,
+               const std::shared_ptr<FlightRecorderSink> &recorder,
+               bool dedupeStacks) {
+  std::lock_guard<std::mutex> lock(mutex);
+  Registration &registration = registrations[logger->name()];
+  registration.recorder = recorder;
+  registration.dedupe_stacks = dedupeStacks;
+  if (has_default_level) {
+    ApplyLevel(*logger, default_level);
+  }
+  ApplyRules(*logger);
+}
+
+std::shared_ptr<FlightRecorderSink> Recorder(const std::string &name) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto found = registrations.find(name);
+  if (found == registrations.end()) {
+    return NULL;
+  }
+  return found->second.recorder.lock();
+}
+
+bool DedupesStacks(const std::string &name) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto found = registrations.find(name);
+  return found != registrations.end() && found->second.dedupe_stacks;
+}
+
+void SetLevel(spdlog::level::level_enum level) {
+  std::lock_guard<std::mutex> lock(mutex);
+  has_default_level = true;
+  default_level = level;
+  spdlog::apply_all([level](std::shared_ptr<spdlog::logger> logger) {
+    ApplyLevel(*logger, level);
+  });
+}
+
+bool Match(const char *glob, const char *name) {
+  // Where to resume after the last "*" if the rest does not match.
+  const char *star = NULL;
+  const char *retry = NULL;
+  while (*name != '\0') {
+    if (*glob == '*') {
+      star = ++glob;
+      retry = name;
+    } else if (*glob == '?' || *glob == *name) {
+      ++glob;
+      ++name;
+    } else if (star != NULL) {
+      glob = star;
+      name = ++retry;
+    } else {
+      return false;
+    }
+  }
+  while (*glob == '*') {
+    ++glob;
+  }
+  return *glob == '\0';
+}
+
+}  // namespace config
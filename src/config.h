@@ -0,0 +1,78 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <spdlog/spdlog.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+class FlightRecorderSink;
+
+// Process wide settings for loggers matched by name, applied to the loggers
+// that are alive when the settings change and to every logger created
+// afterwards, on any thread.
+namespace config {
+
+// Settings for the loggers whose name matches |glob|, where "*" matches any
+// run of characters and "?" any single one.
+struct Rule {
+  Rule() : has_level(false), has_flush_on(false) {}
+
+  std::string glob;
+  bool has_level;
+  spdlog::level::level_enum level;
+  // Empty keeps the pattern.
+  std::string pattern;
+  bool has_flush_on;
+  spdlog::level::level_enum flush_on;
+};
+
+struct Settings {
+  Settings() : has_flush_every(false), flush_every(0) {}
+
+  // Later rules override earlier ones.
+  std::vector<Rule> rules;
+  bool has_flush_every;
+  // Flushes all loggers this often, 0 stops it.
+  std::chrono::seconds flush_every;
+};
+
+// Replaces the current settings with |settings| and applies them to all
+// live loggers, under one lock, so a logger created meanwhile sees either
+// the old or the new settings. Loggers no rule matches keep what they have.
+void Apply(Settings settings);
+
+// Applies the current settings to |logger|, which was just created, and
+// registers what it was created with. The level of a logger with a
+// |recorder| is the level forwarded past it. |dedupeStacks| is whether its
+// file deduplicates stacks.
+void Configure(const std::shared_ptr<spdlog::logger> &logger,
+               const std::shared_ptr<FlightRecorderSink> &recorder,
+               bool dedupeStacks);
+
+// Returns the recorder |name| was created with while that logger lives, so
+// that handles opened later under the name, for example on worker threads,
+// share it.
+std::shared_ptr<FlightRecorderSink> Recorder(const std::string &name);
+
+// Whether the file of the logger |name| deduplicates stacks.
+bool DedupesStacks(const std::string &name);
+
+// Sets the level of all live loggers and of every logger created
+// afterwards, before rules that match it. As with rules, a flight recorder
+// keeps recording from its own level on.
+void SetLevel(spdlog::level::level_enum level);
+
+bool Match(const char *glob, const char *name);
+
+}  // namespace config
+
+#endif  // !CONFIG_H
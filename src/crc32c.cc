@@ -0,0 +1,129 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <nmmintrin.h>
+#define CRC32C_SSE42
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define CRC32C_TARGET
+#else
+#define CRC32C_TARGET __attribute__((target("sse4.2")))
+#endif
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define CRC32C_ARM
+#endif
+
+#include "crc32c.h"
+
+namespace {
+
+const uint32_t kPolynomial = 0x82f63b78;
+
+struct Tables {
+  Tables() {
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t crc = i;
+      for (int bit = 0; bit < 8; ++bit) {
+        crc = (crc >> 1) ^ (kPolynomial & (0u - (crc & 1)));
+      }
+      table[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; ++i) {
+      for (int slice = 1; slice < 8; ++slice) {
+        const uint32_t previous = table[slice - 1][i];
+        table[slice][i] = (previous >> 8) ^ table[0][previous & 0xff];
+      }
+    }
+  }
+
+  uint32_t table[8][256];
+};
+
+uint32_t Software(uint32_t crc, const uint8_t *p, size_t size) {
+  static const Tables tables;
+  const uint32_t(*t)[256] = tables.table;
+  while (size >= 8) {
+    uint32_t low;
+    uint32_t high;
+    std::memcpy(&low, p, 4);
+    std::memcpy(&high, p + 4, 4);
+    // The tables assume little endian words, which every target is.
+    low ^= crc;
+    crc = t[7][low & 0xff] ^ t[6][(low >> 8) & 0xff] ^
+          t[5][(low >> 16) & 0xff] ^ t[4][low >> 24] ^ t[3][high & 0xff] ^
+          t[2][(high >> 8) & 0xff] ^ t[1][(high >> 16) & 0xff] ^
+          t[0][high >> 24];
+    p += 8;
+    size -= 8;
+  }
+  while (size-- > 0) {
+    crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xff];
+  }
+  return crc;
+}
+
+#if defined(CRC32C_SSE42)
+bool HasSse42() {
+#if defined(_MSC_VER)
+  int registers[4];
+  __cpuid(registers, 1);
+  return (registers[2] & (1 << 20)) != 0;
+#else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+CRC32C_TARGET uint32_t Hardware(uint32_t crc, const uint8_t *p, size_t size) {
+  uint64_t crc64 = crc;
+  while (size >= 8) {
+    uint64_t word;
+    std::memcpy(&word, p, 8);
+    crc64 = _mm_crc32_u64(crc64, word);
+    p += 8;
+    size -= 8;
+  }
+  crc = static_cast<uint32_t>(crc64);
+  while (size-- > 0) {
+    crc = _mm_crc32_u8(crc, *p++);
+  }
+  return crc;
+}
+#elif defined(CRC32C_ARM)
+uint32_t Hardware(uint32_t crc, const uint8_t *p, size_t size) {
+  while (size >= 8) {
+    uint64_t word;
+    std::memcpy(&word, p, 8);
+    crc = __crc32cd(crc, word);
+    p += 8;
+    size -= 8;
+  }
+  while (size-- > 0) {
+    crc = __crc32cb(crc, *p++);
+  }
+  return crc;
+}
+#endif
+
+}  // namespace
+
+uint32_t Crc32c(uint32_t crc, const void *data, size_t size) {
+  const uint8_t *p = static_cast<const uint8_t *>(data);
+  crc = ~crc;
+#if defined(CRC32C_SSE42)
+  static const bool hardware = HasSse42();
+  crc = hardware ? Hardware(crc, p, size) : Software(crc, p, size);
+#elif defined(CRC32C_ARM)
+  crc = Hardware(crc, p, size);
+#else
+  crc = Software(crc, p, size);
+#endif
+  return ~crc;
+}
@@ -0,0 +1,18 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Extends |crc|, 0 to start with, by the CRC32C (Castagnoli) of |data|. Uses
+// the SSE4.2 crc32 instruction when the CPU has it, the ARMv8 one when the
+// build targets it, and slicing by 8 tables otherwise.
+uint32_t Crc32c(uint32_t crc, const void *data, size_t size);
+
+#endif  // !CRC32C_H
@@ -0,0 +1,74 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#include <spdlog/details/os.h>
+
+#include "deduping_file_sink.h"
+#include "sink_helpers.h"
+
+namespace {
+
+const size_t kMaxSeenStacks = 4096;
+
+}  // namespace
+
+DedupingFileSink::DedupingFileSink(const spdlog::filename_t &filename,
+                                   size_t max_size, size_t max_files)
+    : max_size_(max_size), size_(0) {
+  // Opening a file, rotations included, starts it over.
+  spdlog::file_event_handlers handlers;
+  handlers.after_open = [this](const spdlog::filename_t &, std::FILE *file) {
+    size_ = spdlog::details::os::filesize(file);
+    seen_stacks_.clear();
+  };
+  file_.reset(new spdlog::sinks::rotating_file_sink_st(
+      filename, max_size, max_files, false, handlers));
+  file_->set_formatter(spdlog::details::make_unique<PassthroughFormatter>());
+}
+
+void DedupingFileSink::sink_it_(const spdlog::details::log_msg &msg) {
+  // The header is decoded before the formatter releases pinned text.
+  const record::View view = record::Decode(msg.payload);
+  formatted_.clear();
+  formatter_->format(msg, formatted_);
+
+  spdlog::details::log_msg written = msg;
+  written.payload = spdlog::string_view_t(formatted_.data(), formatted_.size());
+  // A record that does not fit rotates the file, unless it is empty, so it
+  // is written in full to whichever file it ends up in.
+  const bool fits = size_ + formatted_.size() <= max_size_;
+  stacks_.clear();
+  new_stacks_.clear();
+  if (view.stack_count != 0 &&
+      record::LocateStacks(view, written.payload, &stacks_)) {
+    const char *data = formatted_.data();
+    size_t copied = 0;
+    bool cut = false;
+    written_.clear();
+    for (const record::Stack &stack : stacks_) {
+      if (fits && stack.begin >= copied && seen_stacks_.count(stack.id) != 0) {
+        written_.append(data + copied, data + stack.begin);
+        copied = stack.end;
+        cut = true;
+      } else {
+        new_stacks_.insert(stack.id);
+      }
+    }
+    if (cut) {
+      written_.append(data + copied, data + formatted_.size());
+      written.payload = spdlog::string_view_t(written_.data(), written_.size());
+    }
+  }
+  file_->log(written);
+  size_ += written.payload.size();
+
+  if (seen_stacks_.size() + new_stacks_.size() > kMaxSeenStacks) {
+    seen_stacks_.clear();
+  }
+  seen_stacks_.insert(new_stacks_.begin(), new_stacks_.end());
+}
+
+void DedupingFileSink::flush_() { file_->flush(); }
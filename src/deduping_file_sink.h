@@ -0,0 +1,53 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#ifndef DEDUPING_FILE_SINK_H
+#define DEDUPING_FILE_SINK_H
+
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/base_sink.h>
+#include <spdlog/sinks/rotating_file_sink.h>
+
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+#include "record.h"
+
+// A rotating file sink that writes each stack trace the record header lists
+// in full only the first time it reaches the current file. Later records
+// with the same id lose their frames and keep the id line, which refers to
+// the earlier record. Only the header marks stacks, so no message text can
+// lose lines that merely look like one.
+//
+// The decision is made as the record is written, so every file stands on
+// its own: a record that may rotate the file is always written in full, and
+// the stacks seen are forgotten whenever a file is opened.
+class DedupingFileSink : public spdlog::sinks::base_sink<std::mutex> {
+ public:
+  DedupingFileSink(const spdlog::filename_t &filename, size_t max_size,
+                   size_t max_files);
+
+ protected:
+  void sink_it_(const spdlog::details::log_msg &msg) override;
+  void flush_() override;
+
+ private:
+  const size_t max_size_;
+  // Bytes in the current file, as the inner sink counts them to decide when
+  // to rotate.
+  size_t size_;
+  std::unique_ptr<spdlog::sinks::rotating_file_sink_st> file_;
+  spdlog::memory_buf_t formatted_;
+  spdlog::memory_buf_t written_;
+  std::vector<record::Stack> stacks_;
+  // Ids of the stack traces written in full to the current file.
+  std::unordered_set<uint64_t> seen_stacks_;
+  std::unordered_set<uint64_t> new_stacks_;
+};
+
+#endif  // !DEDUPING_FILE_SINK_H
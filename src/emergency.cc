@@ -0,0 +1,236 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+#include "emergency.h"
+
+namespace emergency {
+
+namespace {
+
+const size_t kMaxRegions = 256;
+
+std::atomic<Region *> regions[kMaxRegions];
+
+}  // namespace
+
+void Register(Region *region) {
+  for (std::atomic<Region *> &slot : regions) {
+    Region *expected = nullptr;
+    if (slot.compare_exchange_strong(expected, region)) {
+      return;
+    }
+  }
+}
+
+void Unregister(Region *region) {
+  for (std::atomic<Region *> &slot : regions) {
+    Region *expected = region;
+    if (slot.compare_exchange_strong(expected, nullptr)) {
+      return;
+    }
+  }
+}
+
+#if defined(_WIN32)
+
+void Enable(const spdlog::filename_t &) {
+  spdlog::throw_spdlog_ex("The emergency dump needs POSIX signals");
+}
+
+#else
+
+namespace {
+
+const int kSignals[] = {SIGSEGV, SIGABRT, SIGBUS};
+const size_t kAltStackSize = 64 * 1024;
+
+std::atomic<int> dump_fd(-1);
+std::atomic<bool> dumped(false);
+struct sigaction previous[sizeof(kSignals) / sizeof(kSignals[0])];
+bool installed = false;
+
+void WriteAll(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    const ssize_t written = ::write(fd, data, size);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      return;
+    }
+    data += written;
+    size -= static_cast<size_t>(written);
+  }
+}
+
+void WriteString(int fd, const char *text) {
+  WriteAll(fd, text, std::strlen(text));
+}
+
+void WriteNumber(int fd, uint64_t number) {
+  char digits[20];
+  size_t count = 0;
+  do {
+    digits[sizeof(digits) - ++count] = static_cast<char>('0' + number % 10);
+    number /= 10;
+  } while (number != 0);
+  WriteAll(fd, digits + sizeof(digits) - count, count);
+}
+
+void Dump(int signal) {
+  const int fd = dump_fd.load(std::memory_order_acquire);
+  // Only the first fatal signal dumps, a fault inside the dump must not
+  // start another one.
+  if (fd < 0 || dumped.exchange(true)) {
+    return;
+  }
+  const int savedErrno = errno;
+  WriteString(fd, "--- fatal signal ");
+  WriteNumber(fd, static_cast<uint64_t>(signal));
+  WriteString(fd, " ---\n");
+  for (std::atomic<Region *> &slot : regions) {
+    const Region *region = slot.load(std::memory_order_acquire);
+    if (region == nullptr) {
+      continue;
+    }
+    size_t start = region->start.load(std::memory_order_acquire);
+    size_t size = region->size.load(std::memory_order_acquire);
+    start = start < region->capacity ? start : region->capacity;
+    size = size < region->capacity - start ? size : region->capacity - start;
+    if (size == 0) {
+      continue;
+    }
+    WriteString(fd, "--- ");
+    WriteString(fd, region->label);
+    WriteString(fd, ", ");
+    WriteNumber(fd, size);
+    WriteString(fd, " bytes ---\n");
+    WriteAll(fd, region->data + start, size);
+  }
+  ::fsync(fd);
+  errno = savedErrno;
+}
+
+bool IsDefault(const struct sigaction &action) {
+  return !(action.sa_flags & SA_SIGINFO) &&
+         (action.sa_handler == SIG_DFL || action.sa_handler == SIG_IGN);
+}
+
+void Call(const struct sigaction &action, int signal, siginfo_t *info,
+          void *context) {
+  if (action.sa_flags & SA_SIGINFO) {
+    action.sa_sigaction(signal, info, context);
+  } else {
+    action.sa_handler(signal);
+  }
+}
+
+// Ignoring a fault would retry it forever, so both fall back to the default
+// action: the signal is raised again and delivered once the handler returns.
+void RaiseDefault(int signal) {
+  struct sigaction fallback;
+  std::memset(&fallback, 0, sizeof(fallback));
+  fallback.sa_handler = SIG_DFL;
+  sigemptyset(&fallback.sa_mask);
+  ::sigaction(signal, &fallback, nullptr);
+  ::raise(signal);
+}
+
+void Handle(int signal, siginfo_t *info, void *context) {
+  for (size_t i = 0; i < sizeof(kSignals) / sizeof(kSignals[0]); ++i) {
+    if (kSignals[i] != signal) {
+      continue;
+    }
+    const struct sigaction &action = previous[i];
+    if ((signal == SIGSEGV || signal == SIGBUS) && !IsDefault(action)) {
+      // The fault may be one the earlier handler expects, such as a
+      // WebAssembly bounds check that V8 turns into an exception. It then
+      // returns with this handler still installed. A handler that does not
+      // recognize the fault puts back the action it replaced and returns, so
+      // that the fault happens again.
+      Call(action, signal, info, context);
+      struct sigaction current;
+      if (::sigaction(signal, nullptr, &current) != 0 ||
+          ((current.sa_flags & SA_SIGINFO) && current.sa_sigaction == Handle)) {
+        return;
+      }
+      Dump(signal);
+      if (IsDefault(current)) {
+        RaiseDefault(signal);
+      }
+      return;
+    }
+
+    Dump(signal);
+    if (!IsDefault(action)) {
+      Call(action, signal, info, context);
+      return;
+    }
+    RaiseDefault(signal);
+    return;
+  }
+}
+
+// A stack overflow leaves no stack for the handler. Only the thread that
+// enables the dump gets an alternate one, it is the one running JS.
+void InstallAltStack() {
+  stack_t current;
+  if (::sigaltstack(nullptr, &current) != 0 || !(current.ss_flags & SS_DISABLE)) {
+    return;
+  }
+  stack_t stack;
+  std::memset(&stack, 0, sizeof(stack));
+  stack.ss_sp = std::malloc(kAltStackSize);
+  stack.ss_size = kAltStackSize;
+  if (stack.ss_sp != nullptr && ::sigaltstack(&stack, nullptr) != 0) {
+    std::free(stack.ss_sp);
+  }
+}
+
+}  // namespace
+
+void Enable(const spdlog::filename_t &path) {
+  const int fd =
+      ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    spdlog::throw_spdlog_ex("Failed to open emergency dump file " + path, errno);
+  }
+  const int old = dump_fd.exchange(fd, std::memory_order_acq_rel);
+  if (old >= 0) {
+    ::close(old);
+  }
+
+  static std::mutex mutex;
+  std::lock_guard<std::mutex> lock(mutex);
+  if (installed) {
+    return;
+  }
+  InstallAltStack();
+  for (size_t i = 0; i < sizeof(kSignals) / sizeof(kSignals[0]); ++i) {
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_sigaction = Handle;
+    action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    sigemptyset(&action.sa_mask);
+    ::sigaction(kSignals[i], &action, &previous[i]);
+  }
+  installed = true;
+}
+
+#endif
+
+}  // namespace emergency
@@ -0,0 +1,47 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#ifndef EMERGENCY_H
+#define EMERGENCY_H
+
+#include <spdlog/spdlog.h>
+
+#include <atomic>
+
+// Writes in-memory log buffers to a file when the process dies of a fatal
+// signal. Everything the signal handler touches is set up in advance: the
+// file is opened by Enable() and buffers register themselves once, so
+// logging itself does no extra work.
+namespace emergency {
+
+// A buffer the signal handler writes out. |data| must stay valid for
+// |capacity| bytes while the region is registered; the owner publishes which
+// of them hold complete records with release stores to |start| and |size|.
+// The handler may see the two from different updates and clamps them to
+// |capacity|, so a torn pair writes stale bytes but never reads out of bounds.
+struct Region {
+  const char *label;
+  const char *data;
+  size_t capacity;
+  std::atomic<size_t> start;
+  std::atomic<size_t> size;
+};
+
+// Empty regions are skipped. Regions past the fixed capacity of the registry
+// are not dumped.
+void Register(Region *region);
+void Unregister(Region *region);
+
+// Opens |path| for appending and installs handlers for SIGSEGV, SIGABRT and
+// SIGBUS. The handlers write every registered region to the file with
+// async-signal-safe calls only, then pass the signal on to the handler that
+// was installed before. Calling it again switches to another file. Throws
+// spdlog_ex on failure and on platforms without POSIX signals.
+void Enable(const spdlog::filename_t &path);
+
+}  // namespace emergency
+
+#endif  // !EMERGENCY_H
@@ -0,0 +1,191 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <openssl/rand.h>
+
+#include "encrypted_sink.h"
+#include "sink_helpers.h"
+
+namespace {
+
+const char kMagic[4] = {'S', 'P', 'D', 'E'};
+const size_t kNonceSize = 12;
+const size_t kTagSize = 16;
+const size_t kMaxChunkSize = 64 * 1024 * 1024;
+
+// Precedes the ciphertext of every chunk, followed by the tag. All of it is
+// authenticated.
+struct FrameHeader {
+  char magic[4];
+  uint8_t nonce[kNonceSize];
+  uint32_t size;
+};
+static_assert(sizeof(FrameHeader) == 20, "FrameHeader must not be padded");
+
+typedef std::unique_ptr<EVP_CIPHER_CTX, decltype(&EVP_CIPHER_CTX_free)>
+    CipherContext;
+
+const EVP_CIPHER *Cipher(const std::string &key) {
+  if (key.size() == 16) {
+    return EVP_aes_128_gcm();
+  }
+  if (key.size() == 32) {
+    return EVP_aes_256_gcm();
+  }
+  spdlog::throw_spdlog_ex("The encryption key must be 16 or 32 bytes");
+}
+
+}  // namespace
+
+EncryptedSink::EncryptedSink(std::shared_ptr<spdlog::sinks::sink> inner,
+                             const std::string &key, size_t chunkSize)
+    : inner_(std::move(inner)),
+      chunk_size_(std::min(chunkSize, kMaxChunkSize)),
+      context_(EVP_CIPHER_CTX_new()) {
+  // The key is only kept in the cipher context, expanded.
+  if (context_ == NULL ||
+      EVP_EncryptInit_ex(context_, Cipher(key), NULL,
+                         reinterpret_cast<const unsigned char *>(key.data()),
+                         NULL) != 1) {
+    EVP_CIPHER_CTX_free(context_);
+    spdlog::throw_spdlog_ex("Failed to set up log encryption");
+  }
+  inner_->set_formatter(spdlog::details::make_unique<PassthroughFormatter>());
+}
+
+EncryptedSink::~EncryptedSink() {
+  try {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Seal();
+    inner_->flush();
+  } catch (...) {
+    // Records that cannot be written are lost either way.
+  }
+  EVP_CIPHER_CTX_free(context_);
+}
+
+void EncryptedSink::sink_it_(const spdlog::details::log_msg &msg) {
+  formatted_.clear();
+  formatter_->format(msg, formatted_);
+  if (chunk_.size() > 0 && chunk_.size() + formatted_.size() > chunk_size_) {
+    Seal();
+  }
+  chunk_.append(formatted_.data(), formatted_.data() + formatted_.size());
+  if (chunk_.size() >= chunk_size_) {
+    Seal();
+  }
+}
+
+void EncryptedSink::flush_() {
+  // Sealing on every flush keeps what was flushed decryptable.
+  Seal();
+  inner_->flush();
+}
+
+void EncryptedSink::Seal() {
+  if (chunk_.size() == 0) {
+    return;
+  }
+
+  FrameHeader header;
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.size = static_cast<uint32_t>(chunk_.size());
+  if (RAND_bytes(header.nonce, sizeof(header.nonce)) != 1) {
+    spdlog::throw_spdlog_ex("Failed to create a log encryption nonce");
+  }
+
+  frame_.resize(sizeof(header) + chunk_.size() + kTagSize);
+  std::memcpy(frame_.data(), &header, sizeof(header));
+  unsigned char *ciphertext =
+      reinterpret_cast<unsigned char *>(frame_.data() + sizeof(header));
+  int length = 0;
+  int final = 0;
+  if (EVP_EncryptInit_ex(context_, NULL, NULL, NULL, header.nonce) != 1 ||
+      EVP_EncryptUpdate(context_, NULL, &length,
+                        reinterpret_cast<const unsigned char *>(&header),
+                        sizeof(header)) != 1 ||
+      EVP_EncryptUpdate(context_, ciphertext, &length,
+                        reinterpret_cast<const unsigned char *>(chunk_.data()),
+                        static_cast<int>(chunk_.size())) != 1 ||
+      EVP_EncryptFinal_ex(context_, ciphertext + length, &final) != 1 ||
+      EVP_CIPHER_CTX_ctrl(context_, EVP_CTRL_GCM_GET_TAG, kTagSize,
+                          ciphertext + chunk_.size()) != 1) {
+    spdlog::throw_spdlog_ex("Failed to encrypt log records");
+  }
+  chunk_.clear();
+
+  spdlog::details::log_msg framed;
+  framed.payload = spdlog::string_view_t(frame_.data(), frame_.size());
+  inner_->log(framed);
+}
+
+std::string EncryptedSink::Decrypt(const spdlog::filename_t &path,
+                                   const std::string &key) {
+  const EVP_CIPHER *cipher = Cipher(key);
+  std::FILE *file = nullptr;
+  if (spdlog::details::os::fopen_s(&file, path, SPDLOG_FILENAME_T("rb"))) {
+    spdlog::throw_spdlog_ex("Failed to open encrypted log file", errno);
+  }
+  std::string contents;
+  char buffer[64 * 1024];
+  size_t read;
+  while ((read = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    contents.append(buffer, read);
+  }
+  std::fclose(file);
+
+  CipherContext context(EVP_CIPHER_CTX_new(), EVP_CIPHER_CTX_free);
+  if (!context) {
+    spdlog::throw_spdlog_ex("Failed to set up log decryption");
+  }
+
+  std::string text;
+  size_t offset = 0;
+  FrameHeader header;
+  while (contents.size() - offset >= sizeof(header)) {
+    std::memcpy(&header, contents.data() + offset, sizeof(header));
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+        header.size > kMaxChunkSize) {
+      spdlog::throw_spdlog_ex("Not an encrypted log file");
+    }
+    if (contents.size() - offset < sizeof(header) + header.size + kTagSize) {
+      // Cut short while it was written.
+      break;
+    }
+
+    const unsigned char *ciphertext = reinterpret_cast<const unsigned char *>(
+        contents.data() + offset + sizeof(header));
+    const size_t start = text.size();
+    text.resize(start + header.size);
+    unsigned char *plaintext = reinterpret_cast<unsigned char *>(&text[start]);
+    unsigned char tag[kTagSize];
+    std::memcpy(tag, ciphertext + header.size, kTagSize);
+    int length = 0;
+    int final = 0;
+    if (EVP_DecryptInit_ex(context.get(), cipher, NULL,
+                           reinterpret_cast<const unsigned char *>(key.data()),
+                           header.nonce) != 1 ||
+        EVP_DecryptUpdate(context.get(), NULL, &length,
+                          reinterpret_cast<const unsigned char *>(&header),
+                          sizeof(header)) != 1 ||
+        EVP_DecryptUpdate(context.get(), plaintext, &length, ciphertext,
+                          static_cast<int>(header.size)) != 1 ||
+        EVP_CIPHER_CTX_ctrl(context.get(), EVP_CTRL_GCM_SET_TAG, kTagSize,
+                            tag) != 1 ||
+        EVP_DecryptFinal_ex(context.get(), plaintext + length, &final) != 1) {
+      spdlog::throw_spdlog_ex(
+          "Failed to authenticate encrypted log records, the key is wrong or "
+          "the file is corrupt");
+    }
+    offset += sizeof(header) + header.size + kTagSize;
+  }
+  return text;
+}
@@ -0,0 +1,57 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#ifndef ENCRYPTED_SINK_H
+#define ENCRYPTED_SINK_H
+
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/base_sink.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <openssl/evp.h>
+
+// Encrypts the formatted records with AES-GCM before they reach |inner|,
+// which gets whole encrypted chunks as preformatted text.
+//
+// Records collect in a chunk of up to |chunkSize| bytes. A full chunk, and
+// whatever is collected when the sink is flushed, is sealed into a frame:
+// a magic, a random 96 bit nonce, the length, the ciphertext and the 16 byte
+// tag, with the header authenticated too. A file cut short after any flush
+// therefore decrypts up to that flush, and a rotated file starts with a
+// frame of its own. OpenSSL picks AES-NI or the ARMv8 crypto extensions
+// when the CPU has them.
+class EncryptedSink : public spdlog::sinks::base_sink<std::mutex> {
+ public:
+  // |key| is 16 or 32 bytes, for AES-128 or AES-256.
+  EncryptedSink(std::shared_ptr<spdlog::sinks::sink> inner,
+                const std::string &key, size_t chunkSize);
+  ~EncryptedSink() override;
+
+  // Returns the text of the complete frames in the file at |path|. A frame
+  // cut short at the end is left out. Throws if |key| does not authenticate
+  // a frame or the file was not written by this sink.
+  static std::string Decrypt(const spdlog::filename_t &path,
+                             const std::string &key);
+
+ protected:
+  void sink_it_(const spdlog::details::log_msg &msg) override;
+  void flush_() override;
+
+ private:
+  void Seal();
+
+  std::shared_ptr<spdlog::sinks::sink> inner_;
+  const size_t chunk_size_;
+  EVP_CIPHER_CTX *context_;
+  spdlog::memory_buf_t formatted_;
+  spdlog::memory_buf_t chunk_;
+  spdlog::memory_buf_t frame_;
+};
+
+#endif  // !ENCRYPTED_SINK_H
@@ -0,0 +1,107 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include "crc32c.h"
+#include "framed_sink.h"
+#include "sink_helpers.h"
+
+namespace {
+
+const char kMarker[4] = {'\xff', 'S', 'P', 'F'};
+
+struct FrameHeader {
+  char marker[4];
+  uint32_t size;
+  // Of |size| and then the record.
+  uint32_t crc;
+};
+static_assert(sizeof(FrameHeader) == 12, "FrameHeader must not be padded");
+
+uint32_t Checksum(uint32_t size, const char *data) {
+  return Crc32c(Crc32c(0, &size, sizeof(size)), data, size);
+}
+
+}  // namespace
+
+FramedSink::FramedSink(std::shared_ptr<spdlog::sinks::sink> inner)
+    : inner_(std::move(inner)) {
+  inner_->set_formatter(spdlog::details::make_unique<PassthroughFormatter>());
+}
+
+void FramedSink::sink_it_(const spdlog::details::log_msg &msg) {
+  // The record is formatted in place after room for the header.
+  frame_.resize(sizeof(FrameHeader));
+  formatter_->format(msg, frame_);
+  FrameHeader header;
+  std::memcpy(header.marker, kMarker, sizeof(kMarker));
+  header.size = static_cast<uint32_t>(frame_.size() - sizeof(header));
+  header.crc = Checksum(header.size, frame_.data() + sizeof(header));
+  std::memcpy(frame_.data(), &header, sizeof(header));
+
+  spdlog::details::log_msg framed;
+  framed.payload = spdlog::string_view_t(frame_.data(), frame_.size());
+  inner_->log(framed);
+}
+
+void FramedSink::flush_() { inner_->flush(); }
+
+FramedSink::Contents FramedSink::Read(const spdlog::filename_t &path) {
+  std::FILE *file = nullptr;
+  if (spdlog::details::os::fopen_s(&file, path, SPDLOG_FILENAME_T("rb"))) {
+    spdlog::throw_spdlog_ex("Failed to open framed log file", errno);
+  }
+  std::string data;
+  char buffer[64 * 1024];
+  size_t read;
+  while ((read = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    data.append(buffer, read);
+  }
+  std::fclose(file);
+
+  Contents contents;
+  size_t offset = 0;
+  while (offset < data.size()) {
+    FrameHeader header;
+    const size_t left = data.size() - offset;
+    if (left >= sizeof(header)) {
+      std::memcpy(&header, data.data() + offset, sizeof(header));
+      const char *record = data.data() + offset + sizeof(header);
+      if (std::memcmp(header.marker, kMarker, sizeof(kMarker)) == 0 &&
+          header.size <= left - sizeof(header) &&
+          header.crc == Checksum(header.size, record)) {
+        contents.text.append(record, header.size);
+        ++contents.records;
+        offset += sizeof(header) + header.size;
+        continue;
+      }
+    }
+
+    // Skip to the next marker after the damage.
+    size_t next = offset + 1;
+    while (next < data.size()) {
+      const void *found =
+          std::memchr(data.data() + next, kMarker[0], data.size() - next);
+      if (found == NULL) {
+        next = data.size();
+        break;
+      }
+      next = static_cast<size_t>(static_cast<const char *>(found) -
+                                 data.data());
+      if (data.compare(next, sizeof(kMarker), kMarker, sizeof(kMarker)) == 0) {
+        break;
+      }
+      ++next;
+    }
+    ++contents.corrupt_regions;
+    contents.skipped_bytes += next - offset;
+    offset = next;
+  }
+  return contents;
+}
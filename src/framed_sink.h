@@ -0,0 +1,52 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#ifndef FRAMED_SINK_H
+#define FRAMED_SINK_H
+
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/base_sink.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+
+// Puts every formatted record in a frame before it reaches |inner|, which
+// gets the frames as preformatted data.
+//
+// A frame is a 4 byte marker, the length of the record and the CRC32C of
+// both, followed by the record. The marker starts with 0xff, which never
+// occurs in UTF-8 text, so a reader that finds a torn or damaged frame
+// resumes at the next marker and only loses the damaged bytes.
+class FramedSink : public spdlog::sinks::base_sink<std::mutex> {
+ public:
+  struct Contents {
+    Contents() : records(0), corrupt_regions(0), skipped_bytes(0) {}
+
+    std::string text;
+    size_t records;
+    // Runs of bytes that did not hold an intact frame, such as a record torn
+    // by a crash.
+    size_t corrupt_regions;
+    uint64_t skipped_bytes;
+  };
+
+  explicit FramedSink(std::shared_ptr<spdlog::sinks::sink> inner);
+
+  // Returns the records of the intact frames in the file at |path|, in
+  // order, and what was skipped.
+  static Contents Read(const spdlog::filename_t &path);
+
+ protected:
+  void sink_it_(const spdlog::details::log_msg &msg) override;
+  void flush_() override;
+
+ private:
+  std::shared_ptr<spdlog::sinks::sink> inner_;
+  spdlog::memory_buf_t frame_;
+};
+
+#endif  // !FRAMED_SINK_H
@@ -0,0 +1,121 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#include <algorithm>
+
+#include "keyed_file_sink.h"
+#include "record.h"
+#include "sink_helpers.h"
+
+KeyedFileSink::KeyedFileSink(const spdlog::filename_t &directory,
+                             const std::string &default_key, size_t max_size,
+                             size_t max_files, size_t max_open)
+    : directory_(directory),
+      default_key_(NormalizeKey(default_key)),
+      max_size_(max_size),
+      max_files_(max_files),
+      max_open_(max_open) {
+  if (!IsValidKey(default_key_)) {
+    spdlog::throw_spdlog_ex("The log name is not a valid file name: " +
+                            default_key_);
+  }
+  if (max_open_ == 0) {
+    spdlog::throw_spdlog_ex("Provide at least one open file");
+  }
+}
+
+bool KeyedFileSink::IsValidKey(spdlog::string_view_t key) {
+  if (key.size() == 0 || key.size() > record::kMaxKeySize || key[0] == '.') {
+    return false;
+  }
+  for (const char c : key) {
+    if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+          (c >= '0' && c <= '9') || c == '.' || c == '_' || c == '-')) {
+      return false;
+    }
+  }
+
+  // Windows opens the device for these names, with any extension.
+  const char *dot = std::find(key.begin(), key.end(), '.');
+  const std::string base = NormalizeKey(
+      spdlog::string_view_t(key.data(), static_cast<size_t>(dot - key.begin())));
+  static const char *const kDevices[] = {"con", "prn", "aux", "nul"};
+  for (const char *device : kDevices) {
+    if (base == device) {
+      return false;
+    }
+  }
+  return !(base.size() == 4 &&
+           (base.compare(0, 3, "com") == 0 || base.compare(0, 3, "lpt") == 0) &&
+           base[3] >= '1' && base[3] <= '9');
+}
+
+std::string KeyedFileSink::NormalizeKey(spdlog::string_view_t key) {
+  std::string normalized(key.data(), key.size());
+  for (char &c : normalized) {
+    if (c >= 'A' && c <= 'Z') {
+      c = static_cast<char>(c - 'A' + 'a');
+    }
+  }
+  return normalized;
+}
+
+void KeyedFileSink::sink_it_(const spdlog::details::log_msg &msg) {
+  // The key is read before the formatter releases pinned text, which may
+  // follow it in the payload.
+  const record::View view = record::Decode(msg.payload);
+  if (view.key.size() > 0) {
+    key_.assign(view.key.data(), view.key.size());
+  } else {
+    key_ = default_key_;
+  }
+  formatted_.clear();
+  formatter_->format(msg, formatted_);
+
+  spdlog::details::log_msg formatted = msg;
+  formatted.payload = spdlog::string_view_t(formatted_.data(), formatted_.size());
+  Open().log(formatted);
+}
+
+void KeyedFileSink::flush_() {
+  for (File &file : files_) {
+    file.sink->flush();
+  }
+}
+
+spdlog::sinks::rotating_file_sink_st &KeyedFileSink::Open() {
+  // Bursts of one key skip the lookup.
+  if (!files_.empty() && files_.front().key == key_) {
+    return *files_.front().sink;
+  }
+  auto found = index_.find(key_);
+  if (found != index_.end()) {
+    files_.splice(files_.begin(), files_, found->second);
+    return *files_.front().sink;
+  }
+
+  // Keys are ASCII, so they widen as they are on Windows.
+  spdlog::filename_t path = directory_;
+  path.push_back(spdlog::details::os::folder_seps_filename[0]);
+  path.append(key_.begin(), key_.end());
+  path.append(SPDLOG_FILENAME_T(".log"));
+  // Keyed loggers do not dedupe stacks, so the files need no stack headers.
+  std::unique_ptr<spdlog::sinks::rotating_file_sink_st> sink(
+      new spdlog::sinks::rotating_file_sink_st(path, max_size_, max_files_));
+  sink->set_formatter(spdlog::details::make_unique<PassthroughFormatter>());
+
+  if (files_.size() >= max_open_) {
+    // Closing flushes what the file still buffers.
+    index_.erase(files_.back().key);
+    files_.pop_back();
+  }
+  File file;
+  file.key = key_;
+  file.sink = std::move(sink);
+  files_.push_front(std::move(file));
+  index_.emplace(key_, files_.begin());
+  return *files_.front().sink;
+}
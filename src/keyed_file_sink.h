@@ -0,0 +1,70 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#ifndef KEYED_FILE_SINK_H
+#define KEYED_FILE_SINK_H
+
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/base_sink.h>
+#include <spdlog/sinks/rotating_file_sink.h>
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Writes every record to a rotating file of its own key in |directory|,
+// named after the key with a .log extension. Records without a key go to
+// the file of |default_key|. Keys are expected to be normalized.
+//
+// Only the |max_open| most recently written files are kept open, each with
+// its stdio buffer; writing to another key closes the least recently used
+// one. Files are opened, rotated and closed where the sink is written to,
+// which is the worker thread of an async logger.
+class KeyedFileSink : public spdlog::sinks::base_sink<std::mutex> {
+ public:
+  KeyedFileSink(const spdlog::filename_t &directory,
+                const std::string &default_key, size_t max_size,
+                size_t max_files, size_t max_open);
+
+  // Whether |key| can name a file: letters, digits, '.', '_' and '-', not
+  // starting with '.', and at most record::kMaxKeySize bytes. Names that
+  // Windows reserves for devices, such as CON or COM1, are not valid either,
+  // whatever follows them after a '.'.
+  static bool IsValidKey(spdlog::string_view_t key);
+  // Returns |key| in lowercase. Windows and macOS do not tell file names
+  // apart by case, so keys are lowercased to give every file one key on
+  // every platform.
+  static std::string NormalizeKey(spdlog::string_view_t key);
+
+ protected:
+  void sink_it_(const spdlog::details::log_msg &msg) override;
+  void flush_() override;
+
+ private:
+  struct File {
+    std::string key;
+    std::unique_ptr<spdlog::sinks::rotating_file_sink_st> sink;
+  };
+
+  // Returns the file of |key_|, opening it if needed.
+  spdlog::sinks::rotating_file_sink_st &Open();
+
+  const spdlog::filename_t directory_;
+  const std::string default_key_;
+  const size_t max_size_;
+  const size_t max_files_;
+  const size_t max_open_;
+  spdlog::memory_buf_t formatted_;
+  std::string key_;
+
+  // Most recently written first.
+  std::list<File> files_;
+  std::unordered_map<std::string, std::list<File>::iterator> index_;
+};
+
+#endif  // !KEYED_FILE_SINK_H
@@ -0,0 +1,100 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#include <algorithm>
+#include <spdlog/details/fmt_helper.h>
+
+#include "load_shedder.h"
+#include "record.h"
+
+const uint32_t LoadShedder::kCheckEvery;
+
+LoadShedder::LoadShedder(std::weak_ptr<spdlog::details::thread_pool> pool,
+                         size_t capacity, double highWatermark,
+                         double lowWatermark,
+                         spdlog::level::level_enum maxLevel,
+                         std::chrono::milliseconds holdTime)
+    : pool_(std::move(pool)),
+      capacity_(std::max<size_t>(capacity, 1)),
+      high_watermark_(highWatermark),
+      low_watermark_(lowWatermark),
+      max_level_(maxLevel),
+      hold_time_(holdTime),
+      countdown_(kCheckEvery),
+      floor_(spdlog::level::trace),
+      dropped_(0),
+      // The first step up does not wait.
+      changed_(std::chrono::steady_clock::now() - holdTime),
+      calm_(false) {}
+
+void LoadShedder::Check(spdlog::logger &logger) {
+  std::shared_ptr<spdlog::details::thread_pool> pool = pool_.lock();
+  if (!pool) {
+    return;
+  }
+  const double fill =
+      static_cast<double>(pool->queue_size()) / static_cast<double>(capacity_);
+  const auto now = std::chrono::steady_clock::now();
+
+  if (fill > high_watermark_) {
+    calm_ = false;
+    // Levels at or below the logger's own are dropped already.
+    const int floor = std::max<int>(floor_, logger.level()) + 1;
+    if (floor <= max_level_ + 1 && now - changed_ >= hold_time_) {
+      Step(logger, static_cast<spdlog::level::level_enum>(floor), fill, now);
+    }
+    return;
+  }
+  if (fill > low_watermark_) {
+    calm_ = false;
+    return;
+  }
+  if (floor_ == spdlog::level::trace) {
+    return;
+  }
+  if (!calm_) {
+    calm_ = true;
+    calm_since_ = now;
+  }
+  if (now - std::max(changed_, calm_since_) >= hold_time_) {
+    const int floor = floor_ - 1;
+    Step(logger,
+         floor <= logger.level() ? spdlog::level::trace
+                                 : static_cast<spdlog::level::level_enum>(floor),
+         fill, now);
+  }
+}
+
+void LoadShedder::Step(spdlog::logger &logger, spdlog::level::level_enum floor,
+                       double fill, std::chrono::steady_clock::time_point now) {
+  floor_ = floor;
+  changed_ = now;
+
+  spdlog::memory_buf_t marker;
+  record::AppendHeader(NULL, NULL, marker);
+  if (floor_ == spdlog::level::trace) {
+    spdlog::details::fmt_helper::append_string_view("Load shedding stopped",
+                                                    marker);
+  } else {
+    spdlog::details::fmt_helper::append_string_view("Load shedding: dropping ",
+                                                    marker);
+    spdlog::details::fmt_helper::append_string_view(
+        spdlog::level::to_string_view(
+            static_cast<spdlog::level::level_enum>(floor_ - 1)),
+        marker);
+    spdlog::details::fmt_helper::append_string_view(" and below", marker);
+  }
+  spdlog::details::fmt_helper::append_string_view(" (queue ", marker);
+  spdlog::details::fmt_helper::append_int(
+      static_cast<int>(std::min(fill, 1.0) * 100), marker);
+  spdlog::details::fmt_helper::append_string_view("% full, ", marker);
+  spdlog::details::fmt_helper::append_int(dropped_, marker);
+  spdlog::details::fmt_helper::append_string_view(" dropped)", marker);
+  dropped_ = 0;
+
+  logger.log(spdlog::level::warn,
+             spdlog::string_view_t(marker.data(), marker.size()));
+}
@@ -0,0 +1,70 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#ifndef LOAD_SHEDDER_H
+#define LOAD_SHEDDER_H
+
+#include <spdlog/spdlog.h>
+#include <spdlog/async.h>
+
+#include <chrono>
+#include <memory>
+
+// Raises the minimum level of an async logger while the queue in front of
+// its worker thread fills up, and lowers it again once the queue drained.
+//
+// Every |kCheckEvery| messages the fill of the queue is read. Above
+// |high_watermark| messages one level higher are dropped, at most up to
+// |max_level|, one step per |hold_time|. Once the fill stayed at or below
+// |low_watermark| for |hold_time| the level goes back down one step. Fills
+// in between keep the current level, so the level does not flap. Every step
+// writes a marker record at warning level with the fill and the number of
+// messages dropped since the previous step.
+class LoadShedder {
+ public:
+  LoadShedder(std::weak_ptr<spdlog::details::thread_pool> pool,
+              size_t capacity, double highWatermark, double lowWatermark,
+              spdlog::level::level_enum maxLevel,
+              std::chrono::milliseconds holdTime);
+
+  // Returns whether to drop a message at |level| logged through |logger|.
+  bool Drop(spdlog::logger &logger, spdlog::level::level_enum level) {
+    if (--countdown_ == 0) {
+      countdown_ = kCheckEvery;
+      Check(logger);
+    }
+    if (level < floor_) {
+      ++dropped_;
+      return true;
+    }
+    return false;
+  }
+
+  static const uint32_t kCheckEvery = 64;
+
+ private:
+  void Check(spdlog::logger &logger);
+  void Step(spdlog::logger &logger, spdlog::level::level_enum floor,
+            double fill, std::chrono::steady_clock::time_point now);
+
+  const std::weak_ptr<spdlog::details::thread_pool> pool_;
+  const size_t capacity_;
+  const double high_watermark_;
+  const double low_watermark_;
+  const spdlog::level::level_enum max_level_;
+  const std::chrono::milliseconds hold_time_;
+
+  uint32_t countdown_;
+  // Messages below it are dropped, trace when nothing is shed.
+  spdlog::level::level_enum floor_;
+  uint64_t dropped_;
+  std::chrono::steady_clock::time_point changed_;
+  // Since when the fill is at or below the low watermark.
+  std::chrono::steady_clock::time_point calm_since_;
+  bool calm_;
+};
+
+#endif  // !LOAD_SHEDDER_H
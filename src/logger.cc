@@ -4,12 +4,31 @@
  *  license information.
  *--------------------------------------------------------------------------------------------*/
 
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <cstring>
 #include <spdlog/async.h>
 #include <spdlog/sinks/rotating_file_sink.h>
 #include <spdlog/sinks/stdout_sinks.h>
 
 #include "logger.h"
+#include "collector_sink.h"
+#include "config.h"
+#include "deduping_file_sink.h"
+#include "emergency.h"
+#include "encrypted_sink.h"
+#include "framed_sink.h"
+#include "keyed_file_sink.h"
+#include "mapped_ring_sink.h"
+#include "otlp_sink.h"
+#include "parallel_sink.h"
+#include "pinned.h"
+#include "recorder_sink.h"
+#include "redaction_sink.h"
+#include "staging_sink.h"
+#include "syslog_sink.h"
+#include "trace_sink.h"
 
 #if defined(_WIN32)
 #include <Windows.h>
@@ -26,7 +45,7 @@ NAN_METHOD(setLevel) {
   }
   auto level = static_cast<spdlog::level::level_enum>(levelNumber);
 
-  spdlog::set_level(level);
+  config::SetLevel(level);
 }
 
 NAN_METHOD(setFlushOn) {
@@ -43,7 +62,760 @@ NAN_METHOD(setFlushOn) {
   spdlog::flush_on(level);
 }
 
-Nan::Persistent<v8::Function> Logger::constructor;
+// Size from which external strings are pinned instead of copied.
+// Below it a copy is cheaper than the bookkeeping.
+static const size_t kMinPinnedSize = 64 * 1024;
+
+static void AppendTruncated(size_t dropped, spdlog::string_view_t unit,
+                            spdlog::memory_buf_t &dest) {
+  spdlog::details::fmt_helper::append_string_view("\xE2\x80\xA6[truncated ",
+                                                  dest);
+  spdlog::details::fmt_helper::append_int(dropped, dest);
+  spdlog::details::fmt_helper::append_string_view(unit, dest);
+}
+
+// Transcodes |str| to UTF-8 directly into |dest|. When |maxSize| is non-zero
+// at most |maxSize| bytes of the message are written and a marker with the
+// number of dropped UTF-16 code units is appended, so oversized messages cost
+// a bounded amount of time and memory no matter how large the input string is.
+void AppendMessage(v8::Local<v8::String> str, size_t maxSize,
+                   spdlog::memory_buf_t &dest) {
+  v8::Isolate *isolate = v8::Isolate::GetCurrent();
+  const int flags =
+      v8::String::REPLACE_INVALID_UTF8 | v8::String::NO_NULL_TERMINATION;
+  const size_t start = dest.size();
+  // Every UTF-16 code unit encodes to at most 3 UTF-8 bytes.
+  const size_t worstCase = static_cast<size_t>(str->Length()) * 3;
+
+  if (maxSize == 0 || worstCase <= maxSize) {
+    // Without a limit the worst case can be far more than the message needs,
+    // so measure it instead.
+    const size_t size =
+        maxSize == 0 ? static_cast<size_t>(str->Utf8Length(isolate)) : worstCase;
+    dest.resize(start + size);
+    const int written = str->WriteUtf8(isolate, dest.data() + start,
+                                       static_cast<int>(size), NULL, flags);
+    dest.resize(start + written);
+    return;
+  }
+
+  int charsWritten = 0;
+  dest.resize(start + maxSize);
+  const int written =
+      str->WriteUtf8(isolate, dest.data() + start, static_cast<int>(maxSize),
+                     &charsWritten, flags);
+  dest.resize(start + written);
+
+  if (charsWritten < str->Length()) {
+    AppendTruncated(static_cast<size_t>(str->Length() - charsWritten),
+                    " characters]", dest);
+  }
+}
+
+// Copies the bytes of |view| into |dest| as they are, cut like AppendMessage
+// when |maxSize| is non-zero.
+static void AppendBytes(v8::Local<v8::ArrayBufferView> view, size_t maxSize,
+                        spdlog::memory_buf_t &dest) {
+  const size_t start = dest.size();
+  const size_t size = view->ByteLength();
+  const size_t kept = maxSize != 0 && size > maxSize ? maxSize : size;
+  dest.resize(start + kept);
+  view->CopyContents(dest.data() + start, kept);
+  if (kept < size) {
+    AppendTruncated(size - kept, " bytes]", dest);
+  }
+}
+
+thread_local Nan::Persistent<v8::Function> Logger::constructor;
+
+// Converts a path from JS to the form spdlog takes. Returns false if an
+// exception is pending.
+static bool ToFilename(v8::Local<v8::Value> value, spdlog::filename_t *filename) {
+#if defined(_WIN32)
+  const std::string utf8Filename = *Nan::Utf8String(value);
+  const int bufferLen = MultiByteToWideChar(
+      CP_UTF8, 0, utf8Filename.c_str(),
+      static_cast<int>(utf8Filename.size()), NULL, 0);
+  if (!bufferLen) {
+    Nan::ThrowError(
+      Nan::Error("Failed to determine buffer length for converting filename to wstring"));
+    return false;
+  }
+  std::wstring fileName(bufferLen, 0);
+  const int status = MultiByteToWideChar(
+      CP_UTF8, 0, utf8Filename.c_str(),
+      static_cast<int>(utf8Filename.size()), &fileName[0], bufferLen);
+  if (!status) {
+    Nan::ThrowError(Nan::Error("Failed to convert filename to wstring"));
+    return false;
+  }
+  *filename = fileName;
+#else
+  *filename = *Nan::Utf8String(value);
+#endif
+  return true;
+}
+
+NAN_METHOD(recoverMappedRing) {
+  if (!info[0]->IsString()) {
+    return Nan::ThrowError(Nan::Error("Provide the mapped ring file name"));
+  }
+  spdlog::filename_t fileName;
+  if (!ToFilename(info[0], &fileName)) {
+    return;
+  }
+  try {
+    const std::string text = MappedRingSink::Recover(fileName);
+    info.GetReturnValue().Set(
+        Nan::New(text.data(), static_cast<int>(text.size())).ToLocalChecked());
+  } catch (const std::exception &ex) {
+    return Nan::ThrowError(Nan::Error(ex.what()));
+  }
+}
+
+// Copies the bytes of an encryption key out of |value|. Returns false if an
+// exception is pending.
+static bool ToKey(v8::Local<v8::Value> value, std::string *key) {
+  if (!value->IsArrayBufferView()) {
+    Nan::ThrowError(Nan::Error("Provide the encryption key as a Buffer"));
+    return false;
+  }
+  v8::Local<v8::ArrayBufferView> view = value.As<v8::ArrayBufferView>();
+  key->resize(view->ByteLength());
+  view->CopyContents(&(*key)[0], key->size());
+  return true;
+}
+
+NAN_METHOD(decryptLog) {
+  if (!info[0]->IsString()) {
+    return Nan::ThrowError(Nan::Error("Provide the encrypted log file name"));
+  }
+  spdlog::filename_t fileName;
+  std::string key;
+  if (!ToFilename(info[0], &fileName) || !ToKey(info[1], &key)) {
+    return;
+  }
+  try {
+    const std::string text = EncryptedSink::Decrypt(fileName, key);
+    OPENSSL_cleanse(&key[0], key.size());
+    v8::Local<v8::String> result;
+    if (!Nan::New(text.data(), static_cast<int>(text.size())).ToLocal(&result)) {
+      return Nan::ThrowError(Nan::Error("Log is too large for a string"));
+    }
+    info.GetReturnValue().Set(result);
+  } catch (const std::exception &ex) {
+    OPENSSL_cleanse(&key[0], key.size());
+    return Nan::ThrowError(Nan::Error(ex.what()));
+  }
+}
+
+NAN_METHOD(readFramedLog) {
+  if (!info[0]->IsString()) {
+    return Nan::ThrowError(Nan::Error("Provide the framed log file name"));
+  }
+  spdlog::filename_t fileName;
+  if (!ToFilename(info[0], &fileName)) {
+    return;
+  }
+  try {
+    const FramedSink::Contents contents = FramedSink::Read(fileName);
+    v8::Local<v8::String> text;
+    if (!Nan::New(contents.text.data(), static_cast<int>(contents.text.size()))
+             .ToLocal(&text)) {
+      return Nan::ThrowError(Nan::Error("Log is too large for a string"));
+    }
+    v8::Local<v8::Object> result = Nan::New<v8::Object>();
+    Nan::Set(result, Nan::New("text").ToLocalChecked(), text);
+    Nan::Set(result, Nan::New("records").ToLocalChecked(),
+             Nan::New(static_cast<double>(contents.records)));
+    Nan::Set(result, Nan::New("corruptRegions").ToLocalChecked(),
+             Nan::New(static_cast<double>(contents.corrupt_regions)));
+    Nan::Set(result, Nan::New("skippedBytes").ToLocalChecked(),
+             Nan::New(static_cast<double>(contents.skipped_bytes)));
+    info.GetReturnValue().Set(result);
+  } catch (const std::exception &ex) {
+    return Nan::ThrowError(Nan::Error(ex.what()));
+  }
+}
+
+NAN_METHOD(enableEmergencyDump) {
+  if (!info[0]->IsString()) {
+    return Nan::ThrowError(Nan::Error("Provide the emergency dump file name"));
+  }
+  spdlog::filename_t fileName;
+  if (!ToFilename(info[0], &fileName)) {
+    return;
+  }
+  try {
+    emergency::Enable(fileName);
+  } catch (const std::exception &ex) {
+    return Nan::ThrowError(Nan::Error(ex.what()));
+  }
+}
+
+struct LoggerOptions {
+  LoggerOptions()
+      : formatter_threads(0),
+        staging_buffers(false),
+        recorder_budget(0),
+        recorder_chunk_size(64 * 1024),
+        recorder_level(spdlog::level::trace),
+        mapped_ring_size(4 * 1024 * 1024),
+        encryption_chunk_size(64 * 1024),
+        framed(false),
+        dedupe_stacks(false) {}
+
+  size_t formatter_threads;
+  bool staging_buffers;
+  size_t recorder_budget;
+  size_t recorder_chunk_size;
+  spdlog::level::level_enum recorder_level;
+  spdlog::filename_t mapped_ring_file;
+  size_t mapped_ring_size;
+  std::shared_ptr<const Redactor> redactor;
+  std::string encryption_key;
+  size_t encryption_chunk_size;
+  bool framed;
+  bool dedupe_stacks;
+  std::unique_ptr<CollectorSink::Options> collector;
+  std::unique_ptr<SyslogSink::Options> syslog;
+  std::unique_ptr<OtlpSink::Options> otlp;
+  spdlog::filename_t trace_file;
+};
+
+// Returns the thread pool async loggers share, creating it the way
+// spdlog::async_factory does if no async logger exists yet.
+static std::shared_ptr<spdlog::details::thread_pool> AsyncThreadPool() {
+  spdlog::details::registry &registry = spdlog::details::registry::instance();
+  std::lock_guard<std::recursive_mutex> lock(registry.tp_mutex());
+  std::shared_ptr<spdlog::details::thread_pool> pool = registry.get_tp();
+  if (!pool) {
+    pool = std::make_shared<spdlog::details::thread_pool>(
+        spdlog::details::default_async_q_size, 1U);
+    registry.set_tp(pool);
+  }
+  return pool;
+}
+
+// Logs |msg|, whose level the caller checked. A record that refers to
+// pinned text goes to the sinks without a second check, which could drop it
+// if another thread, such as the load shedder, raised the level since: the
+// text is only released once the record is formatted.
+static void Submit(const std::shared_ptr<spdlog::logger> &logger,
+                   const spdlog::details::log_msg &msg, bool pinned) {
+  if (!pinned) {
+    logger->log(msg.time, msg.source, msg.level, msg.payload);
+    return;
+  }
+  std::shared_ptr<spdlog::async_logger> async =
+      std::dynamic_pointer_cast<spdlog::async_logger>(logger);
+  if (async) {
+    // Every async logger writes on the registry's pool and blocks while its
+    // queue is full.
+    AsyncThreadPool()->post_log(std::move(async), msg,
+                                spdlog::async_overflow_policy::block);
+    return;
+  }
+  for (const spdlog::sink_ptr &sink : logger->sinks()) {
+    try {
+      sink->log(msg);
+    } catch (const std::exception &ex) {
+      ReportError(ex.what());
+    }
+  }
+  if (msg.level >= logger->flush_level() && msg.level != spdlog::level::off) {
+    logger->flush();
+  }
+}
+
+// Reads the number |key| of |object| into |result| if it is set, which has to
+// be a whole number if |integer|. Returns false if an exception is pending.
+static bool ReadNumber(v8::Local<v8::Object> object, const char *key,
+                       double min, double max, bool integer, double *result) {
+  v8::Local<v8::Value> value;
+  if (!Nan::Get(object, Nan::New(key).ToLocalChecked()).ToLocal(&value)) {
+    return false;
+  }
+  if (value->IsUndefined()) {
+    return true;
+  }
+  const double number = Nan::To<double>(value).FromMaybe(min - 1);
+  if (!(number >= min && number <= max) ||
+      (integer && std::floor(number) != number)) {
+    const std::string message = std::string("Provide ") + key + " between " +
+                                std::to_string(static_cast<int64_t>(min)) +
+                                " and " +
+                                std::to_string(static_cast<int64_t>(max));
+    Nan::ThrowError(Nan::Error(message.c_str()));
+    return false;
+  }
+  *result = number;
+  return true;
+}
+
+// Reads the integer |key| of |object| into |result| if it is set. Returns
+// false if an exception is pending.
+static bool ReadInteger(v8::Local<v8::Object> object, const char *key,
+                        double min, double max, size_t *result) {
+  double number = static_cast<double>(*result);
+  if (!ReadNumber(object, key, min, max, true, &number)) {
+    return false;
+  }
+  *result = static_cast<size_t>(number);
+  return true;
+}
+
+// Reads the level |key| of |object|, a level name or number, into |result|
+// and sets |found| if it is set. Returns false if an exception is pending.
+static bool ReadLevel(v8::Local<v8::Object> object, const char *key,
+                      bool *found, spdlog::level::level_enum *result) {
+  v8::Local<v8::Value> value;
+  if (!Nan::Get(object, Nan::New(key).ToLocalChecked()).ToLocal(&value)) {
+    return false;
+  }
+  if (value->IsUndefined()) {
+    return true;
+  }
+  if (value->IsString()) {
+    const std::string name = *Nan::Utf8String(value);
+    // Unknown names come back as off.
+    *result = spdlog::level::from_str(name);
+    *found = *result != spdlog::level::off || name == "off";
+  } else if (value->IsNumber()) {
+    const double number = value.As<v8::Number>()->Value();
+    *result = static_cast<spdlog::level::level_enum>(number);
+    *found = number >= spdlog::level::trace && number < spdlog::level::n_levels &&
+             std::floor(number) == number;
+  }
+  if (!*found) {
+    const std::string message = std::string("Invalid level for ") + key;
+    Nan::ThrowError(Nan::Error(message.c_str()));
+    return false;
+  }
+  return true;
+}
+
+NAN_METHOD(configure) {
+  if (!info[0]->IsObject()) {
+    return Nan::ThrowError(Nan::Error("Provide the configuration"));
+  }
+  v8::Local<v8::Context> context = Nan::GetCurrentContext();
+  v8::Local<v8::Object> object = info[0].As<v8::Object>();
+
+  // Everything is read first, an invalid setting leaves the loggers alone.
+  config::Settings settings;
+  double flushEvery = -1;
+  if (!ReadNumber(object, "flushEvery", 0, 86400, true, &flushEvery)) {
+    return;
+  }
+  if (flushEvery >= 0) {
+    settings.has_flush_every = true;
+    settings.flush_every =
+        std::chrono::seconds(static_cast<int64_t>(flushEvery));
+  }
+
+  v8::Local<v8::Value> loggers;
+  if (!Nan::Get(object, Nan::New("loggers").ToLocalChecked())
+           .ToLocal(&loggers)) {
+    return;
+  }
+  if (!loggers->IsUndefined()) {
+    if (!loggers->IsObject()) {
+      return Nan::ThrowError(
+          Nan::Error("Provide loggers as an object of name patterns"));
+    }
+    v8::Local<v8::Array> globs;
+    if (!loggers.As<v8::Object>()->GetOwnPropertyNames(context).ToLocal(&globs)) {
+      return;
+    }
+    for (uint32_t i = 0; i < globs->Length(); ++i) {
+      v8::Local<v8::Value> glob;
+      v8::Local<v8::Value> value;
+      if (!Nan::Get(globs, i).ToLocal(&glob) ||
+          !Nan::Get(loggers.As<v8::Object>(), glob).ToLocal(&value)) {
+        return;
+      }
+      if (!value->IsObject()) {
+        return Nan::ThrowError(Nan::Error("Provide logger settings"));
+      }
+      v8::Local<v8::Object> entry = value.As<v8::Object>();
+      config::Rule rule;
+      rule.glob = *Nan::Utf8String(glob);
+      v8::Local<v8::Value> pattern;
+      if (!ReadLevel(entry, "level", &rule.has_level, &rule.level) ||
+          !ReadLevel(entry, "flushOn", &rule.has_flush_on, &rule.flush_on) ||
+          !Nan::Get(entry, Nan::New("pattern").ToLocalChecked())
+               .ToLocal(&pattern)) {
+        return;
+      }
+      if (!pattern->IsUndefined()) {
+        if (!pattern->IsString() || pattern.As<v8::String>()->Length() == 0) {
+          return Nan::ThrowError(Nan::Error("Provide pattern"));
+        }
+        rule.pattern = *Nan::Utf8String(pattern);
+      }
+      settings.rules.push_back(std::move(rule));
+    }
+  }
+
+  config::Apply(std::move(settings));
+}
+
+// Reads the file of the trace option of |object|, if it is set, into
+// |result|. Returns false if an exception is pending.
+static bool ReadTraceFile(v8::Local<v8::Object> object,
+                          spdlog::filename_t *result) {
+  v8::Local<v8::Value> trace;
+  if (!Nan::Get(object, Nan::New("trace").ToLocalChecked()).ToLocal(&trace)) {
+    return false;
+  }
+  if (!trace->IsObject()) {
+    return true;
+  }
+  v8::Local<v8::Value> file;
+  if (!Nan::Get(trace.As<v8::Object>(), Nan::New("file").ToLocalChecked())
+           .ToLocal(&file)) {
+    return false;
+  }
+  if (!file->IsString()) {
+    Nan::ThrowError(Nan::Error("Provide the trace file"));
+    return false;
+  }
+  return ToFilename(file, result);
+}
+
+// Reads the optional last constructor argument. Returns false if an
+// exception is pending.
+static bool ReadLoggerOptions(v8::Local<v8::Value> value,
+                              LoggerOptions *options) {
+  if (!value->IsObject()) {
+    return true;
+  }
+  v8::Local<v8::Object> object = value.As<v8::Object>();
+
+  if (!ReadInteger(object, "formatterThreads", 0, 64,
+                   &options->formatter_threads)) {
+    return false;
+  }
+
+  v8::Local<v8::Value> staging;
+  if (!Nan::Get(object, Nan::New("stagingBuffers").ToLocalChecked())
+           .ToLocal(&staging)) {
+    return false;
+  }
+  options->staging_buffers = Nan::To<bool>(staging).FromJust();
+
+  v8::Local<v8::Value> recorder;
+  if (!Nan::Get(object, Nan::New("flightRecorder").ToLocalChecked())
+           .ToLocal(&recorder)) {
+    return false;
+  }
+  if (recorder->IsObject()) {
+    v8::Local<v8::Object> settings = recorder.As<v8::Object>();
+    size_t level = options->recorder_level;
+    if (!ReadInteger(settings, "memoryBudget", 1, 9007199254740991.0,
+                     &options->recorder_budget) ||
+        !ReadInteger(settings, "chunkSize", 4096, 64 * 1024 * 1024,
+                     &options->recorder_chunk_size) ||
+        !ReadInteger(settings, "level", spdlog::level::trace,
+                     spdlog::level::off, &level)) {
+      return false;
+    }
+    if (options->recorder_budget == 0) {
+      Nan::ThrowError(Nan::Error("Provide the flightRecorder memoryBudget"));
+      return false;
+    }
+    options->recorder_level = static_cast<spdlog::level::level_enum>(level);
+  }
+
+  v8::Local<v8::Value> ring;
+  if (!Nan::Get(object, Nan::New("mappedRing").ToLocalChecked())
+           .ToLocal(&ring)) {
+    return false;
+  }
+  if (ring->IsObject()) {
+    v8::Local<v8::Object> settings = ring.As<v8::Object>();
+    v8::Local<v8::Value> file;
+    if (!Nan::Get(settings, Nan::New("file").ToLocalChecked()).ToLocal(&file)) {
+      return false;
+    }
+    if (!file->IsString() || file.As<v8::String>()->Length() == 0) {
+      Nan::ThrowError(Nan::Error("Provide the mappedRing file"));
+      return false;
+    }
+    if (!ToFilename(file, &options->mapped_ring_file) ||
+        !ReadInteger(settings, "size", 64 * 1024, 1024.0 * 1024 * 1024,
+                     &options->mapped_ring_size)) {
+      return false;
+    }
+  }
+
+  v8::Local<v8::Value> encryption;
+  if (!Nan::Get(object, Nan::New("encryption").ToLocalChecked())
+           .ToLocal(&encryption)) {
+    return false;
+  }
+  if (encryption->IsObject()) {
+    v8::Local<v8::Object> settings = encryption.As<v8::Object>();
+    v8::Local<v8::Value> key;
+    if (!Nan::Get(settings, Nan::New("key").ToLocalChecked()).ToLocal(&key) ||
+        !ToKey(key, &options->encryption_key) ||
+        !ReadInteger(settings, "chunkSize", 4096, 64 * 1024 * 1024,
+                     &options->encryption_chunk_size)) {
+      return false;
+    }
+    if (options->encryption_key.size() != 16 &&
+        options->encryption_key.size() != 32) {
+      Nan::ThrowError(Nan::Error("The encryption key must be 16 or 32 bytes"));
+      return false;
+    }
+    // The mapped ring would put the plain text on disk after all.
+    if (!options->mapped_ring_file.empty()) {
+      Nan::ThrowError(
+          Nan::Error("A mappedRing cannot be combined with encryption"));
+      return false;
+    }
+  }
+
+  v8::Local<v8::Value> framed;
+  if (!Nan::Get(object, Nan::New("framed").ToLocalChecked()).ToLocal(&framed)) {
+    return false;
+  }
+  options->framed = Nan::To<bool>(framed).FromJust();
+  // Encrypted chunks carry a tag that detects damage already.
+  if (options->framed && !options->encryption_key.empty()) {
+    Nan::ThrowError(Nan::Error("Framing cannot be combined with encryption"));
+    return false;
+  }
+
+  v8::Local<v8::Value> dedupeStacks;
+  if (!Nan::Get(object, Nan::New("dedupeStacks").ToLocalChecked())
+           .ToLocal(&dedupeStacks)) {
+    return false;
+  }
+  options->dedupe_stacks = Nan::To<bool>(dedupeStacks).FromJust();
+  // Framed and encrypted files hold bytes that cannot be cut.
+  if (options->dedupe_stacks &&
+      (options->framed || !options->encryption_key.empty())) {
+    Nan::ThrowError(Nan::Error(
+        "Stacks cannot be deduplicated in framed or encrypted files"));
+    return false;
+  }
+
+  v8::Local<v8::Value> collector;
+  if (!Nan::Get(object, Nan::New("collector").ToLocalChecked())
+           .ToLocal(&collector)) {
+    return false;
+  }
+  if (collector->IsObject()) {
+    v8::Local<v8::Object> settings = collector.As<v8::Object>();
+    options->collector.reset(new CollectorSink::Options());
+    CollectorSink::Options &target = *options->collector;
+    v8::Local<v8::Value> socketPath;
+    v8::Local<v8::Value> host;
+    v8::Local<v8::Value> spillFile;
+    size_t port = 0;
+    size_t flushInterval =
+        static_cast<size_t>(target.flush_interval.count());
+    if (!Nan::Get(settings, Nan::New("path").ToLocalChecked())
+             .ToLocal(&socketPath) ||
+        !Nan::Get(settings, Nan::New("host").ToLocalChecked()).ToLocal(&host) ||
+        !Nan::Get(settings, Nan::New("spillFile").ToLocalChecked())
+             .ToLocal(&spillFile) ||
+        !ReadInteger(settings, "port", 1, 65535, &port) ||
+        !ReadInteger(settings, "batchSize", 512, 4 * 1024 * 1024,
+                     &target.batch_size) ||
+        !ReadInteger(settings, "flushInterval", 1, 60000, &flushInterval) ||
+        !ReadInteger(settings, "spillSize", 0, 9007199254740991.0,
+                     &target.spill_size)) {
+      return false;
+    }
+    if (socketPath->IsString()) {
+      target.path = *Nan::Utf8String(socketPath);
+    } else if (host->IsString() && port != 0) {
+      target.host = *Nan::Utf8String(host);
+      target.port = static_cast<uint16_t>(port);
+    } else {
+      Nan::ThrowError(
+          Nan::Error("Provide the collector path, or its host and port"));
+      return false;
+    }
+    target.flush_interval = std::chrono::milliseconds(flushInterval);
+    if (spillFile->IsString() && !ToFilename(spillFile, &target.spill_file)) {
+      return false;
+    }
+    // The spill file would put the plain text on disk after all.
+    if (!target.spill_file.empty() && !options->encryption_key.empty()) {
+      Nan::ThrowError(Nan::Error(
+          "A collector spillFile cannot be combined with encryption"));
+      return false;
+    }
+  }
+
+  v8::Local<v8::Value> syslog;
+  if (!Nan::Get(object, Nan::New("syslog").ToLocalChecked()).ToLocal(&syslog)) {
+    return false;
+  }
+  if (syslog->IsObject()) {
+    v8::Local<v8::Object> settings = syslog.As<v8::Object>();
+    options->syslog.reset(new SyslogSink::Options());
+    SyslogSink::Options &target = *options->syslog;
+    v8::Local<v8::Value> socketPath;
+    v8::Local<v8::Value> format;
+    v8::Local<v8::Value> appName;
+    size_t facility = static_cast<size_t>(target.facility);
+    if (!Nan::Get(settings, Nan::New("path").ToLocalChecked())
+             .ToLocal(&socketPath) ||
+        !Nan::Get(settings, Nan::New("format").ToLocalChecked())
+             .ToLocal(&format) ||
+        !Nan::Get(settings, Nan::New("appName").ToLocalChecked())
+             .ToLocal(&appName) ||
+        !ReadInteger(settings, "facility", 0, 23, &facility)) {
+      return false;
+    }
+    target.facility = static_cast<int>(facility);
+    if (socketPath->IsString()) {
+      target.path = *Nan::Utf8String(socketPath);
+    }
+    if (appName->IsString()) {
+      target.app_name = *Nan::Utf8String(appName);
+    }
+    if (!format->IsUndefined()) {
+      const std::string name = format->IsString() ? *Nan::Utf8String(format) : "";
+      if (name == "journald") {
+        target.format = SyslogSink::kJournald;
+      } else if (name != "rfc5424") {
+        Nan::ThrowError(
+            Nan::Error("The syslog format must be 'rfc5424' or 'journald'"));
+        return false;
+      }
+    }
+  }
+
+  v8::Local<v8::Value> otlp;
+  if (!Nan::Get(object, Nan::New("otlp").ToLocalChecked()).ToLocal(&otlp)) {
+    return false;
+  }
+  if (otlp->IsObject()) {
+    v8::Local<v8::Object> settings = otlp.As<v8::Object>();
+    options->otlp.reset(new OtlpSink::Options());
+    OtlpSink::Options &target = *options->otlp;
+    v8::Local<v8::Value> file;
+    v8::Local<v8::Value> socketPath;
+    v8::Local<v8::Value> resource;
+    if (!Nan::Get(settings, Nan::New("file").ToLocalChecked()).ToLocal(&file) ||
+        !Nan::Get(settings, Nan::New("path").ToLocalChecked())
+             .ToLocal(&socketPath) ||
+        !Nan::Get(settings, Nan::New("resource").ToLocalChecked())
+             .ToLocal(&resource)) {
+      return false;
+    }
+    if (file->IsString()) {
+      if (!ToFilename(file, &target.file)) {
+        return false;
+      }
+    } else if (socketPath->IsString()) {
+      target.path = *Nan::Utf8String(socketPath);
+    } else {
+      Nan::ThrowError(Nan::Error("Provide the OTLP file or socket path"));
+      return false;
+    }
+    if (resource->IsObject()) {
+      v8::Local<v8::Object> attributes = resource.As<v8::Object>();
+      v8::Local<v8::Array> keys;
+      if (!Nan::GetOwnPropertyNames(attributes).ToLocal(&keys)) {
+        return false;
+      }
+      for (uint32_t i = 0; i < keys->Length(); ++i) {
+        v8::Local<v8::Value> key;
+        v8::Local<v8::Value> value;
+        if (!Nan::Get(keys, i).ToLocal(&key) ||
+            !Nan::Get(attributes, key).ToLocal(&value)) {
+          return false;
+        }
+        OtlpSink::Attribute attribute;
+        attribute.key = *Nan::Utf8String(key);
+        if (value->IsString()) {
+          attribute.type = OtlpSink::Attribute::kString;
+          attribute.string_value = *Nan::Utf8String(value);
+        } else if (value->IsBoolean()) {
+          attribute.type = OtlpSink::Attribute::kBool;
+          attribute.int_value = Nan::To<bool>(value).FromJust() ? 1 : 0;
+        } else if (value->IsNumber()) {
+          const double number = Nan::To<double>(value).FromJust();
+          if (std::trunc(number) == number && std::fabs(number) < 9.2e18) {
+            attribute.type = OtlpSink::Attribute::kInt;
+            attribute.int_value = static_cast<int64_t>(number);
+          } else {
+            attribute.type = OtlpSink::Attribute::kDouble;
+            attribute.double_value = number;
+          }
+        } else {
+          Nan::ThrowError(Nan::Error(
+              "OTLP resource attributes must be strings, numbers or booleans"));
+          return false;
+        }
+        target.resource.push_back(attribute);
+      }
+    }
+  }
+
+  if (!ReadTraceFile(object, &options->trace_file)) {
+    return false;
+  }
+
+  v8::Local<v8::Value> redact;
+  if (!Nan::Get(object, Nan::New("redact").ToLocalChecked()).ToLocal(&redact)) {
+    return false;
+  }
+  if (redact->IsObject()) {
+    v8::Local<v8::Object> settings = redact.As<v8::Object>();
+    Redactor::Options redactor;
+    v8::Local<v8::Value> literals;
+    v8::Local<v8::Value> emails;
+    v8::Local<v8::Value> bearerTokens;
+    v8::Local<v8::Value> replacement;
+    if (!Nan::Get(settings, Nan::New("literals").ToLocalChecked())
+             .ToLocal(&literals) ||
+        !Nan::Get(settings, Nan::New("emails").ToLocalChecked())
+             .ToLocal(&emails) ||
+        !Nan::Get(settings, Nan::New("bearerTokens").ToLocalChecked())
+             .ToLocal(&bearerTokens) ||
+        !Nan::Get(settings, Nan::New("replacement").ToLocalChecked())
+             .ToLocal(&replacement)) {
+      return false;
+    }
+    if (!literals->IsUndefined()) {
+      if (!literals->IsArray()) {
+        Nan::ThrowError(Nan::Error("Provide the redact literals as strings"));
+        return false;
+      }
+      v8::Local<v8::Array> array = literals.As<v8::Array>();
+      for (uint32_t i = 0; i < array->Length(); ++i) {
+        v8::Local<v8::Value> literal;
+        if (!Nan::Get(array, i).ToLocal(&literal)) {
+          return false;
+        }
+        if (!literal->IsString() || literal.As<v8::String>()->Length() == 0) {
+          Nan::ThrowError(Nan::Error("Provide the redact literals as strings"));
+          return false;
+        }
+        redactor.literals.push_back(*Nan::Utf8String(literal));
+      }
+    }
+    redactor.emails = Nan::To<bool>(emails).FromJust();
+    redactor.bearer_tokens = Nan::To<bool>(bearerTokens).FromJust();
+    if (!replacement->IsUndefined()) {
+      if (!replacement->IsString()) {
+        Nan::ThrowError(Nan::Error("Provide the redact replacement as a string"));
+        return false;
+      }
+      redactor.replacement = *Nan::Utf8String(replacement);
+    }
+    options->redactor = std::make_shared<Redactor>(redactor);
+  }
+  return true;
+}
 
 NAN_MODULE_INIT(Logger::Init) {
   v8::Local<v8::FunctionTemplate> tpl = Nan::New<v8::FunctionTemplate>(New);
@@ -56,26 +828,65 @@ NAN_MODULE_INIT(Logger::Init) {
   Nan::SetPrototypeMethod(tpl, "info", Logger::Info);
   Nan::SetPrototypeMethod(tpl, "debug", Logger::Debug);
   Nan::SetPrototypeMethod(tpl, "trace", Logger::Trace);
+  Nan::SetPrototypeMethod(tpl, "logBatch", Logger::LogBatch);
 
   Nan::SetPrototypeMethod(tpl, "getLevel", Logger::GetLevel);
   Nan::SetPrototypeMethod(tpl, "setLevel", Logger::SetLevel);
+  Nan::SetPrototypeMethod(tpl, "shouldLog", Logger::ShouldLog);
   Nan::SetPrototypeMethod(tpl, "flush", Logger::Flush);
   Nan::SetPrototypeMethod(tpl, "drop", Logger::Drop);
   Nan::SetPrototypeMethod(tpl, "setPattern", Logger::SetPattern);
   Nan::SetPrototypeMethod(tpl, "clearFormatters", Logger::ClearFormatters);
+  Nan::SetPrototypeMethod(tpl, "setMaxMessageSize", Logger::SetMaxMessageSize);
+  Nan::SetPrototypeMethod(tpl, "setSerializerOptions",
+                          Logger::SetSerializerOptions);
+  Nan::SetPrototypeMethod(tpl, "child", Logger::Child);
+  Nan::SetPrototypeMethod(tpl, "route", Logger::Route);
+  Nan::SetPrototypeMethod(tpl, "setAsyncContext", Logger::SetAsyncContext);
+  Nan::SetPrototypeMethod(tpl, "setJsonFormatter", Logger::SetJsonFormatter);
+  Nan::SetPrototypeMethod(tpl, "snapshot", Logger::Snapshot);
+  Nan::SetPrototypeMethod(tpl, "trackTopTalkers", Logger::TrackTopTalkers);
+  Nan::SetPrototypeMethod(tpl, "getTopTalkers", Logger::GetTopTalkers);
+  Nan::SetPrototypeMethod(tpl, "setSampling", Logger::SetSampling);
+  Nan::SetPrototypeMethod(tpl, "setLoadShedding", Logger::SetLoadShedding);
+  Nan::SetPrototypeMethod(tpl, "recordSpan", Logger::RecordSpan);
+  Nan::SetPrototypeMethod(tpl, "metric", Logger::Metric);
+  Nan::SetPrototypeMethod(tpl, "setMetricsInterval",
+                          Logger::SetMetricsInterval);
 
   constructor.Reset(Nan::GetFunction(tpl).ToLocalChecked());
   Nan::Set(target, Nan::New("Logger").ToLocalChecked(),
            Nan::GetFunction(tpl).ToLocalChecked());
 }
 
-Logger::Logger(std::shared_ptr<spdlog::logger> logger) : logger_(logger) {}
+Logger::Logger(std::shared_ptr<spdlog::logger> logger)
+    : logger_(logger),
+      root_(this),
+      max_message_size_(0),
+      serializer_(std::make_shared<Serializer>()) {}
+
+Logger::Logger(Logger *parent)
+    : root_(parent->root_),
+      prefix_(parent->prefix_),
+      key_(parent->key_),
+      max_message_size_(0),
+      serializer_(parent->serializer_) {
+  root_handle_.Reset(root_->handle());
+  async_storage_.Reset(parent->async_storage_);
+  get_store_.Reset(parent->get_store_);
+}
 
 Logger::~Logger() {
+  root_handle_.Reset();
+  async_storage_.Reset();
+  get_store_.Reset();
+
   if (logger_ == NULL) {
     return;
   }
 
+  // Writes the last summary while the logger is still there.
+  metrics_.reset();
   try {
     spdlog::drop(logger_->name());
   } catch (...) {
@@ -87,13 +898,23 @@ Logger::~Logger() {
 
 NAN_METHOD(Logger::New) {
   try {
-    if (info.IsConstructCall()) {
+    if (info.IsConstructCall() && info[0]->IsExternal()) {
+      // Created by Logger::Child, which is the only code that can pass an
+      // External.
+      Logger *parent = static_cast<Logger *>(info[0].As<v8::External>()->Value());
+      Logger *obj = new Logger(parent);
+      obj->Wrap(info.This());
+      info.GetReturnValue().Set(info.This());
+    } else if (info.IsConstructCall()) {
       if (!info[0]->IsString()) {
         return Nan::ThrowError(Nan::Error("Provide a logger name"));
       }
 
       const std::string name = *Nan::Utf8String(info[0]);
       std::shared_ptr<spdlog::logger> logger;
+      std::shared_ptr<FlightRecorderSink> recorder;
+      std::shared_ptr<TraceSink> trace;
+      bool dedupeStacks = false;
 
       if (name == "rotating" || name == "rotating_async") {
         if (!info[1]->IsString() || !info[2]->IsString()) {
@@ -109,41 +930,169 @@ NAN_METHOD(Logger::New) {
         logger = spdlog::get(logName);
 
         if (!logger) {
-#if defined(_WIN32)
-          const std::string utf8Filename = *Nan::Utf8String(info[2]);
-          const int bufferLen = MultiByteToWideChar(
-              CP_UTF8, 0, utf8Filename.c_str(),
-              static_cast<int>(utf8Filename.size()), NULL, 0);
-          if (!bufferLen) {
-            return Nan::ThrowError(
-              Nan::Error("Failed to determine buffer length for converting filename to wstring"));
+          spdlog::filename_t fileName;
+          if (!ToFilename(info[2], &fileName)) {
+            return;
           }
-          std::wstring fileName(bufferLen, 0);
-          const int status = MultiByteToWideChar(
-              CP_UTF8, 0, utf8Filename.c_str(),
-              static_cast<int>(utf8Filename.size()), &fileName[0], bufferLen);
-          if (!status) {
-            return Nan::ThrowError(
-              Nan::Error("Failed to convert filename to wstring"));
+
+          LoggerOptions options;
+          if (!ReadLoggerOptions(info[5], &options)) {
+            return;
           }
-#else
-          const std::string fileName = *Nan::Utf8String(info[2]);
-#endif
 
-          if (logName == "rotating_async") {
-            logger = spdlog::rotating_logger_st<spdlog::async_factory>(
-              logName, fileName, static_cast<size_t>(Nan::To<int64_t>(info[3]).FromJust()),
-              static_cast<size_t>(Nan::To<int64_t>(info[4]).FromJust()));
+          const size_t maxSize =
+              static_cast<size_t>(Nan::To<int64_t>(info[3]).FromJust());
+          const size_t maxFiles =
+              static_cast<size_t>(Nan::To<int64_t>(info[4]).FromJust());
+          // The logger is shared with worker threads that open the same
+          // name, so the sink has to lock. Only files that deduplicate stacks
+          // look for them in every record.
+          std::shared_ptr<spdlog::sinks::sink> sink;
+          if (options.dedupe_stacks) {
+            sink = std::make_shared<DedupingFileSink>(fileName, maxSize,
+                                                      maxFiles);
+            dedupeStacks = true;
+          } else {
+            sink = std::make_shared<spdlog::sinks::rotating_file_sink_mt>(
+              fileName, maxSize, maxFiles);
+          }
+          if (options.framed) {
+            sink = std::make_shared<FramedSink>(std::move(sink));
+          }
+          if (!options.encryption_key.empty()) {
+            sink = std::make_shared<EncryptedSink>(
+              std::move(sink), options.encryption_key,
+              options.encryption_chunk_size);
+            OPENSSL_cleanse(&options.encryption_key[0],
+                            options.encryption_key.size());
+          }
+          if (!options.mapped_ring_file.empty()) {
+            sink = std::make_shared<MappedRingSink>(
+              std::move(sink), options.mapped_ring_file,
+              options.mapped_ring_size);
+          }
+          if (options.collector) {
+            sink = std::make_shared<CollectorSink>(std::move(sink),
+                                                   *options.collector);
+          }
+          if (options.syslog) {
+            if (options.syslog->app_name.empty()) {
+              options.syslog->app_name = logName;
+            }
+            sink = std::make_shared<SyslogSink>(std::move(sink),
+                                                *options.syslog);
+          }
+          if (options.otlp) {
+            OtlpSink::Options &otlp = *options.otlp;
+            otlp.scope = logName;
+            if (std::none_of(otlp.resource.begin(), otlp.resource.end(),
+                             [](const OtlpSink::Attribute &attribute) {
+                               return attribute.key == "service.name";
+                             })) {
+              OtlpSink::Attribute service;
+              service.key = "service.name";
+              service.string_value = logName;
+              otlp.resource.push_back(service);
+            }
+            OtlpSink::Attribute pid;
+            pid.key = "process.pid";
+            pid.type = OtlpSink::Attribute::kInt;
+            pid.int_value = spdlog::details::os::pid();
+            otlp.resource.push_back(pid);
+            sink = std::make_shared<OtlpSink>(std::move(sink), otlp);
+          }
+          if (options.recorder_budget > 0) {
+            recorder = std::make_shared<FlightRecorderSink>(
+              std::move(sink), options.recorder_budget,
+              options.recorder_chunk_size, options.recorder_level);
+            sink = recorder;
+          }
+          if (options.formatter_threads > 0) {
+            sink = std::make_shared<ParallelFormatSink>(
+              options.formatter_threads, std::move(sink));
+          }
+          if (options.staging_buffers) {
+            sink = std::make_shared<StagingSink>(std::move(sink));
+          }
+          // Outermost, so every formatter set on the logger is wrapped.
+          if (options.redactor) {
+            sink = std::make_shared<RedactionSink>(std::move(sink),
+                                                   options.redactor);
+          }
+          // The staging rings already queue the records of every thread and
+          // their consumer drives the sinks, so they replace the thread pool.
+          if (name == "rotating_async" && !options.staging_buffers) {
+            logger = std::make_shared<spdlog::async_logger>(
+              logName, std::move(sink), AsyncThreadPool(),
+              spdlog::async_overflow_policy::block);
           } else {
-            logger = spdlog::rotating_logger_st(
-              logName, fileName, static_cast<size_t>(Nan::To<int64_t>(info[3]).FromJust()),
-              static_cast<size_t>(Nan::To<int64_t>(info[4]).FromJust()));
+            logger = std::make_shared<spdlog::logger>(logName,
+                                                      std::move(sink));
+          }
+          spdlog::initialize_logger(logger);
+          if (recorder) {
+            recorder->SetForwardLevel(logger->level());
+            if (options.recorder_level < logger->level()) {
+              logger->set_level(options.recorder_level);
+            }
+          }
+          logger->set_formatter(record::MakePatternFormatter());
+          config::Configure(logger, recorder, dedupeStacks);
+          if (!options.trace_file.empty()) {
+            trace = TraceSink::ForLogger(logName, options.trace_file);
           }
+        } else {
+          spdlog::filename_t traceFile;
+          if (info[5]->IsObject() &&
+              !ReadTraceFile(info[5].As<v8::Object>(), &traceFile)) {
+            return;
+          }
+          trace = TraceSink::ForLogger(logName, traceFile);
+          recorder = config::Recorder(logName);
+          dedupeStacks = config::DedupesStacks(logName);
+        }
+      } else if (name == "keyed") {
+        if (!info[1]->IsString() || !info[2]->IsString()) {
+          return Nan::ThrowError(
+              Nan::Error("Provide the log name and directory"));
+        }
+        if (!info[3]->IsNumber() || !info[4]->IsNumber()) {
+          return Nan::ThrowError(
+              Nan::Error("Provide the max size and max files"));
+        }
+        const std::string logName = *Nan::Utf8String(info[1]);
+
+        logger = spdlog::get(logName);
+
+        if (!logger) {
+          spdlog::filename_t directory;
+          if (!ToFilename(info[2], &directory)) {
+            return;
+          }
+          size_t maxOpenFiles = 64;
+          if (info[5]->IsObject() &&
+              !ReadInteger(info[5].As<v8::Object>(), "maxOpenFiles", 1, 65536,
+                           &maxOpenFiles)) {
+            return;
+          }
+          // Files are opened and closed on the async worker thread.
+          logger = spdlog::async_factory::create<KeyedFileSink>(
+            logName, directory, logName,
+            static_cast<size_t>(Nan::To<int64_t>(info[3]).FromJust()),
+            static_cast<size_t>(Nan::To<int64_t>(info[4]).FromJust()),
+            maxOpenFiles);
+          logger->set_formatter(record::MakePatternFormatter());
+          config::Configure(logger, NULL, false);
         }
       } else {
         logger = spdlog::stdout_logger_st<spdlog::async_factory>(name);
+        logger->set_formatter(record::MakePatternFormatter());
+        config::Configure(logger, NULL, false);
       }
       Logger *obj = new Logger(logger);
+      obj->recorder_ = std::move(recorder);
+      obj->trace_ = std::move(trace);
+      obj->serializer_->SetDedupeStacks(dedupeStacks);
       obj->Wrap(info.This());
       info.GetReturnValue().Set(info.This());
     } else {
@@ -161,99 +1110,321 @@ NAN_METHOD(Logger::New) {
 }
 
 NAN_METHOD(Logger::Critical) {
-  if (!info[0]->IsString()) {
-    return Nan::ThrowError(Nan::Error("Provide a message to log"));
-  }
+  Logger::Log(info, spdlog::level::critical);
+}
 
-  Logger *obj = Nan::ObjectWrap::Unwrap<Logger>(info.This());
-  const std::string message = *Nan::Utf8String(info[0]);
+NAN_METHOD(Logger::Error) {
+  Logger::Log(info, spdlog::level::err);
+}
 
-  if (obj->logger_) {
-    obj->logger_->critical(message);
-  }
+NAN_METHOD(Logger::Warn) {
+  Logger::Log(info, spdlog::level::warn);
+}
 
-  info.GetReturnValue().Set(info.This());
+NAN_METHOD(Logger::Info) {
+  Logger::Log(info, spdlog::level::info);
 }
 
-NAN_METHOD(Logger::Error) {
-  if (!info[0]->IsString()) {
+NAN_METHOD(Logger::Debug) {
+  Logger::Log(info, spdlog::level::debug);
+}
+
+NAN_METHOD(Logger::Trace) {
+  Logger::Log(info, spdlog::level::trace);
+}
+
+void Logger::Log(const Nan::FunctionCallbackInfo<v8::Value> &info,
+                 spdlog::level::level_enum level) {
+  if (info[0]->IsUndefined()) {
     return Nan::ThrowError(Nan::Error("Provide a message to log"));
   }
 
   Logger *obj = Nan::ObjectWrap::Unwrap<Logger>(info.This());
-  const std::string message = *Nan::Utf8String(info[0]);
-
-  if (obj->logger_) {
-    obj->logger_->error(message);
+  // Serializing may run getters that drop this logger, keep it alive.
+  std::shared_ptr<spdlog::logger> logger = obj->root_->logger_;
+
+  // Check the level before touching the value so that disabled levels
+  // never pay for transcoding or serialization.
+  if (logger && logger->should_log(level)) {
+    uint64_t skipped;
+    v8::Local<v8::Value> stack;
+    if (!obj->Admit(info[0], level, &skipped, &stack)) {
+      info.GetReturnValue().Set(info.This());
+      return;
+    }
+    record::Context context;
+    bool hasContext = false;
+    if (!obj->CaptureContext(&context, &hasContext)) {
+      return;
+    }
+    spdlog::memory_buf_t message;
+    const bool pinned = obj->FormatMessage(hasContext ? &context : NULL,
+                                           info[0], stack, skipped, message);
+    Submit(logger,
+           spdlog::details::log_msg(
+               logger->name(), level,
+               spdlog::string_view_t(message.data(), message.size())),
+           pinned);
   }
 
   info.GetReturnValue().Set(info.This());
 }
 
-NAN_METHOD(Logger::Warn) {
-  if (!info[0]->IsString()) {
-    return Nan::ThrowError(Nan::Error("Provide a message to log"));
+bool Logger::FormatMessage(const record::Context *context,
+                           v8::Local<v8::Value> value,
+                           v8::Local<v8::Value> stack, uint64_t skipped,
+                           spdlog::memory_buf_t &dest) {
+  // Large external strings are referred to rather than copied, unless they
+  // have to be cut or get a marker appended.
+  const size_t maxSize = root_->max_message_size_;
+  const size_t header = dest.size();
+  record::Pinned *pinned = NULL;
+  if (skipped == 0 && value->IsString()) {
+    pinned = Pin(value, kMinPinnedSize);
+    if (pinned != NULL && maxSize != 0 && pinned->text().size() > maxSize) {
+      pinned->Release();
+      pinned = NULL;
+    }
   }
 
-  Logger *obj = Nan::ObjectWrap::Unwrap<Logger>(info.This());
-  const std::string message = *Nan::Utf8String(info[0]);
-
-  if (obj->logger_) {
-    obj->logger_->warn(message);
+  record::AppendHeader(context, pinned, key_, dest);
+  const size_t text = dest.size();
+  spdlog::details::fmt_helper::append_string_view(prefix_, dest);
+  if (pinned != NULL) {
+    return true;
   }
-
-  info.GetReturnValue().Set(info.This());
+  std::vector<record::Stack> stacks;
+  if (value->IsString()) {
+    AppendMessage(value.As<v8::String>(), maxSize, dest);
+  } else if (value->IsArrayBufferView()) {
+    AppendBytes(value.As<v8::ArrayBufferView>(), maxSize, dest);
+  } else {
+    serializer_->Serialize(value, stack, maxSize, dest, &stacks);
+  }
+  if (skipped != 0) {
+    spdlog::details::fmt_helper::append_string_view(" [", dest);
+    spdlog::details::fmt_helper::append_int(skipped, dest);
+    spdlog::details::fmt_helper::append_string_view(" similar skipped]", dest);
+  }
+  // The stacks go into the header, where no message text can fake one.
+  if (!stacks.empty()) {
+    for (record::Stack &stack : stacks) {
+      stack.begin -= static_cast<uint32_t>(text);
+      stack.end -= static_cast<uint32_t>(text);
+    }
+    record::InsertStacks(header, text, stacks, dest);
+  }
+  return false;
 }
 
-NAN_METHOD(Logger::Info) {
-  if (!info[0]->IsString()) {
-    return Nan::ThrowError(Nan::Error("Provide a message to log"));
+// Copies the start of |value| that makes up its template to |text|. The
+// stack of an error is read into |stack| for the serializer to reuse.
+static size_t TemplateText(v8::Local<v8::Value> value,
+                           char (&text)[kMessageTemplateSize],
+                           v8::Local<v8::Value> *stack) {
+  v8::Isolate *isolate = v8::Isolate::GetCurrent();
+  if (value->IsString()) {
+    return static_cast<size_t>(value.As<v8::String>()->WriteUtf8(
+        isolate, text, sizeof(text), NULL,
+        v8::String::NO_NULL_TERMINATION | v8::String::REPLACE_INVALID_UTF8));
+  }
+  if (value->IsArrayBufferView()) {
+    return value.As<v8::ArrayBufferView>()->CopyContents(text, sizeof(text));
   }
 
-  Logger *obj = Nan::ObjectWrap::Unwrap<Logger>(info.This());
-  const std::string message = *Nan::Utf8String(info[0]);
-
-  if (obj->logger_) {
-    obj->logger_->info(message);
+  // What cannot be read is left out here, the serializer reports it.
+  v8::Local<v8::Context> context = isolate->GetCurrentContext();
+  v8::TryCatch tryCatch(isolate);
+  if (value->IsNativeError() &&
+      value.As<v8::Object>()
+          ->Get(context, Nan::New("stack").ToLocalChecked())
+          .ToLocal(stack) &&
+      (*stack)->IsString()) {
+    // The stack starts with "name: message", the template ends with its
+    // first frame. No more than the template is transcoded.
+    const size_t size = static_cast<size_t>(
+        stack->As<v8::String>()->WriteUtf8(
+            isolate, text, sizeof(text), NULL,
+            v8::String::NO_NULL_TERMINATION |
+                v8::String::REPLACE_INVALID_UTF8));
+    static const char kFrame[] = "\n    at ";
+    const char *begin = text;
+    const char *end = text + size;
+    const char *frame =
+        std::search(begin, end, kFrame, kFrame + sizeof(kFrame) - 1);
+    if (frame == end) {
+      return size;
+    }
+    return static_cast<size_t>(
+        std::find(frame + sizeof(kFrame) - 1, end, '\n') - begin);
   }
 
-  info.GetReturnValue().Set(info.This());
+  // Other values are told apart by their type and the names of their own
+  // keys. Proxies would run their traps twice, they only have a type.
+  std::string shape = "[";
+  if (value->IsObject()) {
+    shape += *Nan::Utf8String(value.As<v8::Object>()->GetConstructorName());
+  } else {
+    shape += *Nan::Utf8String(value->TypeOf(isolate));
+  }
+  shape += "]";
+  v8::Local<v8::Array> names;
+  if (value->IsObject() && !value->IsArray() && !value->IsProxy() &&
+      !value->IsNativeError() &&
+      value.As<v8::Object>()
+          ->GetOwnPropertyNames(
+              context,
+              static_cast<v8::PropertyFilter>(v8::ONLY_ENUMERABLE |
+                                              v8::SKIP_SYMBOLS),
+              v8::KeyConversionMode::kConvertToString)
+          .ToLocal(&names)) {
+    v8::Local<v8::Value> name;
+    for (uint32_t i = 0; i < names->Length() && shape.size() < sizeof(text);
+         ++i) {
+      if (names->Get(context, i).ToLocal(&name)) {
+        shape += ' ';
+        shape += *Nan::Utf8String(name);
+      }
+    }
+  }
+  const size_t size = std::min(shape.size(), sizeof(text));
+  std::memcpy(text, shape.data(), size);
+  return size;
 }
 
-NAN_METHOD(Logger::Debug) {
-  if (!info[0]->IsString()) {
-    return Nan::ThrowError(Nan::Error("Provide a message to log"));
+bool Logger::Admit(v8::Local<v8::Value> value, spdlog::level::level_enum level,
+                   uint64_t *skipped, v8::Local<v8::Value> *stack) {
+  *skipped = 0;
+  // Serializing an earlier message of a batch may have dropped the logger.
+  LoadShedder *shedder = root_->load_shedder_.get();
+  if (shedder != NULL && root_->logger_ &&
+      shedder->Drop(*root_->logger_, level)) {
+    return false;
+  }
+  TopTalkers *talkers = root_->top_talkers_.get();
+  const bool count = talkers != NULL && talkers->Sampled();
+  AdaptiveSampler *sampler = root_->sampler_.get();
+  if (!count && sampler == NULL) {
+    return true;
   }
 
-  Logger *obj = Nan::ObjectWrap::Unwrap<Logger>(info.This());
-  const std::string message = *Nan::Utf8String(info[0]);
+  char text[kMessageTemplateSize];
+  const size_t size = TemplateText(value, text, stack);
+  // Top talkers see everything logged, including what the sampler drops.
+  if (count) {
+    talkers->Add(text, size, level);
+  }
+  return sampler == NULL ||
+         sampler->Keep(MessageTemplate(text, size, level, NULL), skipped);
+}
 
-  if (obj->logger_) {
-    obj->logger_->debug(message);
+bool Logger::CaptureContext(record::Context *context, bool *hasContext) {
+  *hasContext = false;
+  if (async_storage_.IsEmpty()) {
+    return true;
   }
 
-  info.GetReturnValue().Set(info.This());
+  // Read for every record: run() and enterWith() switch the store without a
+  // new async resource, so nothing native tells when a cached one is stale.
+  v8::Local<v8::Value> store;
+  if (!Nan::Call(Nan::New(get_store_), Nan::New(async_storage_), 0, NULL)
+           .ToLocal(&store)) {
+    return false;
+  }
+  *hasContext = LogContext::Read(store, context);
+  return true;
 }
 
-NAN_METHOD(Logger::Trace) {
-  if (!info[0]->IsString()) {
-    return Nan::ThrowError(Nan::Error("Provide a message to log"));
+NAN_METHOD(Logger::LogBatch) {
+  if (!info[0]->IsUint8Array() || !info[1]->IsArray() ||
+      !info[2]->IsFloat64Array()) {
+    return Nan::ThrowError(
+        Nan::Error("Provide the levels, messages and timestamps"));
   }
 
-  Logger *obj = Nan::ObjectWrap::Unwrap<Logger>(info.This());
-  const std::string message = *Nan::Utf8String(info[0]);
+  // Levels and timestamps come in typed arrays so that only the messages
+  // need to be read through the V8 API. They are copied first, since a
+  // toJSON() or getter that logs while the batch is written reuses them.
+  Nan::TypedArrayContents<uint8_t> levelContents(info[0]);
+  v8::Local<v8::Array> messages = info[1].As<v8::Array>();
+  Nan::TypedArrayContents<double> timestampContents(info[2]);
+  const uint32_t length = messages->Length();
+  if (levelContents.length() < length || timestampContents.length() < length) {
+    return Nan::ThrowError(Nan::Error("Batch arrays differ in length"));
+  }
+  const std::vector<uint8_t> levels(*levelContents, *levelContents + length);
+  const std::vector<double> timestamps(*timestampContents,
+                                       *timestampContents + length);
+  // Optional LogContext of each message, captured by the caller.
+  v8::Local<v8::Array> contexts;
+  if (info[3]->IsArray()) {
+    contexts = info[3].As<v8::Array>();
+  }
 
-  if (obj->logger_) {
-    obj->logger_->trace(message);
+  Logger *obj = Nan::ObjectWrap::Unwrap<Logger>(info.This());
+  std::shared_ptr<spdlog::logger> logger = obj->root_->logger_;
+  if (!logger) {
+    return;
   }
 
-  info.GetReturnValue().Set(info.This());
+  v8::Local<v8::Context> context = Nan::GetCurrentContext();
+  spdlog::memory_buf_t message;
+  for (uint32_t i = 0; i < length; ++i) {
+    // should_log() passes "off" at any level, as shouldLog() it is invalid.
+    const uint8_t levelNumber = levels[i];
+    if (levelNumber >= spdlog::level::off) {
+      continue;
+    }
+    auto level = static_cast<spdlog::level::level_enum>(levelNumber);
+    if (!logger->should_log(level)) {
+      continue;
+    }
+
+    v8::Local<v8::Value> value;
+    if (!messages->Get(context, i).ToLocal(&value)) {
+      return;
+    }
+    if (value->IsUndefined()) {
+      continue;
+    }
+    uint64_t skipped;
+    v8::Local<v8::Value> stack;
+    if (!obj->Admit(value, level, &skipped, &stack)) {
+      continue;
+    }
+
+    // Timestamps are milliseconds since the epoch, as captured by the caller.
+    const spdlog::log_clock::time_point time(
+        std::chrono::duration_cast<spdlog::log_clock::duration>(
+            std::chrono::duration<double, std::milli>(timestamps[i])));
+
+    record::Context recordContext;
+    bool hasContext = false;
+    if (!contexts.IsEmpty()) {
+      v8::Local<v8::Value> store;
+      if (!contexts->Get(context, i).ToLocal(&store)) {
+        return;
+      }
+      hasContext = LogContext::Read(store, &recordContext);
+    }
+
+    message.clear();
+    const bool pinned = obj->FormatMessage(
+        hasContext ? &recordContext : NULL, value, stack, skipped, message);
+    Submit(logger,
+           spdlog::details::log_msg(
+               time, spdlog::source_loc{}, logger->name(), level,
+               spdlog::string_view_t(message.data(), message.size())),
+           pinned);
+  }
 }
 
 NAN_METHOD(Logger::GetLevel) {
-  Logger *obj = Nan::ObjectWrap::Unwrap<Logger>(info.This());
+  Logger *obj = Nan::ObjectWrap::Unwrap<Logger>(info.This())->root_;
 
-  if (obj->logger_) {
+  if (obj->recorder_) {
+    info.GetReturnValue().Set(obj->recorder_->ForwardLevel());
+  } else if (obj->logger_) {
     info.GetReturnValue().Set(obj->logger_->level());
   }
 }
@@ -263,7 +1434,7 @@ NAN_METHOD(Logger::SetLevel) {
     return Nan::ThrowError(Nan::Error("Provide level"));
   }
 
-  Logger *obj = Nan::ObjectWrap::Unwrap<Logger>(info.This());
+  Logger *obj = Nan::ObjectWrap::Unwrap<Logger>(info.This())->root_;
 
   if (obj->logger_) {
     const int64_t levelNumber = Nan::To<int64_t>(info[0]).FromJust();
@@ -271,18 +1442,42 @@ NAN_METHOD(Logger::SetLevel) {
       return Nan::ThrowError(Nan::Error("Invalid level"));
     }
     auto level = static_cast<spdlog::level::level_enum>(levelNumber);
+    if (obj->recorder_) {
+      // The level applies to what is written, the recorder may want more.
+      obj->recorder_->SetForwardLevel(level);
+      level = std::min(level, obj->recorder_->RecordLevel());
+    }
     obj->logger_->set_level(level);
   }
 
   info.GetReturnValue().Set(info.This());
 }
 
+NAN_METHOD(Logger::ShouldLog) {
+  if (!info[0]->IsNumber()) {
+    return Nan::ThrowError(Nan::Error("Provide level"));
+  }
+
+  Logger *obj = Nan::ObjectWrap::Unwrap<Logger>(info.This())->root_;
+
+  // Unlike getLevel this includes the levels only the recorder keeps.
+  const int64_t levelNumber = Nan::To<int64_t>(info[0]).FromJust();
+  info.GetReturnValue().Set(
+      obj->logger_ && levelNumber >= spdlog::level::trace &&
+      levelNumber < spdlog::level::n_levels &&
+      obj->logger_->should_log(
+          static_cast<spdlog::level::level_enum>(levelNumber)));
+}
+
 NAN_METHOD(Logger::Flush) {
-  Logger *obj = Nan::ObjectWrap::Unwrap<Logger>(info.This());
+  Logger *obj = Nan::ObjectWrap::Unwrap<Logger>(info.This())->root_;
 
   if (obj->logger_) {
     obj->logger_->flush();
   }
+  if (obj->trace_) {
+    obj->trace_->Flush();
+  }
 
   info.GetReturnValue().Set(info.This());
 }
@@ -290,10 +1485,21 @@ NAN_METHOD(Logger::Flush) {
 NAN_METHOD(Logger::Drop) {
   Logger *obj = Nan::ObjectWrap::Unwrap<Logger>(info.This());
 
-  if (obj->logger_) {
+  if (obj->root_ != obj) {
+    // Dropping a child only detaches it, the parent keeps logging.
+    obj->root_ = obj;
+    obj->root_handle_.Reset();
+  } else if (obj->logger_) {
+    obj->metrics_.reset();
     const std::string name = obj->logger_->name();
+    std::weak_ptr<spdlog::logger> logger = obj->logger_;
     obj->logger_ = NULL;
     spdlog::drop(name);
+    if (obj->recorder_ && logger.expired()) {
+      obj->recorder_->Detach();
+    }
+    // Closes the trace file.
+    obj->trace_ = NULL;
   }
 
   info.GetReturnValue().Set(info.This());
@@ -303,24 +1509,530 @@ NAN_METHOD(Logger::SetPattern) {
   if (!info[0]->IsString()) {
     return Nan::ThrowError(Nan::Error("Provide pattern"));
   }
-  Logger *obj = Nan::ObjectWrap::Unwrap<Logger>(info.This());
+  Logger *obj = Nan::ObjectWrap::Unwrap<Logger>(info.This())->root_;
   const std::string pattern = *Nan::Utf8String(info[0]);
 
   if (obj->logger_) {
-    obj->logger_->set_pattern(pattern);
+    obj->logger_->set_formatter(record::MakePatternFormatter(pattern));
   }
 
   info.GetReturnValue().Set(info.This());
 }
 
 NAN_METHOD(Logger::ClearFormatters) {
-  Logger *obj = Nan::ObjectWrap::Unwrap<Logger>(info.This());
+  Logger *obj = Nan::ObjectWrap::Unwrap<Logger>(info.This())->root_;
   const std::string pattern = *Nan::Utf8String(info[0]);
 
   if (obj->logger_) {
     obj->logger_->set_formatter(
-        std::unique_ptr<VoidFormatter>(new VoidFormatter()));
+        std::unique_ptr<record::RecordFormatter>(new record::RecordFormatter(
+            std::unique_ptr<VoidFormatter>(new VoidFormatter()))));
+  }
+
+  info.GetReturnValue().Set(info.This());
+}
+
+NAN_METHOD(Logger::SetJsonFormatter) {
+  Logger *obj = Nan::ObjectWrap::Unwrap<Logger>(info.This())->root_;
+
+  if (obj->logger_) {
+    obj->logger_->set_formatter(record::MakeJsonFormatter());
+  }
+
+  info.GetReturnValue().Set(info.This());
+}
+
+NAN_METHOD(Logger::Snapshot) {
+  Logger *obj = Nan::ObjectWrap::Unwrap<Logger>(info.This())->root_;
+  if (!obj->recorder_) {
+    return Nan::ThrowError(Nan::Error("Logger has no flight recorder"));
+  }
+
+  bool compressed = false;
+  if (info[0]->IsObject()) {
+    v8::Local<v8::Value> value;
+    if (!Nan::Get(info[0].As<v8::Object>(),
+                  Nan::New("compressed").ToLocalChecked())
+             .ToLocal(&value)) {
+      return;
+    }
+    compressed = Nan::To<bool>(value).FromJust();
+  }
+
+  // Records still queued in front of the recorder belong in the snapshot.
+  // A dropped logger keeps its history.
+  if (obj->logger_) {
+    obj->logger_->flush();
+  }
+
+  if (compressed) {
+    const std::vector<std::string> chunks = obj->recorder_->CompressedSnapshot();
+    v8::Local<v8::Array> result = Nan::New<v8::Array>(
+        static_cast<uint32_t>(chunks.size()));
+    for (uint32_t i = 0; i < chunks.size(); ++i) {
+      v8::Local<v8::Object> buffer;
+      if (!Nan::CopyBuffer(chunks[i].data(),
+                           static_cast<uint32_t>(chunks[i].size()))
+               .ToLocal(&buffer)) {
+        return;
+      }
+      Nan::Set(result, i, buffer);
+    }
+    info.GetReturnValue().Set(result);
+    return;
+  }
+
+  v8::Local<v8::String> text;
+  if (!Nan::New(obj->recorder_->Snapshot()).ToLocal(&text)) {
+    return Nan::ThrowError(Nan::Error("Snapshot is too large for a string"));
+  }
+  info.GetReturnValue().Set(text);
+}
+
+NAN_METHOD(Logger::TrackTopTalkers) {
+  double capacity = 64;
+  double sampleEvery = 16;
+  if (!info[0]->IsUndefined()) {
+    capacity = Nan::To<double>(info[0]).FromMaybe(-1);
+  }
+  if (!info[1]->IsUndefined()) {
+    sampleEvery = Nan::To<double>(info[1]).FromMaybe(-1);
+  }
+  if (!(capacity >= 0 && capacity <= 100000) || std::floor(capacity) != capacity) {
+    return Nan::ThrowError(Nan::Error("Provide a capacity between 0 and 100000"));
+  }
+  if (!(sampleEvery >= 1 && sampleEvery <= 1000000) ||
+      std::floor(sampleEvery) != sampleEvery) {
+    return Nan::ThrowError(
+        Nan::Error("Provide a sample rate between 1 and 1000000"));
+  }
+
+  // Starts over, counts of a previous configuration do not carry over.
+  Logger *obj = Nan::ObjectWrap::Unwrap<Logger>(info.This())->root_;
+  if (capacity == 0) {
+    obj->top_talkers_.reset();
+  } else {
+    obj->top_talkers_.reset(new TopTalkers(static_cast<size_t>(capacity),
+                                           static_cast<uint32_t>(sampleEvery)));
+  }
+
+  info.GetReturnValue().Set(info.This());
+}
+
+NAN_METHOD(Logger::GetTopTalkers) {
+  Logger *obj = Nan::ObjectWrap::Unwrap<Logger>(info.This())->root_;
+  if (!obj->top_talkers_) {
+    return Nan::ThrowError(Nan::Error("Logger does not track top talkers"));
+  }
+
+  size_t count = SIZE_MAX;
+  if (info[0]->IsNumber()) {
+    count = static_cast<size_t>(std::max<int64_t>(Nan::To<int64_t>(info[0]).FromJust(), 0));
+  }
+  const std::vector<TopTalkers::Talker> top = obj->top_talkers_->Top(count);
+  const double seconds = std::max(obj->top_talkers_->Seconds(), 1e-3);
+
+  v8::Local<v8::Array> result = Nan::New<v8::Array>(static_cast<uint32_t>(top.size()));
+  for (uint32_t i = 0; i < top.size(); ++i) {
+    const TopTalkers::Talker &talker = top[i];
+    v8::Local<v8::Object> item = Nan::New<v8::Object>();
+    Nan::Set(item, Nan::New("template").ToLocalChecked(),
+             Nan::New(talker.text).ToLocalChecked());
+    Nan::Set(item, Nan::New("level").ToLocalChecked(),
+             Nan::New(static_cast<int32_t>(talker.level)));
+    Nan::Set(item, Nan::New("count").ToLocalChecked(),
+             Nan::New(static_cast<double>(talker.count)));
+    Nan::Set(item, Nan::New("error").ToLocalChecked(),
+             Nan::New(static_cast<double>(talker.error)));
+    Nan::Set(item, Nan::New("rate").ToLocalChecked(),
+             Nan::New(talker.count / seconds));
+    Nan::Set(result, i, item);
+  }
+  info.GetReturnValue().Set(result);
+}
+
+NAN_METHOD(Logger::SetSampling) {
+  double rate = 0;
+  if (!info[0]->IsUndefined()) {
+    rate = Nan::To<double>(info[0]).FromMaybe(-1);
+  }
+  if (!(rate >= 0 && rate <= 1000000) || std::floor(rate) != rate) {
+    return Nan::ThrowError(Nan::Error("Provide a rate between 0 and 1000000"));
+  }
+
+  Logger *obj = Nan::ObjectWrap::Unwrap<Logger>(info.This())->root_;
+  if (rate == 0) {
+    obj->sampler_.reset();
+  } else {
+    obj->sampler_.reset(new AdaptiveSampler(static_cast<uint32_t>(rate)));
+  }
+
+  info.GetReturnValue().Set(info.This());
+}
+
+NAN_METHOD(Logger::SetLoadShedding) {
+  Logger *obj = Nan::ObjectWrap::Unwrap<Logger>(info.This())->root_;
+  if (info[0]->IsNullOrUndefined()) {
+    obj->load_shedder_.reset();
+    info.GetReturnValue().Set(info.This());
+    return;
+  }
+  if (!info[0]->IsObject()) {
+    return Nan::ThrowError(Nan::Error("Provide load shedding options"));
+  }
+  if (!std::dynamic_pointer_cast<spdlog::async_logger>(obj->logger_)) {
+    return Nan::ThrowError(Nan::Error("Load shedding needs an async logger"));
+  }
+
+  v8::Local<v8::Object> options = info[0].As<v8::Object>();
+  double highWatermark = 0.75;
+  double lowWatermark = 0.25;
+  double maxLevel = spdlog::level::info;
+  double holdTime = 1000;
+  if (!ReadNumber(options, "highWatermark", 0, 1, false, &highWatermark) ||
+      !ReadNumber(options, "lowWatermark", 0, 1, false, &lowWatermark) ||
+      !ReadNumber(options, "maxLevel", spdlog::level::trace,
+                  spdlog::level::err, true, &maxLevel) ||
+      !ReadNumber(options, "holdTime", 0, 3600000, true, &holdTime)) {
+    return;
+  }
+  if (lowWatermark > highWatermark) {
+    return Nan::ThrowError(
+        Nan::Error("Provide a lowWatermark below the highWatermark"));
+  }
+
+  // Async loggers all share the global thread pool, created by the async
+  // factory with the default queue size.
+  obj->load_shedder_.reset(new LoadShedder(
+      spdlog::thread_pool(), spdlog::details::default_async_q_size,
+      highWatermark, lowWatermark,
+      static_cast<spdlog::level::level_enum>(maxLevel),
+      std::chrono::milliseconds(static_cast<int64_t>(holdTime))));
+
+  info.GetReturnValue().Set(info.This());
+}
+
+NAN_METHOD(Logger::RecordSpan) {
+  if (!info[0]->IsString() || !info[1]->IsNumber() || !info[2]->IsNumber()) {
+    return Nan::ThrowError(Nan::Error("Provide the span name, start and end"));
+  }
+  Logger *obj = Nan::ObjectWrap::Unwrap<Logger>(info.This())->root_;
+  TraceSink *trace = obj->trace_.get();
+  if (trace == NULL) {
+    return;
+  }
+
+  // Longer names are cut, spans are recorded often enough to spare the
+  // allocation.
+  char name[256];
+  const int size = info[0].As<v8::String>()->WriteUtf8(
+      v8::Isolate::GetCurrent(), name, sizeof(name), NULL,
+      v8::String::NO_NULL_TERMINATION | v8::String::REPLACE_INVALID_UTF8);
+  // Milliseconds of performance.now(), the trace is in microseconds.
+  trace->Add(spdlog::string_view_t(name, static_cast<size_t>(size)),
+             info[1].As<v8::Number>()->Value() * 1000,
+             info[2].As<v8::Number>()->Value() * 1000);
+}
+
+// Interval of the metrics summary until setMetricsInterval() is called.
+static const std::chrono::milliseconds kDefaultMetricsInterval(60000);
+
+NAN_METHOD(Logger::Metric) {
+  if (!info[0]->IsString() || !info[1]->IsNumber()) {
+    return Nan::ThrowError(Nan::Error("Provide the metric name and kind"));
+  }
+  const std::string name = *Nan::Utf8String(info[0]);
+  // Summaries are space separated name=value pairs.
+  if (name.empty() || name.size() > 128 ||
+      std::any_of(name.begin(), name.end(), [](char c) {
+        return c == '=' || static_cast<unsigned char>(c) <= ' ';
+      })) {
+    return Nan::ThrowError(Nan::Error(
+        "Provide a metric name without spaces or '=' of at most 128 bytes"));
+  }
+  Logger *obj = Nan::ObjectWrap::Unwrap<Logger>(info.This())->root_;
+  if (!obj->logger_) {
+    return Nan::ThrowError(Nan::Error("The logger was dropped"));
+  }
+  if (!obj->metrics_) {
+    obj->metrics_ = Metrics::ForLogger(obj->logger_, kDefaultMetricsInterval);
+  }
+
+  const Metrics::Kind kind = Nan::To<int32_t>(info[1]).FromJust() == 0
+                                 ? Metrics::kCounter
+                                 : Metrics::kGauge;
+  v8::Isolate *isolate = v8::Isolate::GetCurrent();
+  std::shared_ptr<v8::BackingStore> store =
+      obj->metrics_->Get(isolate, name, kind);
+  if (!store) {
+    return Nan::ThrowError(
+        Nan::Error("The metric name is taken by another kind of metric"));
+  }
+  info.GetReturnValue().Set(v8::SharedArrayBuffer::New(isolate, store));
+}
+
+NAN_METHOD(Logger::SetMetricsInterval) {
+  Logger *obj = Nan::ObjectWrap::Unwrap<Logger>(info.This())->root_;
+  double interval = -1;
+  if (info[0]->IsNumber()) {
+    interval = info[0].As<v8::Number>()->Value();
+  }
+  if (!(interval >= 1 && interval <= 86400000)) {
+    return Nan::ThrowError(
+        Nan::Error("Provide the interval between 1 and 86400000 ms"));
+  }
+  const std::chrono::milliseconds milliseconds(
+      static_cast<int64_t>(interval));
+  if (!obj->metrics_ && obj->logger_) {
+    obj->metrics_ = Metrics::ForLogger(obj->logger_, milliseconds);
+  }
+  if (obj->metrics_) {
+    obj->metrics_->SetInterval(milliseconds);
+  }
+
+  info.GetReturnValue().Set(info.This());
+}
+
+NAN_METHOD(Logger::SetMaxMessageSize) {
+  if (!info[0]->IsNumber()) {
+    return Nan::ThrowError(Nan::Error("Provide max message size"));
+  }
+
+  const int64_t maxSize = Nan::To<int64_t>(info[0]).FromJust();
+  if (maxSize < 0 || maxSize > INT32_MAX) {
+    return Nan::ThrowError(Nan::Error("Invalid max message size"));
+  }
+
+  Logger *obj = Nan::ObjectWrap::Unwrap<Logger>(info.This());
+  obj->root_->max_message_size_ = static_cast<size_t>(maxSize);
+
+  info.GetReturnValue().Set(info.This());
+}
+
+NAN_METHOD(Logger::SetSerializerOptions) {
+  if (!info[0]->IsObject()) {
+    return Nan::ThrowError(Nan::Error("Provide serializer options"));
+  }
+
+  Logger *obj = Nan::ObjectWrap::Unwrap<Logger>(info.This());
+  v8::Local<v8::Object> options = info[0].As<v8::Object>();
+
+  size_t depth = obj->serializer_->MaxDepth();
+  size_t maxItems = obj->serializer_->MaxItems();
+  size_t maxStringLength = obj->serializer_->MaxStringLength();
+  // Serialization recurses once per level, so the depth stays well below the
+  // native stack limit.
+  if (!ReadInteger(options, "depth", 0, 1000, &depth) ||
+      !ReadInteger(options, "maxItems", 0, UINT32_MAX, &maxItems) ||
+      !ReadInteger(options, "maxStringLength", 0, INT32_MAX,
+                   &maxStringLength)) {
+    return;
+  }
+
+  v8::Local<v8::Value> dedupeStacks;
+  if (!Nan::Get(options, Nan::New("dedupeStacks").ToLocalChecked())
+           .ToLocal(&dedupeStacks)) {
+    return;
+  }
+  if (dedupeStacks->IsTrue() &&
+      !(obj->root_->logger_ &&
+        config::DedupesStacks(obj->root_->logger_->name()))) {
+    return Nan::ThrowError(Nan::Error(
+        "Create the logger with dedupeStacks to deduplicate stacks"));
+  }
+
+  obj->serializer_->SetMaxDepth(static_cast<int>(depth));
+  obj->serializer_->SetMaxItems(static_cast<uint32_t>(maxItems));
+  obj->serializer_->SetMaxStringLength(static_cast<int>(maxStringLength));
+  if (dedupeStacks->IsBoolean()) {
+    obj->serializer_->SetDedupeStacks(Nan::To<bool>(dedupeStacks).FromJust());
+  }
+
+  info.GetReturnValue().Set(info.This());
+}
+
+NAN_METHOD(Logger::Child) {
+  if (!info[0]->IsObject()) {
+    return Nan::ThrowError(Nan::Error("Provide the child context"));
+  }
+
+  // The context is encoded once here, every message logged through the child
+  // only copies the resulting bytes. Children share the serializer.
+  Logger *parent = Nan::ObjectWrap::Unwrap<Logger>(info.This());
+  spdlog::memory_buf_t prefix;
+  if (!parent->serializer_->SerializeFields(info[0].As<v8::Object>(), prefix)) {
+    return;
+  }
+  v8::Local<v8::Object> handle;
+  if (!NewChild(parent).ToLocal(&handle)) {
+    return;
+  }
+  Nan::ObjectWrap::Unwrap<Logger>(handle)->prefix_.append(prefix.data(),
+                                                         prefix.size());
+
+  info.GetReturnValue().Set(handle);
+}
+
+NAN_METHOD(Logger::Route) {
+  if (!info[0]->IsString()) {
+    return Nan::ThrowError(Nan::Error("Provide the key"));
+  }
+  const std::string key = *Nan::Utf8String(info[0]);
+  if (!KeyedFileSink::IsValidKey(key)) {
+    return Nan::ThrowError(Nan::Error(
+        "Provide a key of letters, digits, '.', '_' and '-' that does not "
+        "start with '.' or name a device, of at most 128 bytes"));
+  }
+
+  Logger *parent = Nan::ObjectWrap::Unwrap<Logger>(info.This());
+  v8::Local<v8::Object> handle;
+  if (!NewChild(parent).ToLocal(&handle)) {
+    return;
+  }
+  Nan::ObjectWrap::Unwrap<Logger>(handle)->key_ =
+      KeyedFileSink::NormalizeKey(key);
+
+  info.GetReturnValue().Set(handle);
+}
+
+Nan::MaybeLocal<v8::Object> Logger::NewChild(Logger *parent) {
+  v8::Local<v8::Value> argv[1] = {Nan::New<v8::External>(parent)};
+  return Nan::NewInstance(Nan::New(constructor), 1, argv);
+}
+
+NAN_METHOD(Logger::SetAsyncContext) {
+  Logger *obj = Nan::ObjectWrap::Unwrap<Logger>(info.This());
+
+  if (info[0]->IsNullOrUndefined()) {
+    obj->async_storage_.Reset();
+    obj->get_store_.Reset();
+    info.GetReturnValue().Set(info.This());
+    return;
+  }
+
+  if (!info[0]->IsObject()) {
+    return Nan::ThrowError(Nan::Error("Provide an AsyncLocalStorage"));
+  }
+  v8::Local<v8::Object> storage = info[0].As<v8::Object>();
+  v8::Local<v8::Value> getStore;
+  if (!Nan::Get(storage, Nan::New("getStore").ToLocalChecked())
+           .ToLocal(&getStore) ||
+      !getStore->IsFunction()) {
+    return Nan::ThrowError(Nan::Error("Provide an AsyncLocalStorage"));
+  }
+
+  obj->async_storage_.Reset(storage);
+  obj->get_store_.Reset(getStore.As<v8::Function>());
+
+  info.GetReturnValue().Set(info.This());
+}
+
+thread_local Nan::Persistent<v8::FunctionTemplate> LogContext::tpl;
+
+NAN_MODULE_INIT(LogContext::Init) {
+  v8::Local<v8::FunctionTemplate> tpl = Nan::New<v8::FunctionTemplate>(New);
+  tpl->SetClassName(Nan::New("LogContext").ToLocalChecked());
+  tpl->InstanceTemplate()->SetInternalFieldCount(1);
+
+  LogContext::tpl.Reset(tpl);
+  Nan::Set(target, Nan::New("LogContext").ToLocalChecked(),
+           Nan::GetFunction(tpl).ToLocalChecked());
+}
+
+LogContext::LogContext(const record::Context &context) : context_(context) {}
+
+bool LogContext::Read(v8::Local<v8::Value> value, record::Context *context) {
+  if (!value->IsObject() || !Nan::New(tpl)->HasInstance(value)) {
+    return false;
+  }
+  *context = Nan::ObjectWrap::Unwrap<LogContext>(value.As<v8::Object>())
+                 ->context_;
+  return true;
+}
+
+// Parses exactly |size| bytes written as lowercase or uppercase hex.
+static bool ParseHex(const std::string &text, uint8_t *bytes, size_t size) {
+  if (text.size() != size * 2) {
+    return false;
+  }
+  for (size_t i = 0; i < text.size(); ++i) {
+    const char c = text[i];
+    uint8_t nibble;
+    if (c >= '0' && c <= '9') {
+      nibble = static_cast<uint8_t>(c - '0');
+    } else if (c >= 'a' && c <= 'f') {
+      nibble = static_cast<uint8_t>(c - 'a' + 10);
+    } else if (c >= 'A' && c <= 'F') {
+      nibble = static_cast<uint8_t>(c - 'A' + 10);
+    } else {
+      return false;
+    }
+    bytes[i / 2] = static_cast<uint8_t>((i % 2) ? (bytes[i / 2] | nibble)
+                                                : (nibble << 4));
+  }
+  return true;
+}
+
+NAN_METHOD(LogContext::New) {
+  if (!info.IsConstructCall()) {
+    return Nan::ThrowError(Nan::Error("Use new to create a LogContext"));
+  }
+  if (!info[0]->IsObject()) {
+    return Nan::ThrowError(Nan::Error("Provide the context ids"));
+  }
+
+  v8::Local<v8::Object> ids = info[0].As<v8::Object>();
+  record::Context context;
+  std::memset(&context, 0, sizeof(context));
+
+  v8::Local<v8::Value> traceId;
+  if (!Nan::Get(ids, Nan::New("traceId").ToLocalChecked()).ToLocal(&traceId)) {
+    return;
+  }
+  if (!traceId->IsUndefined()) {
+    if (!traceId->IsString() ||
+        !ParseHex(*Nan::Utf8String(traceId), context.trace_id,
+                  sizeof(context.trace_id))) {
+      return Nan::ThrowError(Nan::Error("traceId must be 32 hex characters"));
+    }
+    context.fields |= record::Context::kTraceId;
+  }
+
+  v8::Local<v8::Value> spanId;
+  if (!Nan::Get(ids, Nan::New("spanId").ToLocalChecked()).ToLocal(&spanId)) {
+    return;
+  }
+  if (!spanId->IsUndefined()) {
+    if (!spanId->IsString() ||
+        !ParseHex(*Nan::Utf8String(spanId), context.span_id,
+                  sizeof(context.span_id))) {
+      return Nan::ThrowError(Nan::Error("spanId must be 16 hex characters"));
+    }
+    context.fields |= record::Context::kSpanId;
+  }
+
+  v8::Local<v8::Value> requestId;
+  if (!Nan::Get(ids, Nan::New("requestId").ToLocalChecked()).ToLocal(&requestId)) {
+    return;
+  }
+  if (requestId->IsBigInt()) {
+    context.request_id = requestId.As<v8::BigInt>()->Uint64Value();
+    context.fields |= record::Context::kRequestId;
+  } else if (requestId->IsNumber()) {
+    const double number = requestId.As<v8::Number>()->Value();
+    if (number < 0 || number > 9007199254740991.0 ||
+        number != std::floor(number)) {
+      return Nan::ThrowError(
+          Nan::Error("requestId must be a non-negative integer"));
+    }
+    context.request_id = static_cast<uint64_t>(number);
+    context.fields |= record::Context::kRequestId;
+  } else if (!requestId->IsUndefined()) {
+    return Nan::ThrowError(
+        Nan::Error("requestId must be a non-negative integer"));
   }
 
+  LogContext *obj = new LogContext(context);
+  obj->Wrap(info.This());
   info.GetReturnValue().Set(info.This());
 }
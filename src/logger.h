@@ -14,8 +14,33 @@
 
 #include <spdlog/spdlog.h>
 
+#include "load_shedder.h"
+#include "message_template.h"
+#include "metrics.h"
+#include "record.h"
+#include "sampler.h"
+#include "serializer.h"
+#include "sink_helpers.h"
+#include "top_talkers.h"
+
+class FlightRecorderSink;
+class TraceSink;
+
 NAN_METHOD(setLevel);
 NAN_METHOD(setFlushOn);
+// Returns the records left in a mapped ring file by a process that died.
+NAN_METHOD(recoverMappedRing);
+// Returns the text of a log written with encryption.
+NAN_METHOD(decryptLog);
+// Returns the intact records of a log written with framing.
+NAN_METHOD(readFramedLog);
+// Dumps in-memory records to a file when the process dies of a fatal signal.
+NAN_METHOD(enableEmergencyDump);
+// Applies levels, patterns and flush policies to loggers matched by name.
+NAN_METHOD(configure);
+
+void AppendMessage(v8::Local<v8::String> str, size_t maxSize,
+                   spdlog::memory_buf_t &dest);
 
 class Logger : public Nan::ObjectWrap {
  public:
@@ -23,6 +48,7 @@ class Logger : public Nan::ObjectWrap {
 
  private:
   explicit Logger(std::shared_ptr<spdlog::logger> logger);
+  explicit Logger(Logger *parent);
   ~Logger();
 
   static NAN_METHOD(New);
@@ -34,26 +60,106 @@ class Logger : public Nan::ObjectWrap {
   static NAN_METHOD(Debug);
   static NAN_METHOD(Trace);
 
+  static NAN_METHOD(LogBatch);
+
+  static void Log(const Nan::FunctionCallbackInfo<v8::Value> &info,
+                  spdlog::level::level_enum level);
+  // Appends the record header, the child prefix and |value|, transcoded or
+  // serialized, followed by the count of |skipped| messages if there are any.
+  // |stack| is the stack of an error |value| if Admit() read it already.
+  // Returns true if the payload refers to pinned text instead.
+  bool FormatMessage(const record::Context *context, v8::Local<v8::Value> value,
+                     v8::Local<v8::Value> stack, uint64_t skipped,
+                     spdlog::memory_buf_t &dest);
+  // Reads the LogContext from the bound AsyncLocalStorage, if any. Returns
+  // false if reading the store threw.
+  bool CaptureContext(record::Context *context, bool *hasContext);
+  // Asks the load shedder whether to keep |value|, counts it towards the top
+  // talkers and asks the sampler, before it is transcoded. |skipped| is set
+  // to the messages of the same template the sampler dropped before this
+  // one. |stack| is set to the stack of an error |value| if it was read for
+  // the template.
+  bool Admit(v8::Local<v8::Value> value, spdlog::level::level_enum level,
+             uint64_t *skipped, v8::Local<v8::Value> *stack);
+
   static NAN_METHOD(GetLevel);
   static NAN_METHOD(SetLevel);
+  static NAN_METHOD(ShouldLog);
   static NAN_METHOD(Flush);
   static NAN_METHOD(Drop);
   static NAN_METHOD(SetPattern);
   static NAN_METHOD(ClearFormatters);
+  static NAN_METHOD(SetMaxMessageSize);
+  static NAN_METHOD(SetSerializerOptions);
+  static NAN_METHOD(Child);
+  static NAN_METHOD(Route);
+  // Creates a child of |parent| that shares everything with it.
+  static Nan::MaybeLocal<v8::Object> NewChild(Logger *parent);
+  static NAN_METHOD(SetAsyncContext);
+  static NAN_METHOD(SetJsonFormatter);
+  static NAN_METHOD(Snapshot);
+  static NAN_METHOD(TrackTopTalkers);
+  static NAN_METHOD(GetTopTalkers);
+  static NAN_METHOD(SetSampling);
+  static NAN_METHOD(SetLoadShedding);
+  static NAN_METHOD(RecordSpan);
+  static NAN_METHOD(Metric);
+  static NAN_METHOD(SetMetricsInterval);
 
-  static Nan::Persistent<v8::Function> constructor;
+  // Every isolate runs on a thread of its own, main or worker, so handles
+  // that belong to one are kept per thread.
+  static thread_local Nan::Persistent<v8::Function> constructor;
 
+  // Only set on loggers created by the constructor. Children write through
+  // |root_|, which is |this| for those loggers, and keep it alive through
+  // |root_handle_| without going through the spdlog registry.
   std::shared_ptr<spdlog::logger> logger_;
+  Logger *root_;
+  Nan::Persistent<v8::Object> root_handle_;
+  // Already encoded context of a child logger, prepended to every message.
+  std::string prefix_;
+  // File of a keyed logger the records go to, empty for the default one.
+  std::string key_;
+  // Maximum number of UTF-8 bytes kept from a message, 0 means unlimited.
+  // Only read on |root_|, children share the limit of their root.
+  size_t max_message_size_;
+  std::shared_ptr<Serializer> serializer_;
+  // In-memory history of the records, only on loggers created with one.
+  std::shared_ptr<FlightRecorderSink> recorder_;
+  // Timed spans in Chrome trace format, only on loggers created with a file.
+  std::shared_ptr<TraceSink> trace_;
+  // Most frequent message templates, only on root loggers that track them.
+  std::unique_ptr<TopTalkers> top_talkers_;
+  // Per template rate limit, only on root loggers that sample.
+  std::unique_ptr<AdaptiveSampler> sampler_;
+  // Level elevation under queue pressure, only on async root loggers.
+  std::unique_ptr<LoadShedder> load_shedder_;
+  // Counters and gauges shared by the handles of the logger, only on root
+  // loggers that created or looked them up.
+  std::shared_ptr<Metrics> metrics_;
+  // AsyncLocalStorage whose store holds the LogContext of each record.
+  Nan::Persistent<v8::Object> async_storage_;
+  Nan::Persistent<v8::Function> get_store_;
 };
 
-class VoidFormatter : public spdlog::formatter {
-  void format(const spdlog::details::log_msg &msg, spdlog::memory_buf_t &dest) override {
-    spdlog::details::fmt_helper::append_string_view(msg.payload, dest);
-  }
+// Trace, span and request ids created once per request and stored in an
+// AsyncLocalStorage, so that loggers can copy them into records without
+// reading any JS properties.
+class LogContext : public Nan::ObjectWrap {
+ public:
+  static NAN_MODULE_INIT(Init);
+
+  // Copies the context out of |value| if it is a LogContext.
+  static bool Read(v8::Local<v8::Value> value, record::Context *context);
+
+ private:
+  explicit LogContext(const record::Context &context);
+
+  static NAN_METHOD(New);
+
+  static thread_local Nan::Persistent<v8::FunctionTemplate> tpl;
 
-  std::unique_ptr<spdlog::formatter> clone() const override {
-    return spdlog::details::make_unique<VoidFormatter>();
-  }
+  record::Context context_;
 };
 
 #endif  // !CONSOLE_H
@@ -5,14 +5,30 @@
  *--------------------------------------------------------------------------------------------*/
 
 #include <nan.h>
+#include <spdlog/cfg/env.h>
+
+#include <mutex>
+
 #include "logger.h"
 
+static std::once_flag envLevels;
+
 NAN_MODULE_INIT(Init) {
+  // SPDLOG_LEVEL is read once per process, before any logger exists, so the
+  // registry applies it as loggers are created.
+  std::call_once(envLevels, [] { spdlog::cfg::load_env_levels(); });
+
   Nan::Set(target, Nan::New("version").ToLocalChecked(), Nan::New(SPDLOG_VERSION));
   Nan::SetMethod(target, "setLevel", setLevel);
   Nan::SetMethod(target, "setFlushOn", setFlushOn);
+  Nan::SetMethod(target, "recoverMappedRing", recoverMappedRing);
+  Nan::SetMethod(target, "decryptLog", decryptLog);
+  Nan::SetMethod(target, "readFramedLog", readFramedLog);
+  Nan::SetMethod(target, "enableEmergencyDump", enableEmergencyDump);
+  Nan::SetMethod(target, "configure", configure);
 
   Logger::Init(target);
+  LogContext::Init(target);
 }
 
-NODE_MODULE(spdlog, Init)
+NAN_MODULE_WORKER_ENABLED(spdlog, Init)
@@ -0,0 +1,309 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <zlib.h>
+
+#include "mapped_ring_sink.h"
+#include "sink_helpers.h"
+
+namespace {
+
+const char kMagic[8] = {'S', 'P', 'D', 'R', 'I', 'N', 'G', '1'};
+// A record only counts when its commit field holds this value xor the low
+// bits of its sequence, which is written after everything else.
+const uint32_t kCommit = 0x5c0ffee5;
+const size_t kAlignment = 8;
+const size_t kMinSize = 64 * 1024;
+
+struct FileHeader {
+  char magic[8];
+  uint64_t capacity;
+  // Informational, a reopened ring finds its end by scanning.
+  uint64_t head;
+  uint64_t sequence;
+  char reserved[32];
+};
+
+struct RecordHeader {
+  uint64_t sequence;
+  uint32_t size;
+  uint32_t crc;
+  uint32_t commit;
+  uint32_t reserved;
+};
+
+static_assert(sizeof(FileHeader) == 64, "FileHeader must stay 64 bytes");
+static_assert(sizeof(RecordHeader) == 24, "RecordHeader must stay 24 bytes");
+
+size_t Align(size_t size) {
+  return (size + kAlignment - 1) & ~(kAlignment - 1);
+}
+
+uint32_t Checksum(const char *data, size_t size) {
+  return static_cast<uint32_t>(
+      crc32(crc32(0, Z_NULL, 0), reinterpret_cast<const Bytef *>(data),
+            static_cast<uInt>(size)));
+}
+
+struct Found {
+  uint64_t sequence;
+  size_t offset;
+  size_t size;
+};
+
+// Finds the newest run of consecutive committed records in |data|, oldest
+// first. Records of earlier laps that were partly overwritten fail their
+// checksum, older ones that survived whole are cut off by the gap in
+// sequence numbers.
+std::vector<Found> Scan(const char *data, size_t capacity) {
+  std::vector<Found> found;
+  for (size_t offset = 0; offset + sizeof(RecordHeader) <= capacity;
+       offset += kAlignment) {
+    RecordHeader header;
+    std::memcpy(&header, data + offset, sizeof(header));
+    if (header.commit != (kCommit ^ static_cast<uint32_t>(header.sequence)) ||
+        header.size > capacity - offset - sizeof(RecordHeader) ||
+        header.crc != Checksum(data + offset + sizeof(RecordHeader),
+                               header.size)) {
+      continue;
+    }
+    found.push_back(Found{header.sequence, offset, header.size});
+  }
+  std::sort(found.begin(), found.end(), [](const Found &a, const Found &b) {
+    return a.sequence < b.sequence;
+  });
+  size_t first = found.size();
+  while (first > 0 && (first == found.size() ||
+                       found[first - 1].sequence + 1 == found[first].sequence)) {
+    --first;
+  }
+  found.erase(found.begin(), found.begin() + first);
+  return found;
+}
+
+[[noreturn]] void Throw(const std::string &what) {
+  spdlog::throw_spdlog_ex(what, errno);
+}
+
+}  // namespace
+
+// A shared, writable mapping of a whole file.
+class MappedFile {
+ public:
+  MappedFile(const spdlog::filename_t &path, size_t size, bool *existed)
+      : data_(nullptr), size_(size) {
+#if defined(_WIN32)
+    file_ = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE,
+                        FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_ALWAYS,
+                        FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file_ == INVALID_HANDLE_VALUE) {
+      Throw("Failed to open mapped ring file");
+    }
+    LARGE_INTEGER current;
+    *existed = GetFileSizeEx(file_, &current) &&
+               static_cast<uint64_t>(current.QuadPart) == size;
+    mapping_ = CreateFileMappingW(file_, NULL, PAGE_READWRITE,
+                                  static_cast<DWORD>(uint64_t(size) >> 32),
+                                  static_cast<DWORD>(size), NULL);
+    if (mapping_ == NULL) {
+      CloseHandle(file_);
+      Throw("Failed to map ring file");
+    }
+    data_ = static_cast<char *>(
+        MapViewOfFile(mapping_, FILE_MAP_ALL_ACCESS, 0, 0, size));
+    if (data_ == nullptr) {
+      CloseHandle(mapping_);
+      CloseHandle(file_);
+      Throw("Failed to map ring file");
+    }
+#else
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+      Throw("Failed to open mapped ring file " + path);
+    }
+    struct stat st;
+    *existed = ::fstat(fd_, &st) == 0 && static_cast<size_t>(st.st_size) == size;
+    if (!*existed && ::ftruncate(fd_, static_cast<off_t>(size)) != 0) {
+      ::close(fd_);
+      Throw("Failed to size mapped ring file " + path);
+    }
+    void *data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (data == MAP_FAILED) {
+      ::close(fd_);
+      Throw("Failed to map ring file " + path);
+    }
+    data_ = static_cast<char *>(data);
+#endif
+  }
+
+  ~MappedFile() {
+#if defined(_WIN32)
+    UnmapViewOfFile(data_);
+    CloseHandle(mapping_);
+    CloseHandle(file_);
+#else
+    ::munmap(data_, size_);
+    ::close(fd_);
+#endif
+  }
+
+  char *data() const { return data_; }
+
+  // Starts writing dirty pages back. Not needed to survive a crash of the
+  // process, only to narrow what a crash of the machine loses.
+  void Sync() {
+#if defined(_WIN32)
+    FlushViewOfFile(data_, 0);
+#else
+    ::msync(data_, size_, MS_ASYNC);
+#endif
+  }
+
+ private:
+#if defined(_WIN32)
+  HANDLE file_;
+  HANDLE mapping_;
+#else
+  int fd_;
+#endif
+  char *data_;
+  size_t size_;
+};
+
+MappedRingSink::MappedRingSink(std::shared_ptr<spdlog::sinks::sink> inner,
+                               const spdlog::filename_t &path, size_t size)
+    : inner_(std::move(inner)), head_(0), sequence_(0) {
+  if (size < kMinSize) {
+    spdlog::throw_spdlog_ex("Mapped ring is too small");
+  }
+  bool existed = false;
+  file_ = spdlog::details::make_unique<MappedFile>(path, size, &existed);
+  data_ = file_->data() + sizeof(FileHeader);
+  capacity_ = (size - sizeof(FileHeader)) & ~(kAlignment - 1);
+
+  FileHeader *header = reinterpret_cast<FileHeader *>(file_->data());
+  if (existed && std::memcmp(header->magic, kMagic, sizeof(kMagic)) == 0 &&
+      header->capacity == capacity_) {
+    // Continue after the newest record, so a restart keeps what the last
+    // run wrote before it died.
+    const std::vector<Found> found = Scan(data_, capacity_);
+    if (!found.empty()) {
+      head_ = found.back().offset +
+              Align(sizeof(RecordHeader) + found.back().size);
+      sequence_ = found.back().sequence + 1;
+    }
+  } else {
+    std::memset(file_->data(), 0, size);
+    std::memcpy(header->magic, kMagic, sizeof(kMagic));
+    header->capacity = capacity_;
+  }
+
+  if (inner_) {
+    inner_->set_formatter(spdlog::details::make_unique<PassthroughFormatter>());
+  }
+}
+
+MappedRingSink::~MappedRingSink() { file_->Sync(); }
+
+void MappedRingSink::sink_it_(const spdlog::details::log_msg &msg) {
+  formatted_.clear();
+  const size_t start = record::FormatForwarded(*formatter_, msg, formatted_);
+  Write(formatted_.data() + start, formatted_.size() - start);
+
+  if (inner_) {
+    spdlog::details::log_msg formatted = msg;
+    formatted.payload =
+        spdlog::string_view_t(formatted_.data(), formatted_.size());
+    inner_->log(formatted);
+  }
+}
+
+void MappedRingSink::flush_() {
+  file_->Sync();
+  if (inner_) {
+    inner_->flush();
+  }
+}
+
+void MappedRingSink::Write(const char *data, size_t size) {
+  // A single record never takes more than a quarter of the ring, so one huge
+  // message cannot wipe out the history that explains it.
+  size = std::min(size, capacity_ / 4 - sizeof(RecordHeader));
+  const size_t total = Align(sizeof(RecordHeader) + size);
+  if (head_ + total > capacity_) {
+    head_ = 0;
+  }
+
+  char *target = data_ + head_;
+  RecordHeader header;
+  header.sequence = sequence_;
+  header.size = static_cast<uint32_t>(size);
+  header.crc = Checksum(data, size);
+  header.commit = 0;
+  header.reserved = 0;
+  std::memcpy(target, &header, sizeof(header));
+  std::memcpy(target + sizeof(header), data, size);
+  // The commit marker goes last: a record cut short by a crash keeps a zero
+  // marker and is skipped on recovery.
+  std::atomic_thread_fence(std::memory_order_release);
+  *reinterpret_cast<volatile uint32_t *>(target +
+                                         offsetof(RecordHeader, commit)) =
+      kCommit ^ static_cast<uint32_t>(sequence_);
+
+  head_ += total;
+  ++sequence_;
+  FileHeader *file = reinterpret_cast<FileHeader *>(file_->data());
+  file->head = head_;
+  file->sequence = sequence_;
+}
+
+std::string MappedRingSink::Recover(const spdlog::filename_t &path) {
+  std::FILE *file = nullptr;
+  if (spdlog::details::os::fopen_s(&file, path, SPDLOG_FILENAME_T("rb"))) {
+    Throw("Failed to open mapped ring file");
+  }
+  std::string contents;
+  char buffer[64 * 1024];
+  size_t read;
+  while ((read = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    contents.append(buffer, read);
+  }
+  std::fclose(file);
+
+  FileHeader header;
+  if (contents.size() < sizeof(header)) {
+    Throw("Not a mapped ring file");
+  }
+  std::memcpy(&header, contents.data(), sizeof(header));
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.capacity > contents.size() - sizeof(header)) {
+    Throw("Not a mapped ring file");
+  }
+
+  const char *data = contents.data() + sizeof(header);
+  std::string text;
+  for (const Found &record : Scan(data, static_cast<size_t>(header.capacity))) {
+    text.append(data + record.offset + sizeof(RecordHeader), record.size);
+  }
+  return text;
+}
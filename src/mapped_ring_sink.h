@@ -0,0 +1,54 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#ifndef MAPPED_RING_SINK_H
+#define MAPPED_RING_SINK_H
+
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/base_sink.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+
+class MappedFile;
+
+// Writes every formatted record into a memory mapped file used as a ring,
+// then passes it on to |inner|. The mapping is shared, so records live in
+// the page cache as soon as they are written: when the process is killed or
+// crashes the kernel still writes them out, and Recover() finds every
+// record that was completely written.
+//
+// Each record starts with a header holding its sequence number, size and
+// CRC32, and ends up committed by a marker written last. Opening an existing
+// ring continues after its newest record.
+class MappedRingSink : public spdlog::sinks::base_sink<std::mutex> {
+ public:
+  MappedRingSink(std::shared_ptr<spdlog::sinks::sink> inner,
+                 const spdlog::filename_t &path, size_t size);
+  ~MappedRingSink() override;
+
+  // Returns the committed records of the ring at |path|, oldest first.
+  // Throws if the file is not a ring.
+  static std::string Recover(const spdlog::filename_t &path);
+
+ protected:
+  void sink_it_(const spdlog::details::log_msg &msg) override;
+  void flush_() override;
+
+ private:
+  void Write(const char *data, size_t size);
+
+  std::shared_ptr<spdlog::sinks::sink> inner_;
+  std::unique_ptr<MappedFile> file_;
+  char *data_;
+  size_t capacity_;
+  uint64_t head_;
+  uint64_t sequence_;
+  spdlog::memory_buf_t formatted_;
+};
+
+#endif  // !MAPPED_RING_SINK_H
@@ -0,0 +1,65 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#include <algorithm>
+
+#include "message_template.h"
+
+namespace {
+
+const uint64_t kFnvOffset = 14695981039346656037ULL;
+const uint64_t kFnvPrime = 1099511628211ULL;
+
+bool IsWordByte(char c) {
+  return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+         (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+uint64_t Mix(uint64_t hash, char c) {
+  return (hash ^ static_cast<unsigned char>(c)) * kFnvPrime;
+}
+
+}  // namespace
+
+uint64_t MessageTemplate(const char *data, size_t size,
+                         spdlog::level::level_enum level, std::string *text) {
+  size = std::min(size, kMessageTemplateSize);
+  if (text != NULL) {
+    text->clear();
+  }
+  uint64_t hash = kFnvOffset ^ static_cast<uint64_t>(level);
+  for (size_t i = 0; i < size;) {
+    if (!IsWordByte(data[i])) {
+      hash = Mix(hash, data[i]);
+      if (text != NULL) {
+        text->push_back(data[i]);
+      }
+      ++i;
+      continue;
+    }
+    size_t end = i;
+    bool digits = false;
+    while (end < size && IsWordByte(data[end])) {
+      digits = digits || (data[end] >= '0' && data[end] <= '9');
+      ++end;
+    }
+    if (digits) {
+      hash = Mix(hash, '#');
+      if (text != NULL) {
+        text->push_back('#');
+      }
+    } else {
+      for (size_t j = i; j < end; ++j) {
+        hash = Mix(hash, data[j]);
+      }
+      if (text != NULL) {
+        text->append(data + i, end - i);
+      }
+    }
+    i = end;
+  }
+  return hash;
+}
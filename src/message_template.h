@@ -0,0 +1,24 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#ifndef MESSAGE_TEMPLATE_H
+#define MESSAGE_TEMPLATE_H
+
+#include <spdlog/spdlog.h>
+
+#include <string>
+
+// Bytes from the start of a message that make up its template.
+const size_t kMessageTemplateSize = 256;
+
+// Hashes the template of a message at |level|: its first
+// |kMessageTemplateSize| bytes with every word that contains a digit
+// replaced by "#", so "took 12ms for user 42" and "took 7ms for user 3" are
+// the same. Writes the template to |text| unless it is NULL.
+uint64_t MessageTemplate(const char *data, size_t size,
+                         spdlog::level::level_enum level, std::string *text);
+
+#endif  // !MESSAGE_TEMPLATE_H
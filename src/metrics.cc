@@ -0,0 +1,177 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <unordered_map>
+#include <spdlog/details/fmt_helper.h>
+
+#include "metrics.h"
+#include "record.h"
+
+namespace {
+
+const size_t kCellSize = 8;
+
+static_assert(sizeof(std::atomic<uint64_t>) == 8,
+              "Atomics must match the typed arrays JS uses");
+
+// JS reaches the same memory through Atomics on a BigInt64Array and plain
+// stores to a Float64Array, which are not torn on aligned 8 bytes.
+std::atomic<uint64_t> *Counter(const v8::BackingStore &store) {
+  return static_cast<std::atomic<uint64_t> *>(store.Data());
+}
+
+std::atomic<uint64_t> *Gauge(const v8::BackingStore &store) {
+  return static_cast<std::atomic<uint64_t> *>(store.Data());
+}
+
+uint64_t Bits(double value) {
+  uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+// Appends " name=" in front of a value.
+void AppendName(const std::string &name, spdlog::memory_buf_t &dest) {
+  dest.push_back(' ');
+  spdlog::details::fmt_helper::append_string_view(name, dest);
+  dest.push_back('=');
+}
+
+void AppendNumber(double number, spdlog::memory_buf_t &dest) {
+  if (number == std::floor(number) && std::fabs(number) < 9007199254740992.0) {
+    spdlog::details::fmt_helper::append_int(static_cast<int64_t>(number), dest);
+  } else {
+    fmt::format_to(std::back_inserter(dest), "{}", number);
+  }
+}
+
+// Metrics of live loggers by name.
+std::mutex registry_mutex;
+std::unordered_map<std::string, std::weak_ptr<Metrics>> registry;
+
+}  // namespace
+
+std::shared_ptr<Metrics> Metrics::ForLogger(
+    const std::shared_ptr<spdlog::logger> &logger,
+    std::chrono::milliseconds interval) {
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  std::shared_ptr<Metrics> metrics = registry[logger->name()].lock();
+  // A logger created again under the name gets metrics of its own.
+  if (metrics && metrics->logger_.lock() == logger) {
+    return metrics;
+  }
+  metrics = std::make_shared<Metrics>(logger, interval);
+  registry[logger->name()] = metrics;
+  return metrics;
+}
+
+Metrics::Metrics(std::weak_ptr<spdlog::logger> logger,
+                 std::chrono::milliseconds interval)
+    : logger_(std::move(logger)), interval_(interval), stopping_(false) {
+  writer_ = std::thread(&Metrics::WriteLoop, this);
+}
+
+Metrics::~Metrics() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_one();
+  writer_.join();
+}
+
+std::shared_ptr<v8::BackingStore> Metrics::Get(v8::Isolate *isolate,
+                                               const std::string &name,
+                                               Kind kind) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const Metric &metric : metrics_) {
+    if (metric.name == name) {
+      return metric.kind == kind ? metric.store : NULL;
+    }
+  }
+
+  // Allocated by V8, memory from outside is not allowed everywhere.
+  Metric metric;
+  metric.name = name;
+  metric.kind = kind;
+  metric.store = v8::SharedArrayBuffer::NewBackingStore(isolate, kCellSize);
+  // Unset gauges are NaN, counters start at 0.
+  metric.written = Bits(std::numeric_limits<double>::quiet_NaN());
+  if (kind == kGauge) {
+    Gauge(*metric.store)->store(metric.written, std::memory_order_relaxed);
+  } else {
+    Counter(*metric.store)->store(0, std::memory_order_relaxed);
+  }
+  metrics_.push_back(metric);
+  return metric.store;
+}
+
+void Metrics::SetInterval(std::chrono::milliseconds interval) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    interval_ = interval;
+  }
+  // Starts the new interval now.
+  wake_.notify_one();
+}
+
+void Metrics::WriteLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    const std::chrono::milliseconds interval = interval_;
+    const auto deadline = std::chrono::steady_clock::now() + interval;
+    wake_.wait_until(lock, deadline, [&] {
+      return stopping_ || interval_ != interval;
+    });
+    if (!stopping_ && interval_ != interval) {
+      continue;
+    }
+    const bool stopping = stopping_;
+    Write();
+    if (stopping) {
+      return;
+    }
+  }
+}
+
+void Metrics::Write() {
+  summary_.clear();
+  record::AppendHeader(NULL, NULL, summary_);
+  spdlog::details::fmt_helper::append_string_view("metrics", summary_);
+  bool changed = false;
+  for (Metric &metric : metrics_) {
+    if (metric.kind == kCounter) {
+      // Counts past 2^53 would lose digits as a double.
+      const uint64_t count =
+          Counter(*metric.store)->exchange(0, std::memory_order_relaxed);
+      changed = changed || count != 0;
+      AppendName(metric.name, summary_);
+      spdlog::details::fmt_helper::append_int(count, summary_);
+      continue;
+    }
+    const uint64_t bits = Gauge(*metric.store)->load(std::memory_order_relaxed);
+    changed = changed || bits != metric.written;
+    metric.written = bits;
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    if (std::isnan(value)) {
+      continue;
+    }
+    AppendName(metric.name, summary_);
+    AppendNumber(value, summary_);
+  }
+
+  std::shared_ptr<spdlog::logger> logger = logger_.lock();
+  if (changed && logger) {
+    logger->log(spdlog::level::info,
+                spdlog::string_view_t(summary_.data(), summary_.size()));
+  }
+}
@@ -0,0 +1,83 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <nan.h>
+
+#include <spdlog/spdlog.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Counters and gauges that JS updates in shared memory without calling into
+// native code, summed up by a thread of their own and written to the logger
+// as one info record per interval:
+//
+//   metrics requests=120 errors=0 queue_depth=17.5
+//
+// Every metric is an 8 byte SharedArrayBuffer. A counter is a 64 bit
+// integer that JS increments with Atomics.add() on a BigInt64Array and the
+// thread takes back to 0, so it holds up to 2^63 - 1 per interval; the
+// record has the count of the interval. A gauge is a double that JS stores
+// and the record has its last value, gauges that were never set are left
+// out. Intervals in which no counter moved and no gauge changed write
+// nothing.
+class Metrics {
+ public:
+  enum Kind { kCounter, kGauge };
+
+  Metrics(std::weak_ptr<spdlog::logger> logger,
+          std::chrono::milliseconds interval);
+  // Writes the summary of the last interval.
+  ~Metrics();
+
+  // Returns the metrics of |logger|. Handles of the logger opened under the
+  // same name, for example on worker threads, share them and so the metrics
+  // and the summary. They are created with |interval| if the logger has
+  // none.
+  static std::shared_ptr<Metrics> ForLogger(
+      const std::shared_ptr<spdlog::logger> &logger,
+      std::chrono::milliseconds interval);
+
+  // Returns the memory of the metric |name|, created on first use. Returns
+  // NULL if |name| is a metric of the other kind.
+  std::shared_ptr<v8::BackingStore> Get(v8::Isolate *isolate,
+                                        const std::string &name, Kind kind);
+  void SetInterval(std::chrono::milliseconds interval);
+
+ private:
+  struct Metric {
+    std::string name;
+    Kind kind;
+    std::shared_ptr<v8::BackingStore> store;
+    // Gauge value of the previous summary, as bits.
+    uint64_t written;
+  };
+
+  void WriteLoop();
+  void Write();
+
+  const std::weak_ptr<spdlog::logger> logger_;
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::chrono::milliseconds interval_;
+  // In the order they were created, which is the order in the record.
+  std::vector<Metric> metrics_;
+  bool stopping_;
+  spdlog::memory_buf_t summary_;
+
+  std::thread writer_;
+};
+
+#endif  // !METRICS_H
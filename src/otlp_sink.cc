@@ -0,0 +1,405 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+#if !defined(_WIN32)
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "otlp_sink.h"
+#include "sink_helpers.h"
+#include "stream_socket.h"
+
+namespace {
+
+// Records that make the sender export without waiting for the interval.
+const size_t kBatch = 512;
+const std::chrono::milliseconds kInterval(100);
+// Records that may wait for the sender, beyond them records are dropped.
+const size_t kMaxPending = 64 * 1024;
+// A collector that takes longer to accept a connection or a batch counts as
+// unreachable.
+const int kTimeoutMs = 1000;
+
+// Field numbers of the OTLP logs protobuf.
+namespace field {
+const uint32_t kRequestResourceLogs = 1;
+const uint32_t kResourceLogsResource = 1;
+const uint32_t kResourceLogsScopeLogs = 2;
+const uint32_t kResourceAttributes = 1;
+const uint32_t kScopeLogsScope = 1;
+const uint32_t kScopeLogsLogRecords = 2;
+const uint32_t kScopeName = 1;
+const uint32_t kLogRecordTime = 1;
+const uint32_t kLogRecordSeverityNumber = 2;
+const uint32_t kLogRecordSeverityText = 3;
+const uint32_t kLogRecordBody = 5;
+const uint32_t kLogRecordAttributes = 6;
+const uint32_t kLogRecordTraceId = 9;
+const uint32_t kLogRecordSpanId = 10;
+const uint32_t kLogRecordObservedTime = 11;
+const uint32_t kKeyValueKey = 1;
+const uint32_t kKeyValueValue = 2;
+const uint32_t kAnyValueString = 1;
+const uint32_t kAnyValueBool = 2;
+const uint32_t kAnyValueInt = 3;
+const uint32_t kAnyValueDouble = 4;
+}  // namespace field
+
+enum WireType : uint32_t {
+  kVarint = 0,
+  kFixed64 = 1,
+  kLengthDelimited = 2,
+};
+
+size_t VarintSize(uint64_t value) {
+  size_t size = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    ++size;
+  }
+  return size;
+}
+
+void PutVarint(uint64_t value, std::string &dest) {
+  while (value >= 0x80) {
+    dest.push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  dest.push_back(static_cast<char>(value));
+}
+
+void PutTag(uint32_t number, WireType type, std::string &dest) {
+  PutVarint((number << 3) | type, dest);
+}
+
+void PutFixed64(uint32_t number, uint64_t value, std::string &dest) {
+  PutTag(number, kFixed64, dest);
+  for (int i = 0; i < 8; ++i) {
+    dest.push_back(static_cast<char>(value >> (8 * i)));
+  }
+}
+
+void PutBytes(uint32_t number, const char *data, size_t size,
+              std::string &dest) {
+  PutTag(number, kLengthDelimited, dest);
+  PutVarint(size, dest);
+  dest.append(data, size);
+}
+
+// Size of a length delimited field of |size| bytes, for field numbers below
+// 16 whose tag takes one byte.
+size_t FieldSize(size_t size) { return 1 + VarintSize(size) + size; }
+
+// Appends a KeyValue as field |number|. Lengths come first in protobuf, so
+// the size of the value is worked out before it is written.
+void PutAttribute(uint32_t number, const OtlpSink::Attribute &attribute,
+                  std::string &dest) {
+  size_t value_size;
+  switch (attribute.type) {
+    case OtlpSink::Attribute::kString:
+      value_size = FieldSize(attribute.string_value.size());
+      break;
+    case OtlpSink::Attribute::kInt:
+      value_size = 1 + VarintSize(static_cast<uint64_t>(attribute.int_value));
+      break;
+    case OtlpSink::Attribute::kDouble:
+      value_size = 1 + 8;
+      break;
+    default:
+      value_size = 1 + 1;
+      break;
+  }
+  PutTag(number, kLengthDelimited, dest);
+  PutVarint(FieldSize(attribute.key.size()) + FieldSize(value_size), dest);
+  PutBytes(field::kKeyValueKey, attribute.key.data(), attribute.key.size(),
+           dest);
+  PutTag(field::kKeyValueValue, kLengthDelimited, dest);
+  PutVarint(value_size, dest);
+  switch (attribute.type) {
+    case OtlpSink::Attribute::kString:
+      PutBytes(field::kAnyValueString, attribute.string_value.data(),
+               attribute.string_value.size(), dest);
+      break;
+    case OtlpSink::Attribute::kInt:
+      PutTag(field::kAnyValueInt, kVarint, dest);
+      PutVarint(static_cast<uint64_t>(attribute.int_value), dest);
+      break;
+    case OtlpSink::Attribute::kDouble: {
+      uint64_t bits;
+      std::memcpy(&bits, &attribute.double_value, sizeof(bits));
+      PutFixed64(field::kAnyValueDouble, bits, dest);
+      break;
+    }
+    default:
+      PutTag(field::kAnyValueBool, kVarint, dest);
+      PutVarint(attribute.int_value != 0 ? 1 : 0, dest);
+      break;
+  }
+}
+
+int SeverityNumber(spdlog::level::level_enum level) {
+  switch (level) {
+    case spdlog::level::trace:
+      return 1;
+    case spdlog::level::debug:
+      return 5;
+    case spdlog::level::info:
+      return 9;
+    case spdlog::level::warn:
+      return 13;
+    case spdlog::level::err:
+      return 17;
+    default:
+      return 21;
+  }
+}
+
+}  // namespace
+
+OtlpSink::OtlpSink(std::shared_ptr<spdlog::sinks::sink> inner,
+                   const Options &options)
+    : inner_(std::move(inner)),
+      options_(options),
+      pending_count_(0),
+      send_now_(false),
+      stopping_(false),
+      dropped_(0),
+      file_(NULL),
+      socket_(-1),
+      reported_(false) {
+  if (!options_.file.empty()) {
+    if (spdlog::details::os::fopen_s(&file_, options_.file,
+                                     SPDLOG_FILENAME_T("ab"))) {
+      spdlog::throw_spdlog_ex("Failed to open the OTLP file", errno);
+    }
+  } else {
+#if defined(_WIN32)
+    spdlog::throw_spdlog_ex("Exporting OTLP to a socket needs Unix domain "
+                            "sockets, export to a file instead");
+#else
+    if (options_.path.empty() ||
+        options_.path.size() >= sizeof(sockaddr_un().sun_path)) {
+      spdlog::throw_spdlog_ex("Provide the OTLP file or a socket path");
+    }
+#endif
+  }
+
+  // The resource and scope are the same in every batch.
+  for (const Attribute &attribute : options_.resource) {
+    PutAttribute(field::kResourceAttributes, attribute, resource_);
+  }
+  PutBytes(field::kScopeName, options_.scope.data(), options_.scope.size(),
+           scope_);
+  thread_attribute_.key = "thread.id";
+  thread_attribute_.type = Attribute::kInt;
+  request_attribute_.key = "request.id";
+  request_attribute_.type = Attribute::kInt;
+
+  inner_->set_formatter(spdlog::details::make_unique<PassthroughFormatter>());
+  sender_ = std::thread(&OtlpSink::SendLoop, this);
+}
+
+OtlpSink::~OtlpSink() {
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_one();
+  sender_.join();
+  if (file_ != NULL) {
+    std::fclose(file_);
+  }
+#if !defined(_WIN32)
+  if (socket_ >= 0) {
+    ::close(socket_);
+  }
+#endif
+}
+
+void OtlpSink::sink_it_(const spdlog::details::log_msg &msg) {
+  // The header is decoded before the formatter releases pinned text.
+  const record::View view = record::Decode(msg.payload);
+  formatted_.clear();
+  const size_t start = record::FormatForwarded(*formatter_, msg, formatted_);
+  spdlog::details::log_msg formatted = msg;
+  formatted.payload = spdlog::string_view_t(formatted_.data(), formatted_.size());
+  inner_->log(formatted);
+
+  size_t size = formatted_.size();
+  while (size > start &&
+         (formatted_.data()[size - 1] == '\n' || formatted_.data()[size - 1] == '\r')) {
+    --size;
+  }
+
+  bool wake = false;
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    if (pending_count_ >= kMaxPending) {
+      ++dropped_;
+      return;
+    }
+    if (pending_count_ == pending_.size()) {
+      pending_.emplace_back();
+    }
+    Entry &entry = pending_[pending_count_++];
+    entry.time = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            msg.time.time_since_epoch())
+            .count());
+    entry.level = msg.level;
+    entry.thread_id = msg.thread_id;
+    entry.has_context = view.has_context;
+    entry.context = view.context;
+    entry.body.assign(formatted_.data() + start, size - start);
+    wake = pending_count_ == kBatch;
+  }
+  if (wake) {
+    wake_.notify_one();
+  }
+}
+
+void OtlpSink::flush_() {
+  inner_->flush();
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    send_now_ = true;
+  }
+  wake_.notify_one();
+}
+
+void OtlpSink::SendLoop() {
+  std::vector<Entry> entries;
+  std::unique_lock<std::mutex> lock(queue_mutex_);
+  for (;;) {
+    wake_.wait_for(lock, kInterval, [this] {
+      return stopping_ || send_now_ || pending_count_ >= kBatch;
+    });
+    const bool stopping = stopping_;
+    send_now_ = false;
+    // The entries swap sides, so both keep the capacity of their strings.
+    entries.swap(pending_);
+    const size_t count = pending_count_;
+    pending_count_ = 0;
+    const uint64_t dropped = dropped_;
+    dropped_ = 0;
+    lock.unlock();
+
+    if (dropped > 0) {
+      ReportError("Records for OTLP were dropped, the sender fell behind");
+    }
+    if (count > 0) {
+      Encode(entries, count);
+      Write();
+    }
+
+    lock.lock();
+    if (stopping && pending_count_ == 0) {
+      return;
+    }
+  }
+}
+
+void OtlpSink::Encode(const std::vector<Entry> &entries, size_t count) {
+  records_.clear();
+  for (size_t i = 0; i < count; ++i) {
+    EncodeRecord(entries[i]);
+  }
+
+  const size_t scope_logs = FieldSize(scope_.size()) + records_.size();
+  const size_t resource_logs =
+      FieldSize(resource_.size()) + FieldSize(scope_logs);
+  request_.clear();
+  // The length prefix, filled in at the end.
+  request_.append(4, '\0');
+  PutTag(field::kRequestResourceLogs, kLengthDelimited, request_);
+  PutVarint(resource_logs, request_);
+  PutBytes(field::kResourceLogsResource, resource_.data(), resource_.size(),
+           request_);
+  PutTag(field::kResourceLogsScopeLogs, kLengthDelimited, request_);
+  PutVarint(scope_logs, request_);
+  PutBytes(field::kScopeLogsScope, scope_.data(), scope_.size(), request_);
+  request_.append(records_);
+
+  const size_t size = request_.size() - 4;
+  for (int i = 0; i < 4; ++i) {
+    request_[i] = static_cast<char>(size >> (8 * (3 - i)));
+  }
+}
+
+void OtlpSink::EncodeRecord(const Entry &entry) {
+  record_.clear();
+  PutFixed64(field::kLogRecordTime, entry.time, record_);
+  PutTag(field::kLogRecordSeverityNumber, kVarint, record_);
+  PutVarint(SeverityNumber(entry.level), record_);
+  const spdlog::string_view_t level = spdlog::level::to_string_view(entry.level);
+  PutBytes(field::kLogRecordSeverityText, level.data(), level.size(), record_);
+  PutTag(field::kLogRecordBody, kLengthDelimited, record_);
+  PutVarint(FieldSize(entry.body.size()), record_);
+  PutBytes(field::kAnyValueString, entry.body.data(), entry.body.size(),
+           record_);
+  thread_attribute_.int_value = static_cast<int64_t>(entry.thread_id);
+  PutAttribute(field::kLogRecordAttributes, thread_attribute_, record_);
+  if (entry.has_context) {
+    const record::Context &context = entry.context;
+    if (context.fields & record::Context::kRequestId) {
+      request_attribute_.int_value = static_cast<int64_t>(context.request_id);
+      PutAttribute(field::kLogRecordAttributes, request_attribute_, record_);
+    }
+    if (context.fields & record::Context::kTraceId) {
+      PutBytes(field::kLogRecordTraceId,
+               reinterpret_cast<const char *>(context.trace_id),
+               sizeof(context.trace_id), record_);
+    }
+    if (context.fields & record::Context::kSpanId) {
+      PutBytes(field::kLogRecordSpanId,
+               reinterpret_cast<const char *>(context.span_id),
+               sizeof(context.span_id), record_);
+    }
+  }
+  PutFixed64(field::kLogRecordObservedTime, entry.time, record_);
+
+  PutBytes(field::kScopeLogsLogRecords, record_.data(), record_.size(),
+           records_);
+}
+
+void OtlpSink::Write() {
+  if (file_ != NULL) {
+    if (std::fwrite(request_.data(), 1, request_.size(), file_) !=
+            request_.size() ||
+        std::fflush(file_) != 0) {
+      ReportError("Failed to write OTLP records");
+    }
+    return;
+  }
+
+#if !defined(_WIN32)
+  if (socket_ < 0) {
+    socket_ = ConnectStream(options_.path, std::string(), 0, kTimeoutMs);
+    if (socket_ < 0) {
+      if (!reported_) {
+        reported_ = true;
+        ReportError("Failed to connect to the OTLP socket, records are "
+                    "dropped");
+      }
+      return;
+    }
+    reported_ = false;
+  }
+
+  if (!SendAll(socket_, request_.data(), request_.size())) {
+    // The collector went away, connect again for the next batch.
+    ::close(socket_);
+    socket_ = -1;
+    ReportError("Failed to send OTLP records");
+  }
+#endif
+}
@@ -0,0 +1,109 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#ifndef OTLP_SINK_H
+#define OTLP_SINK_H
+
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/base_sink.h>
+
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "record.h"
+
+// Passes every formatted record on to |inner| and also exports it as an
+// OpenTelemetry log record, to a file or a Unix domain socket that a
+// collector reads.
+//
+// A sender thread encodes the records collected so far into one OTLP
+// ExportLogsServiceRequest protobuf, written with its length in front as a
+// 4 byte big endian number. Records carry their time, severity, the
+// formatted text without its line ending as body, the thread id, and the
+// async context as trace and span id and a request.id attribute. The logger
+// name is the instrumentation scope. Encoding buffers are reused from batch
+// to batch.
+class OtlpSink : public spdlog::sinks::base_sink<std::mutex> {
+ public:
+  struct Attribute {
+    enum Type { kString, kInt, kDouble, kBool };
+
+    Attribute() : type(kString), int_value(0), double_value(0) {}
+
+    std::string key;
+    Type type;
+    std::string string_value;
+    int64_t int_value;
+    double double_value;
+  };
+
+  struct Options {
+    // One of them. The socket is not available on Windows.
+    spdlog::filename_t file;
+    std::string path;
+    std::string scope;
+    std::vector<Attribute> resource;
+  };
+
+  OtlpSink(std::shared_ptr<spdlog::sinks::sink> inner, const Options &options);
+  // Exports what is left.
+  ~OtlpSink() override;
+
+ protected:
+  void sink_it_(const spdlog::details::log_msg &msg) override;
+  // Also has the sender export the records collected so far without waiting
+  // for them to be written.
+  void flush_() override;
+
+ private:
+  struct Entry {
+    uint64_t time;
+    spdlog::level::level_enum level;
+    uint64_t thread_id;
+    bool has_context;
+    record::Context context;
+    std::string body;
+  };
+
+  void SendLoop();
+  void Encode(const std::vector<Entry> &entries, size_t count);
+  void EncodeRecord(const Entry &entry);
+  void Write();
+
+  std::shared_ptr<spdlog::sinks::sink> inner_;
+  const Options options_;
+  spdlog::memory_buf_t formatted_;
+
+  std::mutex queue_mutex_;
+  std::condition_variable wake_;
+  // Entries beyond |pending_count_| are left over to be reused.
+  std::vector<Entry> pending_;
+  size_t pending_count_;
+  bool send_now_;
+  bool stopping_;
+  uint64_t dropped_;
+
+  // Only used by the sender thread.
+  std::string resource_;
+  std::string scope_;
+  std::string record_;
+  std::string records_;
+  std::string request_;
+  Attribute thread_attribute_;
+  Attribute request_attribute_;
+  std::FILE *file_;
+  int socket_;
+  bool reported_;
+
+  std::thread sender_;
+};
+
+#endif  // !OTLP_SINK_H
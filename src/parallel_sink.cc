@@ -0,0 +1,180 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#include <algorithm>
+#include <cstdio>
+
+#include <spdlog/pattern_formatter.h>
+
+#include "parallel_sink.h"
+#include "sink_helpers.h"
+
+namespace {
+
+const size_t kSlots = 4096;
+// Upper bound on the records a formatter claims at once. Larger runs mean
+// less locking, smaller ones keep the writer from waiting on a single thread.
+const uint64_t kMaxClaim = 32;
+
+}  // namespace
+
+ParallelFormatSink::ParallelFormatSink(
+    size_t threads, std::shared_ptr<spdlog::sinks::sink> inner)
+    : inner_(std::move(inner)),
+      slots_(kSlots),
+      formatter_(spdlog::details::make_unique<spdlog::pattern_formatter>()),
+      next_(0),
+      claimed_(0),
+      written_(0),
+      stopping_(false) {
+  inner_->set_formatter(spdlog::details::make_unique<PassthroughFormatter>());
+  for (Slot &slot : slots_) {
+    slot.done = false;
+  }
+  for (size_t i = 0; i < std::max<size_t>(threads, 1); ++i) {
+    formatters_.emplace_back(&ParallelFormatSink::FormatLoop, this);
+  }
+  writer_ = std::thread(&ParallelFormatSink::WriteLoop, this);
+}
+
+ParallelFormatSink::~ParallelFormatSink() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  work_.notify_all();
+  formatted_.notify_all();
+  for (std::thread &formatter : formatters_) {
+    formatter.join();
+  }
+  writer_.join();
+}
+
+void ParallelFormatSink::log(const spdlog::details::log_msg &msg) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  freed_.wait(lock, [this] { return next_ - written_ < slots_.size(); });
+  // Concurrent producers would share the slot at |next_|, so the record is
+  // copied under the lock, into buffers that are reused.
+  Slot &slot = slots_[next_ % slots_.size()];
+  slot.message.Assign(msg);
+  slot.formatter = formatter_;
+  ++next_;
+  lock.unlock();
+  work_.notify_one();
+}
+
+void ParallelFormatSink::flush() {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    const uint64_t target = next_;
+    freed_.wait(lock, [this, target] { return written_ >= target; });
+  }
+  inner_->flush();
+}
+
+void ParallelFormatSink::set_pattern(const std::string &pattern) {
+  set_formatter(spdlog::details::make_unique<spdlog::pattern_formatter>(pattern));
+}
+
+void ParallelFormatSink::set_formatter(
+    std::unique_ptr<spdlog::formatter> formatter) {
+  // Records already logged keep the formatter they were logged with.
+  std::shared_ptr<const spdlog::formatter> shared(std::move(formatter));
+  std::lock_guard<std::mutex> lock(mutex_);
+  formatter_ = std::move(shared);
+}
+
+void ParallelFormatSink::FormatLoop() {
+  // Formatters are not thread safe, every thread formats with its own clone.
+  std::shared_ptr<const spdlog::formatter> source;
+  std::unique_ptr<spdlog::formatter> formatter;
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    work_.wait(lock, [this] { return stopping_ || claimed_ < next_; });
+    if (claimed_ == next_) {
+      return;
+    }
+    const uint64_t pending = next_ - claimed_;
+    const uint64_t claim = std::min<uint64_t>(
+        kMaxClaim, std::max<uint64_t>(pending / formatters_.size(), 1));
+    const uint64_t begin = claimed_;
+    const uint64_t end = begin + claim;
+    claimed_ = end;
+    const bool more = claimed_ < next_;
+    lock.unlock();
+    if (more) {
+      work_.notify_one();
+    }
+
+    for (uint64_t sequence = begin; sequence < end; ++sequence) {
+      Slot &slot = slots_[sequence % slots_.size()];
+      slot.formatted.clear();
+      try {
+        if (slot.formatter != source) {
+          source = slot.formatter;
+          formatter = source->clone();
+        }
+        record::FormatForwarded(*formatter, slot.message.msg(),
+                                slot.formatted);
+      } catch (const std::exception &ex) {
+        ReportError(ex.what());
+      } catch (...) {
+        ReportError("Unknown error formatting log record");
+      }
+    }
+
+    lock.lock();
+    for (uint64_t sequence = begin; sequence < end; ++sequence) {
+      slots_[sequence % slots_.size()].done = true;
+    }
+    if (begin == written_) {
+      formatted_.notify_one();
+    }
+  }
+}
+
+void ParallelFormatSink::WriteLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    formatted_.wait(lock, [this] {
+      return (stopping_ && written_ == next_) ||
+             slots_[written_ % slots_.size()].done;
+    });
+    if (!slots_[written_ % slots_.size()].done) {
+      return;
+    }
+
+    // Everything formatted in order from |written_| can be written without
+    // holding the lock, no one else touches these slots until they are freed.
+    uint64_t end = written_;
+    while (end < next_ && slots_[end % slots_.size()].done) {
+      ++end;
+    }
+    lock.unlock();
+
+    for (uint64_t sequence = written_; sequence < end; ++sequence) {
+      const Slot &slot = slots_[sequence % slots_.size()];
+      spdlog::details::log_msg msg = slot.message.msg();
+      msg.payload = spdlog::string_view_t(slot.formatted.data(),
+                                          slot.formatted.size());
+      try {
+        inner_->log(msg);
+      } catch (const std::exception &ex) {
+        ReportError(ex.what());
+      } catch (...) {
+        ReportError("Unknown error writing log record");
+      }
+    }
+
+    lock.lock();
+    for (uint64_t sequence = written_; sequence < end; ++sequence) {
+      slots_[sequence % slots_.size()].done = false;
+    }
+    written_ = end;
+    freed_.notify_all();
+  }
+}
@@ -0,0 +1,69 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#ifndef PARALLEL_SINK_H
+#define PARALLEL_SINK_H
+
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/sink.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "record.h"
+
+// Formats records on several threads and writes them to |inner| from a
+// single writer thread in the order they were logged.
+//
+// Every record gets a sequence number and a slot in a fixed ring. Formatter
+// threads claim runs of records and format them into their slot with their
+// own copy of the formatter; the writer hands each finished slot to |inner|
+// as soon as all earlier ones were written. Logging blocks while the ring is
+// full, so memory stays bounded. |inner| only ever sees preformatted text.
+class ParallelFormatSink : public spdlog::sinks::sink {
+ public:
+  ParallelFormatSink(size_t threads, std::shared_ptr<spdlog::sinks::sink> inner);
+  ~ParallelFormatSink() override;
+
+  void log(const spdlog::details::log_msg &msg) override;
+  // Waits until everything logged so far was written, then flushes |inner|.
+  void flush() override;
+  void set_pattern(const std::string &pattern) override;
+  void set_formatter(std::unique_ptr<spdlog::formatter> formatter) override;
+
+ private:
+  struct Slot {
+    record::OwnedMessage message;
+    std::shared_ptr<const spdlog::formatter> formatter;
+    spdlog::memory_buf_t formatted;
+    bool done;
+  };
+
+  void FormatLoop();
+  void WriteLoop();
+
+  std::shared_ptr<spdlog::sinks::sink> inner_;
+  std::vector<Slot> slots_;
+
+  std::mutex mutex_;
+  std::condition_variable work_;
+  std::condition_variable formatted_;
+  std::condition_variable freed_;
+  std::shared_ptr<const spdlog::formatter> formatter_;
+  // Sequence numbers: records below |claimed_| are owned by a formatter,
+  // below |written_| are done and their slots free again.
+  uint64_t next_;
+  uint64_t claimed_;
+  uint64_t written_;
+  bool stopping_;
+
+  std::vector<std::thread> formatters_;
+  std::thread writer_;
+};
+
+#endif  // !PARALLEL_SINK_H
@@ -0,0 +1,243 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+#include "pinned.h"
+#include "sink_helpers.h"
+
+namespace {
+
+// How long a thread that exits waits for its pinned strings to be written.
+const std::chrono::seconds kCleanupTimeout(10);
+
+class ReleaseQueue;
+
+// Strings can only be let go of on the thread of their isolate.
+class PinnedString : public record::Pinned {
+ public:
+  PinnedString(v8::Local<v8::String> str, const char *data, size_t size,
+               ReleaseQueue *queue)
+      : record::Pinned(data, size), handle(str), queue_(queue) {}
+
+  bool Lock() override;
+  void Unlock() override;
+  void Release() override;
+
+  Nan::Persistent<v8::String> handle;
+
+ private:
+  ReleaseQueue *queue_;
+};
+
+// Hands strings released on other threads back to the thread that pinned
+// them, through a uv_async_t on its event loop. There is one queue per JS
+// thread. The bytes of a string die with its isolate, so when the
+// environment of the thread shuts down, for example on worker.terminate(),
+// the loggers are flushed and the queue waits until every record that refers
+// to one of its strings was written, or kCleanupTimeout passed.
+class ReleaseQueue {
+ public:
+  static ReleaseQueue *Current() {
+    if (current == NULL) {
+      current = new ReleaseQueue();
+    }
+    return current;
+  }
+
+  PinnedString *Pin(v8::Local<v8::String> str, const char *data, size_t size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++outstanding_;
+    return new PinnedString(str, data, size, this);
+  }
+
+  void Release(PinnedString *pinned) {
+    const bool owner = std::this_thread::get_id() == owner_;
+    bool last = false;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!closed_ && !owner) {
+        pending_.push_back(pinned);
+        uv_async_send(&async_);
+        released_.notify_all();
+        return;
+      }
+      if (!closed_) {
+        pinned->handle.Reset();
+      }
+      delete pinned;
+      last = --outstanding_ == 0 && handle_closed_;
+    }
+    if (last) {
+      delete this;
+    }
+  }
+
+  // Keeps the strings alive while a formatter reads one. Returns false if
+  // the thread exited before its strings were written.
+  bool LockStrings() {
+    reading_.lock_shared();
+    if (abandoned_) {
+      reading_.unlock_shared();
+      return false;
+    }
+    return true;
+  }
+
+  void UnlockStrings() { reading_.unlock_shared(); }
+
+ private:
+  ReleaseQueue()
+      : owner_(std::this_thread::get_id()),
+        outstanding_(0),
+        closed_(false),
+        handle_closed_(false),
+        abandoned_(false) {
+    uv_async_init(Nan::GetCurrentEventLoop(), &async_, OnAsync);
+    async_.data = this;
+    // Pending releases must not keep the process alive.
+    uv_unref(reinterpret_cast<uv_handle_t *>(&async_));
+    node::AddEnvironmentCleanupHook(v8::Isolate::GetCurrent(), OnCleanup,
+                                    this);
+  }
+
+  void Drain() {
+    std::vector<PinnedString *> pending;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      pending.swap(pending_);
+      outstanding_ -= pending.size();
+    }
+    for (PinnedString *pinned : pending) {
+      pinned->handle.Reset();
+      delete pinned;
+    }
+  }
+
+  static void OnAsync(uv_async_t *async) {
+    static_cast<ReleaseQueue *>(async->data)->Drain();
+  }
+
+  static void OnCleanup(void *arg) {
+    ReleaseQueue *queue = static_cast<ReleaseQueue *>(arg);
+    queue->Drain();
+    bool pending;
+    {
+      std::lock_guard<std::mutex> lock(queue->mutex_);
+      pending = queue->outstanding_ != 0;
+    }
+    if (pending) {
+      // Records can wait in the async queue, in staging rings or with the
+      // formatter threads. Flushing pushes them through, async loggers write
+      // them on their own thread after flush() returned.
+      spdlog::apply_all([](std::shared_ptr<spdlog::logger> logger) {
+        logger->flush();
+      });
+      bool written;
+      {
+        std::unique_lock<std::mutex> lock(queue->mutex_);
+        written = queue->released_.wait_for(lock, kCleanupTimeout, [queue] {
+          return queue->outstanding_ == queue->pending_.size();
+        });
+      }
+      if (!written) {
+        // A sink that is stuck must not hang the thread's exit. Records it
+        // still holds are written without their text, formatters that are
+        // reading one of the strings right now finish first.
+        std::lock_guard<std::shared_mutex> lock(queue->reading_);
+        queue->abandoned_ = true;
+        ReportError(
+            "Log records of an exiting thread were not written in time");
+      }
+    }
+    queue->Drain();
+    {
+      std::lock_guard<std::mutex> lock(queue->mutex_);
+      queue->closed_ = true;
+    }
+    current = NULL;
+    uv_close(reinterpret_cast<uv_handle_t *>(&queue->async_), OnClose);
+  }
+
+  static void OnClose(uv_handle_t *handle) {
+    ReleaseQueue *queue = static_cast<ReleaseQueue *>(handle->data);
+    bool last = false;
+    {
+      std::lock_guard<std::mutex> lock(queue->mutex_);
+      queue->handle_closed_ = true;
+      last = queue->outstanding_ == 0;
+    }
+    if (last) {
+      delete queue;
+    }
+  }
+
+  static thread_local ReleaseQueue *current;
+
+  const std::thread::id owner_;
+  std::mutex mutex_;
+  std::vector<PinnedString *> pending_;
+  // Signaled when a string is released on another thread.
+  std::condition_variable released_;
+  size_t outstanding_;
+  bool closed_;
+  bool handle_closed_;
+  // Held shared while a formatter reads a string, and exclusively to give
+  // up on the strings.
+  std::shared_mutex reading_;
+  bool abandoned_;
+  uv_async_t async_;
+};
+
+thread_local ReleaseQueue *ReleaseQueue::current = NULL;
+
+bool PinnedString::Lock() { return queue_->LockStrings(); }
+
+void PinnedString::Unlock() { queue_->UnlockStrings(); }
+
+void PinnedString::Release() { queue_->Release(this); }
+
+bool IsAscii(const char *data, size_t size) {
+  uint64_t bits = 0;
+  size_t i = 0;
+  for (; i + sizeof(bits) <= size; i += sizeof(bits)) {
+    uint64_t word;
+    std::memcpy(&word, data + i, sizeof(word));
+    bits |= word;
+  }
+  for (; i < size; ++i) {
+    bits |= static_cast<uint8_t>(data[i]);
+  }
+  return (bits & 0x8080808080808080ULL) == 0;
+}
+
+}  // namespace
+
+record::Pinned *Pin(v8::Local<v8::Value> value, size_t minSize) {
+  if (!value->IsString()) {
+    return NULL;
+  }
+  v8::Local<v8::String> str = value.As<v8::String>();
+  if (!str->IsExternalOneByte() ||
+      static_cast<size_t>(str->Length()) < minSize) {
+    return NULL;
+  }
+  // Latin-1 is only valid UTF-8 where it is ASCII. Checking is a fraction
+  // of the cost of transcoding.
+  const v8::String::ExternalOneByteStringResource *resource =
+      str->GetExternalOneByteStringResource();
+  if (!IsAscii(resource->data(), resource->length())) {
+    return NULL;
+  }
+  return ReleaseQueue::Current()->Pin(str, resource->data(),
+                                      resource->length());
+}
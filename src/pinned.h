@@ -0,0 +1,21 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#ifndef PINNED_H
+#define PINNED_H
+
+#include <nan.h>
+
+#include "record.h"
+
+// Pins the bytes of |value| so that a record can refer to them instead of
+// copying them. Works for external one-byte strings with ASCII content, such
+// as large strings decoded by Node from latin1, ascii, hex or base64, which
+// cannot change. Returns NULL for other values, Buffers included since they
+// can, and for strings shorter than |minSize| bytes.
+record::Pinned *Pin(v8::Local<v8::Value> value, size_t minSize);
+
+#endif  // !PINNED_H
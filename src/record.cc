@@ -0,0 +1,409 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "record.h"
+#include "serializer.h"
+
+namespace record {
+
+namespace {
+
+thread_local const View *current = NULL;
+
+// Pattern flags cannot be longer than one character, so the named flags are
+// mapped onto characters that never appear in a user pattern.
+const char kTraceIdFlag = '\x01';
+const char kSpanIdFlag = '\x02';
+const char kRequestIdFlag = '\x03';
+
+class ContextFlag : public spdlog::custom_flag_formatter {
+ public:
+  explicit ContextFlag(char flag) : flag_(flag) {}
+
+  void format(const spdlog::details::log_msg &, const std::tm &,
+              spdlog::memory_buf_t &dest) override {
+    const View *view = Current();
+    if (view == NULL || !view->has_context) {
+      return;
+    }
+    const Context &context = view->context;
+    if (flag_ == kTraceIdFlag && (context.fields & Context::kTraceId)) {
+      AppendHex(context.trace_id, sizeof(context.trace_id), dest);
+    } else if (flag_ == kSpanIdFlag && (context.fields & Context::kSpanId)) {
+      AppendHex(context.span_id, sizeof(context.span_id), dest);
+    } else if (flag_ == kRequestIdFlag &&
+               (context.fields & Context::kRequestId)) {
+      spdlog::details::fmt_helper::append_int(context.request_id, dest);
+    }
+  }
+
+  std::unique_ptr<spdlog::custom_flag_formatter> clone() const override {
+    return spdlog::details::make_unique<ContextFlag>(flag_);
+  }
+
+ private:
+  char flag_;
+};
+
+class JsonFormatter : public spdlog::formatter {
+ public:
+  JsonFormatter() : cached_seconds_(-1) {}
+
+  void format(const spdlog::details::log_msg &msg,
+              spdlog::memory_buf_t &dest) override {
+    using spdlog::details::fmt_helper::append_string_view;
+
+    // Formatting the date is the expensive part, so it is only redone when
+    // the second changes.
+    const auto sinceEpoch = msg.time.time_since_epoch();
+    const auto seconds =
+        std::chrono::duration_cast<std::chrono::seconds>(sinceEpoch);
+    if (seconds.count() != cached_seconds_) {
+      cached_seconds_ = seconds.count();
+      const std::tm tm = spdlog::details::os::gmtime(
+          spdlog::log_clock::to_time_t(msg.time));
+      cached_date_.clear();
+      spdlog::details::fmt_helper::append_int(tm.tm_year + 1900,
+                                              cached_date_);
+      cached_date_.push_back('-');
+      spdlog::details::fmt_helper::pad2(tm.tm_mon + 1, cached_date_);
+      cached_date_.push_back('-');
+      spdlog::details::fmt_helper::pad2(tm.tm_mday, cached_date_);
+      cached_date_.push_back('T');
+      spdlog::details::fmt_helper::pad2(tm.tm_hour, cached_date_);
+      cached_date_.push_back(':');
+      spdlog::details::fmt_helper::pad2(tm.tm_min, cached_date_);
+      cached_date_.push_back(':');
+      spdlog::details::fmt_helper::pad2(tm.tm_sec, cached_date_);
+      cached_date_.push_back('.');
+    }
+
+    append_string_view("{\"time\":\"", dest);
+    dest.append(cached_date_.data(), cached_date_.data() + cached_date_.size());
+    spdlog::details::fmt_helper::pad3(
+        static_cast<uint32_t>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(sinceEpoch)
+                .count() %
+            1000),
+        dest);
+    append_string_view("Z\",\"level\":\"", dest);
+    append_string_view(spdlog::level::to_string_view(msg.level), dest);
+    append_string_view("\",\"logger\":\"", dest);
+    size_t start = dest.size();
+    append_string_view(msg.logger_name, dest);
+    EscapeJson(start, dest);
+    append_string_view("\",\"message\":\"", dest);
+    start = dest.size();
+    append_string_view(msg.payload, dest);
+    EscapeJson(start, dest);
+    dest.push_back('"');
+
+    const View *view = Current();
+    if (view != NULL && view->has_context) {
+      const Context &context = view->context;
+      if (context.fields & Context::kTraceId) {
+        append_string_view(",\"trace_id\":\"", dest);
+        AppendHex(context.trace_id, sizeof(context.trace_id), dest);
+        dest.push_back('"');
+      }
+      if (context.fields & Context::kSpanId) {
+        append_string_view(",\"span_id\":\"", dest);
+        AppendHex(context.span_id, sizeof(context.span_id), dest);
+        dest.push_back('"');
+      }
+      if (context.fields & Context::kRequestId) {
+        append_string_view(",\"request_id\":", dest);
+        spdlog::details::fmt_helper::append_int(context.request_id, dest);
+      }
+    }
+    dest.push_back('}');
+    append_string_view(spdlog::details::os::default_eol, dest);
+  }
+
+  std::unique_ptr<spdlog::formatter> clone() const override {
+    return spdlog::details::make_unique<JsonFormatter>();
+  }
+
+ private:
+  int64_t cached_seconds_;
+  spdlog::memory_buf_t cached_date_;
+};
+
+}  // namespace
+
+void AppendHex(const uint8_t *bytes, size_t size, spdlog::memory_buf_t &dest) {
+  static const char hex[] = "0123456789abcdef";
+  for (size_t i = 0; i < size; ++i) {
+    dest.push_back(hex[bytes[i] >> 4]);
+    dest.push_back(hex[bytes[i] & 0xf]);
+  }
+}
+
+void AppendHeader(const Context *context, Pinned *pinned,
+                  spdlog::string_view_t key, spdlog::memory_buf_t &dest) {
+  uint8_t flags = kHeader;
+  if (context != NULL) {
+    flags |= kContext;
+  }
+  if (pinned != NULL) {
+    flags |= kPinned;
+  }
+  if (key.size() > 0) {
+    flags |= kKey;
+  }
+  dest.push_back(static_cast<char>(flags));
+  if (context != NULL) {
+    const char *bytes = reinterpret_cast<const char *>(context);
+    dest.append(bytes, bytes + sizeof(Context));
+  }
+  if (key.size() > 0) {
+    const size_t size = std::min(key.size(), kMaxKeySize);
+    dest.push_back(static_cast<char>(size));
+    dest.append(key.data(), key.data() + size);
+  }
+  if (pinned != NULL) {
+    const char *bytes = reinterpret_cast<const char *>(&pinned);
+    dest.append(bytes, bytes + sizeof(pinned));
+  }
+}
+
+void AppendHeader(const Context *context, Pinned *pinned,
+                  spdlog::memory_buf_t &dest) {
+  AppendHeader(context, pinned, spdlog::string_view_t(), dest);
+}
+
+size_t InsertStacks(size_t header, size_t text, const std::vector<Stack> &stacks,
+                    spdlog::memory_buf_t &dest) {
+  const size_t count = std::min(stacks.size(), kMaxStacks);
+  if (count == 0) {
+    return 0;
+  }
+  const size_t inserted = 1 + count * sizeof(Stack);
+  const size_t size = dest.size();
+  dest.resize(size + inserted);
+  char *data = dest.data();
+  std::memmove(data + text + inserted, data + text, size - text);
+  data[header] = static_cast<char>(static_cast<uint8_t>(data[header]) | kStacks);
+  data[text] = static_cast<char>(count);
+  std::memcpy(data + text + 1, stacks.data(), count * sizeof(Stack));
+  return inserted;
+}
+
+Stack StackAt(const View &view, size_t index) {
+  // The payload was copied into the queue without any alignment.
+  Stack stack;
+  std::memcpy(&stack, view.stacks + index * sizeof(Stack), sizeof(Stack));
+  return stack;
+}
+
+View Decode(spdlog::string_view_t payload) {
+  View view;
+  view.has_context = false;
+  view.pinned = NULL;
+  view.stacks = NULL;
+  view.stack_count = 0;
+  view.text = payload;
+  if (payload.size() == 0 ||
+      (static_cast<uint8_t>(payload[0]) & kHeaderMask) != kHeader) {
+    return view;
+  }
+
+  const uint8_t flags = static_cast<uint8_t>(payload[0]);
+  size_t offset = 1;
+  if (flags & kContext) {
+    if (payload.size() < offset + sizeof(Context)) {
+      return view;
+    }
+    // The payload was copied into the queue without any alignment.
+    std::memcpy(&view.context, payload.data() + offset, sizeof(Context));
+    view.has_context = true;
+    offset += sizeof(Context);
+  }
+  if (flags & kKey) {
+    if (payload.size() < offset + 1 ||
+        payload.size() < offset + 1 + static_cast<uint8_t>(payload[offset])) {
+      return view;
+    }
+    const size_t size = static_cast<uint8_t>(payload[offset]);
+    view.key = spdlog::string_view_t(payload.data() + offset + 1, size);
+    offset += 1 + size;
+  }
+  if (flags & kPinned) {
+    if (payload.size() < offset + sizeof(Pinned *)) {
+      return view;
+    }
+    std::memcpy(&view.pinned, payload.data() + offset, sizeof(Pinned *));
+    offset += sizeof(Pinned *);
+  }
+  if (flags & kStacks) {
+    if (payload.size() < offset + 1 ||
+        payload.size() < offset + 1 + static_cast<uint8_t>(payload[offset]) *
+                                          sizeof(Stack)) {
+      view.pinned = NULL;
+      return view;
+    }
+    view.stack_count = static_cast<uint8_t>(payload[offset]);
+    view.stacks = payload.data() + offset + 1;
+    offset += 1 + view.stack_count * sizeof(Stack);
+  }
+  view.text =
+      spdlog::string_view_t(payload.data() + offset, payload.size() - offset);
+  return view;
+}
+
+bool LocateStacks(const View &view, spdlog::string_view_t formatted,
+                  std::vector<Stack> *stacks) {
+  if (view.stack_count == 0) {
+    return true;
+  }
+  // Formatters write the text once and patterns rarely put much in front of
+  // it, so the search ends early.
+  const char *end = formatted.data() + formatted.size();
+  const char *found = std::search(formatted.data(), end, view.text.data(),
+                                  view.text.data() + view.text.size());
+  if (found == end && view.text.size() != 0) {
+    return false;
+  }
+  const size_t offset = static_cast<size_t>(found - formatted.data());
+  for (size_t i = 0; i < view.stack_count; ++i) {
+    Stack stack = StackAt(view, i);
+    if (stack.begin > stack.end || stack.end > view.text.size() ||
+        offset + stack.end > UINT32_MAX) {
+      continue;
+    }
+    stack.begin += static_cast<uint32_t>(offset);
+    stack.end += static_cast<uint32_t>(offset);
+    stacks->push_back(stack);
+  }
+  return true;
+}
+
+size_t FormatForwarded(spdlog::formatter &formatter,
+                       const spdlog::details::log_msg &msg,
+                       spdlog::memory_buf_t &dest) {
+  // The header is decoded before the formatter releases pinned text.
+  const View view = Decode(msg.payload);
+  const size_t header = dest.size();
+  if (view.has_context || view.stack_count != 0) {
+    AppendHeader(view.has_context ? &view.context : NULL, NULL, dest);
+  }
+  const size_t start = dest.size();
+  formatter.format(msg, dest);
+  if (view.stack_count == 0) {
+    return start;
+  }
+  std::vector<Stack> stacks;
+  LocateStacks(view,
+               spdlog::string_view_t(dest.data() + start, dest.size() - start),
+               &stacks);
+  return start + InsertStacks(header, start, stacks, dest);
+}
+
+const View *Current() { return current; }
+
+void OwnedMessage::Assign(const spdlog::details::log_msg &msg) {
+  text_.clear();
+  text_.append(msg.logger_name.begin(), msg.logger_name.end());
+  text_.append(msg.payload.begin(), msg.payload.end());
+  msg_ = msg;
+  msg_.logger_name =
+      spdlog::string_view_t(text_.data(), msg.logger_name.size());
+  msg_.payload = spdlog::string_view_t(text_.data() + msg.logger_name.size(),
+                                       msg.payload.size());
+}
+
+RecordFormatter::RecordFormatter(std::unique_ptr<spdlog::formatter> inner)
+    : inner_(std::move(inner)) {}
+
+void RecordFormatter::format(const spdlog::details::log_msg &msg,
+                             spdlog::memory_buf_t &dest) {
+  const View view = Decode(msg.payload);
+  spdlog::details::log_msg text = msg;
+  text.payload = view.text;
+
+  // Pinned text is handed to the formatter as is. Only a child logger's
+  // prefix in front of it makes a copy necessary.
+  spdlog::memory_buf_t joined;
+  const bool locked = view.pinned != NULL && view.pinned->Lock();
+  if (locked) {
+    if (view.text.size() == 0) {
+      text.payload = view.pinned->text();
+    } else {
+      joined.append(view.text.begin(), view.text.end());
+      joined.append(view.pinned->text().begin(), view.pinned->text().end());
+      text.payload = spdlog::string_view_t(joined.data(), joined.size());
+    }
+  }
+
+  const View *outer = current;
+  current = &view;
+  try {
+    inner_->format(text, dest);
+  } catch (...) {
+    current = outer;
+    if (locked) {
+      view.pinned->Unlock();
+    }
+    if (view.pinned != NULL) {
+      view.pinned->Release();
+    }
+    throw;
+  }
+  current = outer;
+  if (locked) {
+    view.pinned->Unlock();
+  }
+  if (view.pinned != NULL) {
+    view.pinned->Release();
+  }
+}
+
+std::unique_ptr<spdlog::formatter> RecordFormatter::clone() const {
+  return spdlog::details::make_unique<RecordFormatter>(inner_->clone());
+}
+
+std::unique_ptr<spdlog::formatter> MakePatternFormatter(
+    const std::string &pattern) {
+  static const struct {
+    const char *name;
+    char flag;
+  } names[] = {{"%{trace_id}", kTraceIdFlag},
+               {"%{span_id}", kSpanIdFlag},
+               {"%{request_id}", kRequestIdFlag}};
+
+  std::string translated = pattern;
+  for (const auto &name : names) {
+    const size_t length = std::strlen(name.name);
+    for (size_t at = translated.find(name.name); at != std::string::npos;
+         at = translated.find(name.name, at + 2)) {
+      translated.replace(at, length, std::string{'%', name.flag});
+    }
+  }
+
+  spdlog::pattern_formatter::custom_flags flags;
+  for (const auto &name : names) {
+    flags[name.flag] = spdlog::details::make_unique<ContextFlag>(name.flag);
+  }
+  return spdlog::details::make_unique<RecordFormatter>(
+      spdlog::details::make_unique<spdlog::pattern_formatter>(
+          translated, spdlog::pattern_time_type::local,
+          spdlog::details::os::default_eol, std::move(flags)));
+}
+
+std::unique_ptr<spdlog::formatter> MakePatternFormatter() {
+  return MakePatternFormatter("%+");
+}
+
+std::unique_ptr<spdlog::formatter> MakeJsonFormatter() {
+  return spdlog::details::make_unique<RecordFormatter>(
+      spdlog::details::make_unique<JsonFormatter>());
+}
+
+}  // namespace record
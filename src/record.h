@@ -0,0 +1,185 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <spdlog/spdlog.h>
+#include <spdlog/pattern_formatter.h>
+
+#include <vector>
+
+// Every payload that Logger hands to spdlog starts with a one byte header
+// whose flags say which metadata follows before the message text. The
+// metadata travels through the async queue with the payload and is decoded
+// again by RecordFormatter on the thread that writes the record.
+//
+// The header byte is a UTF-8 continuation byte, which no formatted record
+// starts with, so sinks that get records another sink already formatted
+// see them as plain text, behind a header with nothing but their context.
+namespace record {
+
+enum Flags : uint8_t {
+  kContext = 1,
+  kPinned = 2,
+  kKey = 4,
+  kStacks = 8,
+  // Set in every header, with the bit above it clear.
+  kHeader = 0x80,
+  kHeaderMask = 0xc0,
+};
+
+// Longest routing key a record can carry, see KeyedFileSink.
+const size_t kMaxKeySize = 128;
+
+// Compact async context of a record, see LogContext.
+struct Context {
+  enum Fields : uint8_t {
+    kRequestId = 1,
+    kTraceId = 2,
+    kSpanId = 4,
+  };
+
+  uint8_t fields;
+  uint8_t trace_id[16];
+  uint8_t span_id[8];
+  uint64_t request_id;
+};
+
+// A stack trace in the message text that a DedupingFileSink may write
+// without its frames. The frames are the bytes [begin, end) of the text, from
+// the line break before the first one to the line break of the stack id line
+// that follows them.
+struct Stack {
+  uint32_t begin;
+  uint32_t end;
+  uint64_t id;
+};
+
+// Most stacks a header carries, the stacks after them are written in full.
+const size_t kMaxStacks = 255;
+
+// Message text that is not copied into the payload. The payload carries a
+// pointer to it and the bytes stay owned by the JS value they came from,
+// until the formatter that wrote them calls Release(), on whatever thread
+// that happens to be.
+class Pinned {
+ public:
+  Pinned(const char *data, size_t size) : data_(data), size_(size) {}
+  virtual ~Pinned() {}
+
+  spdlog::string_view_t text() const {
+    return spdlog::string_view_t(data_, size_);
+  }
+  // Keeps the bytes from going away until Unlock(), text() must only be read
+  // in between. Returns false, without locking, if they are already gone
+  // because the thread that pinned them exited. The text is then left out.
+  virtual bool Lock() { return true; }
+  virtual void Unlock() {}
+  virtual void Release() = 0;
+
+ private:
+  const char *data_;
+  size_t size_;
+};
+
+struct View {
+  bool has_context;
+  Context context;
+  // Empty unless the record is routed by a key.
+  spdlog::string_view_t key;
+  // Follows |text| when set.
+  Pinned *pinned;
+  // Raw Stack entries, see StackAt().
+  const char *stacks;
+  size_t stack_count;
+  spdlog::string_view_t text;
+};
+
+// Returns the |index|th stack of |view|.
+Stack StackAt(const View &view, size_t index);
+
+// Appends |bytes| to |dest| as lowercase hex, as trace and span ids are
+// written.
+void AppendHex(const uint8_t *bytes, size_t size, spdlog::memory_buf_t &dest);
+
+// Starts a payload in |dest|, with |context| and |pinned| if they are not
+// NULL and |key| if it is not empty. The payload then owns |pinned|.
+void AppendHeader(const Context *context, Pinned *pinned,
+                  spdlog::string_view_t key, spdlog::memory_buf_t &dest);
+void AppendHeader(const Context *context, Pinned *pinned,
+                  spdlog::memory_buf_t &dest);
+
+// Adds |stacks| to the header that starts at |header| in |dest|, in front of
+// the text that starts at |text|. Their offsets are relative to the text.
+// Returns the number of bytes inserted.
+size_t InsertStacks(size_t header, size_t text, const std::vector<Stack> &stacks,
+                    spdlog::memory_buf_t &dest);
+
+// Splits |payload| into its metadata and message text. Payloads without a
+// valid header are returned unchanged as text.
+View Decode(spdlog::string_view_t payload);
+
+// Finds the text of |view| in |formatted|, the record it is part of, and
+// appends the stacks of |view| with their offsets moved there to |stacks|.
+// Returns false, appending nothing, if the formatter changed the text.
+bool LocateStacks(const View &view, spdlog::string_view_t formatted,
+                  std::vector<Stack> *stacks);
+
+// Formats |msg| with |formatter| into |dest| for a sink that hands the
+// formatted record on to another sink. The async context and stacks of |msg|
+// are kept in a header in front of the text, so that inner sinks exporting
+// or deduplicating them still find them, and PassthroughFormatter leaves it
+// out again. Returns the offset of the text in |dest|.
+size_t FormatForwarded(spdlog::formatter &formatter,
+                       const spdlog::details::log_msg &msg,
+                       spdlog::memory_buf_t &dest);
+
+// The record being formatted on the current thread, NULL outside of
+// RecordFormatter::format. Lets custom pattern flags see the metadata.
+const View *Current();
+
+// A log_msg that owns its logger name and payload. Unlike spdlog's
+// log_msg_buffer it can be reassigned from a plain log_msg, reusing its
+// storage, which suits the fixed slots of the queues in front of a sink.
+class OwnedMessage {
+ public:
+  void Assign(const spdlog::details::log_msg &msg);
+  const spdlog::details::log_msg &msg() const { return msg_; }
+
+ private:
+  spdlog::details::log_msg msg_;
+  spdlog::memory_buf_t text_;
+};
+
+// Decodes the record header and formats the message text with |inner|.
+// Pinned text is released once formatted, so every record must be formatted
+// exactly once, which holds as long as sinks do not filter by level.
+class RecordFormatter : public spdlog::formatter {
+ public:
+  explicit RecordFormatter(std::unique_ptr<spdlog::formatter> inner);
+
+  void format(const spdlog::details::log_msg &msg,
+              spdlog::memory_buf_t &dest) override;
+  std::unique_ptr<spdlog::formatter> clone() const override;
+
+ private:
+  std::unique_ptr<spdlog::formatter> inner_;
+};
+
+// Creates a pattern formatter that also understands %{trace_id}, %{span_id}
+// and %{request_id}, wrapped in a RecordFormatter.
+std::unique_ptr<spdlog::formatter> MakePatternFormatter(
+    const std::string &pattern);
+std::unique_ptr<spdlog::formatter> MakePatternFormatter();
+
+// Writes one JSON object per record with time, level, logger name, message
+// and any async context, wrapped in a RecordFormatter.
+std::unique_ptr<spdlog::formatter> MakeJsonFormatter();
+
+}  // namespace record
+
+#endif  // !RECORD_H
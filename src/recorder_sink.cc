@@ -0,0 +1,223 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#include <cstring>
+
+#include "recorder_sink.h"
+#include "sink_helpers.h"
+
+namespace {
+
+// zlib's window bits plus 16 selects the gzip format, plus 32 on inflate
+// detects gzip or zlib.
+const int kGzipWindowBits = 15 + 16;
+const int kDetectWindowBits = 15 + 32;
+
+// Appends the inflated contents of the gzip members in |data| to |out|.
+void Inflate(const char *data, size_t size, std::string &out) {
+  z_stream stream;
+  std::memset(&stream, 0, sizeof(stream));
+  if (inflateInit2(&stream, kDetectWindowBits) != Z_OK) {
+    return;
+  }
+  stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+  stream.avail_in = static_cast<uInt>(size);
+  char buffer[16 * 1024];
+  int status = Z_OK;
+  while (status == Z_OK) {
+    stream.next_out = reinterpret_cast<Bytef *>(buffer);
+    stream.avail_out = sizeof(buffer);
+    status = inflate(&stream, Z_NO_FLUSH);
+    out.append(buffer, sizeof(buffer) - stream.avail_out);
+  }
+  inflateEnd(&stream);
+}
+
+void InitRegion(emergency::Region &region, const char *label,
+                const char *data, size_t capacity) {
+  region.label = label;
+  region.data = data;
+  region.capacity = capacity;
+  region.start.store(0, std::memory_order_relaxed);
+  region.size.store(0, std::memory_order_relaxed);
+  emergency::Register(&region);
+}
+
+}  // namespace
+
+FlightRecorderSink::FlightRecorderSink(
+    std::shared_ptr<spdlog::sinks::sink> inner, size_t memoryBudget,
+    size_t chunkSize, spdlog::level::level_enum recordLevel)
+    : inner_(std::move(inner)),
+      forward_level_(spdlog::level::trace),
+      record_level_(recordLevel),
+      memory_budget_(memoryBudget),
+      chunk_size_(chunkSize),
+      open_(new char[chunkSize]),
+      // The open chunk counts against the budget too.
+      history_capacity_(memoryBudget > chunkSize ? memoryBudget - chunkSize
+                                                 : 0),
+      history_(new char[history_capacity_]),
+      older_start_(0),
+      older_end_(0),
+      newer_end_(0),
+      wrapped_(false) {
+  inner_->set_formatter(spdlog::details::make_unique<PassthroughFormatter>());
+  // Registered in the order they are dumped, oldest records first.
+  InitRegion(older_region_, "flight recorder, older sealed chunks, gzip",
+             history_.get(), history_capacity_);
+  InitRegion(newer_region_, "flight recorder, newer sealed chunks, gzip",
+             history_.get(), history_capacity_);
+  InitRegion(open_region_, "flight recorder", open_.get(), chunkSize);
+  std::memset(&deflate_, 0, sizeof(deflate_));
+  // Fastest level: log text compresses well enough with it and sealing runs
+  // on the thread that writes the records.
+  deflateInit2(&deflate_, Z_BEST_SPEED, Z_DEFLATED, kGzipWindowBits, 8,
+               Z_DEFAULT_STRATEGY);
+}
+
+FlightRecorderSink::~FlightRecorderSink() {
+  emergency::Unregister(&open_region_);
+  emergency::Unregister(&newer_region_);
+  emergency::Unregister(&older_region_);
+  deflateEnd(&deflate_);
+}
+
+void FlightRecorderSink::sink_it_(const spdlog::details::log_msg &msg) {
+  formatted_.clear();
+  const size_t start = record::FormatForwarded(*formatter_, msg, formatted_);
+  if (msg.level >= record_level_) {
+    // The recorder keeps the text alone.
+    const char *text = formatted_.data() + start;
+    const size_t textSize = formatted_.size() - start;
+    size_t size = open_region_.size.load(std::memory_order_relaxed);
+    if (size + textSize > chunk_size_) {
+      Seal(open_.get(), size);
+      size = 0;
+    }
+    if (textSize >= chunk_size_) {
+      Seal(text, textSize);
+    } else {
+      std::memcpy(open_.get() + size, text, textSize);
+      open_region_.size.store(size + textSize, std::memory_order_release);
+    }
+  }
+
+  if (inner_ && msg.level >= forward_level_.load(std::memory_order_relaxed)) {
+    spdlog::details::log_msg formatted = msg;
+    formatted.payload =
+        spdlog::string_view_t(formatted_.data(), formatted_.size());
+    inner_->log(formatted);
+  }
+}
+
+void FlightRecorderSink::flush_() {
+  if (inner_) {
+    inner_->flush();
+  }
+}
+
+void FlightRecorderSink::Detach() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (inner_) {
+    inner_->flush();
+    inner_.reset();
+  }
+}
+
+std::string FlightRecorderSink::Snapshot() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::string text;
+  for (const Chunk &chunk : sealed_) {
+    Inflate(history_.get() + chunk.offset, chunk.size, text);
+  }
+  text.append(open_.get(), open_region_.size.load(std::memory_order_relaxed));
+  return text;
+}
+
+std::vector<std::string> FlightRecorderSink::CompressedSnapshot() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<std::string> chunks;
+  chunks.reserve(sealed_.size() + 1);
+  for (const Chunk &chunk : sealed_) {
+    chunks.emplace_back(history_.get() + chunk.offset, chunk.size);
+  }
+  const size_t size = open_region_.size.load(std::memory_order_relaxed);
+  if (size > 0) {
+    chunks.emplace_back();
+    Compress(open_.get(), size, chunks.back());
+  }
+  return chunks;
+}
+
+void FlightRecorderSink::Seal(const char *data, size_t size) {
+  if (size > 0 && history_capacity_ > 0) {
+    Compress(data, size, compressed_);
+    if (compressed_.size() > history_capacity_) {
+      // Keeping older chunks would leave a gap in the history.
+      sealed_.clear();
+      older_start_ = older_end_ = newer_end_ = 0;
+      wrapped_ = false;
+      PublishHistory();
+    } else {
+      const size_t offset = Place(compressed_.size());
+      // The bytes are overwritten only after the dropped chunks are no
+      // longer published.
+      PublishHistory();
+      std::memcpy(history_.get() + offset, compressed_.data(),
+                  compressed_.size());
+      (wrapped_ ? newer_end_ : older_end_) += compressed_.size();
+      sealed_.push_back({offset, compressed_.size()});
+      PublishHistory();
+    }
+  }
+  if (data == open_.get()) {
+    open_region_.size.store(0, std::memory_order_release);
+  }
+}
+
+size_t FlightRecorderSink::Place(size_t size) {
+  for (;;) {
+    if (!wrapped_) {
+      if (older_end_ + size <= history_capacity_) {
+        return older_end_;
+      }
+      wrapped_ = true;
+      newer_end_ = 0;
+    }
+    while (older_start_ < older_end_ && newer_end_ + size > older_start_) {
+      older_start_ += sealed_.front().size;
+      sealed_.pop_front();
+    }
+    if (older_start_ < older_end_) {
+      return newer_end_;
+    }
+    // The older part is gone, the newer one takes its place.
+    older_start_ = 0;
+    older_end_ = newer_end_;
+    newer_end_ = 0;
+    wrapped_ = false;
+  }
+}
+
+void FlightRecorderSink::PublishHistory() {
+  older_region_.start.store(older_start_, std::memory_order_release);
+  older_region_.size.store(older_end_ - older_start_,
+                           std::memory_order_release);
+  newer_region_.size.store(newer_end_, std::memory_order_release);
+}
+
+void FlightRecorderSink::Compress(const char *data, size_t size,
+                                  std::string &out) {
+  deflateReset(&deflate_);
+  out.resize(deflateBound(&deflate_, static_cast<uLong>(size)));
+  deflate_.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+  deflate_.avail_in = static_cast<uInt>(size);
+  deflate_.next_out = reinterpret_cast<Bytef *>(&out[0]);
+  deflate_.avail_out = static_cast<uInt>(out.size());
+  deflate(&deflate_, Z_FINISH);
+  out.resize(out.size() - deflate_.avail_out);
+}
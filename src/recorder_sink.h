@@ -0,0 +1,108 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#ifndef RECORDER_SINK_H
+#define RECORDER_SINK_H
+
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/base_sink.h>
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+#include "emergency.h"
+
+// Keeps the most recent formatted records in memory, in front of |inner|.
+//
+// Records are appended to an open chunk. Once it holds |chunkSize| bytes the
+// chunk is sealed: gzip compressed on the thread that writes the records and
+// copied into a history ring that takes the rest of |memoryBudget|, where
+// the oldest chunks are overwritten. Each sealed chunk is a complete gzip
+// member, so any run of them concatenated is a valid gzip file. A record
+// larger than a chunk is sealed on its own.
+//
+// Neither the open chunk nor the ring ever moves, both are registered for
+// the emergency dump once. The ring is dumped as its older and its newer
+// part, each a run of gzip members, followed by the open chunk as text.
+//
+// The recorder can keep records below the level that reaches |inner|: the
+// logger level is lowered to |recordLevel| and |inner| only gets records
+// from the forward level on. Every record is still formatted exactly once.
+class FlightRecorderSink : public spdlog::sinks::base_sink<std::mutex> {
+ public:
+  FlightRecorderSink(std::shared_ptr<spdlog::sinks::sink> inner,
+                     size_t memoryBudget, size_t chunkSize,
+                     spdlog::level::level_enum recordLevel);
+  ~FlightRecorderSink() override;
+
+  void SetForwardLevel(spdlog::level::level_enum level) {
+    forward_level_.store(level, std::memory_order_relaxed);
+  }
+  spdlog::level::level_enum ForwardLevel() const {
+    return forward_level_.load(std::memory_order_relaxed);
+  }
+  spdlog::level::level_enum RecordLevel() const { return record_level_; }
+
+  // Flushes and lets go of |inner| once no more records can arrive, which
+  // closes the file while the history stays available.
+  void Detach();
+
+  // Returns all records held, oldest first, as text.
+  std::string Snapshot();
+  // Returns the held records as gzip members, the open chunk compressed on
+  // the fly as the last one.
+  std::vector<std::string> CompressedSnapshot();
+
+ protected:
+  void sink_it_(const spdlog::details::log_msg &msg) override;
+  void flush_() override;
+
+ private:
+  struct Chunk {
+    size_t offset;
+    size_t size;
+  };
+
+  void Seal(const char *data, size_t size);
+  // Drops the oldest chunks until |size| bytes fit behind the newest one and
+  // returns where they go.
+  size_t Place(size_t size);
+  void PublishHistory();
+  void Compress(const char *data, size_t size, std::string &out);
+
+  std::shared_ptr<spdlog::sinks::sink> inner_;
+  std::atomic<spdlog::level::level_enum> forward_level_;
+  const spdlog::level::level_enum record_level_;
+  const size_t memory_budget_;
+  const size_t chunk_size_;
+
+  spdlog::memory_buf_t formatted_;
+  std::unique_ptr<char[]> open_;
+  emergency::Region open_region_;
+
+  // The ring holds the older part [older_start_, older_end_) and, once it
+  // wrapped, the newer part [0, newer_end_) in front of it.
+  const size_t history_capacity_;
+  std::unique_ptr<char[]> history_;
+  emergency::Region older_region_;
+  emergency::Region newer_region_;
+  std::deque<Chunk> sealed_;
+  size_t older_start_;
+  size_t older_end_;
+  size_t newer_end_;
+  bool wrapped_;
+  std::string compressed_;
+
+  // Reused for every chunk, initializing zlib is not free.
+  z_stream deflate_;
+};
+
+#endif  // !RECORDER_SINK_H
@@ -0,0 +1,366 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+
+#include <spdlog/pattern_formatter.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define REDACTION_SSE2
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "record.h"
+#include "redaction_sink.h"
+
+namespace {
+
+bool IsAlnum(uint8_t c) {
+  return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+         (c >= 'A' && c <= 'Z');
+}
+
+bool IsLocalPart(uint8_t c) {
+  return IsAlnum(c) || c == '.' || c == '_' || c == '%' || c == '+' ||
+         c == '-';
+}
+
+bool IsDomain(uint8_t c) { return IsAlnum(c) || c == '.' || c == '-'; }
+
+// Characters of RFC 6750 bearer tokens.
+bool IsToken(uint8_t c) {
+  return IsAlnum(c) || c == '-' || c == '.' || c == '_' || c == '~' ||
+         c == '+' || c == '/' || c == '=';
+}
+
+#if defined(REDACTION_SSE2)
+unsigned LowestBit(unsigned mask) {
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return static_cast<unsigned>(index);
+#else
+  return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+#endif
+
+// Redacts the message text of each record, then formats it with |inner|.
+class RedactingFormatter : public spdlog::formatter {
+ public:
+  RedactingFormatter(std::unique_ptr<spdlog::formatter> inner,
+                     std::shared_ptr<const Redactor> redactor)
+      : inner_(std::move(inner)), redactor_(std::move(redactor)) {}
+
+  void format(const spdlog::details::log_msg &msg,
+              spdlog::memory_buf_t &dest) override {
+    const record::View view = record::Decode(msg.payload);
+    spdlog::string_view_t text = view.text;
+    joined_.clear();
+    const bool locked = view.pinned != NULL && view.pinned->Lock();
+    if (locked) {
+      if (view.text.size() == 0) {
+        text = view.pinned->text();
+      } else {
+        joined_.append(view.text.begin(), view.text.end());
+        joined_.append(view.pinned->text().begin(), view.pinned->text().end());
+        text = spdlog::string_view_t(joined_.data(), joined_.size());
+      }
+    }
+
+    redacted_.clear();
+    record::AppendHeader(view.has_context ? &view.context : NULL, NULL,
+                         redacted_);
+    const bool redacted = redactor_->Redact(text, redacted_);
+    // The formatter below locks the pinned text again itself.
+    if (locked) {
+      view.pinned->Unlock();
+    }
+    if (!redacted) {
+      inner_->format(msg, dest);
+      return;
+    }
+    // The redacted copy replaces the pinned text, which is done with.
+    if (view.pinned != NULL) {
+      view.pinned->Release();
+    }
+    spdlog::details::log_msg copy = msg;
+    copy.payload = spdlog::string_view_t(redacted_.data(), redacted_.size());
+    inner_->format(copy, dest);
+  }
+
+  std::unique_ptr<spdlog::formatter> clone() const override {
+    return spdlog::details::make_unique<RedactingFormatter>(inner_->clone(),
+                                                            redactor_);
+  }
+
+ private:
+  std::unique_ptr<spdlog::formatter> inner_;
+  std::shared_ptr<const Redactor> redactor_;
+  spdlog::memory_buf_t joined_;
+  spdlog::memory_buf_t redacted_;
+};
+
+}  // namespace
+
+const uint32_t Redactor::kNone;
+const size_t Redactor::kMaxSkipBytes;
+
+Redactor::Redactor(const Options &options)
+    : replacement_(options.replacement), class_count_(1), skip_byte_count_(0) {
+  std::vector<std::pair<std::string, uint8_t>> patterns;
+  for (const std::string &literal : options.literals) {
+    if (!literal.empty()) {
+      patterns.emplace_back(literal, 0);
+    }
+  }
+  if (options.emails) {
+    patterns.emplace_back("@", kEmail);
+  }
+  if (options.bearer_tokens) {
+    patterns.emplace_back("Bearer ", kBearer);
+    patterns.emplace_back("bearer ", kBearer);
+    patterns.emplace_back("BEARER ", kBearer);
+  }
+
+  // Bytes that occur in no pattern all share class 0.
+  std::memset(classes_, 0, sizeof(classes_));
+  for (const auto &pattern : patterns) {
+    for (unsigned char c : pattern.first) {
+      if (classes_[c] == 0) {
+        classes_[c] = static_cast<uint16_t>(class_count_++);
+      }
+    }
+  }
+
+  AddState();
+  for (const auto &pattern : patterns) {
+    Add(pattern.first, pattern.second);
+  }
+  Build();
+}
+
+uint32_t Redactor::AddState() {
+  const uint32_t state = static_cast<uint32_t>(depth_.size());
+  next_.resize(next_.size() + class_count_, kNone);
+  depth_.push_back(0);
+  length_.push_back(0);
+  terminal_.push_back(false);
+  kinds_.push_back(0);
+  return state;
+}
+
+void Redactor::Add(const std::string &pattern, uint8_t kind) {
+  uint32_t state = 0;
+  for (unsigned char c : pattern) {
+    const size_t edge = state * class_count_ + classes_[c];
+    if (next_[edge] == kNone) {
+      const uint32_t added = AddState();
+      depth_[added] = depth_[state] + 1;
+      next_[edge] = added;
+    }
+    state = next_[edge];
+  }
+  if (kind != 0) {
+    kinds_[state] |= kind;
+  } else {
+    length_[state] = depth_[state];
+    terminal_[state] = true;
+  }
+}
+
+void Redactor::Build() {
+  // Breadth first, so the failure state of every state is done before it.
+  std::vector<uint32_t> failure(depth_.size(), 0);
+  std::deque<uint32_t> queue;
+  for (size_t c = 0; c < class_count_; ++c) {
+    if (next_[c] == kNone) {
+      next_[c] = 0;
+    } else {
+      queue.push_back(next_[c]);
+    }
+  }
+  while (!queue.empty()) {
+    const uint32_t state = queue.front();
+    queue.pop_front();
+    for (size_t c = 0; c < class_count_; ++c) {
+      uint32_t &edge = next_[state * class_count_ + c];
+      const uint32_t fallback = next_[failure[state] * class_count_ + c];
+      if (edge == kNone) {
+        edge = fallback;
+        continue;
+      }
+      failure[edge] = fallback;
+      length_[edge] = std::max(length_[edge], length_[fallback]);
+      kinds_[edge] |= kinds_[fallback];
+      queue.push_back(edge);
+    }
+  }
+
+  size_t starts = 0;
+  for (size_t c = 0; c < 256; ++c) {
+    starts_[c] = next_[classes_[c]] != 0;
+    if (starts_[c]) {
+      if (starts < kMaxSkipBytes) {
+        skip_bytes_[starts] = static_cast<uint8_t>(c);
+      }
+      ++starts;
+    }
+  }
+  skip_byte_count_ = starts <= kMaxSkipBytes ? starts : 0;
+}
+
+const uint8_t *Redactor::Skip(const uint8_t *p, const uint8_t *end) const {
+#if defined(REDACTION_SSE2)
+  if (skip_byte_count_ > 0) {
+    __m128i needles[kMaxSkipBytes];
+    for (size_t i = 0; i < skip_byte_count_; ++i) {
+      needles[i] = _mm_set1_epi8(static_cast<char>(skip_bytes_[i]));
+    }
+    while (end - p >= 16) {
+      const __m128i block =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+      __m128i hits = _mm_cmpeq_epi8(block, needles[0]);
+      for (size_t i = 1; i < skip_byte_count_; ++i) {
+        hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, needles[i]));
+      }
+      const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(hits));
+      if (mask != 0) {
+        return p + LowestBit(mask);
+      }
+      p += 16;
+    }
+  }
+#endif
+  while (p < end && !starts_[*p]) {
+    ++p;
+  }
+  return p;
+}
+
+bool Redactor::Redact(spdlog::string_view_t text,
+                      spdlog::memory_buf_t &dest) const {
+  const uint8_t *begin = reinterpret_cast<const uint8_t *>(text.data());
+  const uint8_t *end = begin + text.size();
+  const size_t size = text.size();
+  size_t copied = 0;
+  bool matched = false;
+  uint32_t state = 0;
+
+  for (const uint8_t *p = begin; p < end;) {
+    if (state == 0) {
+      p = Skip(p, end);
+      if (p == end) {
+        break;
+      }
+    }
+    state = next_[state * class_count_ + classes_[*p]];
+    ++p;
+    if (length_[state] == 0 && kinds_[state] == 0) {
+      continue;
+    }
+
+    // Everything found here is one span around |at|.
+    const size_t at = static_cast<size_t>(p - begin);
+    size_t start = at;
+    size_t stop = at;
+    bool found = false;
+    if (length_[state] != 0) {
+      start = at - length_[state];
+      found = true;
+      // A longer literal may go on from here, follow the trie as long as it
+      // keeps going deeper.
+      uint32_t deeper = state;
+      for (const uint8_t *q = p; q < end; ++q) {
+        const uint32_t step = next_[deeper * class_count_ + classes_[*q]];
+        if (depth_[step] != depth_[deeper] + 1) {
+          break;
+        }
+        deeper = step;
+        if (terminal_[deeper]) {
+          stop = static_cast<size_t>(q + 1 - begin);
+          start = std::min(start, stop - depth_[deeper]);
+        }
+      }
+    }
+    if (kinds_[state] & kEmail) {
+      size_t left = at - 1;
+      while (left > 0 && IsLocalPart(begin[left - 1])) {
+        --left;
+      }
+      size_t right = at;
+      while (right < size && IsDomain(begin[right])) {
+        ++right;
+      }
+      while (right > at && begin[right - 1] == '.') {
+        --right;
+      }
+      // The domain needs a dot with something on both sides.
+      const uint8_t *dot = static_cast<const uint8_t *>(
+          std::memchr(begin + at, '.', right - at));
+      if (left < at - 1 && dot != NULL && dot > begin + at) {
+        start = found ? std::min(start, left) : left;
+        stop = std::max(stop, right);
+        found = true;
+      }
+    }
+    if (kinds_[state] & kBearer) {
+      size_t right = at;
+      while (right < size && IsToken(begin[right])) {
+        ++right;
+      }
+      if (right > at) {
+        start = found ? std::min(start, at) : at;
+        stop = std::max(stop, right);
+        found = true;
+      }
+    }
+    if (!found || stop <= copied) {
+      continue;
+    }
+
+    // A span that overlaps the previous one extends its replacement.
+    if (start >= copied) {
+      dest.append(text.data() + copied, text.data() + start);
+      dest.append(replacement_.data(), replacement_.data() + replacement_.size());
+    }
+    copied = stop;
+    matched = true;
+    p = begin + stop;
+    state = 0;
+  }
+
+  if (!matched) {
+    return false;
+  }
+  dest.append(text.data() + copied, text.data() + size);
+  return true;
+}
+
+RedactionSink::RedactionSink(std::shared_ptr<spdlog::sinks::sink> inner,
+                             std::shared_ptr<const Redactor> redactor)
+    : inner_(std::move(inner)), redactor_(std::move(redactor)) {}
+
+void RedactionSink::log(const spdlog::details::log_msg &msg) {
+  inner_->log(msg);
+}
+
+void RedactionSink::flush() { inner_->flush(); }
+
+void RedactionSink::set_pattern(const std::string &pattern) {
+  set_formatter(spdlog::details::make_unique<spdlog::pattern_formatter>(pattern));
+}
+
+void RedactionSink::set_formatter(
+    std::unique_ptr<spdlog::formatter> formatter) {
+  inner_->set_formatter(spdlog::details::make_unique<RedactingFormatter>(
+      std::move(formatter), redactor_));
+}
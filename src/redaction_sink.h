@@ -0,0 +1,94 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#ifndef REDACTION_SINK_H
+#define REDACTION_SINK_H
+
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/sink.h>
+
+#include <string>
+#include <vector>
+
+// Finds secrets in message text and replaces them.
+//
+// Literal strings are matched all at once by an Aho-Corasick automaton,
+// compiled to a table of transitions over the byte classes that occur in
+// any literal. Emails are found from their "@" and bearer tokens from the
+// "Bearer " in front of them, both triggered by the same automaton. While
+// the automaton is at its root, bytes that cannot start a match are skipped
+// 16 at a time with SSE2 when there are only a few bytes that can.
+class Redactor {
+ public:
+  struct Options {
+    Options() : emails(false), bearer_tokens(false), replacement("[REDACTED]") {}
+
+    std::vector<std::string> literals;
+    bool emails;
+    // Only the token after "Bearer " is replaced.
+    bool bearer_tokens;
+    std::string replacement;
+  };
+
+  explicit Redactor(const Options &options);
+
+  // Appends |text| with every match replaced to |dest| and returns true, or
+  // returns false without touching |dest| if nothing matched. Of literals
+  // that start at the same byte the longest one is replaced.
+  bool Redact(spdlog::string_view_t text, spdlog::memory_buf_t &dest) const;
+
+ private:
+  enum Kind : uint8_t {
+    kEmail = 1,
+    kBearer = 2,
+  };
+
+  static const uint32_t kNone = UINT32_MAX;
+  static const size_t kMaxSkipBytes = 4;
+
+  uint32_t AddState();
+  void Add(const std::string &pattern, uint8_t kind);
+  void Build();
+  const uint8_t *Skip(const uint8_t *p, const uint8_t *end) const;
+
+  const std::string replacement_;
+  uint16_t classes_[256];
+  size_t class_count_;
+  // |class_count_| transitions per state.
+  std::vector<uint32_t> next_;
+  std::vector<uint32_t> depth_;
+  // Length of the longest literal that ends in each state, 0 for none.
+  std::vector<uint32_t> length_;
+  // Whether a literal of the state's full depth ends there.
+  std::vector<bool> terminal_;
+  std::vector<uint8_t> kinds_;
+  // Bytes that leave the root, and the same as a list if there are few.
+  bool starts_[256];
+  uint8_t skip_bytes_[kMaxSkipBytes];
+  size_t skip_byte_count_;
+};
+
+// Hands records to |inner| unchanged, but wraps every formatter set on it so
+// that message text is redacted when the record is formatted. That happens
+// wherever |inner| formats: on the formatter threads of a ParallelFormatSink,
+// on the consumer thread of a StagingSink, or else on the logging thread.
+// Records without a match are formatted without a copy.
+class RedactionSink : public spdlog::sinks::sink {
+ public:
+  RedactionSink(std::shared_ptr<spdlog::sinks::sink> inner,
+                std::shared_ptr<const Redactor> redactor);
+
+  void log(const spdlog::details::log_msg &msg) override;
+  void flush() override;
+  void set_pattern(const std::string &pattern) override;
+  void set_formatter(std::unique_ptr<spdlog::formatter> formatter) override;
+
+ private:
+  std::shared_ptr<spdlog::sinks::sink> inner_;
+  std::shared_ptr<const Redactor> redactor_;
+};
+
+#endif  // !REDACTION_SINK_H
@@ -0,0 +1,53 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#include <chrono>
+#include <iterator>
+
+#include "sampler.h"
+
+const size_t AdaptiveSampler::kMaxSites;
+
+AdaptiveSampler::AdaptiveSampler(uint32_t rate) : rate_(rate) {}
+
+bool AdaptiveSampler::Keep(uint64_t site, uint64_t *skipped) {
+  const int64_t second = std::chrono::duration_cast<std::chrono::seconds>(
+                             std::chrono::steady_clock::now().time_since_epoch())
+                             .count();
+
+  auto found = sites_.find(site);
+  if (found == sites_.end()) {
+    if (sites_.size() >= kMaxSites) {
+      for (auto it = sites_.begin(); it != sites_.end();) {
+        it = it->second.second < second ? sites_.erase(it) : std::next(it);
+      }
+      if (sites_.size() >= kMaxSites) {
+        sites_.clear();
+      }
+    }
+    found = sites_.emplace(site, Site{second, 0, rate_ + 1, 0}).first;
+  }
+
+  Site &state = found->second;
+  if (state.second != second) {
+    state.second = second;
+    state.seen = 0;
+    state.next_keep = rate_ + 1;
+  }
+
+  ++state.seen;
+  if (state.seen > rate_) {
+    if (state.seen != state.next_keep) {
+      ++state.skipped;
+      return false;
+    }
+    // Back off exponentially, the gap to the next kept message doubles.
+    state.next_keep = rate_ + 2 * (state.next_keep - rate_);
+  }
+  *skipped = state.skipped;
+  state.skipped = 0;
+  return true;
+}
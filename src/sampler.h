@@ -0,0 +1,43 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <cstdint>
+#include <unordered_map>
+
+// Decides per call site, keyed by message template hash, which messages to
+// keep. Every message of a site is kept until the site logs more than
+// |rate| messages within a second; past that only the 1st, 2nd, 4th, 8th
+// and so on message over the rate are kept. Each second starts over. A site
+// that stays under the rate never loses a message.
+class AdaptiveSampler {
+ public:
+  explicit AdaptiveSampler(uint32_t rate);
+
+  // Returns whether to keep the message. When it is kept, |skipped| is set
+  // to the number of messages of the same site dropped since the last one
+  // kept.
+  bool Keep(uint64_t site, uint64_t *skipped);
+
+  // Sites tracked at most. Beyond it sites idle for a second are forgotten,
+  // or all of them if none is idle, which only ever keeps more messages.
+  static const size_t kMaxSites = 4096;
+
+ private:
+  struct Site {
+    int64_t second;
+    uint64_t seen;
+    uint64_t next_keep;
+    uint64_t skipped;
+  };
+
+  const uint64_t rate_;
+  std::unordered_map<uint64_t, Site> sites_;
+};
+
+#endif  // !SAMPLER_H
@@ -0,0 +1,666 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "logger.h"
+#include "serializer.h"
+
+namespace {
+
+const int kDefaultMaxDepth = 10;
+const uint32_t kDefaultMaxItems = 100;
+const int kDefaultMaxStringLength = 10 * 1024;
+const size_t kMaxCachedKeys = 1024;
+
+inline void Append(const char *text, spdlog::memory_buf_t &dest) {
+  spdlog::details::fmt_helper::append_string_view(text, dest);
+}
+
+inline bool NeedsEscape(unsigned char c) {
+  return c < 0x20 || c == '"' || c == '\\';
+}
+
+}  // namespace
+
+void EscapeJson(size_t start, spdlog::memory_buf_t &dest) {
+  size_t i = start;
+  while (i < dest.size() && !NeedsEscape(dest[i])) {
+    ++i;
+  }
+  if (i == dest.size()) {
+    return;
+  }
+
+  const std::string rest(dest.data() + i, dest.size() - i);
+  dest.resize(i);
+  for (const char ch : rest) {
+    const unsigned char c = static_cast<unsigned char>(ch);
+    if (!NeedsEscape(c)) {
+      dest.push_back(ch);
+      continue;
+    }
+    switch (c) {
+      case '"': Append("\\\"", dest); break;
+      case '\\': Append("\\\\", dest); break;
+      case '\n': Append("\\n", dest); break;
+      case '\r': Append("\\r", dest); break;
+      case '\t': Append("\\t", dest); break;
+      case '\b': Append("\\b", dest); break;
+      case '\f': Append("\\f", dest); break;
+      default: {
+        static const char hex[] = "0123456789abcdef";
+        Append("\\u00", dest);
+        dest.push_back(hex[c >> 4]);
+        dest.push_back(hex[c & 0xf]);
+      }
+    }
+  }
+}
+
+namespace {
+
+v8::Local<v8::String> InternalizedString(v8::Isolate *isolate,
+                                         const char *value) {
+  return v8::String::NewFromUtf8(isolate, value,
+                                 v8::NewStringType::kInternalized)
+      .ToLocalChecked();
+}
+
+// Values that JSON.stringify leaves out of objects and turns into null
+// inside arrays.
+inline bool IsOmitted(v8::Local<v8::Value> value) {
+  return value->IsUndefined() || value->IsFunction() || value->IsSymbol();
+}
+
+// 64-bit FNV-1a, used to recognize repeated stack traces.
+uint64_t HashBytes(const char *data, size_t size) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+// Returns the line break before the trailing lines of [begin, end) that
+// start with "    at ", which are the frames of a V8 stack trace, or |end|
+// if there are none.
+const char *FindStackFrames(const char *begin, const char *end) {
+  static const char kFrame[] = "    at ";
+  const size_t frameSize = sizeof(kFrame) - 1;
+  const char *frames = end;
+  const char *lineEnd = end;
+  for (;;) {
+    const char *line = lineEnd;
+    while (line != begin && line[-1] != '\n') {
+      --line;
+    }
+    // The first line holds the message, never a frame.
+    if (line == begin || static_cast<size_t>(lineEnd - line) < frameSize ||
+        std::memcmp(line, kFrame, frameSize) != 0) {
+      return frames;
+    }
+    frames = line - 1;
+    lineEnd = frames;
+  }
+}
+
+void AppendHex(uint64_t value, spdlog::memory_buf_t &dest) {
+  static const char hex[] = "0123456789abcdef";
+  for (int shift = 60; shift >= 0; shift -= 4) {
+    dest.push_back(hex[(value >> shift) & 0xf]);
+  }
+}
+
+}  // namespace
+
+void AppendJsonString(v8::Local<v8::String> str, int maxLength,
+                      spdlog::memory_buf_t &dest) {
+  dest.push_back('"');
+  const size_t start = dest.size();
+  AppendMessage(str, static_cast<size_t>(maxLength), dest);
+  EscapeJson(start, dest);
+  dest.push_back('"');
+}
+
+namespace {
+
+// Appends |str| bare if it has no spaces, quotes, `=` or characters JSON
+// escapes, otherwise as a JSON string, so that `key=value` pairs stay
+// unambiguous.
+void AppendFieldString(v8::Local<v8::String> str, int maxLength,
+                       spdlog::memory_buf_t &dest) {
+  const size_t start = dest.size();
+  AppendMessage(str, static_cast<size_t>(maxLength), dest);
+  const char *begin = dest.data() + start;
+  const char *end = dest.data() + dest.size();
+  const bool bare =
+      begin != end && std::find_if(begin, end, [](char c) {
+                        return c == ' ' || c == '"' || c == '=' ||
+                               NeedsEscape(static_cast<unsigned char>(c));
+                      }) == end;
+  if (!bare) {
+    dest.resize(start);
+    AppendJsonString(str, maxLength, dest);
+  }
+}
+
+}  // namespace
+
+Serializer::Serializer()
+    : max_depth_(kDefaultMaxDepth),
+      max_items_(kDefaultMaxItems),
+      max_string_length_(kDefaultMaxStringLength),
+      dedupe_stacks_(false),
+      limit_(std::numeric_limits<size_t>::max()),
+      stacks_(NULL) {}
+
+Serializer::~Serializer() {}
+
+void Serializer::Serialize(v8::Local<v8::Value> value,
+                           v8::Local<v8::Value> stack, size_t maxSize,
+                           spdlog::memory_buf_t &dest,
+                           std::vector<record::Stack> *stacks) {
+  Nan::HandleScope scope;
+  v8::Isolate *isolate = v8::Isolate::GetCurrent();
+  v8::Local<v8::Context> context = isolate->GetCurrentContext();
+  // Exceptions thrown by getters and toJSON() are replaced by a marker in the
+  // output and swallowed here.
+  v8::TryCatch tryCatch(isolate);
+
+  if (object_prototype_.IsEmpty()) {
+    object_prototype_.Reset(isolate, v8::Object::New(isolate)->GetPrototype());
+    to_json_.Reset(isolate, InternalizedString(isolate, "toJSON"));
+  }
+
+  // Getters and toJSON() may log through the same logger, so save the state
+  // of any outer call instead of assuming this one is the only one.
+  const size_t outerStackSize = stack_.size();
+  const size_t outerLimit = limit_;
+  std::vector<record::Stack> *outerStacks = stacks_;
+  limit_ = maxSize ? dest.size() + maxSize
+                   : std::numeric_limits<size_t>::max();
+  stacks_ = dedupe_stacks_ ? stacks : NULL;
+
+  if (value->IsNativeError()) {
+    WriteErrorRecord(context, value.As<v8::Object>(), stack, 0, dest);
+  } else if (value->IsUndefined()) {
+    Append("undefined", dest);
+  } else if (value->IsFunction()) {
+    Append("[Function]", dest);
+  } else if (value->IsSymbol()) {
+    Append("[Symbol]", dest);
+  } else {
+    Write(context, value, 0, dest);
+  }
+
+  stack_.resize(outerStackSize);
+  limit_ = outerLimit;
+  stacks_ = outerStacks;
+}
+
+bool Serializer::SerializeFields(v8::Local<v8::Object> fields,
+                                 spdlog::memory_buf_t &dest) {
+  Nan::HandleScope scope;
+  v8::Isolate *isolate = v8::Isolate::GetCurrent();
+  v8::Local<v8::Context> context = isolate->GetCurrentContext();
+  // Only what the fields hold is serialized with markers for exceptions, one
+  // thrown by reading a field itself goes to the caller.
+  v8::TryCatch tryCatch(isolate);
+
+  v8::Local<v8::Array> names;
+  if (!fields
+           ->GetOwnPropertyNames(
+               context,
+               static_cast<v8::PropertyFilter>(v8::ONLY_ENUMERABLE |
+                                               v8::SKIP_SYMBOLS),
+               v8::KeyConversionMode::kConvertToString)
+           .ToLocal(&names)) {
+    tryCatch.ReThrow();
+    return false;
+  }
+
+  const size_t outerStackSize = stack_.size();
+  const size_t outerLimit = limit_;
+  std::vector<record::Stack> *outerStacks = stacks_;
+  limit_ = std::numeric_limits<size_t>::max();
+  stacks_ = NULL;
+
+  bool read = true;
+  for (uint32_t i = 0; i < names->Length(); ++i) {
+    v8::Local<v8::Value> key;
+    v8::Local<v8::Value> value;
+    if (!names->Get(context, i).ToLocal(&key) ||
+        !fields->Get(context, key).ToLocal(&value)) {
+      read = false;
+      break;
+    }
+    if (IsOmitted(value)) {
+      continue;
+    }
+
+    AppendFieldString(key.As<v8::String>(), max_string_length_, dest);
+    dest.push_back('=');
+    if (value->IsString()) {
+      AppendFieldString(value.As<v8::String>(), max_string_length_, dest);
+    } else {
+      Write(context, value, 0, dest);
+    }
+    dest.push_back(' ');
+  }
+
+  stack_.resize(outerStackSize);
+  limit_ = outerLimit;
+  stacks_ = outerStacks;
+  if (!read) {
+    tryCatch.ReThrow();
+  }
+  return read;
+}
+
+bool Serializer::Exhausted(const spdlog::memory_buf_t &dest) const {
+  return dest.size() >= limit_;
+}
+
+void Serializer::Write(v8::Local<v8::Context> context,
+                       v8::Local<v8::Value> value, int depth,
+                       spdlog::memory_buf_t &dest) {
+  if (value->IsString()) {
+    AppendJsonString(value.As<v8::String>(), max_string_length_, dest);
+    return;
+  }
+  if (value->IsNumber()) {
+    WriteNumber(context, value, dest);
+    return;
+  }
+  if (value->IsBoolean()) {
+    Append(value->IsTrue() ? "true" : "false", dest);
+    return;
+  }
+  if (value->IsNull() || IsOmitted(value)) {
+    Append("null", dest);
+    return;
+  }
+  if (value->IsBigInt()) {
+    v8::Local<v8::String> digits;
+    if (value->ToString(context).ToLocal(&digits)) {
+      AppendMessage(digits, 0, dest);
+    }
+    return;
+  }
+  if (!value->IsObject()) {
+    Append("null", dest);
+    return;
+  }
+
+  v8::Local<v8::Object> object = value.As<v8::Object>();
+  if (depth >= max_depth_) {
+    Append(object->IsArray() ? "\"[Array]\"" : "\"[Object]\"", dest);
+    return;
+  }
+  for (const v8::Local<v8::Object> &ancestor : stack_) {
+    if (ancestor == object) {
+      Append("\"[Circular]\"", dest);
+      return;
+    }
+  }
+
+  stack_.push_back(object);
+  if (object->IsNativeError()) {
+    WriteError(context, object, depth, dest);
+  } else if (object->IsArray()) {
+    WriteArray(context, object.As<v8::Array>(), depth, dest);
+  } else if (object->IsNumberObject()) {
+    WriteNumber(context,
+                Nan::New(object.As<v8::NumberObject>()->ValueOf()), dest);
+  } else if (object->IsStringObject()) {
+    AppendJsonString(object.As<v8::StringObject>()->ValueOf(),
+                     max_string_length_, dest);
+  } else if (object->IsBooleanObject()) {
+    Append(object.As<v8::BooleanObject>()->ValueOf() ? "true" : "false", dest);
+  } else if (object->IsMap() || object->IsSet()) {
+    // Maps become an array of [key, value] pairs, sets an array of values.
+    v8::Local<v8::Array> entries = object->IsMap()
+                                       ? object.As<v8::Map>()->AsArray()
+                                       : object.As<v8::Set>()->AsArray();
+    const bool isMap = object->IsMap();
+    const uint32_t stride = isMap ? 2 : 1;
+    const uint32_t count = entries->Length() / stride;
+    dest.push_back('[');
+    for (uint32_t i = 0; i < count; ++i) {
+      Nan::HandleScope scope;
+      if (i > 0) {
+        dest.push_back(',');
+      }
+      if (i >= max_items_ || Exhausted(dest)) {
+        Append("\"\xE2\x80\xA6\"", dest);
+        break;
+      }
+      if (isMap) {
+        dest.push_back('[');
+        Write(context, Nan::Get(entries, i * 2).ToLocalChecked(), depth + 1,
+              dest);
+        dest.push_back(',');
+        Write(context, Nan::Get(entries, i * 2 + 1).ToLocalChecked(),
+              depth + 1, dest);
+        dest.push_back(']');
+      } else {
+        Write(context, Nan::Get(entries, i).ToLocalChecked(), depth + 1,
+              dest);
+      }
+    }
+    dest.push_back(']');
+  } else {
+    // Plain objects skip the toJSON() lookup, which would otherwise walk the
+    // whole prototype chain for every object only to find nothing.
+    v8::Isolate *isolate = context->GetIsolate();
+    v8::Local<v8::Value> prototype = object->GetPrototype();
+    v8::Local<v8::Value> toJSON;
+    v8::Local<v8::Value> json;
+    if (!prototype->IsNull() &&
+        prototype != v8::Local<v8::Value>::New(isolate, object_prototype_) &&
+        object->Get(context, v8::Local<v8::String>::New(isolate, to_json_))
+            .ToLocal(&toJSON) &&
+        toJSON->IsFunction()) {
+      if (toJSON.As<v8::Function>()->Call(context, object, 0, NULL).ToLocal(
+              &json)) {
+        Write(context, json, depth + 1, dest);
+      } else {
+        Append("\"[Throws]\"", dest);
+      }
+    } else {
+      WriteObject(context, object, depth, dest);
+    }
+  }
+  stack_.pop_back();
+}
+
+void Serializer::WriteNumber(v8::Local<v8::Context> context,
+                             v8::Local<v8::Value> value,
+                             spdlog::memory_buf_t &dest) {
+  const double number = value.As<v8::Number>()->Value();
+  if (std::isnan(number) || std::isinf(number)) {
+    Append("null", dest);
+  } else if (number == std::floor(number) &&
+             std::fabs(number) < 9007199254740992.0) {
+    spdlog::details::fmt_helper::append_int(static_cast<int64_t>(number), dest);
+  } else {
+    // Let V8 produce the shortest round-trip form so output matches JS.
+    v8::Local<v8::String> text;
+    if (value->ToString(context).ToLocal(&text)) {
+      AppendMessage(text, 0, dest);
+    }
+  }
+}
+
+void Serializer::WriteKey(v8::Local<v8::Name> key,
+                          spdlog::memory_buf_t &dest) {
+  v8::Isolate *isolate = v8::Isolate::GetCurrent();
+  const int hash = key->GetIdentityHash();
+  auto it = keys_.find(hash);
+  if (it != keys_.end() &&
+      v8::Local<v8::Name>::New(isolate, it->second.name)->StrictEquals(key)) {
+    spdlog::details::fmt_helper::append_string_view(it->second.encoded, dest);
+    return;
+  }
+
+  const size_t start = dest.size();
+  AppendJsonString(key.As<v8::String>(), max_string_length_, dest);
+  dest.push_back(':');
+
+  if (it == keys_.end() && keys_.size() >= kMaxCachedKeys) {
+    return;
+  }
+  CachedKey &entry = keys_[hash];
+  entry.name.Reset(isolate, key);
+  entry.encoded.assign(dest.data() + start, dest.size() - start);
+}
+
+bool Serializer::WriteProperty(v8::Local<v8::Context> context,
+                               v8::Local<v8::Object> object,
+                               v8::Local<v8::Name> key, int depth, bool first,
+                               spdlog::memory_buf_t &dest) {
+  v8::Local<v8::Value> value;
+  const bool threw = !object->Get(context, key).ToLocal(&value);
+  if (!threw && IsOmitted(value)) {
+    return false;
+  }
+
+  if (!first) {
+    dest.push_back(',');
+  }
+  WriteKey(key, dest);
+  if (threw) {
+    Append("\"[Throws]\"", dest);
+  } else {
+    Write(context, value, depth + 1, dest);
+  }
+  return true;
+}
+
+void Serializer::WriteObject(v8::Local<v8::Context> context,
+                             v8::Local<v8::Object> object, int depth,
+                             spdlog::memory_buf_t &dest,
+                             v8::Local<v8::Name> skip) {
+  v8::Local<v8::Array> names;
+  if (!object
+           ->GetOwnPropertyNames(
+               context,
+               static_cast<v8::PropertyFilter>(v8::ONLY_ENUMERABLE |
+                                               v8::SKIP_SYMBOLS),
+               v8::KeyConversionMode::kConvertToString)
+           .ToLocal(&names)) {
+    Append("\"[Throws]\"", dest);
+    return;
+  }
+
+  dest.push_back('{');
+  const uint32_t length = names->Length();
+  uint32_t written = 0;
+  for (uint32_t i = 0; i < length; ++i) {
+    Nan::HandleScope scope;
+    if (written >= max_items_ || Exhausted(dest)) {
+      if (written > 0) {
+        dest.push_back(',');
+      }
+      Append("\"\xE2\x80\xA6\":", dest);
+      spdlog::details::fmt_helper::append_int(length - i, dest);
+      break;
+    }
+    v8::Local<v8::Value> key;
+    if (!names->Get(context, i).ToLocal(&key) ||
+        (!skip.IsEmpty() && key->StrictEquals(skip))) {
+      continue;
+    }
+    if (WriteProperty(context, object, key.As<v8::Name>(), depth,
+                      written == 0, dest)) {
+      ++written;
+    }
+  }
+  dest.push_back('}');
+}
+
+void Serializer::WriteArray(v8::Local<v8::Context> context,
+                            v8::Local<v8::Array> array, int depth,
+                            spdlog::memory_buf_t &dest) {
+  dest.push_back('[');
+  const uint32_t length = array->Length();
+  for (uint32_t i = 0; i < length; ++i) {
+    Nan::HandleScope scope;
+    if (i > 0) {
+      dest.push_back(',');
+    }
+    if (i >= max_items_ || Exhausted(dest)) {
+      Append("\"\xE2\x80\xA6 ", dest);
+      spdlog::details::fmt_helper::append_int(length - i, dest);
+      Append(" more items\"", dest);
+      break;
+    }
+    v8::Local<v8::Value> item;
+    if (array->Get(context, i).ToLocal(&item)) {
+      Write(context, item, depth + 1, dest);
+    } else {
+      Append("\"[Throws]\"", dest);
+    }
+  }
+  dest.push_back(']');
+}
+
+void Serializer::WriteError(v8::Local<v8::Context> context,
+                            v8::Local<v8::Object> error, int depth,
+                            spdlog::memory_buf_t &dest) {
+  v8::Isolate *isolate = context->GetIsolate();
+  static const char *const fields[] = {"name", "message", "stack", "cause"};
+
+  dest.push_back('{');
+  bool first = true;
+  for (const char *field : fields) {
+    if (WriteProperty(context, error, InternalizedString(isolate, field),
+                      depth, first, dest)) {
+      first = false;
+    }
+  }
+
+  // Own enumerable properties such as `code` or `errno`.
+  v8::Local<v8::Array> names;
+  if (error
+          ->GetOwnPropertyNames(
+              context,
+              static_cast<v8::PropertyFilter>(v8::ONLY_ENUMERABLE |
+                                              v8::SKIP_SYMBOLS),
+              v8::KeyConversionMode::kConvertToString)
+          .ToLocal(&names)) {
+    const uint32_t length = std::min(names->Length(), max_items_);
+    for (uint32_t i = 0; i < length && !Exhausted(dest); ++i) {
+      Nan::HandleScope scope;
+      v8::Local<v8::Value> key;
+      if (!names->Get(context, i).ToLocal(&key) ||
+          std::any_of(std::begin(fields), std::end(fields),
+                      [&](const char *field) {
+                        return key->StrictEquals(
+                            InternalizedString(isolate, field));
+                      })) {
+        continue;
+      }
+      if (WriteProperty(context, error, key.As<v8::Name>(), depth, first,
+                        dest)) {
+        first = false;
+      }
+    }
+  }
+  dest.push_back('}');
+}
+
+void Serializer::WriteErrorRecord(v8::Local<v8::Context> context,
+                                  v8::Local<v8::Object> error,
+                                  v8::Local<v8::Value> stack, int depth,
+                                  spdlog::memory_buf_t &dest) {
+  v8::Isolate *isolate = context->GetIsolate();
+  stack_.push_back(error);
+
+  // The stack already starts with "name: message", so it is transcoded
+  // straight into the record. Only errors without a usable stack fall back
+  // to building that first line from name and message.
+  if ((!stack.IsEmpty() ||
+       error->Get(context, InternalizedString(isolate, "stack"))
+           .ToLocal(&stack)) &&
+      stack->IsString()) {
+    size_t budget = 0;
+    if (limit_ != std::numeric_limits<size_t>::max()) {
+      budget = Exhausted(dest) ? 1 : limit_ - dest.size();
+    }
+    const size_t start = dest.size();
+    AppendMessage(stack.As<v8::String>(), budget, dest);
+    if (stacks_ != NULL) {
+      AppendStackId(start, dest);
+    }
+  } else {
+    v8::Local<v8::Value> name;
+    v8::Local<v8::Value> message;
+    v8::Local<v8::String> text;
+    if (error->Get(context, InternalizedString(isolate, "name"))
+            .ToLocal(&name) &&
+        name->ToString(context).ToLocal(&text)) {
+      AppendMessage(text, max_string_length_, dest);
+    }
+    Append(": ", dest);
+    if (error->Get(context, InternalizedString(isolate, "message"))
+            .ToLocal(&message) &&
+        message->ToString(context).ToLocal(&text)) {
+      AppendMessage(text, max_string_length_, dest);
+    }
+  }
+
+  // Own enumerable properties such as `code` are appended as JSON, the way
+  // util.inspect() shows them after the stack. The cause follows on lines of
+  // its own even if it was assigned as an enumerable property.
+  v8::Local<v8::String> causeKey = InternalizedString(isolate, "cause");
+  v8::Local<v8::Array> names;
+  v8::Local<v8::Value> first;
+  if (error
+          ->GetOwnPropertyNames(
+              context,
+              static_cast<v8::PropertyFilter>(v8::ONLY_ENUMERABLE |
+                                              v8::SKIP_SYMBOLS),
+              v8::KeyConversionMode::kConvertToString)
+          .ToLocal(&names) &&
+      names->Length() > 0 && !Exhausted(dest) &&
+      !(names->Length() == 1 && names->Get(context, 0).ToLocal(&first) &&
+        first->StrictEquals(causeKey))) {
+    dest.push_back(' ');
+    WriteObject(context, error, depth, dest, causeKey);
+  }
+
+  v8::Local<v8::Value> cause;
+  if (error->Get(context, causeKey).ToLocal(&cause) &&
+      !cause->IsUndefined() && !Exhausted(dest)) {
+    Append("\nCaused by: ", dest);
+    bool seen = false;
+    for (const v8::Local<v8::Object> &ancestor : stack_) {
+      seen = seen || ancestor == cause;
+    }
+    if (seen) {
+      Append("[Circular]", dest);
+    } else if (depth + 1 >= max_depth_) {
+      Append("[Error]", dest);
+    } else if (cause->IsNativeError()) {
+      WriteErrorRecord(context, cause.As<v8::Object>(),
+                       v8::Local<v8::Value>(), depth + 1, dest);
+    } else {
+      Write(context, cause, depth + 1, dest);
+    }
+  }
+
+  stack_.pop_back();
+}
+
+void Serializer::AppendStackId(size_t start, spdlog::memory_buf_t &dest) {
+  // Hash only the frames so that the same throw site with a different
+  // message is still recognized.
+  const char *end = dest.data() + dest.size();
+  const char *frames = FindStackFrames(dest.data() + start, end);
+  if (frames == end) {
+    return;
+  }
+  const uint64_t hash = HashBytes(frames, end - frames);
+  const size_t framesBegin = static_cast<size_t>(frames - dest.data());
+  const size_t framesEnd = dest.size();
+  Append("\n    [stack ", dest);
+  AppendHex(hash, dest);
+  dest.push_back(']');
+  // The id line is only text, what may be cut is recorded next to it.
+  if (framesEnd <= UINT32_MAX) {
+    record::Stack stack;
+    stack.begin = static_cast<uint32_t>(framesBegin);
+    stack.end = static_cast<uint32_t>(framesEnd);
+    stack.id = hash;
+    stacks_->push_back(stack);
+  }
+}
@@ -0,0 +1,118 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#ifndef SERIALIZER_H
+#define SERIALIZER_H
+
+#include <nan.h>
+
+#include <spdlog/spdlog.h>
+
+#include <unordered_map>
+#include <vector>
+
+#include "record.h"
+
+// Serializes arbitrary JS values into JSON-like text directly into a spdlog
+// buffer. Unlike JSON.stringify it never throws: cycles, excessive depth and
+// throwing getters are replaced by markers, and arrays, objects and strings
+// are cut at configurable limits.
+class Serializer {
+ public:
+  Serializer();
+  ~Serializer();
+
+  // Appends the serialized form of |value| to |dest|. When |maxSize| is
+  // non-zero the output stops growing once it reaches roughly that many bytes.
+  // With stack deduplication the stack traces written are added to |stacks|,
+  // with their offsets in |dest|. |stack| is the stack of an error |value|
+  // if the caller read it already, so that its getter does not run twice.
+  void Serialize(v8::Local<v8::Value> value, v8::Local<v8::Value> stack,
+                 size_t maxSize, spdlog::memory_buf_t &dest,
+                 std::vector<record::Stack> *stacks);
+
+  // Appends the own enumerable properties of |fields| as space separated
+  // `key=value` pairs followed by a space. Keys and string values without
+  // spaces, quotes or `=` are written bare, the rest as JSON. Returns false,
+  // with the exception pending, if listing or reading a property threw.
+  bool SerializeFields(v8::Local<v8::Object> fields, spdlog::memory_buf_t &dest);
+
+  int MaxDepth() const { return max_depth_; }
+  uint32_t MaxItems() const { return max_items_; }
+  int MaxStringLength() const { return max_string_length_; }
+  void SetMaxDepth(int maxDepth) { max_depth_ = maxDepth; }
+  void SetMaxItems(uint32_t maxItems) { max_items_ = maxItems; }
+  void SetMaxStringLength(int maxStringLength) {
+    max_string_length_ = maxStringLength;
+  }
+  // When enabled, the frames of a stack trace are followed by a stack id
+  // line and reported to Serialize() callers, so that a DedupingFileSink
+  // writes them in full only the first time they reach a file.
+  void SetDedupeStacks(bool dedupeStacks) { dedupe_stacks_ = dedupeStacks; }
+
+ private:
+  struct CachedKey {
+    v8::Global<v8::Name> name;
+    std::string encoded;
+  };
+
+  void Write(v8::Local<v8::Context> context, v8::Local<v8::Value> value,
+             int depth, spdlog::memory_buf_t &dest);
+  // Writes the own enumerable properties of |object|, except |skip|.
+  void WriteObject(v8::Local<v8::Context> context,
+                   v8::Local<v8::Object> object, int depth,
+                   spdlog::memory_buf_t &dest,
+                   v8::Local<v8::Name> skip = v8::Local<v8::Name>());
+  void WriteArray(v8::Local<v8::Context> context, v8::Local<v8::Array> array,
+                  int depth, spdlog::memory_buf_t &dest);
+  void WriteError(v8::Local<v8::Context> context, v8::Local<v8::Object> error,
+                  int depth, spdlog::memory_buf_t &dest);
+  // Reads the stack of |error| unless |stack| holds it already.
+  void WriteErrorRecord(v8::Local<v8::Context> context,
+                        v8::Local<v8::Object> error,
+                        v8::Local<v8::Value> stack, int depth,
+                        spdlog::memory_buf_t &dest);
+  // Appends the stack id line after the frames of the stack trace written
+  // from |start|, if it has any, and adds the frames to |stacks_|.
+  void AppendStackId(size_t start, spdlog::memory_buf_t &dest);
+  void WriteNumber(v8::Local<v8::Context> context, v8::Local<v8::Value> value,
+                   spdlog::memory_buf_t &dest);
+  void WriteKey(v8::Local<v8::Name> key, spdlog::memory_buf_t &dest);
+  bool WriteProperty(v8::Local<v8::Context> context,
+                     v8::Local<v8::Object> object, v8::Local<v8::Name> key,
+                     int depth, bool first, spdlog::memory_buf_t &dest);
+  bool Exhausted(const spdlog::memory_buf_t &dest) const;
+
+  int max_depth_;
+  uint32_t max_items_;
+  int max_string_length_;
+  bool dedupe_stacks_;
+
+  // State of the current Serialize() call.
+  std::vector<v8::Local<v8::Object>> stack_;
+  size_t limit_;
+  // NULL unless stacks are deduplicated.
+  std::vector<record::Stack> *stacks_;
+
+  // Encoded `"key":` prefixes of recently seen property names, keyed by the
+  // V8 identity hash of the name.
+  std::unordered_map<int, CachedKey> keys_;
+
+  v8::Global<v8::Value> object_prototype_;
+  v8::Global<v8::String> to_json_;
+};
+
+// Escapes the bytes in [start, dest.size()) in place for use inside a JSON
+// string. Most strings need no escaping at all, in which case this is a
+// single scan.
+void EscapeJson(size_t start, spdlog::memory_buf_t &dest);
+
+// Appends |str| as a quoted JSON string, keeping at most |maxLength| UTF-8
+// bytes of its contents (0 means unlimited).
+void AppendJsonString(v8::Local<v8::String> str, int maxLength,
+                      spdlog::memory_buf_t &dest);
+
+#endif  // !SERIALIZER_H
@@ -0,0 +1,52 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#ifndef SINK_HELPERS_H
+#define SINK_HELPERS_H
+
+#include <spdlog/spdlog.h>
+#include <spdlog/details/fmt_helper.h>
+
+#include <cstdio>
+
+#include "record.h"
+
+// Writes the payload as it is, without a pattern or a line ending.
+class VoidFormatter : public spdlog::formatter {
+ public:
+  void format(const spdlog::details::log_msg &msg,
+              spdlog::memory_buf_t &dest) override {
+    spdlog::details::fmt_helper::append_string_view(msg.payload, dest);
+  }
+
+  std::unique_ptr<spdlog::formatter> clone() const override {
+    return spdlog::details::make_unique<VoidFormatter>();
+  }
+};
+
+// Installed on the inner sink of a sink that formats records itself, so the
+// inner sink receives them already formatted. Leaves out the header that
+// record::FormatForwarded keeps in front of them.
+class PassthroughFormatter : public spdlog::formatter {
+ public:
+  void format(const spdlog::details::log_msg &msg,
+              spdlog::memory_buf_t &dest) override {
+    spdlog::details::fmt_helper::append_string_view(
+        record::Decode(msg.payload).text, dest);
+  }
+
+  std::unique_ptr<spdlog::formatter> clone() const override {
+    return spdlog::details::make_unique<PassthroughFormatter>();
+  }
+};
+
+// Reports a failure on a thread that has nowhere to throw it, the way spdlog
+// reports errors of its own.
+inline void ReportError(const char *what) {
+  std::fprintf(stderr, "[*** LOG ERROR ***] %s\n", what);
+}
+
+#endif  // !SINK_HELPERS_H
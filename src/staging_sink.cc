@@ -0,0 +1,227 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#include <iterator>
+#include <unordered_map>
+
+#include "sink_helpers.h"
+#include "staging_sink.h"
+
+namespace {
+
+const size_t kCacheLine = 64;
+
+std::atomic<uint64_t> next_sink_id(1);
+
+// Ring of the current thread per sink, keyed by sink id so that a new sink
+// allocated where a dropped one lived never finds the old ring. |alive|
+// expires with the sink.
+struct ThreadRing {
+  std::weak_ptr<void> alive;
+  void *ring;
+};
+thread_local std::unordered_map<uint64_t, ThreadRing> local_rings;
+
+}  // namespace
+
+// A single producer, single consumer queue. |head| and |tail| live on cache
+// lines of their own, and the producer only rereads |tail| once its cached
+// copy says the ring is full.
+struct StagingSink::Ring {
+  Ring() : head(0), cached_tail(0), tail(0) {}
+
+  std::atomic<uint64_t> head;
+  uint64_t cached_tail;
+  std::mutex producer;
+  char head_padding[kCacheLine];
+  std::atomic<uint64_t> tail;
+  char tail_padding[kCacheLine];
+  record::OwnedMessage slots[kRingSize];
+};
+
+StagingSink::StagingSink(std::shared_ptr<spdlog::sinks::sink> inner)
+    : id_(next_sink_id++),
+      alive_(std::make_shared<char>()),
+      inner_(std::move(inner)),
+      ring_count_(0),
+      thread_count_(0),
+      sleeping_(false),
+      woken_(false),
+      stopping_(false) {
+  consumer_ = std::thread(&StagingSink::ConsumeLoop, this);
+}
+
+StagingSink::~StagingSink() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_one();
+  consumer_.join();
+}
+
+void StagingSink::log(const spdlog::details::log_msg &msg) {
+  Ring *ring = LocalRing();
+  std::lock_guard<std::mutex> lock(ring->producer);
+  const uint64_t head = ring->head.load(std::memory_order_relaxed);
+  while (head - ring->cached_tail >= kRingSize) {
+    ring->cached_tail = ring->tail.load(std::memory_order_acquire);
+    if (head - ring->cached_tail >= kRingSize) {
+      Wake();
+      std::this_thread::yield();
+    }
+  }
+  ring->slots[head % kRingSize].Assign(msg);
+  ring->head.store(head + 1, std::memory_order_seq_cst);
+  if (sleeping_.load(std::memory_order_seq_cst)) {
+    Wake();
+  }
+}
+
+void StagingSink::flush() {
+  Drain();
+  inner_->flush();
+}
+
+void StagingSink::set_pattern(const std::string &pattern) {
+  Drain();
+  inner_->set_pattern(pattern);
+}
+
+void StagingSink::set_formatter(std::unique_ptr<spdlog::formatter> formatter) {
+  // Records staged before the change are written with the old formatter.
+  Drain();
+  inner_->set_formatter(std::move(formatter));
+}
+
+StagingSink::Ring *StagingSink::LocalRing() {
+  auto found = local_rings.find(id_);
+  if (found != local_rings.end()) {
+    return static_cast<Ring *>(found->second.ring);
+  }
+  if (local_rings.size() >= kMaxRings) {
+    // Forget the rings of dropped sinks, live ones keep theirs.
+    for (auto it = local_rings.begin(); it != local_rings.end();) {
+      it = it->second.alive.expired() ? local_rings.erase(it) : std::next(it);
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(rings_mutex_);
+  const size_t count = ring_count_.load(std::memory_order_relaxed);
+  Ring *ring;
+  if (count < kMaxRings) {
+    rings_[count].reset(new Ring());
+    ring = rings_[count].get();
+    ring_count_.store(count + 1, std::memory_order_release);
+  } else {
+    ring = rings_[thread_count_ % kMaxRings].get();
+  }
+  ++thread_count_;
+  ThreadRing &local = local_rings[id_];
+  local.alive = alive_;
+  local.ring = ring;
+  return ring;
+}
+
+void StagingSink::Wake() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    woken_ = true;
+  }
+  wake_.notify_one();
+}
+
+void StagingSink::Drain() {
+  const size_t count = ring_count_.load(std::memory_order_acquire);
+  uint64_t targets[kMaxRings];
+  for (size_t i = 0; i < count; ++i) {
+    targets[i] = rings_[i]->head.load(std::memory_order_seq_cst);
+  }
+  Wake();
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  drained_.wait(lock, [this, count, &targets] {
+    for (size_t i = 0; i < count; ++i) {
+      if (rings_[i]->tail.load(std::memory_order_acquire) < targets[i]) {
+        return false;
+      }
+    }
+    return true;
+  });
+}
+
+void StagingSink::ConsumeLoop() {
+  for (;;) {
+    if (Consume()) {
+      continue;
+    }
+
+    // Announce the sleep before the last look at the rings. A producer
+    // either sees the flag and wakes us, or its record is seen here.
+    sleeping_.store(true, std::memory_order_seq_cst);
+    if (Consume()) {
+      sleeping_.store(false, std::memory_order_relaxed);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    wake_.wait(lock, [this] { return woken_ || stopping_; });
+    woken_ = false;
+    sleeping_.store(false, std::memory_order_relaxed);
+    if (stopping_) {
+      lock.unlock();
+      while (Consume()) {
+      }
+      return;
+    }
+  }
+}
+
+bool StagingSink::Consume() {
+  const size_t count = ring_count_.load(std::memory_order_acquire);
+  uint64_t heads[kMaxRings];
+  uint64_t tails[kMaxRings];
+  bool pending = false;
+  // Sequentially consistent like the store in log() and |sleeping_|, or
+  // the consumer could miss a record and sleep while the producer misses
+  // the flag.
+  for (size_t i = 0; i < count; ++i) {
+    heads[i] = rings_[i]->head.load(std::memory_order_seq_cst);
+    tails[i] = rings_[i]->tail.load(std::memory_order_relaxed);
+    pending = pending || tails[i] < heads[i];
+  }
+  if (!pending) {
+    return false;
+  }
+
+  // Merge what is in the rings now, oldest record first.
+  for (;;) {
+    size_t oldest = count;
+    for (size_t i = 0; i < count; ++i) {
+      if (tails[i] < heads[i] &&
+          (oldest == count ||
+           rings_[i]->slots[tails[i] % kRingSize].msg().time <
+               rings_[oldest]->slots[tails[oldest] % kRingSize].msg().time)) {
+        oldest = i;
+      }
+    }
+    if (oldest == count) {
+      break;
+    }
+    Ring *ring = rings_[oldest].get();
+    try {
+      inner_->log(ring->slots[tails[oldest] % kRingSize].msg());
+    } catch (const std::exception &ex) {
+      ReportError(ex.what());
+    } catch (...) {
+      ReportError("Unknown error writing log record");
+    }
+    ring->tail.store(++tails[oldest], std::memory_order_release);
+  }
+
+  { std::lock_guard<std::mutex> lock(mutex_); }
+  drained_.notify_all();
+  return true;
+}
@@ -0,0 +1,76 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#ifndef STAGING_SINK_H
+#define STAGING_SINK_H
+
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/sink.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "record.h"
+
+// Gives every thread that logs through it a ring of its own, so producers on
+// different threads never write to the same cache lines. A consumer thread
+// drains all rings, merges what it found by record time and writes it to
+// |inner|. Records of one thread keep their order, records of different
+// threads are ordered by their timestamps.
+class StagingSink : public spdlog::sinks::sink {
+ public:
+  explicit StagingSink(std::shared_ptr<spdlog::sinks::sink> inner);
+  ~StagingSink() override;
+
+  void log(const spdlog::details::log_msg &msg) override;
+  // Waits until everything logged so far was handed to |inner|, then flushes
+  // |inner|.
+  void flush() override;
+  void set_pattern(const std::string &pattern) override;
+  void set_formatter(std::unique_ptr<spdlog::formatter> formatter) override;
+
+ private:
+  static const size_t kMaxRings = 64;
+  static const size_t kRingSize = 1024;
+
+  struct Ring;
+
+  Ring *LocalRing();
+  void Wake();
+  // Waits until the consumer caught up with every ring's current head.
+  void Drain();
+  void ConsumeLoop();
+  bool Consume();
+
+  const uint64_t id_;
+  // Lets threads tell the rings of dropped sinks from live ones.
+  const std::shared_ptr<void> alive_;
+  std::shared_ptr<spdlog::sinks::sink> inner_;
+
+  // Rings are only added, by the first log() of each thread. Threads past
+  // |kMaxRings| share rings, which is what the per ring producer lock is for.
+  std::unique_ptr<Ring> rings_[kMaxRings];
+  std::atomic<size_t> ring_count_;
+  // Threads that took a ring, so that shared rings are handed out in turn.
+  size_t thread_count_;
+  std::mutex rings_mutex_;
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable drained_;
+  // Set by the consumer before it sleeps. Producers only take |mutex_| to
+  // wake it when they see this flag.
+  std::atomic<bool> sleeping_;
+  bool woken_;
+  bool stopping_;
+
+  std::thread consumer_;
+};
+
+#endif  // !STAGING_SINK_H
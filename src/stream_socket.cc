@@ -0,0 +1,133 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#include <cerrno>
+#include <cstring>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "stream_socket.h"
+
+#if !defined(_WIN32)
+
+namespace {
+
+// Connects without blocking, so a peer that does not answer only holds up
+// the caller for the timeout.
+bool ConnectWithTimeout(int socket, const sockaddr *address,
+                        socklen_t length, int timeout_ms) {
+  const int flags = ::fcntl(socket, F_GETFL);
+  ::fcntl(socket, F_SETFL, flags | O_NONBLOCK);
+  int error = 0;
+  if (::connect(socket, address, length) != 0) {
+    error = errno;
+    if (error == EINPROGRESS) {
+      pollfd poll_fd = {socket, POLLOUT, 0};
+      socklen_t size = sizeof(error);
+      if (::poll(&poll_fd, 1, timeout_ms) != 1 ||
+          ::getsockopt(socket, SOL_SOCKET, SO_ERROR, &error, &size) != 0) {
+        error = ETIMEDOUT;
+      }
+    }
+  }
+  ::fcntl(socket, F_SETFL, flags);
+  return error == 0;
+}
+
+}  // namespace
+
+int ConnectStream(const std::string &path, const std::string &host,
+                  uint16_t port, int timeout_ms) {
+  int fd = -1;
+  if (!path.empty()) {
+    sockaddr_un address;
+    if (path.size() >= sizeof(address.sun_path)) {
+      return -1;
+    }
+    fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+      return -1;
+    }
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.data(), path.size());
+    if (!ConnectWithTimeout(fd, reinterpret_cast<sockaddr *>(&address),
+                            sizeof(address), timeout_ms)) {
+      ::close(fd);
+      return -1;
+    }
+  } else {
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *addresses = NULL;
+    if (::getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints,
+                      &addresses) != 0) {
+      return -1;
+    }
+    for (addrinfo *address = addresses; address != NULL;
+         address = address->ai_next) {
+      fd = ::socket(address->ai_family, address->ai_socktype,
+                    address->ai_protocol);
+      if (fd < 0) {
+        continue;
+      }
+      if (ConnectWithTimeout(fd, address->ai_addr, address->ai_addrlen,
+                             timeout_ms)) {
+        const int enable = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        break;
+      }
+      ::close(fd);
+      fd = -1;
+    }
+    ::freeaddrinfo(addresses);
+    if (fd < 0) {
+      return -1;
+    }
+  }
+
+  ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+  timeval timeout = {timeout_ms / 1000, (timeout_ms % 1000) * 1000};
+  ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+#if defined(SO_NOSIGPIPE)
+  const int enable = 1;
+  ::setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &enable, sizeof(enable));
+#endif
+  return fd;
+}
+
+bool SendAll(int socket, const char *data, size_t size) {
+#if defined(MSG_NOSIGNAL)
+  const int flags = MSG_NOSIGNAL;
+#else
+  const int flags = 0;
+#endif
+  while (size > 0) {
+    const ssize_t sent = ::send(socket, data, size, flags);
+    if (sent < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += sent;
+    size -= static_cast<size_t>(sent);
+  }
+  return true;
+}
+
+#endif
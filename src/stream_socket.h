@@ -0,0 +1,30 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#ifndef STREAM_SOCKET_H
+#define STREAM_SOCKET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#if !defined(_WIN32)
+
+// Connects a stream socket to the Unix domain socket at |path| or, if it is
+// empty, to |host| and |port| over TCP. A peer that takes longer than
+// |timeout_ms| to accept the connection or data counts as unreachable, and a
+// peer that went away makes sends fail instead of raising SIGPIPE. Returns
+// the socket, or -1.
+int ConnectStream(const std::string &path, const std::string &host,
+                  uint16_t port, int timeout_ms);
+
+// Sends all of |data| on a socket from ConnectStream(). Returns false if the
+// connection failed.
+bool SendAll(int socket, const char *data, size_t size);
+
+#endif
+
+#endif  // !STREAM_SOCKET_H
@@ -0,0 +1,403 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#if !defined(_WIN32)
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "record.h"
+#include "sink_helpers.h"
+#include "syslog_sink.h"
+
+namespace {
+
+// Datagrams sent with one system call.
+const size_t kBatch = 64;
+// How long datagrams wait for the sender at most.
+const std::chrono::milliseconds kInterval(10);
+// Bytes of datagrams that may wait for the sender, beyond them records are
+// dropped.
+const size_t kMaxPending = 4 * 1024 * 1024;
+// Longer messages are cut, the default socket buffer could not take them.
+const size_t kMaxDatagram = 48 * 1024;
+const int kTimeoutMs = 1000;
+
+int Severity(spdlog::level::level_enum level) {
+  switch (level) {
+    case spdlog::level::critical:
+      return 2;
+    case spdlog::level::err:
+      return 3;
+    case spdlog::level::warn:
+      return 4;
+    case spdlog::level::info:
+      return 6;
+    default:
+      return 7;
+  }
+}
+
+// RFC 5424 header fields are printable ASCII without spaces, "-" if empty.
+std::string HeaderField(const std::string &value, size_t max) {
+  std::string field = value.substr(0, max);
+  for (char &c : field) {
+    if (c <= ' ' || c > '~') {
+      c = '_';
+    }
+  }
+  return field.empty() ? "-" : field;
+}
+
+void AppendString(const char *text, spdlog::memory_buf_t &dest) {
+  dest.append(text, text + std::strlen(text));
+}
+
+spdlog::string_view_t TrimEol(spdlog::string_view_t text) {
+  size_t size = text.size();
+  while (size > 0 && (text.data()[size - 1] == '\n' ||
+                      text.data()[size - 1] == '\r')) {
+    --size;
+  }
+  return spdlog::string_view_t(text.data(), size);
+}
+
+}  // namespace
+
+#if defined(_WIN32)
+
+SyslogSink::SyslogSink(std::shared_ptr<spdlog::sinks::sink>,
+                       const Options &) {
+  spdlog::throw_spdlog_ex("The syslog sink needs Unix domain sockets");
+}
+
+SyslogSink::~SyslogSink() {}
+
+void SyslogSink::sink_it_(const spdlog::details::log_msg &) {}
+
+void SyslogSink::flush_() {}
+
+#else
+
+SyslogSink::SyslogSink(std::shared_ptr<spdlog::sinks::sink> inner,
+                       const Options &options)
+    : inner_(std::move(inner)),
+      options_(options),
+      pid_(std::to_string(spdlog::details::os::pid())),
+      send_now_(false),
+      stopping_(false),
+      dropped_(0),
+      socket_(-1),
+      reported_(false) {
+  if (options_.path.size() >= sizeof(sockaddr_un().sun_path)) {
+    spdlog::throw_spdlog_ex("The syslog socket path is too long");
+  }
+  if (options_.facility < 0 || options_.facility > 23) {
+    spdlog::throw_spdlog_ex("The syslog facility must be from 0 to 23");
+  }
+  char hostname[256] = {0};
+  if (::gethostname(hostname, sizeof(hostname) - 1) == 0) {
+    hostname_ = hostname;
+  }
+  inner_->set_formatter(spdlog::details::make_unique<PassthroughFormatter>());
+  sender_ = std::thread(&SyslogSink::SendLoop, this);
+}
+
+SyslogSink::~SyslogSink() {
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_one();
+  sender_.join();
+  if (socket_ >= 0) {
+    ::close(socket_);
+  }
+}
+
+void SyslogSink::sink_it_(const spdlog::details::log_msg &msg) {
+  // The header is decoded before the formatter releases pinned text.
+  const record::View view = record::Decode(msg.payload);
+  formatted_.clear();
+  const size_t start = record::FormatForwarded(*formatter_, msg, formatted_);
+  spdlog::details::log_msg formatted = msg;
+  formatted.payload = spdlog::string_view_t(formatted_.data(), formatted_.size());
+  inner_->log(formatted);
+
+  spdlog::string_view_t text = TrimEol(spdlog::string_view_t(
+      formatted_.data() + start, formatted_.size() - start));
+  if (text.size() > kMaxDatagram) {
+    text = spdlog::string_view_t(text.data(), kMaxDatagram);
+  }
+  datagram_.clear();
+  const record::Context *context = view.has_context ? &view.context : NULL;
+  if (options_.format == kJournald) {
+    AppendJournald(msg, context, text);
+  } else {
+    AppendRfc5424(msg, context, text);
+  }
+
+  bool wake = false;
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    if (pending_.size() + datagram_.size() > kMaxPending) {
+      ++dropped_;
+      return;
+    }
+    pending_.append(datagram_.data(), datagram_.size());
+    pending_ends_.push_back(pending_.size());
+    wake = pending_ends_.size() == kBatch;
+  }
+  if (wake) {
+    wake_.notify_one();
+  }
+}
+
+void SyslogSink::flush_() {
+  inner_->flush();
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    send_now_ = true;
+  }
+  wake_.notify_one();
+}
+
+void SyslogSink::AppendRfc5424(const spdlog::details::log_msg &msg,
+                               const record::Context *context,
+                               spdlog::string_view_t text) {
+  using spdlog::details::fmt_helper::append_int;
+  using spdlog::details::fmt_helper::pad2;
+  datagram_.push_back('<');
+  append_int(options_.facility * 8 + Severity(msg.level), datagram_);
+  AppendString(">1 ", datagram_);
+
+  const auto since_epoch = msg.time.time_since_epoch();
+  const auto seconds =
+      std::chrono::duration_cast<std::chrono::seconds>(since_epoch);
+  const std::tm tm =
+      spdlog::details::os::gmtime(static_cast<std::time_t>(seconds.count()));
+  append_int(tm.tm_year + 1900, datagram_);
+  datagram_.push_back('-');
+  pad2(tm.tm_mon + 1, datagram_);
+  datagram_.push_back('-');
+  pad2(tm.tm_mday, datagram_);
+  datagram_.push_back('T');
+  pad2(tm.tm_hour, datagram_);
+  datagram_.push_back(':');
+  pad2(tm.tm_min, datagram_);
+  datagram_.push_back(':');
+  pad2(tm.tm_sec, datagram_);
+  datagram_.push_back('.');
+  spdlog::details::fmt_helper::pad6(
+      static_cast<uint64_t>(
+          std::chrono::duration_cast<std::chrono::microseconds>(since_epoch -
+                                                                seconds)
+              .count()),
+      datagram_);
+  AppendString("Z ", datagram_);
+
+  const std::string hostname = HeaderField(hostname_, 255);
+  const std::string app_name = HeaderField(options_.app_name, 48);
+  datagram_.append(hostname.data(), hostname.data() + hostname.size());
+  datagram_.push_back(' ');
+  datagram_.append(app_name.data(), app_name.data() + app_name.size());
+  datagram_.push_back(' ');
+  datagram_.append(pid_.data(), pid_.data() + pid_.size());
+  // No MSGID.
+  AppendString(" - ", datagram_);
+
+  if (context != NULL && context->fields != 0) {
+    // 32473 is the enterprise number RFC 5612 sets aside for examples.
+    AppendString("[context@32473", datagram_);
+    if (context->fields & record::Context::kTraceId) {
+      AppendString(" trace_id=\"", datagram_);
+      record::AppendHex(context->trace_id, sizeof(context->trace_id),
+                        datagram_);
+      datagram_.push_back('"');
+    }
+    if (context->fields & record::Context::kSpanId) {
+      AppendString(" span_id=\"", datagram_);
+      record::AppendHex(context->span_id, sizeof(context->span_id), datagram_);
+      datagram_.push_back('"');
+    }
+    if (context->fields & record::Context::kRequestId) {
+      AppendString(" request_id=\"", datagram_);
+      append_int(context->request_id, datagram_);
+      datagram_.push_back('"');
+    }
+    datagram_.push_back(']');
+  } else {
+    datagram_.push_back('-');
+  }
+  datagram_.push_back(' ');
+  datagram_.append(text.data(), text.data() + text.size());
+}
+
+void SyslogSink::AppendJournald(const spdlog::details::log_msg &msg,
+                                const record::Context *context,
+                                spdlog::string_view_t text) {
+  using spdlog::details::fmt_helper::append_int;
+  AppendString("PRIORITY=", datagram_);
+  append_int(Severity(msg.level), datagram_);
+  AppendString("\nSYSLOG_FACILITY=", datagram_);
+  append_int(options_.facility, datagram_);
+  AppendString("\nSYSLOG_IDENTIFIER=", datagram_);
+  datagram_.append(options_.app_name.data(),
+                   options_.app_name.data() + options_.app_name.size());
+  // journald stamps records with the time they arrive.
+  datagram_.push_back('\n');
+  if (context != NULL) {
+    if (context->fields & record::Context::kTraceId) {
+      AppendString("TRACE_ID=", datagram_);
+      record::AppendHex(context->trace_id, sizeof(context->trace_id),
+                        datagram_);
+      datagram_.push_back('\n');
+    }
+    if (context->fields & record::Context::kSpanId) {
+      AppendString("SPAN_ID=", datagram_);
+      record::AppendHex(context->span_id, sizeof(context->span_id), datagram_);
+      datagram_.push_back('\n');
+    }
+    if (context->fields & record::Context::kRequestId) {
+      AppendString("REQUEST_ID=", datagram_);
+      append_int(context->request_id, datagram_);
+      datagram_.push_back('\n');
+    }
+  }
+
+  if (std::memchr(text.data(), '\n', text.size()) == NULL) {
+    AppendString("MESSAGE=", datagram_);
+  } else {
+    // Values with a newline go with their length, as 64 bit little endian.
+    AppendString("MESSAGE\n", datagram_);
+    uint64_t size = text.size();
+    for (int i = 0; i < 8; ++i) {
+      datagram_.push_back(static_cast<char>(size & 0xff));
+      size >>= 8;
+    }
+  }
+  datagram_.append(text.data(), text.data() + text.size());
+  datagram_.push_back('\n');
+}
+
+void SyslogSink::SendLoop() {
+  std::string data;
+  std::vector<size_t> ends;
+  std::unique_lock<std::mutex> lock(queue_mutex_);
+  for (;;) {
+    wake_.wait_for(lock, kInterval, [this] {
+      return stopping_ || send_now_ || pending_ends_.size() >= kBatch;
+    });
+    const bool stopping = stopping_;
+    send_now_ = false;
+    data.clear();
+    ends.clear();
+    data.swap(pending_);
+    ends.swap(pending_ends_);
+    const uint64_t dropped = dropped_;
+    dropped_ = 0;
+    lock.unlock();
+
+    if (dropped > 0) {
+      ReportError("Records for syslog were dropped, the sender fell behind");
+    }
+    if (!ends.empty()) {
+      Send(data, ends);
+    }
+
+    lock.lock();
+    if (stopping && pending_ends_.empty()) {
+      return;
+    }
+  }
+}
+
+void SyslogSink::Send(const std::string &data,
+                      const std::vector<size_t> &ends) {
+  if (socket_ < 0) {
+    socket_ = ::socket(AF_UNIX, SOCK_DGRAM, 0);
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    const std::string &path =
+        !options_.path.empty() ? options_.path
+        : options_.format == kJournald ? std::string("/run/systemd/journal/socket")
+                                       : std::string("/dev/log");
+    std::memcpy(address.sun_path, path.data(),
+                std::min(path.size(), sizeof(address.sun_path) - 1));
+    if (socket_ < 0 ||
+        ::connect(socket_, reinterpret_cast<sockaddr *>(&address),
+                  sizeof(address)) != 0) {
+      if (socket_ >= 0) {
+        ::close(socket_);
+        socket_ = -1;
+      }
+      if (!reported_) {
+        reported_ = true;
+        ReportError("Failed to connect to the syslog socket, records are "
+                    "dropped");
+      }
+      return;
+    }
+    timeval timeout = {kTimeoutMs / 1000, (kTimeoutMs % 1000) * 1000};
+    ::setsockopt(socket_, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    reported_ = false;
+  }
+
+  size_t sent = 0;
+  while (sent < ends.size()) {
+    const size_t count = std::min(ends.size() - sent, kBatch);
+#if defined(__linux__)
+    mmsghdr headers[kBatch];
+    iovec vectors[kBatch];
+    std::memset(headers, 0, sizeof(headers[0]) * count);
+    for (size_t i = 0; i < count; ++i) {
+      const size_t start = sent + i == 0 ? 0 : ends[sent + i - 1];
+      vectors[i].iov_base = const_cast<char *>(data.data() + start);
+      vectors[i].iov_len = ends[sent + i] - start;
+      headers[i].msg_hdr.msg_iov = &vectors[i];
+      headers[i].msg_hdr.msg_iovlen = 1;
+    }
+    const int result =
+        ::sendmmsg(socket_, headers, static_cast<unsigned>(count), 0);
+#else
+    const size_t start = sent == 0 ? 0 : ends[sent - 1];
+    const int result =
+        ::send(socket_, data.data() + start, ends[sent] - start, 0) < 0 ? -1
+                                                                        : 1;
+#endif
+    if (result > 0) {
+      sent += static_cast<size_t>(result);
+      continue;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    if (errno == EMSGSIZE || errno == ENOBUFS) {
+      // Only this datagram is lost.
+      ++sent;
+      continue;
+    }
+    // The receiver went away or did not keep up, drop the rest and connect
+    // again next time.
+    ::close(socket_);
+    socket_ = -1;
+    if (!reported_) {
+      reported_ = true;
+      ReportError("Failed to send to the syslog socket, records are dropped");
+    }
+    return;
+  }
+}
+
+#endif
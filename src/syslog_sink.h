@@ -0,0 +1,91 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#ifndef SYSLOG_SINK_H
+#define SYSLOG_SINK_H
+
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/base_sink.h>
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "record.h"
+
+// Passes every formatted record on to |inner| and also sends it as a
+// datagram to a local Unix domain socket, as an RFC 5424 syslog message or
+// in the native protocol of journald. The async context of a record becomes
+// structured data or journal fields.
+//
+// Records are turned into datagrams where the sink is written to and a
+// sender thread sends them, many per sendmmsg() call on Linux. Records the
+// socket does not take, because nothing listens or the receiver is
+// overwhelmed, are dropped. Not available on Windows.
+class SyslogSink : public spdlog::sinks::base_sink<std::mutex> {
+ public:
+  enum Format { kRfc5424, kJournald };
+
+  struct Options {
+    Options() : format(kRfc5424), facility(1) {}
+
+    // Defaults to /dev/log, or the journald socket for kJournald.
+    std::string path;
+    Format format;
+    std::string app_name;
+    // 0 to 23, 1 is user.
+    int facility;
+  };
+
+  SyslogSink(std::shared_ptr<spdlog::sinks::sink> inner,
+             const Options &options);
+  // Sends what is left.
+  ~SyslogSink() override;
+
+ protected:
+  void sink_it_(const spdlog::details::log_msg &msg) override;
+  // Also has the sender send the datagrams collected so far without waiting
+  // for them to be sent.
+  void flush_() override;
+
+ private:
+  // Append the datagram of |msg| to |datagram_|. |context| may be NULL.
+  void AppendRfc5424(const spdlog::details::log_msg &msg,
+                     const record::Context *context,
+                     spdlog::string_view_t text);
+  void AppendJournald(const spdlog::details::log_msg &msg,
+                      const record::Context *context,
+                      spdlog::string_view_t text);
+  void SendLoop();
+  void Send(const std::string &data, const std::vector<size_t> &ends);
+
+  std::shared_ptr<spdlog::sinks::sink> inner_;
+  const Options options_;
+  std::string hostname_;
+  std::string pid_;
+  spdlog::memory_buf_t formatted_;
+  spdlog::memory_buf_t datagram_;
+
+  std::mutex queue_mutex_;
+  std::condition_variable wake_;
+  // Datagrams back to back, and where each of them ends.
+  std::string pending_;
+  std::vector<size_t> pending_ends_;
+  bool send_now_;
+  bool stopping_;
+  uint64_t dropped_;
+
+  // Only used by the sender thread.
+  int socket_;
+  bool reported_;
+
+  std::thread sender_;
+};
+
+#endif  // !SYSLOG_SINK_H
@@ -0,0 +1,123 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#include <algorithm>
+
+#include "message_template.h"
+#include "top_talkers.h"
+
+TopTalkers::TopTalkers(size_t capacity, uint32_t sampleEvery)
+    : capacity_(std::max<size_t>(capacity, 1)),
+      sample_every_(std::max<uint32_t>(sampleEvery, 1)),
+      random_(0x9e3779b97f4a7c15ULL ^
+              reinterpret_cast<uintptr_t>(this)),
+      start_(std::chrono::steady_clock::now()) {
+  countdown_ = NextGap();
+  heap_.reserve(capacity_);
+  index_.reserve(capacity_);
+}
+
+uint32_t TopTalkers::NextGap() {
+  if (sample_every_ == 1) {
+    return 1;
+  }
+  // Random gaps averaging |sample_every_|, a fixed stride would always
+  // sample the same message of a repeating sequence.
+  random_ ^= random_ << 13;
+  random_ ^= random_ >> 7;
+  random_ ^= random_ << 17;
+  return 1 + static_cast<uint32_t>(random_ % (2 * uint64_t(sample_every_) - 1));
+}
+
+void TopTalkers::Add(const char *data, size_t size,
+                     spdlog::level::level_enum level) {
+  const uint64_t hash = MessageTemplate(data, size, level, &text_);
+
+  auto found = index_.find(hash);
+  if (found != index_.end()) {
+    ++heap_[found->second].count;
+    SiftDown(found->second);
+  } else if (heap_.size() < capacity_) {
+    heap_.push_back(Entry{hash, 1, 0, level, text_});
+    index_[hash] = heap_.size() - 1;
+    SiftUp(heap_.size() - 1);
+  } else {
+    Entry &smallest = heap_[0];
+    index_.erase(smallest.hash);
+    smallest.hash = hash;
+    smallest.error = smallest.count;
+    ++smallest.count;
+    smallest.level = level;
+    smallest.text = text_;
+    index_[hash] = 0;
+    SiftDown(0);
+  }
+}
+
+std::vector<TopTalkers::Talker> TopTalkers::Top(size_t count) const {
+  std::vector<const Entry *> entries;
+  entries.reserve(heap_.size());
+  for (const Entry &entry : heap_) {
+    entries.push_back(&entry);
+  }
+  count = std::min(count, entries.size());
+  std::partial_sort(entries.begin(), entries.begin() + count, entries.end(),
+                    [](const Entry *a, const Entry *b) {
+                      return a->count > b->count;
+                    });
+
+  std::vector<Talker> top;
+  top.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    const Entry &entry = *entries[i];
+    top.push_back(Talker{entry.text, entry.level,
+                         entry.count * sample_every_,
+                         entry.error * sample_every_});
+  }
+  return top;
+}
+
+double TopTalkers::Seconds() const {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start_)
+      .count();
+}
+
+void TopTalkers::SiftDown(size_t i) {
+  for (;;) {
+    size_t smallest = i;
+    const size_t left = 2 * i + 1;
+    const size_t right = left + 1;
+    if (left < heap_.size() && heap_[left].count < heap_[smallest].count) {
+      smallest = left;
+    }
+    if (right < heap_.size() && heap_[right].count < heap_[smallest].count) {
+      smallest = right;
+    }
+    if (smallest == i) {
+      return;
+    }
+    Swap(i, smallest);
+    i = smallest;
+  }
+}
+
+void TopTalkers::SiftUp(size_t i) {
+  while (i > 0) {
+    const size_t parent = (i - 1) / 2;
+    if (heap_[parent].count <= heap_[i].count) {
+      return;
+    }
+    Swap(i, parent);
+    i = parent;
+  }
+}
+
+void TopTalkers::Swap(size_t a, size_t b) {
+  std::swap(heap_[a], heap_[b]);
+  index_[heap_[a].hash] = a;
+  index_[heap_[b].hash] = b;
+}
@@ -0,0 +1,82 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#ifndef TOP_TALKERS_H
+#define TOP_TALKERS_H
+
+#include <spdlog/spdlog.h>
+
+#include <chrono>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Finds the message templates logged most often with the Space-Saving
+// algorithm: a fixed number of counters, where a template without one takes
+// over the smallest counter and inherits its count as possible error. Any
+// template logged more often than 1/|capacity| of all sampled messages is
+// guaranteed to hold a counter.
+//
+// Messages are keyed by their MessageTemplate(). Only a random sample of
+// about one in |sampleEvery| messages is counted; counts are scaled back up
+// when read.
+class TopTalkers {
+ public:
+  struct Talker {
+    std::string text;
+    spdlog::level::level_enum level;
+    // Estimated messages, at most |error| too high.
+    uint64_t count;
+    uint64_t error;
+  };
+
+  TopTalkers(size_t capacity, uint32_t sampleEvery);
+
+  // Whether the next message is part of the sample. Cheap enough to call for
+  // every message.
+  bool Sampled() {
+    if (--countdown_ > 0) {
+      return false;
+    }
+    countdown_ = NextGap();
+    return true;
+  }
+
+  // Counts a sampled message, of which only the start is needed.
+  void Add(const char *data, size_t size, spdlog::level::level_enum level);
+
+  // The |count| templates with the highest counts, highest first.
+  std::vector<Talker> Top(size_t count) const;
+  // Seconds since counting started.
+  double Seconds() const;
+
+ private:
+  struct Entry {
+    uint64_t hash;
+    uint64_t count;
+    uint64_t error;
+    spdlog::level::level_enum level;
+    std::string text;
+  };
+
+  uint32_t NextGap();
+  void SiftDown(size_t i);
+  void SiftUp(size_t i);
+  void Swap(size_t a, size_t b);
+
+  const size_t capacity_;
+  const uint32_t sample_every_;
+  uint32_t countdown_;
+  uint64_t random_;
+  const std::chrono::steady_clock::time_point start_;
+
+  // Min-heap on count, so the counter to take over is always at the front.
+  std::vector<Entry> heap_;
+  std::unordered_map<uint64_t, size_t> index_;
+  std::string text_;
+};
+
+#endif  // !TOP_TALKERS_H
@@ -0,0 +1,189 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+#include "serializer.h"
+#include "sink_helpers.h"
+#include "trace_sink.h"
+
+namespace {
+
+// Spans that make the writer write without waiting for the interval.
+const size_t kBatch = 4096;
+const std::chrono::milliseconds kInterval(100);
+
+void AppendString(const char *text, spdlog::memory_buf_t &dest) {
+  dest.append(text, text + std::strlen(text));
+}
+
+// Appends |value| with three decimals, the nanoseconds of a microsecond
+// value.
+void AppendMicros(double value, spdlog::memory_buf_t &dest) {
+  const int64_t nanos = static_cast<int64_t>(value * 1000 + 0.5);
+  spdlog::details::fmt_helper::append_int(nanos / 1000, dest);
+  dest.push_back('.');
+  spdlog::details::fmt_helper::pad3(static_cast<uint32_t>(nanos % 1000), dest);
+}
+
+// Sinks of live loggers by name.
+std::mutex registry_mutex;
+std::unordered_map<std::string, std::weak_ptr<TraceSink>> registry;
+
+}  // namespace
+
+std::shared_ptr<TraceSink> TraceSink::ForLogger(
+    const std::string &name, const spdlog::filename_t &path) {
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  std::shared_ptr<TraceSink> sink = registry[name].lock();
+  if (sink) {
+    if (!path.empty() && path != sink->path_) {
+      spdlog::throw_spdlog_ex("The logger " + name +
+                              " already writes spans to another trace file");
+    }
+    return sink;
+  }
+  if (path.empty()) {
+    registry.erase(name);
+    return NULL;
+  }
+  sink = std::make_shared<TraceSink>(path, name);
+  registry[name] = sink;
+  return sink;
+}
+
+TraceSink::TraceSink(const spdlog::filename_t &path,
+                     const std::string &process_name)
+    : path_(path),
+      file_(NULL),
+      pid_(spdlog::details::os::pid()),
+      added_(0),
+      done_(0),
+      write_now_(false),
+      stopping_(false) {
+  if (spdlog::details::os::fopen_s(&file_, path, SPDLOG_FILENAME_T("wb"))) {
+    spdlog::throw_spdlog_ex("Failed to open the trace file", errno);
+  }
+  // Every span follows with a comma in front.
+  AppendString("[{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":", buffer_);
+  spdlog::details::fmt_helper::append_int(pid_, buffer_);
+  AppendString(",\"args\":{\"name\":\"", buffer_);
+  const size_t start = buffer_.size();
+  buffer_.append(process_name.data(), process_name.data() + process_name.size());
+  EscapeJson(start, buffer_);
+  AppendString("\"}}", buffer_);
+  std::fwrite(buffer_.data(), 1, buffer_.size(), file_);
+  std::fflush(file_);
+
+  writer_ = std::thread(&TraceSink::WriteLoop, this);
+}
+
+TraceSink::~TraceSink() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_one();
+  writer_.join();
+  std::fputs("\n]\n", file_);
+  std::fclose(file_);
+}
+
+void TraceSink::Add(spdlog::string_view_t name, double start, double end) {
+  const uint32_t thread =
+      static_cast<uint32_t>(spdlog::details::os::thread_id());
+  bool wake = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Looked up without a copy in the common case of a known name.
+    key_.assign(name.data(), name.size());
+    auto found = ids_.find(key_);
+    uint32_t id;
+    if (found != ids_.end()) {
+      id = found->second;
+    } else {
+      id = static_cast<uint32_t>(names_.size());
+      ids_.emplace(key_, id);
+      spdlog::memory_buf_t escaped;
+      escaped.append(name.data(), name.data() + name.size());
+      EscapeJson(0, escaped);
+      names_.emplace_back(escaped.data(), escaped.size());
+    }
+    Span span;
+    span.name = id;
+    span.thread = thread;
+    span.start = start;
+    span.duration = end > start ? end - start : 0;
+    pending_.push_back(span);
+    ++added_;
+    wake = pending_.size() == kBatch;
+  }
+  if (wake) {
+    wake_.notify_one();
+  }
+}
+
+void TraceSink::Flush() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  const uint64_t target = added_;
+  write_now_ = true;
+  wake_.notify_one();
+  written_.wait(lock, [this, target] { return done_ >= target; });
+}
+
+void TraceSink::WriteLoop() {
+  std::vector<Span> spans;
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    wake_.wait_for(lock, kInterval, [this] {
+      return stopping_ || write_now_ || pending_.size() >= kBatch;
+    });
+    const bool stopping = stopping_;
+    write_now_ = false;
+    spans.clear();
+    spans.swap(pending_);
+    // Names only grow, the new ones are copied while the lock is held.
+    for (size_t i = written_names_.size(); i < names_.size(); ++i) {
+      written_names_.push_back(names_[i]);
+    }
+    lock.unlock();
+
+    if (!spans.empty()) {
+      Write(spans);
+    }
+
+    lock.lock();
+    done_ += spans.size();
+    written_.notify_all();
+    if (stopping && pending_.empty()) {
+      return;
+    }
+  }
+}
+
+void TraceSink::Write(const std::vector<Span> &spans) {
+  buffer_.clear();
+  for (const Span &span : spans) {
+    AppendString(",\n{\"name\":\"", buffer_);
+    const std::string &name = written_names_[span.name];
+    buffer_.append(name.data(), name.data() + name.size());
+    AppendString("\",\"ph\":\"X\",\"ts\":", buffer_);
+    AppendMicros(span.start, buffer_);
+    AppendString(",\"dur\":", buffer_);
+    AppendMicros(span.duration, buffer_);
+    AppendString(",\"pid\":", buffer_);
+    spdlog::details::fmt_helper::append_int(pid_, buffer_);
+    AppendString(",\"tid\":", buffer_);
+    spdlog::details::fmt_helper::append_int(span.thread, buffer_);
+    buffer_.push_back('}');
+  }
+  if (std::fwrite(buffer_.data(), 1, buffer_.size(), file_) != buffer_.size() ||
+      std::fflush(file_) != 0) {
+    ReportError("Failed to write trace events");
+  }
+}
@@ -0,0 +1,83 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for
+ *  license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#ifndef TRACE_SINK_H
+#define TRACE_SINK_H
+
+#include <spdlog/spdlog.h>
+
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Writes timed spans to a file in the Chrome trace event format, which
+// chrome://tracing, Perfetto and speedscope load directly.
+//
+// A span costs a name lookup and 24 bytes in a buffer. A writer thread
+// turns the buffered spans into complete ("X") events; the file is a JSON
+// array that is closed when the sink is destroyed, and the trace viewers
+// also take it unclosed after a crash.
+class TraceSink {
+ public:
+  // |process_name| labels the spans in the viewer.
+  TraceSink(const spdlog::filename_t &path, const std::string &process_name);
+  ~TraceSink();
+
+  // Returns the sink of the logger |name|. Loggers opened under the same
+  // name, for example on worker threads, share it. It is created for |path|
+  // if the logger has none, and it is an error to ask for another file than
+  // the one it has. With an empty |path| it returns the sink the logger has,
+  // if any.
+  static std::shared_ptr<TraceSink> ForLogger(const std::string &name,
+                                              const spdlog::filename_t &path);
+
+  // Records a span of |name| from |start| to |end|, in microseconds of any
+  // monotonic clock, on the calling thread. Thread safe.
+  void Add(spdlog::string_view_t name, double start, double end);
+  // Returns once the spans added so far are written.
+  void Flush();
+
+ private:
+  struct Span {
+    uint32_t name;
+    uint32_t thread;
+    double start;
+    double duration;
+  };
+
+  void WriteLoop();
+  void Write(const std::vector<Span> &spans);
+
+  const spdlog::filename_t path_;
+  std::FILE *file_;
+  const int pid_;
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable written_;
+  // Names are interned, their JSON escaped form is what spans refer to.
+  std::unordered_map<std::string, uint32_t> ids_;
+  std::string key_;
+  std::vector<std::string> names_;
+  std::vector<Span> pending_;
+  // Spans added so far and spans written.
+  uint64_t added_;
+  uint64_t done_;
+  bool write_now_;
+  bool stopping_;
+
+  // Only used by the writer thread.
+  std::vector<std::string> written_names_;
+  spdlog::memory_buf_t buffer_;
+
+  std::thread writer_;
+};
+
+#endif  // !TRACE_SINK_H
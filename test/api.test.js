@@ -6,8 +6,15 @@
 // @ts-check
 
 const assert = require('assert');
+const crypto = require('crypto');
 const fs = require('fs');
+const net = require('net');
 const path = require('path');
+const { AsyncLocalStorage } = require('async_hooks');
+const { spawn } = require('child_process');
+const { performance } = require('perf_hooks');
+const { Worker } = require('worker_threads');
+const zlib = require('zlib');
 const spdlog = require('..');
 
 suite('API', function () {
@@ -281,6 +288,1581 @@ suite('API', function () {
 		assert.strictEqual(actuals[actuals.length - 1], 'Cleared Formatters: This message should be written as is');
 	});
 
+	test('max message size', async function () {
+		testObject = await aTestObject(logFile);
+		testObject.setPattern('%v');
+		testObject.setMaxMessageSize(10);
+
+		testObject.info('short');
+		testObject.info('0123456789abcdef');
+		testObject.info('ø'.repeat(8));
+
+		const actuals = await getAllLines();
+		assert.ok(actuals[actuals.length - 4].endsWith('short'));
+		assert.strictEqual(actuals[actuals.length - 3], '0123456789…[truncated 6 characters]');
+		assert.strictEqual(actuals[actuals.length - 2], 'øøøøø…[truncated 3 characters]');
+	});
+
+	test('max message size does not truncate messages within the limit', async function () {
+		testObject = await aTestObject(logFile);
+		testObject.setPattern('%v');
+		testObject.setMaxMessageSize(10);
+
+		testObject.info('0123456789');
+		testObject.setMaxMessageSize(0);
+		testObject.info('x'.repeat(100));
+
+		const actuals = await getAllLines();
+		assert.strictEqual(actuals[actuals.length - 3], '0123456789');
+		assert.strictEqual(actuals[actuals.length - 2], 'x'.repeat(100));
+	});
+
+	test('unlimited message size keeps multi-byte characters whole', async function () {
+		testObject = await aTestObject(logFile);
+		testObject.setPattern('%v');
+
+		// Two, three and four UTF-8 bytes per character, and a lone surrogate
+		// that is replaced.
+		testObject.info('ø€😀\ud800'.repeat(1000));
+
+		assert.strictEqual(await getLastLine(), 'ø€😀�'.repeat(1000));
+	});
+
+	test('log objects', async function () {
+		testObject = await aTestObject(logFile);
+		testObject.setPattern('%v');
+
+		const cyclic = { name: 'a"b', list: [1, 2.5, null, undefined, true], nested: { date: new Date(0) } };
+		cyclic.self = cyclic;
+		testObject.info(cyclic);
+		testObject.info([new Map([['k', 1]]), new Set(['s']), 10n]);
+
+		const actuals = await getAllLines();
+		assert.strictEqual(actuals[actuals.length - 3], '{"name":"a\\"b","list":[1,2.5,null,null,true],"nested":{"date":"1970-01-01T00:00:00.000Z"},"self":"[Circular]"}');
+		assert.strictEqual(actuals[actuals.length - 2], '[[["k",1]],["s"],10]');
+	});
+
+	test('log objects respects serializer limits', async function () {
+		testObject = await aTestObject(logFile);
+		testObject.setPattern('%v');
+		testObject.setSerializerOptions({ depth: 2, maxItems: 2, maxStringLength: 3 });
+
+		testObject.info({ a: { b: { c: 1 } }, s: 'abcdef', l: [1, 2, 3, 4] });
+
+		const actuals = await getAllLines();
+		assert.strictEqual(actuals[actuals.length - 2], '{"a":{"b":"[Object]"},"s":"abc…[truncated 3 characters]","…":1}');
+	});
+
+	test('serializer options reject invalid values', async function () {
+		testObject = await aTestObject(logFile);
+		testObject.setPattern('%v');
+
+		assert.throws(() => testObject.setSerializerOptions({ depth: -1 }));
+		assert.throws(() => testObject.setSerializerOptions({ maxStringLength: -1 }));
+		assert.throws(() => testObject.setSerializerOptions({ maxItems: 1.5 }));
+		assert.throws(() => testObject.setSerializerOptions({ depth: 'deep' }));
+		assert.throws(() => testObject.setSerializerOptions({ get depth() { throw new Error('getter'); } }), /getter/);
+		// Only loggers created with dedupeStacks have a file that dedupes.
+		assert.throws(() => testObject.setSerializerOptions({ dedupeStacks: true }));
+
+		// A rejected call leaves the previous limits in place.
+		testObject.info({ a: { b: { c: 1 } } });
+
+		const actuals = await getAllLines();
+		assert.strictEqual(actuals[actuals.length - 2], '{"a":{"b":{"c":1}}}');
+	});
+
+	test('log errors', async function () {
+		testObject = await aTestObject(logFile);
+		testObject.setPattern('%v');
+
+		const cause = new RangeError('inner');
+		const error = new TypeError('boom', { cause });
+		error.code = 'E_BOOM';
+		testObject.error(error);
+		testObject.error({ error: new Error('nested') });
+
+		const lines = await getAllLines();
+		const content = lines.join(EOL);
+		assert.ok(content.includes(`${error.stack} {"code":"E_BOOM"}\nCaused by: ${cause.stack}`));
+		const nested = JSON.parse(lines[lines.length - 2]);
+		assert.strictEqual(nested.error.name, 'Error');
+		assert.strictEqual(nested.error.message, 'nested');
+	});
+
+	test('log errors dedupes stacks', async function () {
+		const dedupedFile = path.join(tempDirectory, 'dedupes.log');
+		filesToDelete.push(dedupedFile);
+		assert.throws(() => new spdlog.Logger('rotating', 'dedupes', dedupedFile, 1048576 * 5, 2, { dedupeStacks: true, framed: true }));
+		const logger = await spdlog.createRotatingLogger('dedupes', dedupedFile, 1048576 * 5, 2, { dedupeStacks: true });
+		logger.setPattern('%v');
+
+		let reference;
+		for (let i = 0; i < 2; i++) {
+			logger.error(new Error(`failure ${i}`));
+			if (i === 0) {
+				logger.flush();
+				reference = /\n(    \[stack [0-9a-f]{16}\])/.exec(fs.readFileSync(dedupedFile, 'utf8'))[1];
+				// Text that looks like a stack with the same id is written as it is.
+				logger.error(`not an error\n    at spoofed (spoofed.js:1:1)\n${reference}`);
+			}
+		}
+		logger.drop();
+
+		// Stack frames are separated by \n on every platform.
+		const lines = fs.readFileSync(dedupedFile, 'utf8').split(/\r?\n/);
+		assert.deepStrictEqual(lines.slice(-6), ['not an error', '    at spoofed (spoofed.js:1:1)', reference, 'Error: failure 1', reference, '']);
+		assert.strictEqual(lines[lines.length - 7], reference);
+		assert.ok(lines[lines.length - 8].startsWith('    at '));
+	});
+
+	test('log errors dedupes stacks through every handle', async function () {
+		const dedupedFile = path.join(tempDirectory, 'dedupes-shared.log');
+		filesToDelete.push(dedupedFile);
+		const logger = await spdlog.createRotatingLogger('dedupes-shared', dedupedFile, 1048576 * 5, 2, { dedupeStacks: true });
+		logger.setPattern('%v');
+		// The file was created with dedupeStacks, not this handle.
+		const second = new spdlog.Logger('rotating', 'dedupes-shared', dedupedFile, 1048576 * 5, 2);
+		second.setSerializerOptions({ dedupeStacks: false });
+		second.setSerializerOptions({ dedupeStacks: true });
+
+		for (let i = 0; i < 2; i++) {
+			second.error(new Error(`failure ${i}`));
+		}
+		second.drop();
+		logger.drop();
+
+		const lines = fs.readFileSync(dedupedFile, 'utf8').split(/\r?\n/);
+		const references = lines.filter(line => /^    \[stack [0-9a-f]{16}\]$/.test(line));
+		assert.strictEqual(references.length, 2);
+		assert.deepStrictEqual(lines.slice(-3), ['Error: failure 1', references[0], '']);
+	});
+
+	test('log errors writes deduped stacks in full in every file', async function () {
+		const dedupedFile = path.join(tempDirectory, 'deduped.log');
+		filesToDelete.push(dedupedFile, path.join(tempDirectory, 'deduped.1.log'));
+		// Every record is larger than the file, so each one rotates it.
+		const logger = await spdlog.createRotatingLogger('deduped', dedupedFile, 64, 2, { dedupeStacks: true, flightRecorder: { memoryBudget: 16 * 1024 } });
+		logger.setPattern('%v');
+
+		const errors = [0, 1, 2].map(i => new Error(`failure ${i}`));
+		// Only reaches the flight recorder.
+		logger.debug(errors[0]);
+		logger.error(errors[1]);
+		logger.error(errors[2]);
+		logger.drop();
+
+		assert.ok(fs.readFileSync(dedupedFile).toString().includes(errors[2].stack));
+		assert.ok(fs.readFileSync(path.join(tempDirectory, 'deduped.1.log')).toString().includes(errors[1].stack));
+	});
+
+	test('log errors writes an enumerable cause once', async function () {
+		testObject = await aTestObject(logFile);
+		testObject.setPattern('%v');
+
+		const cause = new RangeError('inner');
+		const error = new TypeError('boom');
+		error.cause = cause;
+		testObject.error(error);
+		testObject.error({ error });
+
+		const lines = await getAllLines();
+		const content = lines.join(EOL);
+		assert.ok(content.includes(`${error.stack}\nCaused by: ${cause.stack}`));
+		const json = lines[lines.length - 2];
+		assert.strictEqual(json.split('"cause"').length, 2);
+	});
+
+	test('log objects is skipped when level is disabled', async function () {
+		testObject = await aTestObject(logFile);
+		testObject.setLevel(3);
+
+		let reads = 0;
+		testObject.info({ get value() { reads++; return 1; } });
+		assert.strictEqual(reads, 0);
+	});
+
+	test('child logger', async function () {
+		testObject = await aTestObject(logFile);
+		testObject.setPattern('%n %v');
+
+		const child = testObject.child({ component: 'git', session: 42, note: 'has space' });
+		const grandChild = child.child({ request: 'r1' });
+		child.info('Hello');
+		grandChild.info({ ok: true });
+		testObject.info('Parent');
+
+		const actuals = await getAllLines();
+		assert.strictEqual(actuals[actuals.length - 4], 'test component=git session=42 note="has space" Hello');
+		assert.strictEqual(actuals[actuals.length - 3], 'test component=git session=42 note="has space" request=r1 {"ok":true}');
+		assert.strictEqual(actuals[actuals.length - 2], 'test Parent');
+	});
+
+	test('child logger quotes ambiguous field names', async function () {
+		testObject = await aTestObject(logFile);
+		testObject.setPattern('%v');
+
+		testObject.child({ 'has space': 1, 'a=b': 'c', '"q"': 'x', plain: 'y' }).info('Hello');
+
+		assert.strictEqual(await getLastLine(), '"has space"=1 "a=b"=c "\\"q\\""=x plain=y Hello');
+	});
+
+	test('child logger throws when reading the context throws', async function () {
+		testObject = await aTestObject(logFile);
+		testObject.setPattern('%v');
+
+		assert.throws(() => testObject.child({ component: 'git', get session() { throw new Error('getter'); } }), /getter/);
+		assert.throws(() => testObject.child(new Proxy({}, { ownKeys() { throw new Error('trap'); } })), /trap/);
+		// Values inside a property are serialized like messages.
+		testObject.child({ nested: { get value() { throw new Error('inner'); } } }).info('Hello');
+
+		const actual = await getLastLine();
+		assert.ok(actual.startsWith('nested={"value":'));
+		assert.ok(actual.endsWith('} Hello'));
+	});
+
+	test('child logger shares the max message size', async function () {
+		testObject = await aTestObject(logFile);
+		testObject.setPattern('%v');
+
+		const child = testObject.child({ component: 'git' });
+		testObject.setMaxMessageSize(10);
+		child.info('0123456789abcdef');
+		child.setMaxMessageSize(4);
+		testObject.info('0123456789abcdef');
+
+		const actuals = await getAllLines();
+		assert.strictEqual(actuals[actuals.length - 3], 'component=git 0123456789…[truncated 6 characters]');
+		assert.strictEqual(actuals[actuals.length - 2], '0123…[truncated 12 characters]');
+	});
+
+	test('child logger stops when parent is dropped', async function () {
+		testObject = await aTestObject(logFile);
+		testObject.setPattern('%v');
+
+		const child = testObject.child({ component: 'git' });
+		child.drop();
+		child.info('Dropped child');
+		testObject.info('Parent');
+		const other = testObject.child({ component: 'other' });
+		testObject.drop();
+		other.info('Dropped parent');
+
+		const content = fs.readFileSync(logFile).toString();
+		testObject = await aTestObject(logFile);
+		assert.ok(content.endsWith(`Parent${EOL}`));
+	});
+
+	test('batching', async function () {
+		testObject = await aTestObject(logFile);
+		testObject.setPattern('%l %v');
+		testObject.setBatching(true);
+
+		testObject.info('first');
+		testObject.trace('filtered');
+		testObject.error({ second: true });
+		testObject.warn('third');
+		assert.ok(!fs.readFileSync(logFile).toString().includes('first'));
+		await Promise.resolve();
+		testObject.info('fourth');
+		testObject.setBatching(false);
+		testObject.info('fifth');
+
+		const actuals = await getAllLines();
+		assert.deepStrictEqual(actuals.slice(-6, -1), ['info first', 'error {"second":true}', 'warning third', 'info fourth', 'info fifth']);
+	});
+
+	test('batching survives logging while a batch is written', async function () {
+		testObject = await aTestObject(logFile);
+		testObject.setPattern('%l %v');
+		testObject.setBatching(true);
+
+		const logger = testObject;
+		testObject.info({
+			toJSON() {
+				logger.warn('inner 1');
+				logger.warn('inner 2');
+				return 'outer';
+			}
+		});
+		testObject.error('second');
+		testObject.critical('third');
+		await Promise.resolve();
+
+		const actuals = await getAllLines();
+		assert.deepStrictEqual(actuals.slice(-6, -1), ['info "outer"', 'error second', 'critical third', 'warning inner 1', 'warning inner 2']);
+	});
+
+	test('batching checks the level at call time', async function () {
+		testObject = await aTestObject(logFile);
+		testObject.setPattern('%l %v');
+		testObject.setLevel(2);
+		testObject.setBatching(true);
+
+		testObject.debug('dropped');
+		testObject.info('first');
+		testObject.child({ dump: 1 }).setLevel(4);
+		testObject.warn('dropped too');
+		testObject.error('second');
+		testObject.setLevel(0);
+		testObject.debug('third');
+		await Promise.resolve();
+		testObject.setBatching(false);
+
+		const actuals = await getAllLines();
+		assert.deepStrictEqual(actuals.slice(-4, -1), ['info first', 'error second', 'debug third']);
+	});
+
+	test('batching checks the level at call time across a global setLevel', async function () {
+		testObject = await aTestObject(logFile);
+		testObject.setPattern('%l %v');
+		testObject.setBatching(true);
+
+		try {
+			testObject.info('first');
+			spdlog.setLevel(3);
+			testObject.info('dropped');
+			testObject.warn('second');
+			spdlog.setLevel(2);
+			testObject.info('third');
+			await Promise.resolve();
+		} finally {
+			spdlog.setLevel(2);
+		}
+		testObject.setBatching(false);
+
+		const actuals = await getAllLines();
+		assert.deepStrictEqual(actuals.slice(-4, -1), ['info first', 'warning second', 'info third']);
+	});
+
+	test('batching reports errors instead of throwing', async function () {
+		testObject = await aTestObject(logFile);
+		testObject.setPattern('%l %v');
+		testObject.setAsyncContext({ getStore() { throw new Error('No store'); } });
+		testObject.setBatching(true);
+
+		const errors = [];
+		const consoleError = console.error;
+		console.error = message => errors.push(message);
+		try {
+			testObject.info('first');
+			await Promise.resolve();
+		} finally {
+			console.error = consoleError;
+		}
+		testObject.setBatching(false);
+
+		assert.deepStrictEqual(errors, ['[*** LOG ERROR ***] No store']);
+		assert.strictEqual(await getLastLine(), 'info first');
+	});
+
+	test('batching keeps call time', async function () {
+		testObject = await aTestObject(logFile);
+		testObject.setPattern('%Y-%m-%dT%H:%M:%S.%e %v');
+
+		testObject.logBatch(Uint8Array.of(2), ['Old message'], Float64Array.of(Date.UTC(2020, 0, 2, 3, 4, 5, 678)));
+		// "off" is not a level to log at.
+		testObject.logBatch(Uint8Array.of(6), ['Off message'], Float64Array.of(Date.now()));
+		const contexts = [];
+		Object.defineProperty(contexts, 0, { get() { throw new Error('context getter'); } });
+		assert.throws(() => testObject.logBatch(Uint8Array.of(2, 2), ['Dropped', 'Not reached'], Float64Array.of(Date.now(), Date.now()), contexts), /context getter/);
+
+		const actual = await getLastLine();
+		const expected = new Date(Date.UTC(2020, 0, 2, 3, 4, 5, 678));
+		const pad = (n, width = 2) => String(n).padStart(width, '0');
+		assert.strictEqual(actual, `${expected.getFullYear()}-${pad(expected.getMonth() + 1)}-${pad(expected.getDate())}T${pad(expected.getHours())}:${pad(expected.getMinutes())}:${pad(expected.getSeconds())}.678 Old message`);
+	});
+
+	test('log buffers', async function () {
+		testObject = await aTestObject(logFile);
+		testObject.setPattern('%v');
+
+		// Buffers are copied, large external strings are written from their
+		// own memory.
+		const large = Buffer.alloc(200 * 1024, 'b');
+		const external = Buffer.alloc(2 * 1024 * 1024, 'c').toString('latin1');
+		testObject.info(Buffer.from('Small buffer'));
+		testObject.info(large);
+		testObject.child({ dump: 1 }).info(external);
+		testObject.info(external);
+		testObject.setMaxMessageSize(10);
+		testObject.info(large);
+
+		const actuals = await getAllLines();
+		assert.deepStrictEqual(actuals.slice(-6).map(line => line.length), [12, large.length, external.length + 7, external.length, 10 + '…[truncated 204790 bytes]'.length, 0]);
+		assert.strictEqual(actuals[actuals.length - 6], 'Small buffer');
+		assert.strictEqual(actuals[actuals.length - 5], large.toString());
+		assert.strictEqual(actuals[actuals.length - 4], 'dump=1 ' + external);
+		assert.strictEqual(actuals[actuals.length - 2], 'bbbbbbbbbb…[truncated 204790 bytes]');
+	});
+
+	test('log buffers copies them before the call returns', async function () {
+		const copiedFile = path.join(tempDirectory, 'copied-buffer.log');
+		filesToDelete.push(copiedFile);
+		// Formatted later on another thread.
+		const logger = await spdlog.createAsyncRotatingLogger('copied-buffer', copiedFile, 1048576 * 5, 2, { formatterThreads: 1 });
+		logger.setPattern('%v');
+
+		const large = Buffer.alloc(200 * 1024, 'b');
+		logger.info(large);
+		large.fill('z');
+		logger.flush();
+		logger.drop();
+
+		// The worker thread writes and flushes after flush() returned.
+		await waitFor(() => fs.readFileSync(copiedFile, 'utf8').length === large.length + EOL.length);
+		assert.strictEqual(fs.readFileSync(copiedFile, 'utf8'), 'b'.repeat(large.length) + EOL);
+	});
+
+	test('flight recorder', async function () {
+		const recordedFile = path.join(tempDirectory, 'recorded.log');
+		filesToDelete.push(recordedFile);
+		const logger = await spdlog.createRotatingLogger('recorded', recordedFile, 1048576 * 5, 2, { flightRecorder: { memoryBudget: 16 * 1024, chunkSize: 4096 } });
+		logger.setPattern('%l %v');
+		logger.setLevel(2);
+		assert.strictEqual(logger.getLevel(), 2);
+
+		for (let i = 0; i < 10000; i++) {
+			logger.trace(`step ${i}`);
+		}
+		logger.info('done');
+		logger.drop();
+
+		assert.strictEqual(fs.readFileSync(recordedFile).toString(), 'info done' + EOL);
+
+		// Old chunks were dropped to stay within the budget.
+		const lines = logger.snapshot().split(EOL);
+		assert.deepStrictEqual(lines.slice(-3), ['trace step 9999', 'info done', '']);
+		assert.ok(lines.length > 1000 && lines.length < 10000);
+		const first = Number(lines[0].split(' ')[2]);
+		lines.slice(0, -2).forEach((line, i) => assert.strictEqual(line, `trace step ${first + i}`));
+
+		const chunks = logger.snapshot({ compressed: true });
+		assert.ok(chunks.length > 1);
+		assert.strictEqual(zlib.gunzipSync(Buffer.concat(chunks)).toString(), lines.join(EOL));
+
+		assert.throws(() => testObject.snapshot());
+	});
+
+	test('flight recorder is shared by every handle of the logger', async function () {
+		const recordedFile = path.join(tempDirectory, 'recorded-shared.log');
+		filesToDelete.push(recordedFile);
+		const logger = await spdlog.createRotatingLogger('recorded-shared', recordedFile, 1048576 * 5, 2, { flightRecorder: { memoryBudget: 16 * 1024 } });
+		logger.setPattern('%v');
+		const second = new spdlog.Logger('rotating', 'recorded-shared', recordedFile, 1048576 * 5, 2);
+		second.info('second');
+
+		const source = `
+			const { parentPort, workerData } = require('worker_threads');
+			const spdlog = require(${JSON.stringify(path.join(__dirname, '..'))});
+			const logger = new spdlog.Logger('rotating', 'recorded-shared', workerData.file, 1048576 * 5, 2);
+			logger.info('worker');
+			parentPort.postMessage(logger.snapshot());
+		`;
+		const worker = new Worker(source, { eval: true, workerData: { file: recordedFile } });
+		const exited = new Promise((c, e) => worker.on('exit', c).on('error', e));
+		const snapshot = await new Promise((c, e) => worker.on('message', c).on('error', e));
+		await exited;
+
+		assert.strictEqual(snapshot, 'second' + EOL + 'worker' + EOL);
+		assert.strictEqual(second.snapshot(), snapshot);
+		assert.strictEqual(logger.snapshot(), snapshot);
+		second.drop();
+		logger.drop();
+	});
+
+	test('flight recorder keeps its level under the global level', async function () {
+		const recordedFile = path.join(tempDirectory, 'recorded-global.log');
+		filesToDelete.push(recordedFile);
+		const logger = await spdlog.createRotatingLogger('recorded-global', recordedFile, 1048576 * 5, 2, { flightRecorder: { memoryBudget: 16 * 1024, level: 1 } });
+		logger.setPattern('%l %v');
+
+		try {
+			spdlog.setLevel(3);
+			logger.debug('recorded');
+			logger.trace('dropped');
+			logger.warn('written');
+			// Loggers created afterwards get the level too.
+			const later = await spdlog.createRotatingLogger('recorded-later', recordedFile + '.later', 1048576 * 5, 2, { flightRecorder: { memoryBudget: 16 * 1024, level: 0 } });
+			filesToDelete.push(recordedFile + '.later');
+			later.setPattern('%l %v');
+			later.trace('recorded');
+			later.info('not written');
+			later.drop();
+			assert.strictEqual(fs.readFileSync(recordedFile + '.later').toString(), '');
+			assert.strictEqual(later.snapshot(), 'trace recorded' + EOL + 'info not written' + EOL);
+		} finally {
+			spdlog.setLevel(2);
+		}
+		logger.drop();
+
+		assert.strictEqual(fs.readFileSync(recordedFile).toString(), 'warn written' + EOL);
+		assert.strictEqual(logger.snapshot(), 'debug recorded' + EOL + 'warn written' + EOL);
+	});
+
+	test('mapped ring survives a killed process', async function () {
+		this.timeout(30000);
+		const ringFile = path.join(tempDirectory, 'ring.bin');
+		const ringLog = path.join(tempDirectory, 'ring.log');
+		filesToDelete.push(ringFile, ringLog);
+		if (fs.existsSync(ringFile)) {
+			fs.unlinkSync(ringFile);
+		}
+
+		// The child reports how far it got, then keeps logging until it is killed.
+		const script = `
+			const spdlog = require(${JSON.stringify(path.join(__dirname, '..'))});
+			const logger = new spdlog.Logger('rotating', 'ring', ${JSON.stringify(ringLog)}, 1048576 * 5, 2, { mappedRing: { file: ${JSON.stringify(ringFile)}, size: 65536 } });
+			logger.setPattern('%v');
+			let i = 0;
+			(function next() {
+				for (const end = i + 1000; i < end; i++) {
+					logger.info('record ' + i);
+				}
+				process.stdout.write(i + '\\n');
+				setImmediate(next);
+			})();`;
+		const child = spawn(process.execPath, ['-e', script], { stdio: ['ignore', 'pipe', 'inherit'] });
+		const logged = await new Promise((resolve, reject) => {
+			child.on('error', reject);
+			child.on('exit', code => reject(new Error(`child exited with ${code}`)));
+			child.stdout.on('data', data => {
+				const count = Number(data.toString().trim().split('\n').pop());
+				if (count >= 20000) {
+					child.removeAllListeners('exit');
+					child.kill('SIGKILL');
+					resolve(count);
+				}
+			});
+		});
+		await new Promise(resolve => child.on('exit', resolve));
+
+		const lines = spdlog.recoverMappedRing(ringFile).split(EOL);
+		assert.strictEqual(lines.pop(), '');
+		assert.ok(lines.length > 1000);
+		const first = Number(lines[0].split(' ')[1]);
+		lines.forEach((line, i) => assert.strictEqual(line, `record ${first + i}`));
+		assert.ok(first + lines.length >= logged);
+
+		assert.throws(() => spdlog.recoverMappedRing(ringLog));
+	});
+
+	test('top talkers', async function () {
+		testObject = await aTestObject(logFile);
+		assert.throws(() => testObject.getTopTalkers());
+		testObject.trackTopTalkers(8, 1);
+		for (let i = 0; i < 1000; i++) {
+			testObject.info(`request ${i} took ${i % 50}ms`);
+			if (i % 10 === 0) {
+				testObject.child({ requestId: i }).warn(`cache miss for key${i}`);
+			}
+			testObject.debug('below the level is not counted');
+		}
+		for (let i = 0; i < 200; i++) {
+			testObject.info(`rare message ${String.fromCharCode(97 + i % 26)}`);
+		}
+		testObject.error({ code: 1 });
+
+		const top = testObject.getTopTalkers(2);
+		assert.strictEqual(top.length, 2);
+		assert.strictEqual(top[0].template, 'request # took #');
+		assert.strictEqual(top[0].level, 2);
+		assert.ok(top[0].count >= 1000 && top[0].count - top[0].error <= 1000);
+		assert.ok(top[0].rate > 0);
+		assert.strictEqual(top[1].template, 'cache miss for #');
+		assert.strictEqual(top[1].level, 3);
+		assert.ok(testObject.getTopTalkers().length <= 8);
+
+		// Sampled counts are scaled back up.
+		testObject.trackTopTalkers(4, 16);
+		for (let i = 0; i < 16000; i++) {
+			testObject.info(`flood ${i}`);
+		}
+		const sampled = testObject.getTopTalkers(1)[0];
+		assert.strictEqual(sampled.template, 'flood #');
+		assert.ok(Math.abs(sampled.count - 16000) < 2000);
+
+		testObject.trackTopTalkers(0);
+		assert.throws(() => testObject.getTopTalkers());
+		assert.throws(() => testObject.trackTopTalkers(1, 0));
+	});
+
+	test('adaptive sampling', async function () {
+		testObject = await aTestObject(logFile);
+		testObject.setPattern('%v');
+		testObject.setSampling(10);
+		for (let i = 0; i < 1000; i++) {
+			testObject.info(`hot ${i}`);
+			if (i % 100 === 0) {
+				testObject.warn(`rare ${i}`);
+				testObject.info({ rare: i });
+			}
+		}
+
+		const lines = (await getAllLines()).slice(0, -1);
+		// Logging 1000 messages may cross into the next second, which starts over.
+		const hot = lines.filter(line => line.startsWith('hot '));
+		assert.ok(hot.length >= 18 && hot.length <= 60, `${hot.length} kept`);
+		assert.deepStrictEqual(hot.slice(0, 14), [...Array.from({ length: 12 }, (_, i) => `hot ${i}`), 'hot 13 [1 similar skipped]', 'hot 17 [3 similar skipped]']);
+		let total = 0;
+		hot.forEach(line => total += 1 + Number((/\[(\d+) similar skipped\]$/.exec(line) || [0, 0])[1]));
+		assert.ok(total <= 1000 && total > 400);
+
+		// Rare messages are never sampled out.
+		assert.deepStrictEqual(lines.filter(line => line.startsWith('rare ')), Array.from({ length: 10 }, (_, i) => `rare ${i * 100}`));
+		assert.strictEqual(lines.filter(line => line.startsWith('{')).length, 10);
+
+		assert.throws(() => testObject.setSampling(-1));
+	});
+
+	test('adaptive sampling tells errors and objects apart', async function () {
+		testObject = await aTestObject(logFile);
+		testObject.setPattern('%v');
+		testObject.setSampling(10);
+		const flood = new Error('flood');
+		for (let i = 0; i < 200; i++) {
+			testObject.error(flood);
+			testObject.info({ hot: i });
+		}
+		testObject.error(new Error('rare'));
+		testObject.info({ rare: 1 });
+
+		const lines = (await getAllLines()).slice(0, -1);
+		assert.ok(lines.filter(line => line === 'Error: flood').length < 200);
+		assert.ok(lines.filter(line => line.startsWith('{"hot":')).length < 200);
+		assert.strictEqual(lines.filter(line => line === 'Error: rare').length, 1);
+		assert.deepStrictEqual(lines.filter(line => line.startsWith('{"rare":')), ['{"rare":1}']);
+
+		// The stack read for the template is the one written.
+		let reads = 0;
+		const counted = new Error('counted');
+		Object.defineProperty(counted, 'stack', { get() { reads++; return 'Error: counted\n    at here (here.js:1:1)'; } });
+		testObject.error(counted);
+		assert.strictEqual(reads, 1);
+		assert.strictEqual(await getLastLine(), '    at here (here.js:1:1)');
+	});
+
+	test('load shedding', async function () {
+		this.timeout(30000);
+		testObject = await aTestObject(logFile);
+		assert.throws(() => testObject.setLoadShedding({}));
+
+		const file = path.join(tempDirectory, 'shedding.log');
+		filesToDelete.push(file);
+		const logger = await spdlog.createAsyncRotatingLogger('shedding', file, 1048576 * 50, 2);
+		assert.throws(() => logger.setLoadShedding({ highWatermark: 0.2, lowWatermark: 0.5 }));
+		logger.setPattern('%l %v');
+		logger.setLevel(0);
+		logger.setLoadShedding({ highWatermark: 0.01, lowWatermark: 0.01, maxLevel: 1, holdTime: 0 });
+		// Flushing every record makes the worker thread the bottleneck.
+		spdlog.setFlushOn(0);
+		const message = 'x'.repeat(1000);
+		for (let i = 0; i < 50000; i++) {
+			logger.trace(message);
+			logger.debug(message);
+			if (i % 1000 === 0) {
+				logger.info(`kept ${i}`);
+			}
+		}
+		// One check per round, with the queue holding at most this round.
+		// Every record is flushed, so the end of the file shows how far the
+		// worker thread got.
+		const tail = () => {
+			const fd = fs.openSync(file, 'r');
+			try {
+				const size = fs.fstatSync(fd).size;
+				const buffer = Buffer.alloc(Math.min(size, 65536));
+				fs.readSync(fd, buffer, 0, buffer.length, size - buffer.length);
+				return buffer.toString();
+			} finally {
+				fs.closeSync(fd);
+			}
+		};
+		let rounds = 0;
+		await waitFor(() => {
+			for (let i = 0; i < 64; i++) {
+				logger.info('calm');
+			}
+			rounds++;
+			// The last marker says it stopped and calm records follow it.
+			const text = tail();
+			const marker = text.lastIndexOf(`${EOL}warning Load shedding`);
+			return marker >= 0 && text.startsWith(`${EOL}warning Load shedding stopped`, marker) && text.includes(`${EOL}info calm${EOL}`, marker);
+		});
+		logger.info('done');
+		logger.setLoadShedding(null);
+		logger.drop();
+		await waitFor(() => tail().endsWith(`${EOL}info done${EOL}`));
+		spdlog.setFlushOn(3);
+
+		const lines = fs.readFileSync(file).toString().split(EOL);
+		const markers = lines.filter(line => line.startsWith('warning Load shedding'));
+		assert.ok(/^warning Load shedding: dropping trace and below \(queue \d+% full, 0 dropped\)$/.test(markers[0]), markers[0]);
+		assert.ok(markers.some(line => line.startsWith('warning Load shedding: dropping debug and below')));
+		assert.ok(/^warning Load shedding stopped \(queue 0% full, \d+ dropped\)$/.test(markers[markers.length - 1]), markers[markers.length - 1]);
+		assert.ok(lines.filter(line => line.startsWith('trace ')).length < 50000);
+		// Levels above maxLevel are never dropped.
+		assert.strictEqual(lines.filter(line => line.startsWith('info kept ')).length, 50);
+		assert.strictEqual(lines.filter(line => line === 'info calm').length, rounds * 64);
+	});
+
+	test('configure loggers by name', async function () {
+		this.timeout(30000);
+		const file = path.join(tempDirectory, 'config.log');
+		filesToDelete.push(file);
+		const live = new spdlog.Logger('rotating', 'config.live', file, 1048576 * 5, 2);
+		const other = new spdlog.Logger('rotating', 'other', file, 1048576 * 5, 2);
+		other.setLevel(4);
+		try {
+			spdlog.configure({ loggers: { 'config.*': { level: 'debug', pattern: '%l %v' }, '*.late': { level: 1, flushOn: 'warn' } } });
+			assert.strictEqual(live.getLevel(), 1);
+			assert.strictEqual(other.getLevel(), 4);
+			const late = new spdlog.Logger('rotating', 'config.late', file, 1048576 * 5, 2);
+			assert.strictEqual(late.getLevel(), 1);
+			late.drop();
+
+			// Nothing is applied when a setting is invalid.
+			assert.throws(() => spdlog.configure({ loggers: { 'config.?ive': { level: 'trace' }, 'config.*': { level: 'loud' } } }));
+			assert.throws(() => spdlog.configure({ flushEvery: -1 }));
+			assert.strictEqual(live.getLevel(), 1);
+
+			const configFile = path.join(tempDirectory, 'config.json');
+			filesToDelete.push(configFile);
+			fs.writeFileSync(configFile, JSON.stringify({ loggers: { 'config.?ive': { level: 'warn' } } }));
+			const errors = [];
+			const watcher = spdlog.loadConfig(configFile, { watch: true, onError: err => errors.push(err) });
+			assert.strictEqual(live.getLevel(), 3);
+			fs.writeFileSync(configFile, JSON.stringify({ loggers: { 'config.live': { level: 'error' } } }));
+			await waitFor(() => live.getLevel() === 4);
+			fs.writeFileSync(configFile, '{');
+			await waitFor(() => errors.length > 0);
+			watcher.close();
+			assert.strictEqual(live.getLevel(), 4);
+		} finally {
+			spdlog.configure({});
+			live.drop();
+			other.drop();
+		}
+	});
+
+	test('levels from SPDLOG_LEVEL', async function () {
+		const file = path.join(tempDirectory, 'env.log');
+		filesToDelete.push(file);
+		const script = `
+			const spdlog = require(${JSON.stringify(path.join(__dirname, '..'))});
+			const levels = ['env', 'other'].map(name => new spdlog.Logger('rotating', name, ${JSON.stringify(file)}, 1048576 * 5, 2).getLevel());
+			process.stdout.write(levels.join(','));`;
+		const child = spawn(process.execPath, ['-e', script], { stdio: ['ignore', 'pipe', 'inherit'], env: { ...process.env, SPDLOG_LEVEL: 'error,env=trace' } });
+		let output = '';
+		child.stdout.on('data', data => output += data);
+		const code = await new Promise(resolve => child.on('exit', resolve));
+		assert.strictEqual(code, 0);
+		assert.strictEqual(output, '0,4');
+	});
+
+	test('emergency dump on fatal signal', async function () {
+		if (process.platform === 'win32') {
+			this.skip();
+		}
+		this.timeout(30000);
+		const dumpFile = path.join(tempDirectory, 'emergency.dump');
+		const dumpLog = path.join(tempDirectory, 'emergency.log');
+		filesToDelete.push(dumpFile, dumpLog);
+		if (fs.existsSync(dumpFile)) {
+			fs.unlinkSync(dumpFile);
+		}
+
+		const script = `
+			const spdlog = require(${JSON.stringify(path.join(__dirname, '..'))});
+			spdlog.enableEmergencyDump(${JSON.stringify(dumpFile)});
+			const logger = new spdlog.Logger('rotating', 'emergency', ${JSON.stringify(dumpLog)}, 1048576 * 5, 2, { flightRecorder: { memoryBudget: 65536 } });
+			logger.setPattern('%v');
+			logger.setLevel(6);
+			for (let i = 0; i < 100; i++) {
+				logger.trace('record ' + i);
+			}
+			process.abort();`;
+		// No core file for the deliberate crash.
+		const child = spawn('/bin/sh', ['-c', 'ulimit -c 0; exec "$0" -e "$1"', process.execPath, script], { stdio: 'ignore' });
+		const signal = await new Promise(resolve => child.on('exit', (code, signal) => resolve(signal)));
+		assert.strictEqual(signal, 'SIGABRT');
+
+		const lines = fs.readFileSync(dumpFile).toString().split('\n');
+		assert.strictEqual(lines[0], '--- fatal signal 6 ---');
+		assert.ok(lines[1].startsWith('--- flight recorder, '));
+		assert.deepStrictEqual(lines.slice(2, -1), Array.from({ length: 100 }, (_, i) => `record ${i}`));
+	});
+
+	test('emergency dump keeps sealed chunks', async function () {
+		if (process.platform === 'win32') {
+			this.skip();
+		}
+		this.timeout(30000);
+		const dumpFile = path.join(tempDirectory, 'emergency-sealed.dump');
+		const dumpLog = path.join(tempDirectory, 'emergency-sealed.log');
+		filesToDelete.push(dumpFile, dumpLog);
+		if (fs.existsSync(dumpFile)) {
+			fs.unlinkSync(dumpFile);
+		}
+
+		// Random hex compresses poorly, so the history ring wraps.
+		const script = `
+			const crypto = require('crypto');
+			const spdlog = require(${JSON.stringify(path.join(__dirname, '..'))});
+			spdlog.enableEmergencyDump(${JSON.stringify(dumpFile)});
+			const logger = new spdlog.Logger('rotating', 'emergency-sealed', ${JSON.stringify(dumpLog)}, 1048576 * 5, 2, { flightRecorder: { memoryBudget: 32768, chunkSize: 4096 } });
+			logger.setPattern('%v');
+			for (let i = 0; i < 2000; i++) {
+				logger.info('record ' + i + ' ' + crypto.randomBytes(32).toString('hex'));
+			}
+			process.abort();`;
+		const child = spawn('/bin/sh', ['-c', 'ulimit -c 0; exec "$0" -e "$1"', process.execPath, script], { stdio: 'ignore' });
+		const signal = await new Promise(resolve => child.on('exit', (code, signal) => resolve(signal)));
+		assert.strictEqual(signal, 'SIGABRT');
+
+		const dump = fs.readFileSync(dumpFile);
+		let offset = dump.indexOf('\n') + 1;
+		const labels = [];
+		let text = '';
+		while (offset < dump.length) {
+			const end = dump.indexOf('\n', offset);
+			const [, label, size] = /^--- (.*), (\d+) bytes ---$/.exec(dump.toString('utf8', offset, end));
+			const data = dump.subarray(end + 1, end + 1 + Number(size));
+			labels.push(label);
+			text += label.endsWith('gzip') ? zlib.gunzipSync(data).toString() : data.toString();
+			offset = end + 1 + Number(size);
+		}
+		assert.ok(labels.includes('flight recorder, older sealed chunks, gzip'));
+		assert.strictEqual(labels[labels.length - 1], 'flight recorder');
+
+		const numbers = text.split(EOL).slice(0, -1).map(line => Number(line.split(' ')[1]));
+		assert.ok(numbers.length > 4096 / 80, 'more than the open chunk');
+		assert.ok(numbers[0] > 0, 'the oldest chunks were dropped');
+		assert.deepStrictEqual(numbers, Array.from({ length: numbers.length }, (_, i) => numbers[0] + i));
+		assert.strictEqual(numbers[numbers.length - 1], 1999);
+	});
+
+	test('parallel formatting keeps order', async function () {
+		const parallelFile = path.join(tempDirectory, 'parallel.log');
+		filesToDelete.push(parallelFile);
+		const logger = await spdlog.createRotatingLogger('parallel', parallelFile, 1048576 * 5, 2, { formatterThreads: 4 });
+		logger.setPattern('%l %v');
+		for (let i = 0; i < 5000; i++) {
+			logger.info(`message ${i}`);
+		}
+		logger.setPattern('%v');
+		logger.warn({ last: true });
+		logger.flush();
+		logger.drop();
+
+		const actuals = fs.readFileSync(parallelFile).toString().split(EOL);
+		assert.strictEqual(actuals.length, 5002);
+		for (let i = 0; i < 5000; i++) {
+			assert.strictEqual(actuals[i], `info message ${i}`);
+		}
+		assert.strictEqual(actuals[5000], '{"last":true}');
+
+		assert.throws(() => new spdlog.Logger('rotating', 'invalid', parallelFile, 1024, 2, { formatterThreads: -1 }));
+	});
+
+	test('async logger with options stays asynchronous', async function () {
+		const asyncFile = path.join(tempDirectory, 'async-options.log');
+		const syncFile = path.join(tempDirectory, 'sync-options.log');
+		filesToDelete.push(asyncFile, syncFile);
+		const logger = await spdlog.createAsyncRotatingLogger('async-options', asyncFile, 1048576 * 5, 2, { formatterThreads: 2 });
+		const syncLogger = await spdlog.createRotatingLogger('sync-options', syncFile, 1048576 * 5, 2, { formatterThreads: 2 });
+		// Load shedding is only available on async loggers.
+		logger.setLoadShedding({});
+		assert.throws(() => syncLogger.setLoadShedding({}), /async logger/);
+		syncLogger.drop();
+
+		logger.setPattern('%v');
+		for (let i = 0; i < 100; i++) {
+			logger.info(`message ${i}`);
+		}
+		logger.flush();
+		logger.drop();
+
+		// The worker thread writes and flushes after flush() returned.
+		const expected = Array.from({ length: 100 }, (_, i) => `message ${i}`).join(EOL) + EOL;
+		for (let i = 0; i < 100 && fs.readFileSync(asyncFile, 'utf8') !== expected; i++) {
+			await new Promise(c => setTimeout(c, 20));
+		}
+		assert.strictEqual(fs.readFileSync(asyncFile, 'utf8'), expected);
+	});
+
+	test('redaction', async function () {
+		const redactedFile = path.join(tempDirectory, 'redacted.log');
+		filesToDelete.push(redactedFile);
+		const logger = await spdlog.createRotatingLogger('redacted', redactedFile, 1048576 * 5, 2, { formatterThreads: 2, redact: { literals: ['hunter2', 'pass', 'password'], emails: true, bearerTokens: true } });
+		logger.setPattern('%v');
+		logger.info('nothing to hide');
+		logger.info('password: hunter2, pass: hunter2');
+		logger.info('mail jane.doe+logs@example.co.uk, not @here or a@b');
+		logger.info('Authorization: Bearer eyJhbGciOi.J9-x_y== ok');
+		logger.child({ user: 'bob@example.com' }).warn('hunter2');
+		// The JSON formatter escapes what is left.
+		logger.setJsonFormatter();
+		logger.info('"hunter2"');
+		logger.info(Buffer.from('x'.repeat(70000) + 'hunter2'));
+		logger.flush();
+		logger.drop();
+
+		const lines = fs.readFileSync(redactedFile).toString().split(EOL);
+		assert.deepStrictEqual(lines.slice(0, 5), [
+			'nothing to hide',
+			'[REDACTED]: [REDACTED], [REDACTED]: [REDACTED]',
+			'mail [REDACTED], not @here or a@b',
+			'Authorization: Bearer [REDACTED] ok',
+			'user=[REDACTED] [REDACTED]',
+		]);
+		assert.strictEqual(JSON.parse(lines[5]).message, '"[REDACTED]"');
+		assert.strictEqual(JSON.parse(lines[6]).message, 'x'.repeat(70000) + '[REDACTED]');
+
+		assert.throws(() => new spdlog.Logger('rotating', 'invalid', redactedFile, 1024, 2, { redact: { literals: [''] } }));
+	});
+
+	test('encryption', async function () {
+		const encryptedFile = path.join(tempDirectory, 'encrypted.log');
+		filesToDelete.push(encryptedFile);
+		const key = crypto.randomBytes(32);
+		const logger = await spdlog.createRotatingLogger('encrypted', encryptedFile, 1048576 * 5, 2, { encryption: { key, chunkSize: 4096 } });
+		logger.setPattern('%v');
+		const expected = [];
+		for (let i = 0; i < 1000; i++) {
+			expected.push(`secret record ${i}`);
+			logger.info(`secret record ${i}`);
+		}
+		logger.flush();
+		assert.deepStrictEqual(spdlog.decryptLog(encryptedFile, key).split(EOL).slice(0, -1), expected);
+		logger.info('after the flush');
+		logger.drop();
+
+		const contents = fs.readFileSync(encryptedFile);
+		assert.strictEqual(contents.includes('secret record'), false);
+		assert.deepStrictEqual(spdlog.decryptLog(encryptedFile, key).split(EOL).slice(-2), ['after the flush', '']);
+
+		// A cut short chunk is left out, the ones before it still decrypt.
+		fs.writeFileSync(encryptedFile, contents.subarray(0, contents.length - 10));
+		assert.deepStrictEqual(spdlog.decryptLog(encryptedFile, key).split(EOL).slice(0, -1), expected);
+
+		assert.throws(() => spdlog.decryptLog(encryptedFile, crypto.randomBytes(32)));
+		assert.throws(() => new spdlog.Logger('rotating', 'invalid', encryptedFile, 1024, 2, { encryption: { key: Buffer.alloc(8) } }));
+		assert.throws(() => new spdlog.Logger('rotating', 'invalid', encryptedFile, 1024, 2, { encryption: { key }, mappedRing: { file: encryptedFile + '.ring' } }));
+	});
+
+	test('framing', async function () {
+		const framedFile = path.join(tempDirectory, 'framed.log');
+		filesToDelete.push(framedFile);
+		const logger = await spdlog.createRotatingLogger('framed', framedFile, 1048576 * 5, 2, { framed: true });
+		logger.setPattern('%v');
+		const expected = [];
+		for (let i = 0; i < 100; i++) {
+			expected.push(`record ${i}`);
+			logger.info(`record ${i}`);
+		}
+		logger.flush();
+		logger.drop();
+
+		let contents = spdlog.readFramedLog(framedFile);
+		assert.deepStrictEqual(contents.text.split(EOL).slice(0, -1), expected);
+		assert.strictEqual(contents.records, 100);
+		assert.strictEqual(contents.corruptRegions, 0);
+
+		// Damage one record in the middle and tear the last one.
+		const file = fs.readFileSync(framedFile);
+		const damaged = file.indexOf('record 50');
+		file[damaged] ^= 1;
+		fs.writeFileSync(framedFile, file.subarray(0, file.length - 3));
+		contents = spdlog.readFramedLog(framedFile);
+		assert.deepStrictEqual(contents.text.split(EOL).slice(0, -1), expected.filter((_, i) => i !== 50 && i !== 99));
+		assert.strictEqual(contents.records, 98);
+		assert.strictEqual(contents.corruptRegions, 2);
+
+		assert.throws(() => new spdlog.Logger('rotating', 'invalid', framedFile, 1024, 2, { framed: true, encryption: { key: crypto.randomBytes(16) } }));
+	});
+
+	test('collector', async function () {
+		if (process.platform === 'win32') {
+			this.skip();
+		}
+		this.timeout(30000);
+		const collectorFile = path.join(tempDirectory, 'collector.log');
+		const socketPath = path.join(tempDirectory, 'collector.sock');
+		const spillFile = path.join(tempDirectory, 'collector.spill');
+		filesToDelete.push(collectorFile, socketPath, spillFile);
+		for (const file of [socketPath, spillFile]) {
+			if (fs.existsSync(file)) {
+				fs.unlinkSync(file);
+			}
+		}
+
+		// The collector is down at first, logging must not block meanwhile.
+		const logger = await spdlog.createRotatingLogger('collected', collectorFile, 1048576 * 5, 2, { collector: { path: socketPath, spillFile, flushInterval: 10 } });
+		logger.setPattern('%v');
+		const expected = [];
+		const start = performance.now();
+		for (let i = 0; i < 1000; i++) {
+			expected.push(`record ${i}`);
+			logger.info(`record ${i}`);
+		}
+		logger.flush();
+		assert.ok(performance.now() - start < 1000);
+		await new Promise(resolve => setTimeout(resolve, 200));
+		assert.ok(fs.statSync(spillFile).size > 0);
+
+		let received = '';
+		const server = net.createServer(socket => socket.on('data', data => received += data));
+		await new Promise(resolve => server.listen(socketPath, resolve));
+		try {
+			for (let i = 1000; i < 2000; i++) {
+				expected.push(`record ${i}`);
+				logger.info(`record ${i}`);
+			}
+			logger.flush();
+			const deadline = Date.now() + 10000;
+			while (received.split(EOL).length <= expected.length && Date.now() < deadline) {
+				await new Promise(resolve => setTimeout(resolve, 50));
+			}
+			// Spilled records come first, in order.
+			assert.deepStrictEqual(received.split(EOL).slice(0, -1), expected);
+			assert.strictEqual(fs.statSync(spillFile).size, 0);
+			assert.deepStrictEqual(fs.readFileSync(collectorFile).toString().split(EOL).slice(0, -1), expected);
+		} finally {
+			logger.drop();
+			await new Promise(resolve => server.close(resolve));
+		}
+
+		assert.throws(() => new spdlog.Logger('rotating', 'invalid', collectorFile, 1024, 2, { collector: { port: 1234 } }));
+	});
+
+	test('syslog', async function () {
+		if (process.platform === 'win32') {
+			this.skip();
+		}
+		this.timeout(30000);
+		const syslogFile = path.join(tempDirectory, 'syslog.log');
+		const socketPath = path.join(tempDirectory, 'syslog.sock');
+		filesToDelete.push(syslogFile, socketPath);
+
+		// Node has no Unix datagram sockets, a Python stand-in receives.
+		const receiver = spawn('python3', ['-c', `
+import json, os, socket, sys
+path, count = sys.argv[1], int(sys.argv[2])
+if os.path.exists(path):
+	os.unlink(path)
+s = socket.socket(socket.AF_UNIX, socket.SOCK_DGRAM)
+s.bind(path)
+print('ready', flush=True)
+for _ in range(count):
+	print(json.dumps(s.recv(65536).decode()), flush=True)
+`, socketPath, '202']);
+		let output = '';
+		receiver.stdout.on('data', data => output += data);
+		const started = await new Promise(resolve => {
+			receiver.on('error', () => resolve(false));
+			receiver.stdout.once('data', () => resolve(true));
+		});
+		if (!started) {
+			this.skip();
+		}
+
+		const logger = await spdlog.createRotatingLogger('syslogged', syslogFile, 1048576 * 5, 2, { syslog: { path: socketPath, appName: 'spdlog test', facility: 16 } });
+		logger.setPattern('%v');
+		for (let i = 0; i < 200; i++) {
+			logger.warn(`record ${i}`);
+		}
+		const storage = new AsyncLocalStorage();
+		logger.setAsyncContext(storage);
+		storage.run(new spdlog.LogContext({ traceId: '0af7651916cd43dd8448eb211c80319c', requestId: 7 }), () => logger.error('with context'));
+		logger.info('two\nlines');
+		logger.flush();
+		await new Promise(resolve => receiver.on('exit', resolve));
+		logger.drop();
+
+		const datagrams = output.split('\n').slice(1, -1).map(line => JSON.parse(line));
+		assert.strictEqual(datagrams.length, 202);
+		assert.match(datagrams[0], /^<132>1 \d{4}-\d\d-\d\dT\d\d:\d\d:\d\d\.\d{6}Z \S+ spdlog_test \d+ - - record 0$/);
+		assert.match(datagrams[200], / - \[context@32473 trace_id="0af7651916cd43dd8448eb211c80319c" request_id="7"\] with context$/);
+		assert.ok(datagrams[201].startsWith('<134>1 '));
+		assert.ok(datagrams[201].endsWith(' two\nlines'));
+
+		assert.throws(() => new spdlog.Logger('rotating', 'invalid', syslogFile, 1024, 2, { syslog: { format: 'xml' } }));
+	});
+
+	test('syslog keeps the context behind otlp', async function () {
+		if (process.platform === 'win32') {
+			this.skip();
+		}
+		this.timeout(30000);
+		const syslogFile = path.join(tempDirectory, 'syslog-otlp.log');
+		const otlpFile = path.join(tempDirectory, 'syslog-otlp.bin');
+		const socketPath = path.join(tempDirectory, 'syslog-otlp.sock');
+		filesToDelete.push(syslogFile, otlpFile, socketPath);
+
+		const receiver = spawn('python3', ['-c', `
+import json, os, socket, sys
+path = sys.argv[1]
+if os.path.exists(path):
+	os.unlink(path)
+s = socket.socket(socket.AF_UNIX, socket.SOCK_DGRAM)
+s.bind(path)
+print('ready', flush=True)
+print(json.dumps(s.recv(65536).decode()), flush=True)
+`, socketPath]);
+		let output = '';
+		receiver.stdout.on('data', data => output += data);
+		const started = await new Promise(resolve => {
+			receiver.on('error', () => resolve(false));
+			receiver.stdout.once('data', () => resolve(true));
+		});
+		if (!started) {
+			this.skip();
+		}
+
+		// OtlpSink formats the records before they reach SyslogSink.
+		const logger = await spdlog.createRotatingLogger('syslog-otlp', syslogFile, 1048576 * 5, 2, { syslog: { path: socketPath, appName: 'spdlog test' }, otlp: { file: otlpFile } });
+		logger.setPattern('%v');
+		const storage = new AsyncLocalStorage();
+		logger.setAsyncContext(storage);
+		storage.run(new spdlog.LogContext({ traceId: '0af7651916cd43dd8448eb211c80319c', requestId: 7 }), () => logger.error('with context'));
+		logger.flush();
+		await new Promise(resolve => receiver.on('exit', resolve));
+		logger.drop();
+
+		const datagrams = output.split('\n').slice(1, -1).map(line => JSON.parse(line));
+		assert.strictEqual(datagrams.length, 1);
+		assert.match(datagrams[0], / - \[context@32473 trace_id="0af7651916cd43dd8448eb211c80319c" request_id="7"\] with context$/);
+		assert.strictEqual(otlpAttributes(readOtlpRecords(otlpFile)[0][6])['request.id'], 7);
+		assert.strictEqual(fs.readFileSync(syslogFile).toString(), `with context${EOL}`);
+	});
+
+	test('otlp', async function () {
+		const otlpLog = path.join(tempDirectory, 'otlp.log');
+		const otlpFile = path.join(tempDirectory, 'otlp.bin');
+		filesToDelete.push(otlpLog, otlpFile);
+		if (fs.existsSync(otlpFile)) {
+			fs.unlinkSync(otlpFile);
+		}
+
+		const logger = await spdlog.createRotatingLogger('otlp', otlpLog, 1048576 * 5, 2, { otlp: { file: otlpFile, resource: { 'service.version': '1.2.3', 'deployment.canary': true } } });
+		logger.setPattern('%v');
+		const storage = new AsyncLocalStorage();
+		logger.setAsyncContext(storage);
+		logger.warn('first');
+		storage.run(new spdlog.LogContext({ traceId: '4bf92f3577b34da6a3ce929d0e0e4736', spanId: '00f067aa0ba902b7', requestId: 7 }), () => logger.error('second'));
+		logger.drop();
+
+		const file = fs.readFileSync(otlpFile);
+		const length = file.readUInt32BE(0);
+		assert.strictEqual(file.length, 4 + length);
+		const resourceLogs = decodeProtobuf(decodeProtobuf(file.subarray(4, 4 + length))[1][0]);
+		const resource = otlpAttributes(decodeProtobuf(resourceLogs[1][0])[1]);
+		assert.deepStrictEqual(resource, { 'service.version': '1.2.3', 'deployment.canary': true, 'service.name': 'otlp', 'process.pid': process.pid });
+		const scopeLogs = decodeProtobuf(resourceLogs[2][0]);
+		assert.strictEqual(decodeProtobuf(scopeLogs[1][0])[1][0].toString(), 'otlp');
+		const records = scopeLogs[2].map(decodeProtobuf);
+		assert.strictEqual(records.length, 2);
+
+		const [first, second] = records;
+		assert.ok(Math.abs(Number(first[1][0] / 1000000n) - Date.now()) < 60000);
+		assert.strictEqual(first[2][0], 13);
+		assert.strictEqual(first[3][0].toString(), 'warning');
+		assert.strictEqual(decodeProtobuf(first[5][0])[1][0].toString(), 'first');
+		assert.deepStrictEqual(Object.keys(otlpAttributes(first[6])), ['thread.id']);
+		assert.strictEqual(first[9], undefined);
+
+		assert.strictEqual(second[2][0], 17);
+		assert.strictEqual(decodeProtobuf(second[5][0])[1][0].toString(), 'second');
+		assert.strictEqual(otlpAttributes(second[6])['request.id'], 7);
+		assert.strictEqual(second[9][0].toString('hex'), '4bf92f3577b34da6a3ce929d0e0e4736');
+		assert.strictEqual(second[10][0].toString('hex'), '00f067aa0ba902b7');
+
+		assert.throws(() => new spdlog.Logger('rotating', 'invalid', otlpLog, 1024, 2, { otlp: {} }));
+	});
+
+	test('otlp keeps the context behind the flight recorder and formatter threads', async function () {
+		const storage = new AsyncLocalStorage();
+		for (const [name, options] of [['recorded', { flightRecorder: { memoryBudget: 16 * 1024 } }], ['threaded', { formatterThreads: 2 }]]) {
+			const otlpLog = path.join(tempDirectory, `otlp-${name}.log`);
+			const otlpFile = path.join(tempDirectory, `otlp-${name}.bin`);
+			filesToDelete.push(otlpLog, otlpFile);
+			if (fs.existsSync(otlpFile)) {
+				fs.unlinkSync(otlpFile);
+			}
+
+			const logger = await spdlog.createRotatingLogger(`otlp-${name}`, otlpLog, 1048576 * 5, 2, { ...options, otlp: { file: otlpFile } });
+			logger.setPattern('%v');
+			logger.setAsyncContext(storage);
+			storage.run(new spdlog.LogContext({ traceId: '4bf92f3577b34da6a3ce929d0e0e4736', spanId: '00f067aa0ba902b7', requestId: 7 }), () => logger.error('traced'));
+			logger.drop();
+
+			const records = readOtlpRecords(otlpFile);
+			assert.strictEqual(records.length, 1, name);
+			const [record] = records;
+			assert.strictEqual(decodeProtobuf(record[5][0])[1][0].toString(), 'traced', name);
+			assert.strictEqual(otlpAttributes(record[6])['request.id'], 7, name);
+			assert.strictEqual(record[9][0].toString('hex'), '4bf92f3577b34da6a3ce929d0e0e4736', name);
+			assert.strictEqual(record[10][0].toString('hex'), '00f067aa0ba902b7', name);
+			// The context does not leak into the file.
+			assert.strictEqual(fs.readFileSync(otlpLog).toString(), `traced${EOL}`, name);
+		}
+	});
+
+	test('trace spans', async function () {
+		const traceLog = path.join(tempDirectory, 'trace.log');
+		const traceFile = path.join(tempDirectory, 'trace.json');
+		filesToDelete.push(traceLog, traceFile);
+
+		const logger = await spdlog.createRotatingLogger('trace', traceLog, 1048576 * 5, 2, { trace: { file: traceFile } });
+		const outer = logger.span('index');
+		const inner = logger.child({ component: 'git' }).span('read "HEAD"');
+		const duration = inner.end();
+		assert.ok(duration >= 0);
+		assert.strictEqual(inner.end(), duration);
+		outer.end();
+		logger.flush();
+
+		// Written but not closed yet, which the trace viewers accept.
+		const events = JSON.parse(fs.readFileSync(traceFile, 'utf8') + ']');
+		assert.deepStrictEqual(events[0], { name: 'process_name', ph: 'M', pid: process.pid, args: { name: 'trace' } });
+		const spans = events.slice(1);
+		assert.deepStrictEqual(spans.map(span => span.name), ['read "HEAD"', 'index']);
+		for (const span of spans) {
+			assert.strictEqual(span.ph, 'X');
+			assert.strictEqual(span.pid, process.pid);
+			assert.strictEqual(span.tid, spans[0].tid);
+		}
+		assert.ok(spans[1].ts <= spans[0].ts);
+		assert.ok(spans[1].ts + spans[1].dur >= spans[0].ts + spans[0].dur);
+		assert.ok(Math.abs(spans[0].dur / 1000 - duration) < 0.01);
+
+		logger.drop();
+		logger.span('dropped').end();
+		assert.strictEqual(JSON.parse(fs.readFileSync(traceFile, 'utf8')).length, 3);
+		assert.throws(() => logger.span(1));
+		assert.throws(() => new spdlog.Logger('rotating', 'invalid', traceLog, 1024, 2, { trace: {} }));
+	});
+
+	test('trace spans of loggers opened under the same name', async function () {
+		const traceLog = path.join(tempDirectory, 'shared-trace.log');
+		const traceFile = path.join(tempDirectory, 'shared-trace.json');
+		filesToDelete.push(traceLog, traceFile);
+
+		const logger = await spdlog.createRotatingLogger('shared-trace', traceLog, 1048576 * 5, 2, { trace: { file: traceFile } });
+		const same = new spdlog.Logger('rotating', 'shared-trace', traceLog, 1048576 * 5, 2);
+		assert.throws(() => new spdlog.Logger('rotating', 'shared-trace', traceLog, 1048576 * 5, 2, { trace: { file: traceFile + '.other' } }), /another trace file/);
+		const again = new spdlog.Logger('rotating', 'shared-trace', traceLog, 1048576 * 5, 2, { trace: { file: traceFile } });
+		logger.span('first').end();
+		same.span('second').end();
+		again.span('third').end();
+		logger.flush();
+
+		const events = JSON.parse(fs.readFileSync(traceFile, 'utf8') + ']');
+		assert.deepStrictEqual(events.slice(1).map(span => span.name), ['first', 'second', 'third']);
+		logger.drop();
+		same.drop();
+		again.drop();
+		assert.ok(!fs.existsSync(traceFile + '.other'));
+	});
+
+	test('metrics', async function () {
+		const metricsLog = path.join(tempDirectory, 'metrics.log');
+		filesToDelete.push(metricsLog);
+		const logger = await spdlog.createRotatingLogger('metrics', metricsLog, 1048576 * 5, 2);
+		logger.setPattern('%v');
+
+		const requests = logger.counter('requests');
+		logger.counter('errors');
+		logger.gauge('unset');
+		for (let i = 0; i < 1000; i++) {
+			requests.inc();
+		}
+		logger.child({ component: 'git' }).counter('requests').inc(5);
+		logger.gauge('queue_depth').set(17.5);
+		// Starts the first interval now.
+		logger.setMetricsInterval(20);
+		await new Promise(c => setTimeout(c, 200));
+		requests.inc(3);
+		logger.drop();
+
+		// Idle intervals write nothing, drop writes the last one.
+		assert.deepStrictEqual(fs.readFileSync(metricsLog, 'utf8').split(EOL).slice(0, -1), [
+			'metrics requests=1005 errors=0 queue_depth=17.5',
+			'metrics requests=3 errors=0 queue_depth=17.5',
+		]);
+
+		const other = await spdlog.createRotatingLogger('metrics-invalid', metricsLog, 1048576 * 5, 2);
+		assert.throws(() => other.counter('with space'));
+		assert.throws(() => other.counter(''));
+		other.counter('taken');
+		assert.throws(() => other.gauge('taken'));
+		assert.throws(() => other.counter('taken').inc(-1));
+		assert.throws(() => other.counter('taken').inc(1.5));
+		assert.throws(() => other.counter('taken').inc(2 ** 53));
+		assert.throws(() => other.counter('taken').inc('1'));
+		assert.throws(() => other.setMetricsInterval(0));
+		other.drop();
+	});
+
+	test('metrics count past 32 bits', async function () {
+		const metricsLog = path.join(tempDirectory, 'metrics-large.log');
+		filesToDelete.push(metricsLog);
+		const logger = await spdlog.createRotatingLogger('metrics-large', metricsLog, 1048576 * 5, 2);
+		logger.setPattern('%v');
+
+		const bytes = logger.counter('bytes');
+		bytes.inc(2 ** 32);
+		bytes.inc(2 ** 32 - 1);
+		bytes.inc(Number.MAX_SAFE_INTEGER);
+		bytes.inc(Number.MAX_SAFE_INTEGER);
+		logger.drop();
+
+		assert.strictEqual(fs.readFileSync(metricsLog, 'utf8'), `metrics bytes=${2n ** 33n - 1n + 2n * BigInt(Number.MAX_SAFE_INTEGER)}` + EOL);
+	});
+
+	test('metrics are shared by every handle of the logger', async function () {
+		const metricsLog = path.join(tempDirectory, 'metrics-shared.log');
+		filesToDelete.push(metricsLog);
+		const logger = await spdlog.createRotatingLogger('metrics-shared', metricsLog, 1048576 * 5, 2);
+		logger.setPattern('%v');
+		const second = new spdlog.Logger('rotating', 'metrics-shared', metricsLog, 1048576 * 5, 2);
+
+		logger.counter('requests').inc();
+		second.counter('requests').inc(2);
+		second.gauge('queue_depth').set(4);
+		logger.drop();
+		second.drop();
+
+		assert.strictEqual(fs.readFileSync(metricsLog, 'utf8'), 'metrics requests=3 queue_depth=4' + EOL);
+	});
+
+	test('keyed files', async function () {
+		const keyedDirectory = path.join(tempDirectory, 'keyed');
+		const logger = await spdlog.createKeyedLogger('keyed', keyedDirectory, 1048576 * 5, 2, { maxOpenFiles: 2 });
+		logger.setPattern('%v');
+		const keys = ['ext-a', 'ext-b', 'ext-c', 'workspace.1'];
+		filesToDelete.push(...['keyed', ...keys].map(key => path.join(keyedDirectory, `${key}.log`)));
+
+		// More keys than open files, so files are closed and opened again.
+		const routed = keys.map(key => logger.route(key));
+		for (let i = 0; i < 100; i++) {
+			routed[i % keys.length].info(`${keys[i % keys.length]} ${i}`);
+		}
+		logger.info('unkeyed');
+		routed[0].child({ component: 'git' }).warn('child');
+		logger.flush();
+		logger.drop();
+
+		// The worker thread writes and flushes after flush() returned.
+		const read = key => fs.existsSync(path.join(keyedDirectory, `${key}.log`)) ? fs.readFileSync(path.join(keyedDirectory, `${key}.log`), 'utf8') : '';
+		for (let i = 0; i < 100 && !(read('keyed') && read('ext-a').endsWith('child' + EOL)); i++) {
+			await new Promise(c => setTimeout(c, 20));
+		}
+		for (const [index, key] of keys.entries()) {
+			const lines = read(key).split(EOL).slice(0, -1);
+			const expected = [];
+			for (let i = index; i < 100; i += keys.length) {
+				expected.push(`${key} ${i}`);
+			}
+			if (index === 0) {
+				expected.push('component=git child');
+			}
+			assert.deepStrictEqual(lines, expected);
+		}
+		assert.strictEqual(read('keyed'), 'unkeyed' + EOL);
+
+		assert.throws(() => logger.route('../escape'));
+		assert.throws(() => logger.route('.hidden'));
+		assert.throws(() => logger.route(''));
+		for (const device of ['con', 'NUL', 'Aux.txt', 'prn', 'com1', 'LPT9.log']) {
+			assert.throws(() => logger.route(device), device);
+		}
+		logger.route('console');
+		logger.route('com10');
+	});
+
+	test('keyed files ignore the case of keys', async function () {
+		const keyedDirectory = path.join(tempDirectory, 'keyed-case');
+		const logger = await spdlog.createKeyedLogger('Keyed-Case', keyedDirectory, 1048576 * 5, 2);
+		logger.setPattern('%v');
+		filesToDelete.push(...['keyed-case', 'alice'].map(key => path.join(keyedDirectory, `${key}.log`)));
+
+		logger.route('Alice').info('first');
+		logger.route('alice').info('second');
+		logger.route('ALICE').info('third');
+		logger.info('unkeyed');
+		logger.flush();
+		logger.drop();
+
+		// The worker thread writes and flushes after flush() returned.
+		const read = key => fs.existsSync(path.join(keyedDirectory, `${key}.log`)) ? fs.readFileSync(path.join(keyedDirectory, `${key}.log`), 'utf8') : '';
+		for (let i = 0; i < 100 && !(read('keyed-case') && read('alice').endsWith('third' + EOL)); i++) {
+			await new Promise(c => setTimeout(c, 20));
+		}
+		assert.strictEqual(read('alice'), ['first', 'second', 'third', ''].join(EOL));
+		assert.strictEqual(read('keyed-case'), 'unkeyed' + EOL);
+		assert.deepStrictEqual(fs.readdirSync(keyedDirectory).sort(), ['alice.log', 'keyed-case.log']);
+	});
+
+	test('staging buffers merge worker threads', async function () {
+		const stagedFile = path.join(tempDirectory, 'staged.log');
+		filesToDelete.push(stagedFile);
+		const logger = await spdlog.createRotatingLogger('staged', stagedFile, 1048576 * 5, 2, { stagingBuffers: true });
+		logger.setPattern('%v');
+
+		// Workers opening the same name share the native logger.
+		const source = `
+			const { workerData } = require('worker_threads');
+			const spdlog = require(${JSON.stringify(path.join(__dirname, '..'))});
+			const logger = new spdlog.Logger('rotating', 'staged', workerData.file, 1048576 * 5, 2);
+			for (let i = 0; i < 2000; i++) {
+				logger.info(workerData.name + ' ' + i);
+			}
+		`;
+		const workers = ['a', 'b'].map(name => new Worker(source, { eval: true, workerData: { name, file: stagedFile } }));
+		for (let i = 0; i < 2000; i++) {
+			logger.info('main ' + i);
+		}
+		await Promise.all(workers.map(worker => new Promise((c, e) => worker.on('exit', c).on('error', e))));
+		logger.flush();
+		logger.drop();
+
+		const next = { main: 0, a: 0, b: 0 };
+		for (const line of fs.readFileSync(stagedFile).toString().split(EOL).slice(0, -1)) {
+			const [name, i] = line.split(' ');
+			assert.strictEqual(Number(i), next[name]++);
+		}
+		assert.deepStrictEqual(next, { main: 2000, a: 2000, b: 2000 });
+	});
+
+	test('async staging buffers keep the order of each worker thread', async function () {
+		const stagedFile = path.join(tempDirectory, 'staged-async.log');
+		filesToDelete.push(stagedFile);
+		const logger = await spdlog.createAsyncRotatingLogger('staged-async', stagedFile, 1048576 * 5, 2, { stagingBuffers: true });
+		logger.setPattern('%v');
+		// The staging rings are the queue, there is no thread pool to watch.
+		assert.throws(() => logger.setLoadShedding({}), /async logger/);
+
+		const source = `
+			const { workerData } = require('worker_threads');
+			const spdlog = require(${JSON.stringify(path.join(__dirname, '..'))});
+			const logger = new spdlog.Logger('rotating_async', 'staged-async', workerData.file, 1048576 * 5, 2);
+			for (let i = 0; i < 2000; i++) {
+				logger.info(workerData.name + ' ' + i);
+			}
+		`;
+		const names = ['a', 'b', 'c', 'd'];
+		const workers = names.map(name => new Worker(source, { eval: true, workerData: { name, file: stagedFile } }));
+		await Promise.all(workers.map(worker => new Promise((c, e) => worker.on('exit', c).on('error', e))));
+		logger.flush();
+		logger.drop();
+
+		const next = { a: 0, b: 0, c: 0, d: 0 };
+		for (const line of fs.readFileSync(stagedFile).toString().split(EOL).slice(0, -1)) {
+			const [name, i] = line.split(' ');
+			assert.strictEqual(Number(i), next[name]++);
+		}
+		assert.deepStrictEqual(next, { a: 2000, b: 2000, c: 2000, d: 2000 });
+	});
+
+	test('terminating a worker keeps its pinned strings until they are written', async function () {
+		const pinnedFile = path.join(tempDirectory, 'pinned-worker.log');
+		filesToDelete.push(pinnedFile);
+		const logger = await spdlog.createAsyncRotatingLogger('pinned-worker', pinnedFile, 1048576 * 50, 2, { stagingBuffers: true, formatterThreads: 2 });
+		logger.setPattern('%v');
+
+		// Large latin1 strings are external, so records refer to the bytes of
+		// the worker's isolate while they wait in the queues.
+		const source = `
+			const { parentPort, workerData } = require('worker_threads');
+			const spdlog = require(${JSON.stringify(path.join(__dirname, '..'))});
+			const logger = new spdlog.Logger('rotating_async', 'pinned-worker', workerData.file, 1048576 * 50, 2);
+			for (let i = 0; i < 20; i++) {
+				logger.info(Buffer.alloc(2 * 1024 * 1024, 97 + i).toString('latin1'));
+			}
+			parentPort.postMessage('logged');
+			setInterval(() => { }, 1000);
+		`;
+		const worker = new Worker(source, { eval: true, workerData: { file: pinnedFile } });
+		await new Promise((c, e) => worker.once('message', c).once('error', e));
+		await worker.terminate();
+		logger.flush();
+		logger.drop();
+
+		// The async worker thread writes after flush() returned.
+		const read = () => fs.existsSync(pinnedFile) ? fs.readFileSync(pinnedFile, 'latin1').split(EOL).slice(0, -1) : [];
+		for (let i = 0; i < 100 && read().length < 20; i++) {
+			await new Promise(c => setTimeout(c, 20));
+		}
+		const lines = read();
+		assert.strictEqual(lines.length, 20);
+		lines.forEach((line, i) => assert.ok(line === String.fromCharCode(97 + i).repeat(2 * 1024 * 1024), `line ${i}`));
+	});
+
+	test('async context', async function () {
+		testObject = await aTestObject(logFile);
+		testObject.setPattern('[%{trace_id}|%{span_id}|%{request_id}] %v');
+		const storage = new AsyncLocalStorage();
+		testObject.setAsyncContext(storage);
+
+		const context = new spdlog.LogContext({ traceId: '4bf92f3577b34da6a3ce929d0e0e4736', spanId: '00f067aa0ba902b7', requestId: 7 });
+		testObject.info('Outside');
+		await storage.run(context, async () => {
+			testObject.info('Inside');
+			await Promise.resolve();
+			testObject.child({ component: 'git' }).info('Later');
+		});
+
+		const actuals = await getAllLines();
+		assert.deepStrictEqual(actuals.slice(-4, -1), [
+			'[||] Outside',
+			'[4bf92f3577b34da6a3ce929d0e0e4736|00f067aa0ba902b7|7] Inside',
+			'[4bf92f3577b34da6a3ce929d0e0e4736|00f067aa0ba902b7|7] component=git Later'
+		]);
+	});
+
+	test('async context with batching', async function () {
+		testObject = await aTestObject(logFile);
+		testObject.setPattern('%{request_id} %v');
+		const storage = new AsyncLocalStorage();
+		testObject.setAsyncContext(storage);
+		testObject.setBatching(true);
+
+		storage.run(new spdlog.LogContext({ requestId: 1 }), () => testObject.info('First'));
+		storage.run(new spdlog.LogContext({ requestId: 2n }), () => testObject.info('Second'));
+		await Promise.resolve();
+
+		const actuals = await getAllLines();
+		assert.deepStrictEqual(actuals.slice(-3, -1), ['1 First', '2 Second']);
+	});
+
+	test('json formatter', async function () {
+		testObject = await aTestObject(logFile);
+		testObject.setJsonFormatter();
+		const storage = new AsyncLocalStorage();
+		testObject.setAsyncContext(storage);
+
+		storage.run(new spdlog.LogContext({ traceId: '4BF92F3577B34DA6A3CE929D0E0E4736', requestId: 3 }), () => testObject.warn('Say "hi"\n'));
+
+		const record = JSON.parse(await getLastLine());
+		assert.strictEqual(record.level, 'warning');
+		assert.strictEqual(record.logger, 'test');
+		assert.strictEqual(record.message, 'Say "hi"\n');
+		assert.strictEqual(record.trace_id, '4bf92f3577b34da6a3ce929d0e0e4736');
+		assert.strictEqual(record.span_id, undefined);
+		assert.strictEqual(record.request_id, 3);
+		assert.ok(Math.abs(Date.parse(record.time) - Date.now()) < 60000);
+	});
+
+	test('invalid log context', function () {
+		assert.throws(() => new spdlog.LogContext({ traceId: 'abc' }));
+		assert.throws(() => new spdlog.LogContext({ spanId: 'zz'.repeat(8) }));
+		assert.throws(() => new spdlog.LogContext({ requestId: -1 }));
+		assert.throws(() => new spdlog.LogContext({ get traceId() { throw new Error('getter'); } }), /getter/);
+		assert.throws(() => new spdlog.LogContext(new Proxy({}, { get() { throw new Error('trap'); } })), /trap/);
+	});
+
 	test('create log file with special characters in file name', function () {
 		let file = path.join(__dirname, 'abcdø', 'test.log');
 		filesToDelete.push(file);
@@ -301,7 +1883,8 @@ suite('API', function () {
 	}
 
 	async function aTestObject(logfile) {
-		const logger = await spdlog.createAsyncRotatingLogger('test', logfile, 1048576 * 5, 2);
+		// Synchronous, so records are in the file once a call returns.
+		const logger = await spdlog.createRotatingLogger('test', logfile, 1048576 * 5, 2);
 		logger.setPattern('%+');
 		return logger;
 	}
@@ -322,4 +1905,66 @@ suite('API', function () {
 		const content = fs.readFileSync(logFile).toString();
 		return content.split(EOL);
 	}
+
+	async function waitFor(condition, timeout = 10000) {
+		const deadline = Date.now() + timeout;
+		while (!condition()) {
+			if (Date.now() > deadline) {
+				throw new Error(`Timed out waiting for ${condition}`);
+			}
+			await new Promise(resolve => setTimeout(resolve, 10));
+		}
+	}
+
+	// A minimal protobuf reader: every field is a list of numbers, bigints or buffers.
+	function decodeProtobuf(buffer) {
+		const fields = {};
+		let offset = 0;
+		const varint = () => {
+			let value = 0n;
+			for (let shift = 0n; ; shift += 7n) {
+				const byte = buffer[offset++];
+				value |= BigInt(byte & 0x7f) << shift;
+				if (byte < 0x80) {
+					return value;
+				}
+			}
+		};
+		while (offset < buffer.length) {
+			const tag = Number(varint());
+			let value;
+			if ((tag & 7) === 0) {
+				value = Number(varint());
+			} else if ((tag & 7) === 1) {
+				value = buffer.readBigUInt64LE(offset);
+				offset += 8;
+			} else {
+				const length = Number(varint());
+				value = buffer.subarray(offset, offset + length);
+				offset += length;
+			}
+			(fields[tag >> 3] = fields[tag >> 3] || []).push(value);
+		}
+		return fields;
+	}
+
+	function otlpAttributes(list) {
+		return Object.fromEntries(list.map(decodeProtobuf).map(entry => {
+			const value = decodeProtobuf(entry[2][0]);
+			return [entry[1][0].toString(), value[1] ? value[1][0].toString() : value[2] ? !!value[2][0] : value[3][0]];
+		}));
+	}
+
+	// Returns the decoded log records of every export request in an OTLP file.
+	function readOtlpRecords(otlpFile) {
+		const file = fs.readFileSync(otlpFile);
+		const records = [];
+		for (let offset = 0; offset < file.length;) {
+			const length = file.readUInt32BE(offset);
+			const resourceLogs = decodeProtobuf(decodeProtobuf(file.subarray(offset + 4, offset + 4 + length))[1][0]);
+			records.push(...decodeProtobuf(resourceLogs[2][0])[2].map(decodeProtobuf));
+			offset += 4 + length;
+		}
+		return records;
+	}
 });